@@ -230,7 +230,9 @@ const wxString DefaultMenuLabels[] = {
   _("Switch to the Panes"), _("Switch to the Terminal Emulator"), _("Switch to the Command-line"), _("Switch to the toolbar Textcontrol"), _("Switch to the previous window"), 
   _("Go to Previous Tab"), _("Go to Next Tab"), _("Paste as Director&y Template"), _("&First dot"), _("&Penultimate dot"), _("&Last dot"),
   _("Mount over Ssh using ssh&fs"), _("Show &Previews"), _("C&ancel Paste"), _("Decimal-aware filename sort"), _("&Keep Modification-time when pasting files"), 
-  _("Navigate up to higher directory"), _("Navigate back to previously visited directory"), _("Navigate forward to next visited directory")};
+  _("Navigate up to higher directory"), _("Navigate back to previously visited directory"), _("Navigate forward to next visited directory"),
+  _("Keep &Undo history between sessions"), _("&Flat listing of the subtree"), _("Cache &directory listings between sessions"), _("Paste, S&kipping Identical Files"),
+  _("Find &Duplicate Files"), _("Show &Jobs"), _("D&urable pasting"), _("Resume &Interrupted Paste")};
 
 int DefaultShortcutFlags[] = { wxACCEL_CTRL, wxACCEL_CTRL, wxACCEL_NORMAL, wxACCEL_SHIFT, wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_CTRL,
       wxACCEL_ALT, wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_CTRL, wxACCEL_CTRL+wxACCEL_SHIFT, wxACCEL_ALT+wxACCEL_SHIFT,
@@ -247,7 +249,8 @@ int DefaultShortcutFlags[] = { wxACCEL_CTRL, wxACCEL_CTRL, wxACCEL_NORMAL, wxACC
       wxACCEL_NORMAL, wxACCEL_NORMAL,wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_CTRL+wxACCEL_SHIFT, wxACCEL_CTRL+wxACCEL_SHIFT,
       wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_NORMAL,
       wxACCEL_CTRL+wxACCEL_SHIFT, wxACCEL_CTRL+wxACCEL_SHIFT, wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_CTRL, wxACCEL_SHIFT, wxACCEL_NORMAL, wxACCEL_NORMAL,
-      wxACCEL_CTRL+wxACCEL_SHIFT, wxACCEL_CTRL+wxACCEL_SHIFT, wxACCEL_CTRL+wxACCEL_SHIFT };
+      wxACCEL_CTRL+wxACCEL_SHIFT, wxACCEL_CTRL+wxACCEL_SHIFT, wxACCEL_CTRL+wxACCEL_SHIFT,
+      wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_NORMAL, wxACCEL_NORMAL };
 
 int DefaultShortcutKeycode[] = { 'X', 'C', WXK_DELETE,WXK_DELETE,0, WXK_F2, 'D', // 7 entries
                               'P', 0, 0, 0, 'V', 'L', 'L',                       // 7
@@ -264,7 +267,8 @@ int DefaultShortcutKeycode[] = { 'X', 'C', WXK_DELETE,WXK_DELETE,0, WXK_F2, 'D',
                               0, 0, 0, 0, 0, 'O','A',                            // 7
                               0, 0, 0, 0, 0,                                     // 5
                               ',', '.', 0, 0, 0, 0 , 0, 'P', WXK_ESCAPE, 0, 0,   // 11
-                              WXK_UP, WXK_LEFT, WXK_RIGHT };                     // 3
+                              WXK_UP, WXK_LEFT, WXK_RIGHT,                       // 3
+                              0, 0, 0, 0, 0, 0, 0, 0 };                          // 8
 
 const wxString DefaultMenuHelp[] = { 
   _("Cuts the current selection"), _("Copies the current selection"), _("Send to the Trashcan"), _("Kill, but may be resuscitatable"),_("Delete with extreme prejudice"), wxT(""), wxT(""),
@@ -283,7 +287,15 @@ _("Delete the currently-selected Tab"), _("Rename the currently-selected Tab"),
   wxT(""), wxT(""), wxT(""), wxT(""), wxT(""),
   wxT(""), wxT(""), _("Paste only the directory structure from the clipboard"),_("An ext starts at first . in the filename"), _("An ext starts at last or last-but-one . in the filename"), _("An ext starts at last . in the filename"),
   wxT(""), _("Show previews of image and text files"), _("Cancel the current process"), _("Should files like foo1, foo2 be in Decimal order"), _("Should a Moved or Pasted file keep its original modification time (as in 'cp -a')"), 
-  wxT(""), wxT(""), wxT("") };
+  wxT(""), wxT(""), wxT(""),
+  _("Should Undo and Redo still work after 4Pane is restarted. Takes effect on the next start"),
+  _("List every file below the current directory in one sortable view"),
+  _("Remember directories' contents between sessions, so that panes fill faster at startup. Useful for slow filesystems e.g. NFS"),
+  _("Paste into any same-named directory, copying only the files that aren't already there"),
+  _("Find files with identical contents below the current directory"),
+  _("Show the queued and running archive, compression and paste jobs, and pause or cancel them"),
+  _("Write each pasted file under a temporary name, and only rename it into place once it's safely on disk. Slower, but a crash can't leave a truncated file"),
+  _("Carry on with a paste or move that was interrupted, checking what had already been copied") };
                               
 const size_t SHCUTno = sizeof(DefaultShortcutKeycode)/sizeof(int);
 
@@ -464,9 +476,9 @@ const size_t ptrsize = sizeof(int);
 int* itemslistarray[ menuno ]; size_t itemslistcount[ menuno ];
 int* subitemslistarray[ submenuno ]; size_t subitemslistcount[ submenuno ];
 int fileitems[] = { SHCUT_EXIT };
-int edititems[] = { SHCUT_CUT, SHCUT_COPY, SHCUT_PASTE, SHCUT_PASTE_DIR_SKELETON, SHCUT_ESCAPE, wxID_SEPARATOR, SHCUT_NEW, SHCUT_SOFTLINK, SHCUT_HARDLINK, wxID_SEPARATOR,
+int edititems[] = { SHCUT_CUT, SHCUT_COPY, SHCUT_PASTE, SHCUT_PASTE_DIR_SKELETON, SHCUT_PASTE_DEDUP, SHCUT_ESCAPE, SHCUT_RESUME_PASTE, wxID_SEPARATOR, SHCUT_NEW, SHCUT_SOFTLINK, SHCUT_HARDLINK, wxID_SEPARATOR,
                   SHCUT_TRASH, SHCUT_DELETE, SHCUT_REALLYDELETE, wxID_SEPARATOR, SHCUT_REFRESH, SHCUT_RENAME, SHCUT_DUP, wxID_SEPARATOR, SHCUT_UNDO, SHCUT_REDO, wxID_SEPARATOR, SHCUT_PROPERTIES };
-int viewitems[] = { SHCUT_TERMINAL_EMULATOR, SHCUT_COMMANDLINE, ID_CHECKNEXTITEM, SHCUT_PREVIEW, wxID_SEPARATOR, SHCUT_SPLITPANE_VERTICAL, SHCUT_SPLITPANE_HORIZONTAL,
+int viewitems[] = { SHCUT_TERMINAL_EMULATOR, SHCUT_COMMANDLINE, SHCUT_SHOW_JOBS, ID_CHECKNEXTITEM, SHCUT_PREVIEW, wxID_SEPARATOR, SHCUT_SPLITPANE_VERTICAL, SHCUT_SPLITPANE_HORIZONTAL,
                  SHCUT_SPLITPANE_UNSPLIT, wxID_SEPARATOR, SHCUT_REPLICATE, SHCUT_SWAPPANES, wxID_SEPARATOR, SHCUT_FILTER, SHCUT_TOGGLEHIDDEN,wxID_SEPARATOR, ID_INSERT_SUBMENU };
 int tabitems[] = { SHCUT_NEWTAB, SHCUT_DELTAB, SHCUT_INSERTTAB, SHCUT_RENAMETAB, SHCUT_DUPLICATETAB, wxID_SEPARATOR, 
                 ID_CHECKNEXTITEM, SHCUT_ALWAYS_SHOW_TAB, ID_CHECKNEXTITEM, SHCUT_SAME_TEXTSIZE_TAB, wxID_SEPARATOR,
@@ -485,8 +497,8 @@ int archiveitems[] = { SHCUT_ARCHIVE_EXTRACT, wxID_SEPARATOR, SHCUT_ARCHIVE_CREA
 #endif
 
 
-int toolsitems[] = { SHCUT_TOOL_LOCATE, SHCUT_TOOL_FIND, SHCUT_TOOL_GREP, wxID_SEPARATOR, SHCUT_LAUNCH_TERMINAL };
-int optionsitems[] = { ID_CHECKNEXTITEM, SHCUT_SHOW_RECURSIVE_SIZE, ID_CHECKNEXTITEM, SHCUT_RETAIN_REL_TARGET, ID_CHECKNEXTITEM, SHCUT_RETAIN_MTIME_ON_PASTE, wxID_SEPARATOR, SHCUT_SAVETABS, ID_CHECKNEXTITEM, SHCUT_SAVETABS_ONEXIT, wxID_SEPARATOR, SHCUT_EMPTYTRASH, SHCUT_EMPTYDELETED, wxID_SEPARATOR, SHCUT_CONFIGURE };
+int toolsitems[] = { SHCUT_TOOL_LOCATE, SHCUT_TOOL_FIND, SHCUT_TOOL_GREP, SHCUT_TOOL_DUPLICATES, wxID_SEPARATOR, SHCUT_LAUNCH_TERMINAL };
+int optionsitems[] = { ID_CHECKNEXTITEM, SHCUT_SHOW_RECURSIVE_SIZE, ID_CHECKNEXTITEM, SHCUT_RETAIN_REL_TARGET, ID_CHECKNEXTITEM, SHCUT_RETAIN_MTIME_ON_PASTE, ID_CHECKNEXTITEM, SHCUT_DURABLE_PASTE, ID_CHECKNEXTITEM, SHCUT_PERSISTENT_UNDO, ID_CHECKNEXTITEM, SHCUT_DIR_CACHE, wxID_SEPARATOR, SHCUT_SAVETABS, ID_CHECKNEXTITEM, SHCUT_SAVETABS_ONEXIT, wxID_SEPARATOR, SHCUT_EMPTYTRASH, SHCUT_EMPTYDELETED, wxID_SEPARATOR, SHCUT_CONFIGURE };
 int helpitems[] = { SHCUT_HELP, SHCUT_FAQ, wxID_SEPARATOR, SHCUT_ABOUT };
 
 int columnitems[] = { ID_CHECKNEXTITEM,SHCUT_SHOW_COL_EXT, ID_CHECKNEXTITEM,SHCUT_SHOW_COL_SIZE, ID_CHECKNEXTITEM,SHCUT_SHOW_COL_TIME,
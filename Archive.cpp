@@ -15,7 +15,6 @@
 
 #include "MyGenericDirCtrl.h"
 #include "Externs.h"
-#include "ExecuteInDialog.h"
 #include "Misc.h"
 #include "Tools.h"
 #include "Filetypes.h"
@@ -96,7 +95,7 @@ return UncompressedName;
 bool ArchiveDialogBase::IsAnArchive(const wxString& filename, bool append/*=false*/)    // Decide if the file is an archive suitable for extracting +/- appending to
 {
 wxString ext = filename.AfterLast('.'); ext.MakeLower();    // See if the last .ext is relevant
-if (ext==wxT("tar") || ext==wxT("tgz") || ext==wxT("tbz2") || ext==wxT("tbz") || ext==wxT("lzma") || ext==wxT("tlz")
+if (ext==wxT("tar") || ext==wxT("tgz") || ext==wxT("tbz2") || ext==wxT("tbz") || ext==wxT("lzma") || ext==wxT("tlz") || ext==wxT("tzst")
   || ext==wxT("a") || ext==wxT("ar") || ext==wxT("cpio") || ext==wxT("rpm") || ext==wxT("deb")
   || (ext=="rar" && !append) // We can extract a .rar using  'unar' or ( the free-ish) 'unrar' but can't append to one
   || ext==wxT("7z") // All 7z's are archives
@@ -175,11 +174,11 @@ createincombo = (wxComboBox*)FindWindow(wxT("CreateInCombo"));
 ((wxCheckBox*)FindWindow(wxT("DeleteSources")))->SetValue(m_parent->DeleteSource);
 if (NewArchive)
   { m_compressorradio = (wxRadioBox*)FindWindow(wxT("CompressRadio"));
-    int compressors[] = { zt_bzip, zt_gzip, zt_xz, zt_lzma, zt_7z, zt_lzop };
+    int compressors[] = { zt_bzip, zt_gzip, zt_xz, zt_lzma, zt_7z, zt_lzop, zt_zstd, zt_lz4 };
     for (size_t n=0; n < sizeof(compressors)/sizeof(int); ++n)
       m_compressorradio->Enable(n, m_parent->IsThisCompressorAvailable((ziptype)compressors[n]));  // Disable any unavailable compression types
     // If the last-used compressor is still available, make it the default. Otherwise, set no compression
-    m_compressorradio->SetSelection(m_compressorradio->IsItemEnabled(m_parent->ArchiveCompress) ? m_parent->ArchiveCompress : 6);
+    m_compressorradio->SetSelection(m_compressorradio->IsItemEnabled(m_parent->ArchiveCompress) ? m_parent->ArchiveCompress : 8);
   }
 
 for (size_t n=0; n < m_parent->ArchiveHistory.GetCount(); ++n) // Load the archive path history into the combo
@@ -341,6 +340,8 @@ if (((wxCheckBox*)FindWindow(wxT("UseZip")))->GetValue())     // If zip is, that
                         << wxT("\\\" | \\\"") << m_parent->GetSevenZString() << wxT("\\\" a -si \\\"")        //  a -si means create from stdin
                         << archivename << wxT(".7z\\\" && rm -f \\\"") << archivename << wxT("\\\""); break;  // 7z doesn't delete the tarball, so do it ourselves
        case 5:  command << wxT("&& echo Compressing with lzop && lzop -U \\\"") << archivename << wxT("\\\"");   break;
+       case 6:  command << wxT("&& echo Compressing with zstd && zstd -T0 --rm \\\"") << archivename << wxT("\\\""); break;  // -T0 means use all the cpus
+       case 7:  command << wxT("&& echo Compressing with lz4 && lz4 -m --rm \\\"") << archivename << wxT("\\\"");   break;
      }
   }
 
@@ -408,6 +409,8 @@ switch(m_parent->Categorise(archivename))
                       if (decompresscmd.empty()) { wxMessageBox(_("Can't find a 7z binary on your system"), _("Oops"), wxOK, this); return cancel; }
                       command << decompresscmd; break;}
     case zt_tarlzop:  command = wxT("echo Appending to a tarball compressed with lzop; "); command << AppendCompressedTar(archivename, zt_lzop); break;
+    case zt_tarzst:   command = wxT("echo Appending to a tarball compressed with zstd; "); command << AppendCompressedTar(archivename, zt_zstd); break;
+    case zt_tarlz4:   command = wxT("echo Appending to a tarball compressed with lz4; "); command << AppendCompressedTar(archivename, zt_lz4); break;
      default:         wxMessageBox(_("Can't find a valid archive to which to append"), _("Oops"), wxOK, this);
                       return cancel;    // if archive doesn't seem to be an archive, or one that can't be handled
   }
@@ -453,6 +456,10 @@ switch(ztype)
                     return command;}
     case zt_lzop :  command = wxT("lzop -dUv \\\"") + archivefpath; command += wxT("\\\"");
                     Recompress << wxT(" ; echo Recompressing with lzop && lzop -Uv \\\"") << UncompressedName << wxT("\\\""); break;
+    case zt_zstd :  command = wxT("zstd -dv --rm \\\"") + archivefpath; command += wxT("\\\"");  // Unlike gzip etc, zstd and lz4 keep the original unless told --rm
+                    Recompress << wxT(" ; echo Recompressing with zstd && zstd -T0 --rm \\\"") << UncompressedName << wxT("\\\""); break;
+    case zt_lz4 :   command = wxT("lz4 -dv -m --rm \\\"") + archivefpath; command += wxT("\\\"");
+                    Recompress << wxT(" ; echo Recompressing with lz4 && lz4 -m --rm \\\"") << UncompressedName << wxT("\\\""); break;
      default:       return command;
   }
 
@@ -548,7 +555,7 @@ for (size_t n=0; n < count; ++n)                                    // Put the h
     list->Append(m_parent->FilepathArray[n]);
 
 wxRadioBox* radio = (wxRadioBox*)FindWindow(wxT("CompressRadio"));
-int compressors[] = { zt_bzip, zt_gzip, zt_xz, zt_lzma, zt_lzop, zt_compress };
+int compressors[] = { zt_bzip, zt_gzip, zt_xz, zt_lzma, zt_lzop, zt_compress, zt_zstd, zt_lz4 };
 for (size_t n=0; n < sizeof(compressors)/sizeof(int); ++n)
   radio->Enable(n, m_parent->IsThisCompressorAvailable((ziptype)compressors[n]));  // Disable any unavailable compression types
 
@@ -566,7 +573,7 @@ void CompressDialog::OnUpdateUI(wxUpdateUIEvent& event)
 {
 if (event.GetId() == XRCID("Slider"))                                // I'm using the slider UI event, as the radiobox didn't seem to generate one!?  
   { int selection = ((wxRadioBox*)FindWindow(wxT("CompressRadio")))->GetSelection();
-    bool enabled = (selection > 0) && (selection < 6) && (selection != 4);     // Disable the slider if the selected compressor is 0 (bzip2), 4 (7z) or 6 (compress)
+    bool enabled = (selection > 0) && (selection != 4) && (selection != 5);    // Disable the slider if the selected compressor is 0 (bzip2), 4 (lzop) or 5 (compress)
     ((wxStaticText*)FindWindow(wxT("FasterStatic")))->Enable(enabled);
     ((wxSlider*)FindWindow(wxT("Slider")))->Enable(enabled);
     ((wxStaticText*)FindWindow(wxT("SmallerStatic")))->Enable(enabled);
@@ -578,7 +585,7 @@ if (event.GetId() == XRCID("wxID_OK"))                               // Enable t
 
 enum returntype CompressDialog::GetCommand()    // Parse entered options into a command
 {
-enum { cdgc_bzip, cdgc_gzip, cdgc_xz, cdgc_lzma, cdgc_lzop, cdgc_compress };
+enum { cdgc_bzip, cdgc_gzip, cdgc_xz, cdgc_lzma, cdgc_lzop, cdgc_compress, cdgc_zstd, cdgc_lz4 };
 wxString command, files, verifystring;
 bool data = 0;                                              // Flags that we've got >0 files to compress
 
@@ -601,6 +608,8 @@ switch(whichcompressor)
     case cdgc_lzma: command << wxT("using lzma; xz --format=lzma -v") << squash; break;  // lzma, but still use xz to do the work
     case cdgc_lzop: command << wxT("using lzop; lzop -Uv") << squash; break;      // lzop retains original files unless the -U option is given
     case cdgc_compress: command << wxT("using \'compress\'; compress -v"); break; // For historical interest, 'compress'
+    case cdgc_zstd: command << wxT("using zstd; zstd --rm -T0 -v") << squash; break;  // zstd and lz4 keep the original files unless --rm is given
+    case cdgc_lz4:  command << wxT("using lz4; lz4 -m --rm -v") << squash; break;     // -m means there may be multiple files
   }
 
 wxCheckBox* fcb = (wxCheckBox*)FindWindow(wxT("Force"));
@@ -670,7 +679,7 @@ for (size_t n=0; n < count; ++n)
     if (fd.IsDir()) list->Append(m_parent->FilepathArray[n]); // If someone selected a dir(s), presumably he wants its files decompressed
      else
       { enum ziptype ztype = m_parent->Categorise(m_parent->FilepathArray[n]);
-            if ((ztype <= zt_compress)                     // If this is a compressed file,
+            if ((ztype <= zt_lastcompressed)               // If this is a compressed file,
                       || (ztype >= zt_firstcompressedarchive && ztype != zt_invalid))  //or a compressed archive,
               list->Append(m_parent->FilepathArray[n]);    // put it in the to-be-decompressed listbox
       }
@@ -689,7 +698,7 @@ if (event.GetId() == XRCID("wxID_OK")) // Enable the OK button if >0 files in li
 
 enum returntype DecompressDialog::GetCommand()  // Parse entered options into a command
 {
-wxString command; wxArrayString gz, bz, xz, sevenz, rar, lzo;
+wxString command; wxArrayString gz, bz, xz, sevenz, rar, lzo, zst, lz4;
 
 if (!list->GetCount()) return cancel;                   // Shouldn't happen, as Return would be disabled
 
@@ -706,7 +715,7 @@ m_parent->DecompressArchivesToo = ((wxCheckBox*)FindWindow(wxT("ArchivesToo")))-
 
     // We may have 5 sorts of file in the array:  gz, bz2 etc, and ordinary files added in error.  Oh, and dirs. Because of possible recursion, do in a submethod
     // NB we don't use sevenz (as foo.7z is an archive, not a 'compressed file'; but it's needed as a SortFiles() parameter
-if (!SortFiles(m_parent->FilepathArray, gz, bz, xz, sevenz, lzo, recurse, m_parent->DecompressArchivesToo))        
+if (!SortFiles(m_parent->FilepathArray, gz, bz, xz, sevenz, lzo, zst, lz4, recurse, m_parent->DecompressArchivesToo))        
   { wxMessageDialog dialog(this, _("No relevant compressed files were selected.\nTry again?"),    // If there weren't any compressed files selected...
                                                                         wxT(""), wxYES_NO | wxICON_QUESTION);
     return (dialog.ShowModal() == wxID_YES ? retry : cancel);
@@ -744,13 +753,29 @@ if (!lzo.IsEmpty())
       { command << wxT(" \\\"") << lzo[c] << wxT("\\\""); }
   }
 
+if (!zst.IsEmpty())
+  { if (!command.empty()) command << wxT(" && ");
+    command << wxT("zstd -d --rm -v"); // Similarly --rm
+    if (force) command << wxT('f');
+    for (size_t c=0; c < zst.GetCount(); ++c)
+      { command << wxT(" \\\"") << zst[c] << wxT("\\\""); }
+  }
+
+if (!lz4.IsEmpty())
+  { if (!command.empty()) command << wxT(" && ");
+    command << wxT("lz4 -d -m --rm -v"); // -m, otherwise lz4 takes a second filename to be the output file
+    if (force) command << wxT('f');
+    for (size_t c=0; c < lz4.GetCount(); ++c)
+      { command << wxT(" \\\"") << lz4[c] << wxT("\\\""); }
+  }
+
 if (!command.empty())
   { m_parent->command = wxT("echo Decompressing; ") + command;  return valid; }
  else return cancel;
 }
 
 bool DecompressDialog::SortFiles(const wxArrayString& selected, 
-    wxArrayString& gz, wxArrayString& bz, wxArrayString& xz, wxArrayString& sevenz, wxArrayString& lzo, bool recurse, bool archivestoo /*=false */)  //  Sort selected files into .bz, .gz & rubbish
+    wxArrayString& gz, wxArrayString& bz, wxArrayString& xz, wxArrayString& sevenz, wxArrayString& lzo, wxArrayString& zst, wxArrayString& lz4, bool recurse, bool archivestoo /*=false */)  //  Sort selected files into .bz, .gz & rubbish
 {
 for (size_t n=0; n < selected.GetCount(); ++n)
   { FileData fd(selected[n]);
@@ -764,7 +789,7 @@ for (size_t n=0; n < selected.GetCount(); ++n)
           }
         wxArrayString filearray;      // Put files from this dir, & optionally all its subdirs, into filearray
         wxDir::GetAllFiles(selected[n], &filearray, wxEmptyString, flags);
-        SortFiles(filearray, gz, bz, xz, sevenz, lzo, true, archivestoo); // Now sort by recursion
+        SortFiles(filearray, gz, bz, xz, sevenz, lzo, zst, lz4, true, archivestoo); // Now sort by recursion
         continue;                                        // We've processed this item. Loop here to avoid falling thru to the next bit
       }    
     
@@ -780,10 +805,14 @@ for (size_t n=0; n < selected.GetCount(); ++n)
         case zt_7z:  sevenz.Add(selected[n]); break;
         case zt_tarlzop: if (!archivestoo)  break;
         case zt_lzop:  lzo.Add(selected[n]); break;
+        case zt_tarzst: if (!archivestoo)  break;
+        case zt_zstd:  zst.Add(selected[n]); break;
+        case zt_tarlz4: if (!archivestoo)  break;
+        case zt_lz4:   lz4.Add(selected[n]); break;
           default: break;                                // because the file is not compressed
       }
   }
-return !(gz.IsEmpty() && bz.IsEmpty() && xz.IsEmpty() && sevenz.IsEmpty() && lzo.IsEmpty());
+return !(gz.IsEmpty() && bz.IsEmpty() && xz.IsEmpty() && sevenz.IsEmpty() && lzo.IsEmpty() && zst.IsEmpty() && lz4.IsEmpty());
 }
 
 
@@ -984,7 +1013,7 @@ switch(ztype)
                                   << archivename << wxT("\\\" && cd \\\"") << oldcwd << wxT("\\\" && ");
                }// Fall through towards zt_taronly for the proper extraction
 
-    case zt_targz: case zt_tarbz: case zt_tarlzma: case zt_tarxz: case zt_tarlzop: case zt_taZ:
+    case zt_targz: case zt_tarbz: case zt_tarlzma: case zt_tarxz: case zt_tarlzop: case zt_taZ: case zt_tarzst: case zt_tarlz4:
                 // Variously-commpressed tarballs. We used to specify the correct option e.g. -j. Since v1.15 in 12/04 tar can work it out for itself
     case zt_taronly:
                 command.Printf(wxT("echo Extracting %s;"), archivename.c_str());
@@ -1071,7 +1100,7 @@ for (size_t n=0; n < count; ++n)
 
 enum returntype VerifyCompressedDialog::GetCommand()  // Parse entered options into a command
 {
-wxString command; wxArrayString gz, bz, xz, sevenz, lzo;
+wxString command; wxArrayString gz, bz, xz, sevenz, lzo, zst, lz4;
 
 if (!list->GetCount()) return cancel;                         // Shouldn't happen, as Return would be disabled
 
@@ -1079,8 +1108,8 @@ m_parent->FilepathArray.Clear();                              // In case files w
 for (size_t n=0; n < list->GetCount(); ++n)
   m_parent->FilepathArray.Insert(list->GetString(n), 0);
 
-        // We may have 5 sorts of file in the array: bz2, gz (and Z), xz (and lzma), lzo, and ordinary files added in error
-if (!SortFiles(m_parent->FilepathArray, gz, bz, xz, sevenz, lzo, false))       // If there weren't any compressed files selected...
+        // We may have 7 sorts of file in the array: bz2, gz (and Z), xz (and lzma), lzo, zst, lz4, and ordinary files added in error
+if (!SortFiles(m_parent->FilepathArray, gz, bz, xz, sevenz, lzo, zst, lz4, false))       // If there weren't any compressed files selected...
   { wxMessageDialog dialog(this, _("No relevant compressed files were selected.\nTry again?"), wxT(""), wxYES_NO | wxICON_QUESTION);
     if (dialog.ShowModal() == wxID_YES)  return retry; else return cancel;
   }
@@ -1112,6 +1141,20 @@ if (!lzo.IsEmpty())
       command << wxT(" \\\"") << lzo[c] << wxT("\\\"");
   }
 
+if (!zst.IsEmpty())
+  { if (!command.empty()) command << wxT(" && ");
+    command << wxT("zstd -tv"); 
+    for (size_t c=0; c < zst.GetCount(); ++c)
+      command << wxT(" \\\"") << zst[c] << wxT("\\\"");
+  }
+
+if (!lz4.IsEmpty())
+  { if (!command.empty()) command << wxT(" && ");
+    command << wxT("lz4 -t -m -v"); 
+    for (size_t c=0; c < lz4.GetCount(); ++c)
+      command << wxT(" \\\"") << lz4[c] << wxT("\\\"");
+  }
+
 if (!command.empty())
   { m_parent->command = wxT("echo Verifying; ") + command; return valid; }
  else return cancel;
@@ -1167,7 +1210,7 @@ switch(m_parent->Categorise(archivefilepath))
             command << wxString::Format(wxT("echo Verifying %s && cd \\\""), archivename.c_str()) << archivepath << wxT("\\\" && ") << sevenzbinary << wxT(" e \\\"")
                     << archivename << wxT("\\\" && tar -tvf \\\"") << uncompressedfilepath <<  wxT("\\\" && rm -f \\\"") << uncompressedfilepath 
                     << wxT("\\\" && cd \\\"") << oldcwd << wxT("\\\""); break;}
-    case zt_targz: case zt_tarbz: case zt_tarlzma: case zt_tarxz: case zt_tarlzop: case zt_taZ: // tar can now list compressed archives on the fly :)
+    case zt_targz: case zt_tarbz: case zt_tarlzma: case zt_tarxz: case zt_tarlzop: case zt_taZ: case zt_tarzst: case zt_tarlz4: // tar can now list compressed archives on the fly :)
     case zt_taronly:
             command << wxString::Format(wxT("echo Verifying %s && "), archivename.c_str()) << wxT("tar -tvf \\\"") << archivefilepath <<  wxT("\\\""); break;
     case zt_rpm:
@@ -1247,41 +1290,41 @@ delete this;                                               // If neither choice
 
 void Archive::DoExtractCompressVerify(enum ExtractCompressVerify_type type)
 {
-enum returntype ans; wxString successmsg, failuremsg;
+enum returntype ans; wxString successmsg, failuremsg, jobname;
 
 wxDialog* dlg = NULL;
 switch(type)
   { case ecv_compress:
             {dlg = new CompressDialog(this);
-             successmsg = _("File(s) compressed"); failuremsg = _("Compression failed");
+             successmsg = _("File(s) compressed"); failuremsg = _("Compression failed"); jobname = _("Compress");
              break;}
     case ecv_decompress:
             {dlg = new DecompressDialog(this);
-             successmsg = _("File(s) decompressed"); failuremsg = _("Decompression failed");
+             successmsg = _("File(s) decompressed"); failuremsg = _("Decompression failed"); jobname = _("Decompress");
              break;}
     case ecv_verifycompressed:
             {dlg = new VerifyCompressedDialog(this);
-             successmsg = _("File(s) verified"); failuremsg = _("Verification failed");
+             successmsg = _("File(s) verified"); failuremsg = _("Verification failed"); jobname = _("Verify");
              break;}
 
     case ecv_makearchive:
             {dlg = new MakeArchiveDialog(this, true);
              LoadHistory();
-             successmsg = _("Archive created"); failuremsg = _("Archive creation failed");
+             successmsg = _("Archive created"); failuremsg = _("Archive creation failed"); jobname = _("Create an archive");
              break;}
     case ecv_addtoarchive:
             {dlg = new MakeArchiveDialog(this, false);
              LoadHistory();
-             successmsg = _("File(s) added to Archive"); failuremsg = _("Archive addition failed");
+             successmsg = _("File(s) added to Archive"); failuremsg = _("Archive addition failed"); jobname = _("Add to an archive");
              break;}
     case ecv_extractarchive:
             {dlg = new ExtractArchiveDlg(this);
              LoadHistory();
-             successmsg = _("Archive extracted"); failuremsg = _("Extraction failed");
+             successmsg = _("Archive extracted"); failuremsg = _("Extraction failed"); jobname = _("Extract");
              break;}
     case ecv_verifyarchive:
             {dlg = new VerifyArchiveDlg(this);
-             successmsg = _("Archive verified"); failuremsg = _("Verification failed");
+             successmsg = _("Archive verified"); failuremsg = _("Verification failed"); jobname = _("Verify");
              break;}
      default: return;
   }
@@ -1311,25 +1354,36 @@ if (ans == cancel)   return;
 
 command = wxT("sh -c \"") + command; command += wxT('\"'); // Since command is multiple (if only with echos) we need to execute it thru a shell
 
-            // We now have the command.  Do the dialog that runs it and displays the results
-wxBusyCursor busy;
-
-CommandDisplay OutputDlg;
-wxXmlResource::Get()->LoadDialog(&OutputDlg, MyFrame::mainframe, wxT("OutputDlg"));
-LoadPreviousSize(&OutputDlg, wxT("OutputDlg"));
-
-OutputDlg.Init(command);
-OutputDlg.ShowModal();
-SaveCurrentSize(&OutputDlg, wxT("OutputDlg"));
+            // We now have the command.  Queue it as a background job, so that several can be queued and the panes stay usable meanwhile
+wxString description(jobname), path;
+if (FilepathArray.GetCount())
+  { description << wxT(": ") << FilepathArray[0].AfterLast(wxFILE_SEP_PATH);
+    if (FilepathArray.GetCount() > 1) description << wxString::Format(_(" and %u more"), (unsigned int)FilepathArray.GetCount() - 1);
+  }
+if (Updatedir.GetCount()) path = Updatedir[0];    // The dir being written to, if we know it. Otherwise the first of the files
+ else if (FilepathArray.GetCount()) path = FilepathArray[0];
+ else if (active) path = active->GetActiveDirPath();
 
-if (!OutputDlg.exitstatus) BriefLogStatus bls(successmsg);
- else  BriefLogStatus bls(_("Verification failed"));
+ArchiveCommandJob* job = new ArchiveCommandJob(this, command, description, path, successmsg, failuremsg,
+                                                (type != ecv_verifycompressed) && (type != ecv_verifyarchive));
+dlg->Destroy();
+JobManager::Get().Submit(job);                    // The job now owns this Archive, and deletes it when it's finished
+JobManager::Get().ShowPanel();                    // This replaces the dialog that used to show the command's output
+}
 
-if ((type != ecv_verifycompressed) && (type != ecv_verifyarchive))
-  UpdatePanes();
+void ArchiveCommandJob::OnFinished()
+{
+switch(GetState())
+  { case js_done:   {BriefLogStatus bls(m_successmsg); break;}
+    case js_failed: {BriefLogStatus bls(m_failuremsg); break;}
+     default:       break;
+  }
 
-dlg->Destroy();
-delete this;
+if (m_archive)
+  { if (m_updatepanes && WasStarted())            // Even a cancelled job may have altered something
+      m_archive->UpdatePanes();
+    delete m_archive; m_archive = NULL;
+  }
 }
 
 //static
@@ -1360,6 +1414,7 @@ if (endExt==wxT("tbz2") || endExt==wxT("tbz"))                          return z
 if (endExt==wxT("txz"))                                                 return zt_tarxz;
 if (endExt==wxT("tlz"))                                                 return zt_tarlzma;
 if (endExt==wxT("taZ"))                                                 return zt_taZ;
+if (endExt==wxT("tzst"))                                                return zt_tarzst;
 
 if (prevExt==wxT("tar") && (endExt==wxT("bz2") || endExt==wxT("bz")))   return zt_tarbz;
 if (prevExt==wxT("tar") && endExt==wxT("lzma"))                         return zt_tarlzma;
@@ -1367,6 +1422,8 @@ if (prevExt==wxT("tar") && endExt==wxT("xz"))                           return z
 if (prevExt==wxT("tar") && endExt==wxT("7z"))                           return zt_tar7z;
 if (prevExt==wxT("tar") && endExt==wxT("lzo"))                          return zt_tarlzop;
 if (prevExt==wxT("tar") && endExt==wxT("Z"))                            return zt_taZ;
+if (prevExt==wxT("tar") && (endExt==wxT("zst") || endExt==wxT("zstd"))) return zt_tarzst;
+if (prevExt==wxT("tar") && endExt==wxT("lz4"))                          return zt_tarlz4;
 
 if (endExt==wxT("gz"))   return zt_gzip;       // Since we've already tested for e.g. foo.tar.gz, it's safe to test for foo.gz
 if (endExt==wxT("bz2"))  return zt_bzip;
@@ -1375,6 +1432,8 @@ if (endExt==wxT("xz"))   return zt_xz;
 if (endExt==wxT("7z"))   return zt_7z;
 if (endExt==wxT("lzo"))  return zt_lzop;
 if (endExt==wxT("Z"))    return zt_compress;
+if (endExt==wxT("zst") || endExt==wxT("zstd")) return zt_zstd;
+if (endExt==wxT("lz4"))  return zt_lz4;
 
 return zt_invalid;
 }
@@ -1411,9 +1470,9 @@ if (type == zt_7z) // Do this first, as it's more complicated. There are 3 possi
     m_7zString.Clear(); return false;
   }
     // Now the rest:
-const int values[] = { zt_gzip, zt_bzip, zt_xz, zt_lzma, zt_lzop, zt_compress }; // Protect against future changes in ziptype order
+const int values[] = { zt_gzip, zt_bzip, zt_xz, zt_lzma, zt_lzop, zt_compress, zt_zstd, zt_lz4 }; // Protect against future changes in ziptype order
 const wxString strings[] = 
-  { wxString(wxT("gzip")), wxString(wxT("bzip2")), wxString(wxT("xz")), wxString(wxT("xz")) /*we use xz for lzma*/, wxString(wxT("lzop")), wxString(wxT("compress")) };
+  { wxString(wxT("gzip")), wxString(wxT("bzip2")), wxString(wxT("xz")), wxString(wxT("xz")) /*we use xz for lzma*/, wxString(wxT("lzop")), wxString(wxT("compress")), wxString(wxT("zstd")), wxString(wxT("lz4")) };
 wxString compressor;
 
 for (size_t n=0; n < sizeof(values)/sizeof(int); ++n)
@@ -1468,7 +1527,10 @@ key = wxT("ArchiveExtractForce"); config->Read(key, &ArchiveExtractForce, 0);  /
 key = wxT("DerefSymlinks"); config->Read(key, &DerefSymlinks, 0);
 key = wxT("Verify"); config->Read(key, &m_Verify, 0);
 key = wxT("DeleteSource"); config->Read(key, &DeleteSource, 0);
-key = wxT("ArchiveCompress"); config->Read(key, &lng, (long)1); ArchiveCompress = (unsigned int)lng;
+key = wxT("ArchiveCompressor");
+if (!config->Read(key, &lng))                   // This replaced "ArchiveCompress" when zstd and lz4 were inserted before 'don't compress' (which moved from 6 to 8)
+  { config->Read(wxT("ArchiveCompress"), &lng, (long)1); if (lng == 6) lng = 8; }
+ArchiveCompress = (unsigned int)lng;
 
 config->SetPath(wxT("/"));
 }
@@ -1516,7 +1578,7 @@ config->Write(path+wxT("ArchiveExtractForce"), ArchiveExtractForce);
 config->Write(path+wxT("DerefSymlinks"), DerefSymlinks);
 config->Write(path+wxT("Verify"), m_Verify);
 config->Write(path+wxT("DeleteSource"), DeleteSource);
-config->Write(path+wxT("ArchiveCompress"), (long)ArchiveCompress);
+config->Write(path+wxT("ArchiveCompressor"), (long)ArchiveCompress);
 
 config->Flush();
 }
@@ -11,6 +11,8 @@
 
 #include "wx/xrc/xmlres.h"
 
+#include "Jobs.h"
+
 enum returntype { cancel, valid, retry };
 
 class Archive;
@@ -109,7 +111,7 @@ DecompressDialog(Archive* parent);
 enum returntype GetCommand();                       // Parse entered options into a command
 
 protected:
-bool SortFiles(const wxArrayString& selected, wxArrayString& gz, wxArrayString& bz, wxArrayString& xz, wxArrayString& sevenz, wxArrayString& lzo, bool recurse, bool archivestoo = false);  //  Sort selected files into .bz, .gz & rubbish.  Recurses into dirs if recurse
+bool SortFiles(const wxArrayString& selected, wxArrayString& gz, wxArrayString& bz, wxArrayString& xz, wxArrayString& sevenz, wxArrayString& lzo, wxArrayString& zst, wxArrayString& lz4, bool recurse, bool archivestoo = false);  //  Sort selected files into .bz, .gz & rubbish.  Recurses into dirs if recurse
 void OnUpdateUI(wxUpdateUIEvent& event);
 
 private:
@@ -208,6 +210,25 @@ void UpdatePanes();                         // Work out which dirs are most like
 
 static wxString m_7zString;
 wxConfigBase* config;
+
+friend class ArchiveCommandJob;
+};
+
+class ArchiveCommandJob : public ProcessJob  // Runs one of Archive's tar/compressor commands in the background, then refreshes the panes it affected
+{
+public:
+ArchiveCommandJob(Archive* archive, const wxString& command, const wxString& description, const wxString& path,
+                    const wxString& successmsg, const wxString& failuremsg, bool updatepanes)
+  : ProcessJob(command, description, path), m_archive(archive), m_successmsg(successmsg), m_failuremsg(failuremsg), m_updatepanes(updatepanes) {}
+virtual ~ArchiveCommandJob() { delete m_archive; }
+
+virtual void OnFinished();
+
+protected:
+Archive* m_archive;        // It knows which dirs will need refreshing, so it's kept until we finish
+wxString m_successmsg;
+wxString m_failuremsg;
+bool m_updatepanes;        // Not for a verify, which changes nothing
 };
 
 #endif
@@ -15,6 +15,9 @@
 #include "wx/zstream.h"
 #include "wx/mstream.h"
 #include "wx/wfstream.h"
+#include "wx/datstrm.h"
+#include "wx/filename.h"
+#include "wx/dynlib.h"
 
 #include "Devices.h"
 #include "MyDirs.h"
@@ -30,6 +33,12 @@
 #include "bzipstream.h"
 #include "Otherstreams.h"
 #include <grp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <algorithm>
 
 wxString FakeFiledata::PermissionsToText() // Returns a string describing the filetype & permissions eg -rwxr--r--. Adapted from real FileData, but uses the archivestream::GetMode() info
 {
@@ -335,14 +344,65 @@ m_membuf->AppendData(mbuf->GetData(), mbuf->GetDataLen());
 return true;
 }
 
+static bool ArchiveWriteAll(int fd, const char* data, size_t len, off_t offset)  // pwrite() the lot, coping with short writes
+{
+while (len)
+  { ssize_t written = pwrite(fd, data, len, offset);
+    if (written == -1 && errno == EINTR) continue;
+    if (written <= 0) return false;
+    data += written; len -= written; offset += written;
+  }
+return true;
+}
+
 bool ArchiveStream::SaveBuffer()  // Saves the compressed archive in buffer back to the filesystem
 {
 if (IsNested()) { Dirty = true; return true; }  // Except we don't if this is a nested archive: it gets saved on Pop
 
-wxFFileOutputStream fileoutstream(archivename); if (!fileoutstream.Ok()) return false;
-fileoutstream.Write(m_membuf->GetData(), m_membuf->GetDataLen());
+struct stat st; bool exists = (lstat(archivename.fn_str(), &st) == 0);
+int fd = -1;
+wxString tempname = archivename + wxT(".4pane-new");
+if (!exists || !(S_ISLNK(st.st_mode) || st.st_nlink > 1)) // Renaming over a symlink or a hardlink would detach it from the other names, so those are overwritten in place
+  { fd = open(tempname.fn_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd != -1 && exists && (fchown(fd, st.st_uid, st.st_gid) != 0 || fchmod(fd, st.st_mode & 07777) != 0))
+      { close(fd); unlink(tempname.fn_str()); fd = -1; } // We can't give the new file the old one's owner (it isn't ours) so replacing it would change that. Overwrite it instead
+  }
+if (fd == -1)                                   // Either a link, or we can't create a file in the archive's dir, though we may still be able to write to the archive itself
+  { wxFFileOutputStream fileoutstream(archivename); if (!fileoutstream.Ok()) return false;
+    fileoutstream.Write(m_membuf->GetData(), m_membuf->GetDataLen());
+    return fileoutstream.IsOk();                // Returns true if the Write was successful
+  }
+                // Otherwise write the new file alongside, then rename() it over the old one. That's atomic, so a failure part-way leaves the original archive intact
+bool ok = ArchiveWriteAll(fd, (const char*)m_membuf->GetData(), m_membuf->GetDataLen(), 0) && (fdatasync(fd) == 0);
+if (close(fd) != 0) ok = false;
+if (ok)
+  ok = (rename(tempname.fn_str(), archivename.fn_str()) == 0);
+if (!ok)
+  { unlink(tempname.fn_str()); return false; }
+
+return true;
+}
+
+bool ArchiveStream::SaveBufferTail(size_t unchanged, size_t oldlen)  // Saves the buffer after an edit that left its first 'unchanged' bytes as they were
+{
+if (IsNested()) { Dirty = true; return true; }
+
+int fd = open(archivename.fn_str(), O_WRONLY | O_CLOEXEC);
+struct stat st;
+if (fd == -1 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size != oldlen || unchanged > m_membuf->GetDataLen())
+  { if (fd != -1) close(fd);                    // This isn't the file we loaded, so patching it would corrupt it. Write the whole thing instead
+    return SaveBuffer();
+  }
 
-return fileoutstream.IsOk();                    // Returns true if the Write was successful
+bool ok = true;                                 // NB unlike SaveBuffer() this isn't atomic: a crash part-way can leave the archive without a valid end. It's synced before we return though
+for (size_t n=0; ok && n < m_patches.size(); ++n)
+  ok = (m_patches[n].first + m_patches[n].second <= unchanged)
+        && ArchiveWriteAll(fd, (const char*)m_membuf->GetData() + m_patches[n].first, m_patches[n].second, m_patches[n].first);
+ok = ok && ArchiveWriteAll(fd, (const char*)m_membuf->GetData() + unchanged, m_membuf->GetDataLen() - unchanged, unchanged)
+        && (ftruncate(fd, m_membuf->GetDataLen()) == 0)  // The new tail may be shorter than the old one e.g. a zip's central directory after a Remove
+        && (fdatasync(fd) == 0);
+if (close(fd) != 0) ok = false;
+return ok;
 }
 
 void ArchiveStream::ListContentsFromBuffer(wxString archivename)
@@ -477,9 +537,292 @@ MyFrame::mainframe->OnUpdateTrees(destination, IDs, wxT(""), true);
 return true;
 }
 
+static const size_t ARCHIVE_WRITER_MAXQUEUED = 64 * 1024 * 1024; // Don't let decompression get more than this far ahead of the disk
+
+ArchiveFileWriter::ArchiveFileWriter() : m_changed(m_mutex), m_queuedbytes(0), m_inflight(0), m_finishing(false), m_failed(false)
+{
+size_t count = wxMax(ThreadsManager::GetCPUCount(), (size_t)2); // Even with one cpu, one thread can write while another waits for the disk
+for (size_t n=0; n < count; ++n)
+  { ArchiveWriterThread* thread = new ArchiveWriterThread(*this);
+    wxThreadError error;
+#if wxVERSION_NUMBER < 2905
+    error = thread->Create();
+    if (error == wxTHREAD_NO_ERROR)
+      error = thread->Run();
+#else
+    error = thread->Run(); // >2.9.5 Run() calls Create() itself
+#endif
+    if (error == wxTHREAD_NO_ERROR) m_threads.push_back(thread);
+     else delete thread;
+  }
+}
+
+bool ArchiveFileWriter::Add(const wxString& filepath, int mode, std::vector<char>& data)
+{
+ArchiveWriteJob* job = new ArchiveWriteJob;
+job->filepath = filepath.c_str();            // Deep-copy: wxString may share its data between threads otherwise
+job->mode = mode; job->data.swap(data);
+
+if (m_threads.empty())                       // None could be started, so do it here
+  { bool success = WriteFile(job->filepath, job->mode, job->data);
+    delete job;
+    wxMutexLocker locker(m_mutex);
+    if (!success) m_failed = true;
+    return !m_failed;
+  }
+
+wxMutexLocker locker(m_mutex);
+while (!m_failed && m_queuedbytes && (m_queuedbytes + job->data.size()) > ARCHIVE_WRITER_MAXQUEUED)
+  m_changed.Wait();
+if (m_failed)
+  { delete job; return false; }
+
+m_queuedbytes += job->data.size();
+m_queue.push_back(job);
+m_changed.Broadcast();
+return true;
+}
+
+void ArchiveFileWriter::Drain()
+{
+wxMutexLocker locker(m_mutex);
+while (!m_failed && (!m_queue.empty() || m_inflight))
+  m_changed.Wait();
+}
+
+bool ArchiveFileWriter::Finish()
+{
+{ wxMutexLocker locker(m_mutex);
+  m_finishing = true;
+  m_changed.Broadcast();
+}
+
+for (size_t n=0; n < m_threads.size(); ++n)
+  { m_threads[n]->Wait(); delete m_threads[n]; }
+m_threads.clear();
+
+wxMutexLocker locker(m_mutex);
+return !m_failed;
+}
+
+void ArchiveFileWriter::Cancel()
+{
+wxMutexLocker locker(m_mutex);
+m_failed = true;                             // which makes the threads discard what's queued
+m_changed.Broadcast();
+}
+
+ArchiveWriteJob* ArchiveFileWriter::TakeJob()
+{
+wxMutexLocker locker(m_mutex);
+while (m_queue.empty() && !m_finishing && !m_failed)
+  m_changed.Wait();
+
+if (m_failed)                                // There's no point writing any more
+  { for (size_t n=0; n < m_queue.size(); ++n) { m_queuedbytes -= m_queue[n]->data.size(); delete m_queue[n]; }
+    m_queue.clear();
+    m_changed.Broadcast();
+    return NULL;
+  }
+if (m_queue.empty()) return NULL;            // We're finishing, and there's nothing left
+
+ArchiveWriteJob* job = m_queue.front(); m_queue.pop_front();
+++m_inflight;
+return job;
+}
+
+void ArchiveFileWriter::JobDone(ArchiveWriteJob* job, bool success)
+{
+wxMutexLocker locker(m_mutex);
+m_queuedbytes -= job->data.size(); --m_inflight;
+if (!success) m_failed = true;
+m_changed.Broadcast();
+delete job;
+}
+
+static bool WriteAll(int fd, const char* buf, size_t len)
+{
+size_t done = 0;
+while (done < len)
+  { ssize_t written = write(fd, buf + done, len - done);
+    if (written == -1 && errno == EINTR) continue;
+    if (written <= 0) return false;
+    done += written;
+  }
+return true;
+}
+
+//static
+bool ArchiveFileWriter::WriteFile(const wxString& filepath, int mode, const std::vector<char>& data)
+{
+int fd = open(filepath.mb_str(wxConvUTF8), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+if (fd == -1) return false;
+
+#if defined(__LINUX__)
+  if (!data.empty()) posix_fallocate(fd, 0, data.size()); // Reserve the space in one go, rather than growing the file a write at a time
+#endif
+if (!data.empty() && !WriteAll(fd, &data[0], data.size()))
+  { close(fd); return false; }
+
+fchmod(fd, mode & 07777);                    // On the fd we already have, so there's no need to stat the file again
+return close(fd) == 0;
+}
+
+//static
+bool ArchiveFileWriter::StreamFile(wxInputStream& in, const wxString& filepath, int mode, wxFileOffset size)
+{
+int fd = open(filepath.mb_str(wxConvUTF8), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+if (fd == -1) return false;
+
+#if defined(__LINUX__)
+  if (size > 0) posix_fallocate(fd, 0, size);
+#endif
+std::vector<char> chunk(1024 * 1024);
+while (true)
+  { in.Read(&chunk[0], chunk.size());
+    size_t got = in.LastRead();
+    if (!got) break;
+    if (!WriteAll(fd, &chunk[0], got)) { close(fd); return false; }
+  }
+
+fchmod(fd, mode & 07777);
+return (close(fd) == 0) && in.Eof();
+}
+
+void* ArchiveWriterThread::Entry()
+{
+ArchiveWriteJob* job;
+while ((job = m_writer.TakeJob()) != NULL)
+  m_writer.JobDone(job, ArchiveFileWriter::WriteFile(job->filepath, job->mode, job->data));
+return NULL;
+}
+
+ArchiveExtractProgress::~ArchiveExtractProgress()
+{
+if (m_dlg) m_dlg->Destroy();
+}
+
+bool ArchiveExtractProgress::Update(size_t done)
+{
+if (m_cancelled) return false;
+
+wxLongLong now = wxGetLocalTimeMillis();
+if ((now - m_lastupdate) < 100) return true; // Updating a dialog for each of 200,000 files would take longer than extracting them
+m_lastupdate = now;
+
+if (!m_dlg)
+  { if ((now - m_start) < 1000) return true; // Most extractions are finished before anyone would notice
+    m_dlg = new wxProgressDialog(_("Extracting"), _("Extracting from the archive"), (int)wxMax(m_total, (size_t)1), MyFrame::mainframe,
+                                                    wxPD_APP_MODAL | wxPD_CAN_ABORT | wxPD_ELAPSED_TIME | wxPD_REMAINING_TIME);
+  }
+
+if (!m_dlg->Update((int)wxMin(done, m_total), wxString::Format(_("%u of %u items extracted"), (unsigned int)done, (unsigned int)m_total)))
+  m_cancelled = true;
+return !m_cancelled;
+}
+
+bool ZipExtractShared::Claim(size_t& index)
+{
+wxCriticalSectionLocker locker(lock);
+if (finished || failed || cancelled) return false;
+
+index = next++;
+return true;
+}
+
+void ZipExtractShared::Done(bool success)
+{
+wxCriticalSectionLocker locker(lock);
+if (success) ++extracted;
+ else failed = true;
+}
+
+void ZipExtractShared::Finished(bool atend)
+{
+wxCriticalSectionLocker locker(lock);
+if (atend) finished = true;
+if (running) --running;
+}
+
+//static
+void ZipExtractThread::ExtractClaimed(const wxMemoryBuffer* membuf, const ArchiveNameIndex& wanted, const ArchiveNameIndex& lastentry, const wxArrayString& destinations, ZipExtractShared& shared)
+{
+wxLogNull log;
+wxMemoryInputStream meminstream(membuf->GetData(), membuf->GetDataLen());
+wxZipInputStream zip(meminstream);           // As meminstream is seekable, this reads the central directory, and skips to each entry without decompressing the ones in between
+
+wxZipEntryPtr entry;
+size_t position = 0, index;
+while (shared.Claim(index))
+  { while (position <= index)                // Skip the entries that other threads claimed
+      { entry.reset(zip.GetNextEntry());
+        if (entry.get() == NULL)
+          { shared.Finished(true); return; }
+        ++position;
+      }
+
+    if (entry->IsDir()) continue;            // The dirs were made before the threads started
+    ArchiveNameIndex::const_iterator iter = wanted.find(entry->GetName());
+    if (iter == wanted.end()) continue;
+    ArchiveNameIndex::const_iterator last = lastentry.find(entry->GetName());
+    if (last != lastentry.end() && last->second != (int)(position-1)) continue; // A later entry has the same name, and it's that one that must win
+
+    if (ArchiveFileWriter::IsTooBigToQueue(entry->GetSize()))
+      { shared.Done(ArchiveFileWriter::StreamFile(zip, destinations[iter->second], entry->GetMode(), entry->GetSize())); continue; }
+    std::vector<char> data;
+    shared.Done(ArchiveStream::ReadEntryData(zip, data, entry->GetSize())
+                  && ArchiveFileWriter::WriteFile(destinations[iter->second], entry->GetMode(), data));
+  }
+
+shared.Finished(false);
+}
+
+void* ZipExtractThread::Entry()
+{
+ExtractClaimed(m_membuf, m_wanted, m_lastentry, m_destinations, m_shared);
+return NULL;
+}
+
+int ArchiveStream::FindWithinArchiveName(const wxString& name)
+{
+if (WithinArchiveIndex.empty() && !WithinArchiveNames.IsEmpty())
+  for (size_t n = WithinArchiveNames.GetCount(); n > 0; --n) // Backwards, so that if a name is there twice the first one wins, as it did with Index()
+    WithinArchiveIndex[WithinArchiveNames[n-1]] = (int)(n-1);
+
+ArchiveNameIndex::const_iterator iter = WithinArchiveIndex.find(name);
+if (iter == WithinArchiveIndex.end()) return wxNOT_FOUND;
+return iter->second;
+}
+
+//static
+bool ArchiveStream::ReadEntryData(wxInputStream& in, std::vector<char>& data, wxFileOffset size)
+{
+data.resize((size > 0) ? (size_t)size + 1 : 64 * 1024); // +1 so that the read that finds the end doesn't need a bigger buffer
+size_t total = 0;
+while (true)
+  { if (total == data.size()) data.resize(data.size() * 2); // The size was unknown, or wrong
+    in.Read(&data[total], data.size() - total);
+    size_t got = in.LastRead();
+    if (!got) break;
+    total += got;
+  }
+
+data.resize(total);
+return in.Eof();
+}
+
+//static
+bool ArchiveStream::MakeDir(const wxString& dirpath, ArchiveDirSet& made)
+{
+if (made.find(dirpath) != made.end()) return true;
+if (!wxFileName::Mkdir(dirpath, 0777, wxPATH_MKDIR_FULL)) return false;
+made.insert(dirpath);
+return true;
+}
+
 bool ArchiveStream::SortOutNames(const wxString& filepath)  // Subroutine used in Extract etc, so made into a function in the name of code reuse
 {
-WithinArchiveName.Empty(); WithinArchiveNames.Clear(); WithinArchiveNewNames.Clear(); IsDir = false;
+WithinArchiveName.Empty(); WithinArchiveNames.Clear(); WithinArchiveIndex.clear(); WithinArchiveNewNames.Clear(); IsDir = false;
 archivename = ffs->GetRootDir()->GetFilepath(); if (archivename.IsEmpty()) return false;  // Now get the true archivename: the archive expects it ;)
 
 wxString FakeFilesystemPath(ffs->GetCurrentDir()->GetFilepath()); if (FakeFilesystemPath.IsEmpty()) return false;  // First use current path, in case we're recursing in a subdir
@@ -504,7 +847,7 @@ return true;
     // Get the within-archive names, any descendants, and (if renaming) the new names
 bool ArchiveStream::AdjustFilepaths(const wxArrayString& filepaths, const wxString& destpath, wxArrayString& newnames, adjFPs whichtype/*=afp_neither*/, bool dirs_only/*=false*/, bool files_only/*=false*/)
 {
-WithinArchiveNames.Clear(); WithinArchiveNewNames.Clear();
+WithinArchiveNames.Clear(); WithinArchiveIndex.clear(); WithinArchiveNewNames.Clear();
 archivename = ffs->GetRootDir()->GetFilepath(); if (archivename.IsEmpty()) return false; // Get the archive name, which we need to remove
                       // If we're from Rename or Extract, newnames will hold the new names/destination path
 if (whichtype==afp_rename && newnames.GetCount() > filepaths.GetCount()) return false;  // If there are too many of them, abort
@@ -559,10 +902,15 @@ bool ArchiveStream::Alter(wxArrayString& filepaths, enum alterarc DoWhich, wxArr
 {
 if (filepaths.IsEmpty()) return false;
 
+size_t oldlen = m_membuf->GetDataLen(), unchanged = 0;
+bool inplace = false;                           // Some edits can be made by patching the end of the buffer, which saves rewriting (and recompressing) the whole archive
+m_patches.clear();
+
 if (DoWhich != arc_add)                         // If not arc_add, remove the /pathtoarchive/archive bit of each filepath
   { wxString Unused; if (!AdjustFilepaths(filepaths, Unused, newnames, DoWhich==arc_rename || DoWhich==arc_dup ? afp_rename : afp_neither, dirs_only)) return false; 
-    wxBusyCursor busy;
-    if (!DoAlteration(filepaths, DoWhich)) return false;  // Do the exciting bit in a tar or zip-specific method
+    wxBusyCursor busy;                          // This still runs in the main thread, not as a Job: the tree and the open archive's buffer are both in use by the GUI throughout
+    inplace = AlterInPlace(filepaths, DoWhich, unchanged);
+    if (!inplace && !DoAlteration(filepaths, DoWhich)) return false;  // Do the exciting bit in a tar or zip-specific method
   }
  else                                           // If arc_add, get the target dir for insertion into WithinArchivename.  I've overloaded newnames to contain its full filepath
   { if (newnames.IsEmpty())   return false; 
@@ -570,23 +918,31 @@ if (DoWhich != arc_add)                         // If not arc_add, remove the /p
     if (SortOutNames(dest))                     // Sortoutnames also fills archivename. Don't test for success: if we're pasting directly onto the archive, it'll return false
       if (!IsDir) WithinArchiveName = WithinArchiveName.BeforeLast(wxFILE_SEP_PATH) + wxFILE_SEP_PATH;  // If we're pasting onto a file, remove the filename
     wxBusyCursor busy;
-    if (!DoAlteration(filepaths, DoWhich, newnames[1], dirs_only)) return false;  // Do the exciting bit in a tar or zip-specific method
+    inplace = AlterInPlace(filepaths, DoWhich, unchanged, newnames[1], dirs_only);
+    if (!inplace && !DoAlteration(filepaths, DoWhich, newnames[1], dirs_only)) return false;  // Do the exciting bit in a tar or zip-specific method
   }
 
-size_t size = OutStreamPtr->GetSize();          // This is how much was loaded i.e. the file size
-wxChar* buf = new wxChar[ size ];               // It's ugly, but the easiest way I've found to get the data from the stream to a memorybuffer
-((wxMemoryOutputStream*)OutStreamPtr.get())->CopyTo(buf, size);  // is by using an intermediate char[]
-OutStreamPtr.reset();                           // Delete memoutstream
-
-delete m_membuf; m_membuf = new wxMemoryBuffer(size); // I've no idea why, but trying to delete the old data by SetDataLen(0) failed :(
-m_membuf->AppendData(buf, size);                // Store the data
-delete[] buf;
+bool saved;
+if (inplace)
+  saved = SaveBufferTail(unchanged, oldlen);    // Only what's past 'unchanged' needs writing
+ else
+  { size_t size = OutStreamPtr->GetSize();      // This is how much was loaded i.e. the file size
+    delete m_membuf; m_membuf = new wxMemoryBuffer(size); // I've no idea why, but trying to delete the old data by SetDataLen(0) failed :(
+    ((wxMemoryOutputStream*)OutStreamPtr.get())->CopyTo(m_membuf->GetAppendBuf(size), size);  // Copy straight into the buffer's storage
+    m_membuf->UngetAppendBuf(size);
+    OutStreamPtr.reset();                       // Delete memoutstream
 
-SaveBuffer();
+    saved = SaveBuffer();
+  }
 
 ffs->Clear();                                   // Throw out the old dir structure, and reload
 ListContentsFromBuffer(archivename);
 
+if (!saved)
+  { wxString msg; msg.Printf(_("Sorry, the altered archive couldn't be saved to\n%s\nThe file on disk may not match what's shown"), archivename.c_str());
+    wxMessageDialog dialog(MyFrame::mainframe, msg, _("Oops!"), wxOK | wxICON_ERROR); dialog.ShowModal();
+    return false;
+  }
 return true;
 }
 
@@ -992,31 +1348,74 @@ if (filepaths.IsEmpty() || destpath.IsEmpty()) return false;
   // AdjustFilepaths puts each filepath into WithinArchiveNames, less the /path-to-archive/archive; & creates its dest in WithinArchiveNewNames. If a dir, recursively adds into children too
 if (!AdjustFilepaths(filepaths, destpath, resultingfilepaths, afp_extract, dirs_only, files_only)) return false;
 
-wxZipEntryPtr entry;
-wxMemoryInputStream meminstream(m_membuf->GetData(), m_membuf->GetDataLen());  // The archive is in the memory buffer m_membuf. 'Extract' it to a memory stream
-wxZipInputStream zip(meminstream);
-
-size_t NumberFound = 0;
-
-while (entry.reset(zip.GetNextEntry()), entry.get() != NULL)
-  { int item = WithinArchiveNames.Index(entry->GetName());  // See if this file is one of the ones we're interested in
-    if (item == wxNOT_FOUND)  continue;
-                // Found it. If it's a file, extract it. If a dir,  make a new dir with this name (*outside* the archive ;)
-    wxLogNull log;
-    if (!entry->IsDir())                                    // (For a dir there's no data to extract)
-      { wxString Path(resultingfilepaths[ item ]); Path = Path.BeforeLast(wxFILE_SEP_PATH);
-        if (!wxFileName::Mkdir(Path, 0777, wxPATH_MKDIR_FULL)) return false;  // Make any necessary dir
+size_t NumberFound = 0, files = 0;
+ArchiveNameIndex lastentry;                                 // A zip can hold the same name twice. When extracting serially the later one won, so it must here too
+{ wxZipEntryPtr entry;
+  wxMemoryInputStream meminstream(m_membuf->GetData(), m_membuf->GetDataLen());  // The archive is in the memory buffer m_membuf. 'Extract' it to a memory stream
+  wxZipInputStream zip(meminstream);
+  ArchiveDirSet made;
+  wxLogNull log;
+  int position = -1;
+    // First a quick pass through the central directory, decompressing nothing, to make the dirs. Then the threads below needn't race to make them
+  while (entry.reset(zip.GetNextEntry()), entry.get() != NULL)
+    { ++position;
+      int item = FindWithinArchiveName(entry->GetName());  // See if this file is one of the ones we're interested in
+      if (item == wxNOT_FOUND)  continue;
+      if (entry->IsDir())                                   // (For a dir there's no data to extract)
+        { if (!MakeDir(StripSep(resultingfilepaths[ item ]), made)) return false;  // Just create the dir
+          ++NumberFound;
+        }
+       else
+        { if (!MakeDir(resultingfilepaths[ item ].BeforeLast(wxFILE_SEP_PATH), made)) return false;  // Make any necessary dir
+          ++files; lastentry[entry->GetName()] = position;
+        }
+    }
+}
+NumberFound += files - lastentry.size(); files = lastentry.size(); // The earlier duplicates are superseded, not extracted; count them as the serial code did
+if (!files) return NumberFound >= WithinArchiveNames.GetCount();
+
+  // Now extract the files. Each thread reads its own stream over m_membuf, claiming entries one at a time, so they decompress in parallel
+ZipExtractShared shared;
+std::vector<ZipExtractThread*> pool;
+size_t threads = wxMin(ThreadsManager::GetCPUCount(), files);
+for (size_t n=0; n < threads; ++n)
+  { ZipExtractThread* thread = new ZipExtractThread(m_membuf, WithinArchiveIndex, lastentry, resultingfilepaths, shared);
+    { wxCriticalSectionLocker locker(shared.lock); ++shared.running; }
+    wxThreadError error;
+#if wxVERSION_NUMBER < 2905
+    error = thread->Create();
+    if (error == wxTHREAD_NO_ERROR)
+      error = thread->Run();
+#else
+    error = thread->Run(); // >2.9.5 Run() calls Create() itself
+#endif
+    if (error == wxTHREAD_NO_ERROR) pool.push_back(thread);
+     else
+      { delete thread;
+        wxCriticalSectionLocker locker(shared.lock); --shared.running;
+      }
+  }
 
-        wxFFileOutputStream out(resultingfilepaths[ item ]);
-        if (!out || ! out.Write(zip) || ! zip.Eof())   return false;  // and extract into the new filepath
-        FileData fd(resultingfilepaths[ item ]); if (fd.IsValid()) fd.DoChmod(entry->GetMode());    // Correct the extracted file's permissions
+if (pool.empty())
+  ZipExtractThread::ExtractClaimed(m_membuf, WithinArchiveIndex, lastentry, resultingfilepaths, shared); // No threads, so do it here
+ else
+  { ArchiveExtractProgress progress(WithinArchiveNames.GetCount());
+    while (true)
+      { size_t extracted;
+        { wxCriticalSectionLocker locker(shared.lock);
+          if (!shared.running) break;
+          extracted = shared.extracted;
+        }
+        if (!progress.Update(NumberFound + extracted))
+          { wxCriticalSectionLocker locker(shared.lock); shared.cancelled = true; }
+        wxMilliSleep(20);
       }
-     else if (!wxFileName::Mkdir(resultingfilepaths[ item ], 0777, wxPATH_MKDIR_FULL)) return false;  // Just create the dir
-     
-     if (++NumberFound >= WithinArchiveNames.GetCount()) return true; // See if we've used all the passed filepaths
+    for (size_t n=0; n < pool.size(); ++n)
+      { pool[n]->Wait(); delete pool[n]; }
   }
 
-return false;
+if (shared.failed || shared.cancelled) return false;
+return (NumberFound + shared.extracted) >= WithinArchiveNames.GetCount(); // See if we've used all the passed filepaths
 }
 
 bool ZipArchiveStream::DoAlteration(wxArrayString& filepaths, enum alterarc DoWhich, const wxString& originroot/*=wxT("")*/, bool dirs_only/*=false*/)  // Implement add remove del or rename, depending on the enum
@@ -1033,7 +1432,7 @@ outzip.CopyArchiveMetaData(*(wxZipInputStream*)InStreamPtr.get());
 
 wxZipEntryPtr entry,  dupentry;
 while (entry.reset(((wxZipInputStream*)InStreamPtr.get())->GetNextEntry()), entry.get() != NULL)      // Go thru the archive, looking for the selected files.
-  { int item = WithinArchiveNames.Index(entry->GetName());     // See if this file is one of the ones we're interested in
+  { int item = FindWithinArchiveName(entry->GetName());     // See if this file is one of the ones we're interested in
     switch(DoWhich)
       { case arc_add:      break;                              // Add happens later
         case arc_remove:  if (item != wxNOT_FOUND)  continue;  // If this file is one of the 2b-removed ones, ignore it, don't add it to the new archive
@@ -1089,6 +1488,102 @@ OutStreamPtr.reset(memoutstream);  // This has a kludgey feel, but it returns th
 return true;
 }
 
+static wxUint16 ArcGet16(const unsigned char* p) { return (wxUint16)(p[0] | (p[1] << 8)); }  // Zip headers are little-endian, whatever the host is
+static wxUint32 ArcGet32(const unsigned char* p) { return ArcGet16(p) | ((wxUint32)ArcGet16(p + 2) << 16); }
+static void ArcPut16(unsigned char* p, wxUint16 val) { p[0] = val & 0xff; p[1] = val >> 8; }
+static void ArcPut32(unsigned char* p, wxUint32 val) { ArcPut16(p, val & 0xffff); ArcPut16(p + 2, val >> 16); }
+
+const wxUint32 ZIP_LOCAL_MAGIC = 0x04034b50, ZIP_CENTRAL_MAGIC = 0x02014b50, ZIP_END_MAGIC = 0x06054b50, ZIP64_LOCATOR_MAGIC = 0x07064b50;
+const size_t ZIP_LOCAL_SIZE = 30, ZIP_CENTRAL_SIZE = 46, ZIP_END_SIZE = 22;  // The fixed parts of a local header, a central-directory record, and the end record
+
+bool ZipArchiveStream::AlterInPlace(wxArrayString& WXUNUSED(filepaths), enum alterarc DoWhich, size_t& unchanged, const wxString& WXUNUSED(originroot), bool WXUNUSED(dirs_only))
+{
+if (DoWhich != arc_remove && DoWhich != arc_rename) return false;  // Anything else means new data, so needs DoAlteration
+                // A zip's central directory, at the end, is the authoritative list of entries. So to Remove or Rename we mostly need only rewrite that
+                // and the end record that follows it. However streaming readers use the local headers instead, so a rename must patch those too,
+                // which can only be done if the name's length is unchanged; and a Remove must drop the entries' data, so it can only be done if that's at the end
+const unsigned char* data = (const unsigned char*)m_membuf->GetData(); size_t len = m_membuf->GetDataLen();
+if (len < ZIP_END_SIZE) return false;
+
+size_t end = len - ZIP_END_SIZE, stop = (end > 0xffff) ? end - 0xffff : 0;  // The end record may be followed by a comment of up to 64K
+while (ArcGet32(data + end) != ZIP_END_MAGIC)
+  { if (end == stop) return false;
+    --end;
+  }
+if (end + ZIP_END_SIZE + ArcGet16(data + end + 20) != len) return false;  // Probably the 'signature' was part of the comment
+if (end >= 20 && ArcGet32(data + end - 20) == ZIP64_LOCATOR_MAGIC) return false;  // Zip64. Leave that to wxZipOutputStream
+
+size_t count = ArcGet16(data + end + 10), cdsize = ArcGet32(data + end + 12), cdstart = ArcGet32(data + end + 16);
+if (ArcGet16(data + end + 4) || ArcGet16(data + end + 6) || count != ArcGet16(data + end + 8)) return false;  // Multi-disk
+if (cdstart + cdsize != end) return false;
+
+std::vector<bool> found(WithinArchiveNames.GetCount(), false);
+wxMemoryBuffer cd(cdsize); size_t newcount = 0;
+size_t firstremoved = cdstart, lastkept = 0; bool anykept = false; // For a Remove: where the removed and the kept entries' local headers are
+std::vector< std::pair<size_t, std::vector<char> > > localnames;  // For a Rename: the new names to write into the local headers
+for (size_t pos = cdstart, n=0; n < count; ++n)
+  { if (pos + ZIP_CENTRAL_SIZE > end || ArcGet32(data + pos) != ZIP_CENTRAL_MAGIC) return false;
+    size_t namelen = ArcGet16(data + pos + 28);
+    size_t reclen = ZIP_CENTRAL_SIZE + namelen + ArcGet16(data + pos + 30) + ArcGet16(data + pos + 32);
+    if (pos + reclen > end) return false;
+    
+    const wxMBConv& conv = (ArcGet16(data + pos + 8) & 0x800) ? (const wxMBConv&)wxConvUTF8 : (const wxMBConv&)wxConvLocal; // Flag bit 11 means the name is utf8
+    wxString name((const char*)data + pos + ZIP_CENTRAL_SIZE, conv, namelen);
+    if (name.IsEmpty()) return false;           // Either there's no name, or it didn't convert. Either way, not something to patch blind
+    size_t local = ArcGet32(data + pos + 42);   // The offset of the entry's local header
+    if (local + ZIP_LOCAL_SIZE + namelen > cdstart || ArcGet32(data + local) != ZIP_LOCAL_MAGIC) return false;
+    int item = FindWithinArchiveName(name);
+    if (item == wxNOT_FOUND)
+      { cd.AppendData(data + pos, reclen);      // Not one of ours, so copy it unchanged
+        lastkept = wxMax(lastkept, local); anykept = true;
+      }
+     else
+      { found[item] = true;
+        if (DoWhich == arc_remove)
+          { firstremoved = wxMin(firstremoved, local);
+            pos += reclen; continue;            // Just leave it out
+          }
+
+        wxString newname(WithinArchiveNewNames[ item ]);
+        if (name.Last() == wxFILE_SEP_PATH && newname.Last() != wxFILE_SEP_PATH) newname << wxFILE_SEP_PATH;
+        if (newname.IsEmpty() || newname.GetChar(0) == wxFILE_SEP_PATH) return false;
+        wxCharBuffer newbytes(newname.mb_str(conv)); if (!newbytes.data()) return false;
+        size_t newlen = strlen(newbytes.data());
+        if (newlen != namelen) return false;    // The local header can't grow or shrink without moving everything after it
+        if (ArcGet16(data + local + 26) != namelen || memcmp(data + local + ZIP_LOCAL_SIZE, data + pos + ZIP_CENTRAL_SIZE, namelen)) return false; // The two names must agree now, or we'd not know which to believe
+
+        localnames.push_back(std::make_pair(local + ZIP_LOCAL_SIZE, std::vector<char>(newbytes.data(), newbytes.data() + newlen)));
+        cd.AppendData(data + pos, ZIP_CENTRAL_SIZE); cd.AppendData(newbytes.data(), newlen);  // The extra field and comment follow unchanged
+        cd.AppendData(data + pos + ZIP_CENTRAL_SIZE + namelen, reclen - ZIP_CENTRAL_SIZE - namelen);
+        lastkept = wxMax(lastkept, local); anykept = true;
+      }
+    ++newcount; pos += reclen;
+  }
+for (size_t n=0; n < found.size(); ++n)
+  if (!found[n]) return false;                  // Something we were asked to alter isn't listed as we'd expect e.g. an implied dir. Let DoAlteration cope
+
+size_t newcdstart = cdstart;
+if (DoWhich == arc_remove)
+  { if (anykept && lastkept > firstremoved) return false; // Some removed data is followed by data we're keeping. Leaving it there would still let streaming readers extract it
+    newcdstart = firstremoved;                  // Otherwise it's all at the end, so the new central directory can overwrite it
+  }
+
+unsigned char endrec[ZIP_END_SIZE]; memcpy(endrec, data + end, ZIP_END_SIZE);
+ArcPut16(endrec + 8, newcount); ArcPut16(endrec + 10, newcount); ArcPut32(endrec + 12, cd.GetDataLen()); ArcPut32(endrec + 16, newcdstart);
+
+wxMemoryBuffer* newbuf = new wxMemoryBuffer(newcdstart + cd.GetDataLen() + len - end);
+newbuf->AppendData(data, newcdstart); newbuf->AppendData(cd.GetData(), cd.GetDataLen());
+newbuf->AppendData(endrec, ZIP_END_SIZE); newbuf->AppendData(data + end + ZIP_END_SIZE, len - end - ZIP_END_SIZE);  // then any comment
+for (size_t n=0; n < localnames.size(); ++n)    // Rename the local headers too. As their lengths are unchanged, nothing moves
+  { memcpy((char*)newbuf->GetData() + localnames[n].first, &localnames[n].second[0], localnames[n].second.size());
+    m_patches.push_back(std::make_pair(localnames[n].first, localnames[n].second.size()));
+  }
+delete m_membuf; m_membuf = newbuf;
+
+unchanged = newcdstart;
+return true;
+}
+
 wxMemoryBuffer* ZipArchiveStream::ExtractToBuffer(wxString filepath)  // Extract filepath from this archive into a new wxMemoryBuffer
 {
 if (filepath.IsEmpty()) return NULL;
@@ -1204,6 +1699,394 @@ SaveBuffer();                                     // We now need to save (or dec
 
 //-----------------------------------------------------------------------------------------------------------------------
 
+const size_t ARCHIVE_INDEX_MINSIZE = 16 * 1024 * 1024;  // Smaller archives decompress quickly enough not to need checkpoints, or a cached index
+const size_t ARCHIVE_INDEX_MAXPOINTS = 256;             // Each gzip checkpoint holds 32K of window, so don't have too many
+const wxUint64 ARCHIVE_INDEX_FIRSTSPAN = 1024 * 1024;
+const size_t ARCHIVE_INDEX_MAXFILES = 32;               // How many archives' indexes to keep in the cache
+static const char ARCHIVEINDEX_MAGIC[4] = { '4', 'P', 'A', 'I' };
+static const wxUint32 ARCHIVEINDEX_VERSION = 1;
+
+static bool ArchiveSkip(wxInputStream& in, wxUint64 count)  // Read and discard count bytes of a stream that can't seek
+{
+char buf[65536];
+while (count)
+  { size_t got = in.Read(buf, (size_t)wxMin(count, (wxUint64)sizeof(buf))).LastRead();
+    if (!got) return false;
+    count -= got;
+  }
+return true;
+}
+
+void ArchiveSeekIndex::Clear()
+{
+m_entries.clear(); m_names.clear(); m_points.clear();
+m_span = ARCHIVE_INDEX_FIRSTSPAN;
+}
+
+void ArchiveSeekIndex::AddEntry(const ArchiveIndexEntry& entry)
+{
+if (m_names.find(entry.name) == m_names.end())
+  m_names[entry.name] = m_entries.size();
+m_entries.push_back(entry);
+}
+
+const ArchiveIndexEntry* ArchiveSeekIndex::FindEntry(const wxString& name) const
+{
+ArchiveIndexNames::const_iterator iter = m_names.find(name);
+return (iter != m_names.end()) ? &m_entries[iter->second] : NULL;
+}
+
+void ArchiveSeekIndex::AddPoint(ArchiveSeekPoint& point)
+{
+if (m_points.size() >= ARCHIVE_INDEX_MAXPOINTS)  // Too many, so keep alternate ones, and space future ones twice as far apart
+  { size_t kept = 0;
+    for (size_t n=0; n < m_points.size(); n += 2)
+      { if (n != kept) std::swap(m_points[kept], m_points[n]);
+        ++kept;
+      }
+    m_points.resize(kept);
+    m_span *= 2;
+  }
+
+m_points.push_back(ArchiveSeekPoint());
+ArchiveSeekPoint& added = m_points.back();
+added.out = point.out; added.in = point.in; added.bits = point.bits;
+added.window.swap(point.window);
+}
+
+const ArchiveSeekPoint* ArchiveSeekIndex::FindPoint(wxUint64 out) const
+{
+size_t lo = 0, hi = m_points.size();        // Binary search for the first point after out. The one before it is what we want
+while (lo < hi)
+  { size_t mid = (lo + hi) / 2;
+    if (m_points[mid].out <= out) lo = mid + 1;
+     else hi = mid;
+  }
+return lo ? &m_points[lo - 1] : NULL;
+}
+
+static bool XzVarint(const unsigned char* data, size_t end, size_t& pos, wxUint64& val)  // xz's integers: 7 bits per byte, least-significant first
+{
+val = 0;
+for (int shift = 0; shift < 63; shift += 7)
+  { if (pos >= end) return false;
+    unsigned char byte = data[pos++];
+    val |= (wxUint64)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+return false;
+}
+
+bool ArchiveSeekIndex::AddXzBlocks(const unsigned char* data, size_t len)
+{
+static const unsigned char XZ_MAGIC[6] = { 0xfd, '7', 'z', 'X', 'Z', 0 };
+const size_t XZ_HEADERSIZE = 12;              // Both the stream header and the footer are 12 bytes
+
+if (len < 2 * XZ_HEADERSIZE || memcmp(data, XZ_MAGIC, 6)) return false;
+size_t end = len;
+while (end >= 4 && !data[end-1] && !data[end-2] && !data[end-3] && !data[end-4]) end -= 4;  // Skip any stream padding
+if (end < 2 * XZ_HEADERSIZE || data[end-2] != 'Y' || data[end-1] != 'Z') return false;
+size_t footer = end - XZ_HEADERSIZE;
+if (memcmp(data + footer + 8, data + 6, 2)) return false;  // The footer's stream flags must match the header's
+
+wxUint64 indexsize = ((wxUint64)ArcGet32(data + footer + 4) + 1) * 4;
+if (indexsize > footer - XZ_HEADERSIZE) return false;
+size_t index = footer - indexsize, pos = index;
+wxUint64 count;
+if (data[pos++] != 0 || !XzVarint(data, footer, pos, count)) return false;
+
+std::vector<ArchiveSeekPoint> points;
+wxUint64 compressed = XZ_HEADERSIZE, uncompressed = 0;
+for (wxUint64 n=0; n < count; ++n)
+  { wxUint64 unpadded, size;
+    if (!XzVarint(data, footer, pos, unpadded) || !XzVarint(data, footer, pos, size) || !unpadded) return false;
+    points.push_back(ArchiveSeekPoint());
+    points.back().out = uncompressed; points.back().in = compressed; points.back().bits = 0;
+    compressed += (unpadded + 3) & ~(wxUint64)3;  // Blocks are padded to a multiple of 4
+    uncompressed += size;
+  }
+if (compressed != index) return false;        // There's more than one stream (or something's wrong), so the offsets don't fit this file
+
+m_points.swap(points);
+return true;
+}
+
+//static
+wxString ArchiveSeekIndex::GetCacheFilepath(const wxString& archivepath)
+{
+std::string utf8(archivepath.mb_str(wxConvUTF8));
+wxUint64 hash = wxULL(14695981039346656037);   // FNV-1a, to give each archive a filename
+for (size_t n=0; n < utf8.size(); ++n)
+  { hash ^= (unsigned char)utf8[n]; hash *= wxULL(1099511628211); }
+
+return StrWithSep(wxGetApp().GetXDGcachedir()) + wxT("4Pane/archiveindex/") + wxString::Format(wxT("%016") wxLongLongFmtSpec wxT("x.idx"), hash);
+}
+
+bool ArchiveSeekIndex::Load(const wxString& archivepath, size_t len)
+{
+Clear();
+struct stat st;
+if (stat(archivepath.fn_str(), &st) != 0 || (size_t)st.st_size != len) return false;
+wxString filepath = GetCacheFilepath(archivepath);
+if (!wxFileExists(filepath)) return false;
+
+wxFFileInputStream file(filepath); if (!file.IsOk()) return false;
+wxDataInputStream in(file);
+char magic[4];              // The archive must be the same file, unchanged since the index was saved
+bool ok = (file.Read(magic, 4).LastRead() == 4) && !memcmp(magic, ARCHIVEINDEX_MAGIC, 4)
+            && (in.Read32() == ARCHIVEINDEX_VERSION) && (in.ReadString() == archivepath)
+            && (in.Read64() == (wxUint64)st.st_size) && (in.Read64() == (wxUint64)st.st_mtime) && (in.Read64() == (wxUint64)st.st_ino);
+if (ok) m_span = in.Read64();
+
+wxUint32 count = ok ? in.Read32() : 0;
+for (wxUint32 n=0; ok && n < count; ++n)
+  { ArchiveIndexEntry entry;
+    entry.name = in.ReadString(); entry.target = in.ReadString();
+    entry.headerpos = in.Read64(); entry.size = in.Read64(); entry.time = (wxInt64)in.Read64();
+    entry.mode = in.Read32(); entry.type = in.Read8();
+    ok = file.IsOk();
+    if (ok) AddEntry(entry);
+  }
+
+count = ok ? in.Read32() : 0;
+for (wxUint32 n=0; ok && n < count; ++n)
+  { ArchiveSeekPoint point;
+    point.out = in.Read64(); point.in = in.Read64(); point.bits = in.Read8();
+    wxUint32 windowlen = in.Read32();
+    ok = file.IsOk() && (point.bits < 8) && (windowlen <= 32768);
+    if (ok && windowlen)
+      { point.window.resize(windowlen);
+        ok = (file.Read(&point.window[0], windowlen).LastRead() == windowlen);
+      }
+    if (ok) AddPoint(point);
+  }
+
+if (!ok) { Clear(); return false; }
+wxFileName(filepath).Touch();                 // so that PruneCache() treats it as recently used
+return true;
+}
+
+bool ArchiveSeekIndex::Save(const wxString& archivepath, size_t len)
+{
+struct stat st;
+if (stat(archivepath.fn_str(), &st) != 0 || (size_t)st.st_size != len) return false;  // Then what's on disk isn't what we indexed
+wxString filepath = GetCacheFilepath(archivepath), dir = filepath.BeforeLast(wxFILE_SEP_PATH);
+if (!wxDirExists(dir) && !wxFileName::Mkdir(dir, 0700, wxPATH_MKDIR_FULL)) return false;
+
+wxString tempfilepath = filepath + wxT(".tmp");
+bool ok;
+  { wxFFileOutputStream file(tempfilepath); if (!file.IsOk()) return false;
+    wxDataOutputStream out(file);
+    file.Write(ARCHIVEINDEX_MAGIC, 4);
+    out.Write32(ARCHIVEINDEX_VERSION); out.WriteString(archivepath);
+    out.Write64((wxUint64)st.st_size); out.Write64((wxUint64)st.st_mtime); out.Write64((wxUint64)st.st_ino);
+    out.Write64(m_span);
+
+    out.Write32(m_entries.size());
+    for (size_t n=0; n < m_entries.size(); ++n)
+      { const ArchiveIndexEntry& entry = m_entries[n];
+        out.WriteString(entry.name); out.WriteString(entry.target);
+        out.Write64(entry.headerpos); out.Write64(entry.size); out.Write64((wxUint64)entry.time);
+        out.Write32(entry.mode); out.Write8(entry.type);
+      }
+
+    out.Write32(m_points.size());
+    for (size_t n=0; n < m_points.size(); ++n)
+      { const ArchiveSeekPoint& point = m_points[n];
+        out.Write64(point.out); out.Write64(point.in); out.Write8(point.bits);
+        out.Write32(point.window.size());
+        if (!point.window.empty()) file.Write(&point.window[0], point.window.size());
+      }
+    ok = file.IsOk() && file.Close();
+  }
+if (ok) ok = (rename(tempfilepath.fn_str(), filepath.fn_str()) == 0);  // so a crash mid-save can't leave a truncated index
+if (!ok) { wxRemoveFile(tempfilepath); return false; }
+
+PruneCache(dir);
+return true;
+}
+
+//static
+void ArchiveSeekIndex::PruneCache(const wxString& dir)
+{
+wxArrayString files;
+if (wxDir::GetAllFiles(dir, &files, wxT("*.idx"), wxDIR_FILES) <= ARCHIVE_INDEX_MAXFILES) return;
+
+std::vector< std::pair<time_t, wxString> > bytime;
+for (size_t n=0; n < files.GetCount(); ++n)
+  bytime.push_back(std::make_pair(wxFileModificationTime(files[n]), files[n]));
+std::sort(bytime.begin(), bytime.end());      // Oldest first
+for (size_t n=0; n < bytime.size() - ARCHIVE_INDEX_MAXFILES; ++n)
+  wxRemoveFile(bytime[n].second);
+}
+
+size_t ArchiveCountingInputStream::OnSysRead(void* buffer, size_t size)
+{
+size_t count = m_parent_i_stream->Read(buffer, size).LastRead();
+m_count += count;
+if (!count)
+  { wxStreamError error = m_parent_i_stream->GetLastError();
+    m_lasterror = (error == wxSTREAM_NO_ERROR) ? wxSTREAM_EOF : error;
+  }
+return count;
+}
+
+wxFileOffset ArchiveCountingInputStream::OnSysSeek(wxFileOffset pos, wxSeekMode mode)  // Only used when the parent is a memory stream, which started at 0
+{
+wxFileOffset result = m_parent_i_stream->SeekI(pos, mode);
+if (result != wxInvalidOffset) m_count = result;
+return result;
+}
+
+size_t ArchiveSpliceInputStream::OnSysRead(void* buffer, size_t size)
+{
+size_t done = 0;
+while (done < size && m_pos < m_headlen + m_taillen)
+  { bool inhead = (m_pos < m_headlen);
+    const unsigned char* from = inhead ? m_head + m_pos : m_tail + (m_pos - m_headlen);
+    size_t count = wxMin(size - done, inhead ? m_headlen - m_pos : m_headlen + m_taillen - m_pos);
+    memcpy((char*)buffer + done, from, count);
+    done += count; m_pos += count;
+  }
+if (!done) m_lasterror = wxSTREAM_EOF;
+return done;
+}
+
+typedef int (* dl_inflateInit2_)        (z_streamp, int, const char*, int);
+typedef int (* dl_inflate)              (z_streamp, int);
+typedef int (* dl_inflateEnd)           (z_streamp);
+typedef int (* dl_inflatePrime)         (z_streamp, int, int);
+typedef int (* dl_inflateSetDictionary) (z_streamp, const Bytef*, uInt);
+
+struct ZlibSymbols  // zlib is dlopen()ed, as is liblzma
+{
+dl_inflateInit2_ init2;
+dl_inflate inflate;
+dl_inflateEnd end;
+dl_inflatePrime prime;
+dl_inflateSetDictionary setdictionary;
+};
+
+static ZlibSymbols* GetZlibSymbols()  // NULL if zlib, or one of the symbols, couldn't be loaded
+{
+static ZlibSymbols symbols; static bool tried = false, loaded = false;
+if (!tried)
+  { tried = true;
+    wxDynamicLibrary* libz = wxGetApp().GetLibz();
+    if (LIBZ_LOADED && libz)
+      { symbols.init2 = (dl_inflateInit2_)(libz->GetSymbol(wxT("inflateInit2_")));
+        symbols.inflate = (dl_inflate)(libz->GetSymbol(wxT("inflate")));
+        symbols.end = (dl_inflateEnd)(libz->GetSymbol(wxT("inflateEnd")));
+        symbols.prime = (dl_inflatePrime)(libz->GetSymbol(wxT("inflatePrime")));
+        symbols.setdictionary = (dl_inflateSetDictionary)(libz->GetSymbol(wxT("inflateSetDictionary")));
+        loaded = symbols.init2 && symbols.inflate && symbols.end && symbols.prime && symbols.setdictionary;
+      }
+  }
+return loaded ? &symbols : NULL;
+}
+
+//static
+bool GzipSeekInputStream::IsAvailable()
+{
+return GetZlibSymbols() != NULL;
+}
+
+GzipSeekInputStream::GzipSeekInputStream(const unsigned char* data, size_t len, const ArchiveSeekPoint* start/*=NULL*/, ArchiveSeekIndex* record/*=NULL*/)
+  : m_data(data), m_len(len), m_record(record), m_zStream(NULL), m_open(false), m_raw(false), m_finished(false), m_inpos(0), m_out(0), m_filled(0), m_served(0)
+{
+memset(m_window, 0, WINDOWSIZE);
+ZlibSymbols* zlib = GetZlibSymbols();
+if (!zlib) { m_lasterror = wxSTREAM_READ_ERROR; return; }
+m_zStream = new z_stream;
+
+if (!start)
+  { if (!Restart(0, false)) m_lasterror = wxSTREAM_READ_ERROR;
+    return;
+  }
+                // Starting from a checkpoint. The first byte may be partly used, and the decompressor needs the preceding 32K of output
+if (!start->in || start->in > len || start->window.size() != WINDOWSIZE || !Restart(start->in, true))
+  { m_lasterror = wxSTREAM_READ_ERROR; return; }
+z_stream* strm = (z_stream*)m_zStream;
+if ((start->bits && zlib->prime(strm, start->bits, data[start->in - 1] >> (8 - start->bits)) != Z_OK)
+      || zlib->setdictionary(strm, &start->window[0], WINDOWSIZE) != Z_OK)
+  { m_lasterror = wxSTREAM_READ_ERROR; return; }
+m_out = start->out;
+m_record = NULL;                              // There's no point recording checkpoints from part-way through
+}
+
+GzipSeekInputStream::~GzipSeekInputStream()
+{
+if (m_open) GetZlibSymbols()->end((z_stream*)m_zStream);
+delete (z_stream*)m_zStream;
+}
+
+bool GzipSeekInputStream::Restart(size_t pos, bool raw)
+{
+ZlibSymbols* zlib = GetZlibSymbols();
+z_stream* strm = (z_stream*)m_zStream;
+if (m_open) zlib->end(strm);
+
+memset(strm, 0, sizeof(z_stream));
+m_open = (zlib->init2(strm, raw ? -15 : 47, ZLIB_VERSION, (int)sizeof(z_stream)) == Z_OK);  // 47 means gzip or zlib, whichever the header says
+m_raw = raw; m_inpos = pos;
+return m_open;
+}
+
+size_t GzipSeekInputStream::OnSysRead(void* buffer, size_t size)
+{
+if (!m_open) { m_lasterror = wxSTREAM_READ_ERROR; return 0; }
+ZlibSymbols* zlib = GetZlibSymbols();
+z_stream* strm = (z_stream*)m_zStream;
+
+size_t done = 0;
+while (done < size)
+  { if (m_served < m_filled)                  // There's output waiting, so pass it on
+      { size_t count = wxMin(size - done, m_filled - m_served);
+        memcpy((char*)buffer + done, m_window + m_served, count);
+        m_served += count; done += count;
+        continue;
+      }
+    if (m_finished) break;
+    if (m_filled == WINDOWSIZE) m_filled = m_served = 0;  // The window's full and all passed on, so go round again
+
+    strm->next_in = (Bytef*)(m_data + m_inpos); strm->avail_in = (uInt)wxMin(m_len - m_inpos, (size_t)0x40000000);
+    strm->next_out = m_window + m_filled; strm->avail_out = WINDOWSIZE - m_filled;
+    int ret = zlib->inflate(strm, Z_BLOCK);   // Z_BLOCK returns at each deflate-block boundary, which are the only places a checkpoint can go
+    size_t produced = (WINDOWSIZE - m_filled) - strm->avail_out;
+    m_filled += produced; m_out += produced;
+    m_inpos = (const unsigned char*)strm->next_in - m_data;
+
+    if (ret == Z_STREAM_END)                  // The end of a gzip member. There may be another after it
+      { size_t next = m_inpos + (m_raw ? 8 : 0);  // Raw inflating leaves the crc and length for us to skip
+        if (next + 2 <= m_len && m_data[next] == 0x1f && m_data[next+1] == 0x8b)
+          { if (!Restart(next, false)) { m_lasterror = wxSTREAM_READ_ERROR; break; } }
+         else
+          m_finished = true;
+        continue;
+      }
+    if (ret != Z_OK)                          // Including Z_BUF_ERROR, which here means the data's truncated
+      { m_lasterror = wxSTREAM_READ_ERROR; break; }
+
+    if (m_record && (strm->data_type & 128) && !(strm->data_type & 64) && m_out && m_record->WantPoint(m_out))
+      RecordPoint();                          // 128 means we're at a block boundary, 64 that it's the last one
+  }
+
+if (!done && m_finished && m_lasterror == wxSTREAM_NO_ERROR) m_lasterror = wxSTREAM_EOF;
+return done;
+}
+
+void GzipSeekInputStream::RecordPoint()
+{
+ArchiveSeekPoint point;
+point.out = m_out; point.in = m_inpos; point.bits = ((z_stream*)m_zStream)->data_type & 7;
+point.window.resize(WINDOWSIZE);              // The window is circular, so the oldest output is what's after m_filled
+memcpy(&point.window[0], m_window + m_filled, WINDOWSIZE - m_filled);
+memcpy(&point.window[WINDOWSIZE - m_filled], m_window, m_filled);
+m_record->AddPoint(point);
+}
+
+//-----------------------------------------------------------------------------------------------------------------------
+
 TarArchiveStream::TarArchiveStream(DataBase* archive)  :  ArchiveStream(archive)  // Opens a 'real' archive, not a nested one
 {
 Valid = false;
@@ -1226,18 +2109,35 @@ Valid = true;
 void TarArchiveStream::ListContentsFromBuffer(wxString archivename)
 {
 wxBusyCursor busy;
-GetFromBuffer();
+GetFromBufferForListing();
 ListContents(archivename);
 }
 
 void TarArchiveStream::ListContents(wxString archivename)
 {
+wxString archivepath(StripSep(archivename));
         // Tar files don't contain absolute paths, just any subdirs, so get the bit to be prepended
 if (archivename.GetChar(archivename.Len()-1) != wxFILE_SEP_PATH) archivename << wxFILE_SEP_PATH;
 
+bool persist = !IsNested() && (m_membuf->GetDataLen() >= ARCHIVE_INDEX_MINSIZE);
+if (persist && m_seekindex.Load(archivepath, m_membuf->GetDataLen()))  // We've listed this archive before, and it hasn't changed since. So no need to decompress it
+  { const std::vector<ArchiveIndexEntry>& entries = m_seekindex.GetEntries();
+    for (size_t n=0; n < entries.size(); ++n)
+      ffs->AddItem(archivename + entries[n].name, entries[n].size, (time_t)entries[n].time, entries[n].mode, (DB_filetype)entries[n].type, entries[n].target);
+    return;
+  }
+m_seekindex.Clear();
+                // Read through a counting stream, so that we know where each member's header starts in the uncompressed tar
+ArchiveCountingInputStream counter(IsCompressed() ? *zlibInStreamPtr.get() : *MemInStreamPtr.get());
+wxTarInputStream tarstream(counter);
+
 wxTarEntryPtr entry;
-while (entry.reset(((wxTarInputStream*)InStreamPtr.get())->GetNextEntry()), entry.get() != NULL)
-  { wxString target;
+while (true)
+  { tarstream.CloseEntry();                   // This skips the rest of the previous member, so the count is now at the next header
+    wxUint64 headerpos = counter.GetCount();
+    entry.reset(tarstream.GetNextEntry()); if (entry.get() == NULL) break;
+
+    wxString target;
     wxString name = archivename + entry->GetName();
     wxDateTime time = entry->GetDateTime();
     DB_filetype Type;  // wxTarEntry (cf. zipentry) stores the type of 'file' e.g. symlink. So make use of that
@@ -1249,7 +2149,16 @@ while (entry.reset(((wxTarInputStream*)InStreamPtr.get())->GetNextEntry()), entr
       }
 
     ffs->AddItem(name, entry->GetSize(), time.GetTicks(),  entry->GetMode(), Type, target);
+
+    ArchiveIndexEntry indexentry;
+    indexentry.name = entry->GetName(); indexentry.target = target;
+    indexentry.headerpos = headerpos; indexentry.size = entry->GetSize();
+    indexentry.time = time.GetTicks(); indexentry.mode = entry->GetMode(); indexentry.type = Type;
+    m_seekindex.AddEntry(indexentry);
   }
+
+AddNativeSeekPoints();
+if (persist) m_seekindex.Save(archivepath, m_membuf->GetDataLen());
 }
 
 void TarArchiveStream::GetFromBuffer(bool dup)    // Get the stored archive from m_membuf into the stream
@@ -1268,6 +2177,16 @@ if (!dup)
 InStreamPtr.reset(tar);                                       // Use this member wxScopedPtr to 'return' the stream
 }
 
+bool TarArchiveStream::GetFromBufferAt(wxUint64 headerpos)  // An uncompressed tar is random-access anyway, so just start the stream at the header
+{
+if (IsCompressed() || headerpos >= m_membuf->GetDataLen()) return false;  // Compressed subclasses that can do this override it
+
+InStreamPtr.reset();
+MemInStreamPtr.reset(new wxMemoryInputStream((const char*)m_membuf->GetData() + headerpos, m_membuf->GetDataLen() - headerpos));
+InStreamPtr.reset(new wxTarInputStream(*MemInStreamPtr.get()));
+return true;
+}
+
 bool TarArchiveStream::CompressStream(wxOutputStream* outstream) // Pretend to compress this stream, ready to be put into membuf
 {
 OutStreamPtr.reset(outstream);  // Since we can't compress a plain vanilla tarstream, use the member wxScopedPtr to 'return' the same stream
@@ -1285,22 +2204,32 @@ GetFromBuffer();
 
 size_t NumberFound = 0;
 wxTarEntryPtr entry;
+  // Decompression happens here, in this thread; the files' data is handed to a pool of threads to write
+ArchiveFileWriter writer;
+ArchiveExtractProgress progress(WithinArchiveNames.GetCount());
+ArchiveDirSet made, queued;
 
 while (entry.reset(((wxTarInputStream*)InStreamPtr.get())->GetNextEntry()), entry.get() != NULL)
-  { int item = WithinArchiveNames.Index(entry->GetName());  // See if this file is one of the ones we're interested in
+  { int item = FindWithinArchiveName(entry->GetName());  // See if this file is one of the ones we're interested in
     if (item == wxNOT_FOUND)  continue;
                 // Found it. If it's a file, extract it. If a dir,  make a new dir with this name (*outside* the archive ;)
     wxLogNull log;
     if ((entry->GetTypeFlag() == wxTAR_REGTYPE) // Start with the files, which are the only things that require extraction of data. wxTAR_REGTYPE is 48 ('0')
           || (entry->GetTypeFlag() == 0))       // However in ancient tar formats (as automake's make dist seems to use by default :/) a regular file has a type of NUL
-      { wxString Path(resultingfilepaths[ item ]); Path = Path.BeforeLast(wxFILE_SEP_PATH);
-        if (!wxFileName::Mkdir(Path, 0777, wxPATH_MKDIR_FULL)) return false;    // Make any necessary dir
-        wxFFileOutputStream out(resultingfilepaths[ item ]);
-        if (!out || ! out.Write(*(wxTarInputStream*)InStreamPtr.get()) || ! InStreamPtr->Eof())   return false;  // and extract into the new filepath
-        FileData fd(resultingfilepaths[ item ]); if (fd.IsValid()) fd.DoChmod(entry->GetMode());  // Correct the extracted file's permissions
+      { if (!MakeDir(resultingfilepaths[ item ].BeforeLast(wxFILE_SEP_PATH), made)) { writer.Cancel(); return false; } // Make any necessary dir
+        if (queued.find(resultingfilepaths[ item ]) != queued.end())
+          writer.Drain();                       // The archive holds this file twice. The later one must win, so it mustn't be written at the same time as the earlier
+         else queued.insert(resultingfilepaths[ item ]);
+        if (ArchiveFileWriter::IsTooBigToQueue(entry->GetSize())) // Stream it here rather than holding it all in memory. Any earlier duplicate was Drain()ed above
+          { if (!ArchiveFileWriter::StreamFile(*InStreamPtr.get(), resultingfilepaths[ item ], entry->GetMode(), entry->GetSize())) { writer.Cancel(); return false; } }
+         else
+          { std::vector<char> data;
+            if (!ReadEntryData(*InStreamPtr.get(), data, entry->GetSize())
+                  || !writer.Add(resultingfilepaths[ item ], entry->GetMode(), data)) { writer.Cancel(); return false; } // and queue it to be written to the new filepath
+          }
       }
      else if (entry->IsDir())  
-           { if (!wxFileName::Mkdir(resultingfilepaths[ item ], 0777, wxPATH_MKDIR_FULL)) return false; }  // Just create the dir
+           { if (!MakeDir(StripSep(resultingfilepaths[ item ]), made)) { writer.Cancel(); return false; } }  // Just create the dir
 
     else if (entry->GetTypeFlag() == wxTAR_SYMTYPE || entry->GetTypeFlag() == wxTAR_LNKTYPE) // The 2nd is in case of confusion, but all links should be symlinks
            { if (!CreateSymlink(entry->GetLinkName(), resultingfilepaths[ item ])) return false; }
@@ -1334,8 +2263,10 @@ while (entry.reset(((wxTarInputStream*)InStreamPtr.get())->GetNextEntry()), entr
       }
      
     ++NumberFound;
+    if (!progress.Update(NumberFound)) { writer.Cancel(); return false; }
   }
 
+if (!writer.Finish()) return false;             // Wait for the last files to be written
   // This line used to be inside the loop. However it broke if someone added foo to an archive that already contained a foo; the bogof situation messed up the count
 if (NumberFound >= WithinArchiveNames.GetCount()) return true;  // See if we've used all the passed filepaths
  else return false;
@@ -1350,21 +2281,24 @@ if (!SortOutNames(filepath)) return NULL;
 wxTarEntryPtr entry;
 
 wxBusyCursor busy;
-GetFromBuffer();          // The archive is in the memory buffer m_membuf. 'Extract' it to InStreamPtr
-
-while (entry.reset(((wxTarInputStream*)InStreamPtr.get())->GetNextEntry()), entry.get() != NULL)
-  { if (entry->GetName() != WithinArchiveName)  continue;   // Go thru the archive, looking for the desired file
+const ArchiveIndexEntry* indexed = m_seekindex.FindEntry(WithinArchiveName);  // If we know where it is, start there (or at least at the nearest checkpoint)
+bool jumped = indexed && GetFromBufferAt(indexed->headerpos);
+if (!jumped)
+  GetFromBuffer();        // The archive is in the memory buffer m_membuf. 'Extract' it to InStreamPtr
+
+while (entry.reset(((wxTarInputStream*)InStreamPtr.get())->GetNextEntry()), entry.get() != NULL || jumped)
+  { if (entry.get() == NULL || entry->GetName() != WithinArchiveName)   // Go thru the archive, looking for the desired file
+      { if (jumped) { jumped = false; GetFromBuffer(); }   // The index was wrong (stale?) so start again at the beginning
+        continue;
+      }
                 // Found it. Extract it to a new buffer
     wxMemoryOutputStream memoutstream;
     if (!memoutstream || ! memoutstream.Write(*(wxTarInputStream*)InStreamPtr.get()))   return NULL;  
 
     size_t size = memoutstream.GetSize();                   // This is how much was loaded i.e. the file size
-    wxChar* buf = new wxChar[ size ];                       // It's ugly, but the easiest way I've found to get the data from the stream to a memorybuffer
-    memoutstream.CopyTo(buf, size);                         //   is by using an intermediate char[]
-
-    wxMemoryBuffer* membuf = new wxMemoryBuffer(size);      // Now (at last) we can store the data in a memory buffer
-    membuf->AppendData(buf, size);
-    delete[] buf;
+    wxMemoryBuffer* membuf = new wxMemoryBuffer(size);
+    memoutstream.CopyTo(membuf->GetAppendBuf(size), size);  // Copy straight into the buffer's storage
+    membuf->UngetAppendBuf(size);
   
     return membuf;
   }
@@ -1386,7 +2320,7 @@ wxTarOutputStream taroutstream(*OutStreamPtr.get());  // OutStreamPtr is the 'ou
 
 wxTarEntryPtr entry,  dupentry;
 while (entry.reset(((wxTarInputStream*)InStreamPtr.get())->GetNextEntry()), entry.get() != NULL)  // Go thru the archive, looking for the selected files.
-  { int item = WithinArchiveNames.Index(entry->GetName());  // See if this file is one of the ones we're interested in
+  { int item = FindWithinArchiveName(entry->GetName());  // See if this file is one of the ones we're interested in
     switch(DoWhich)
       { case arc_add:      break;                 // Add happens later
         case arc_remove:  if (item != wxNOT_FOUND)  continue; // If this file is one of the 2b-removed ones, ignore it, don't add it to the new archive
@@ -1455,6 +2389,61 @@ if (fd.IsSymlink()) addentry->SetLinkName(fd.GetSymlinkDestination(true));  // I
 return taroutstream.PutNextEntry(addentry);                  // Add it to the outputstream
 }
 
+static bool TarOctal(const unsigned char* field, size_t len, wxUint64& val)  // Parse a tar header's numeric field
+{
+if (field[0] & 0x80)                            // The gnu/star base-256 extension, for values too big for the octal digits
+  { val = 0;
+    for (size_t n=1; n < len; ++n) val = (val << 8) | field[n];
+    return true;
+  }
+size_t n = 0; while (n < len && field[n] == ' ') ++n;
+if (n == len || field[n] < '0' || field[n] > '7') return false;
+for (val = 0; n < len && field[n] >= '0' && field[n] <= '7'; ++n)
+  val = (val << 3) | (field[n] - '0');
+return (n == len || field[n] == ' ' || field[n] == 0);
+}
+
+const size_t TAR_BLOCKSIZE = 512;
+
+bool TarArchiveStream::AlterInPlace(wxArrayString& filepaths, enum alterarc DoWhich, size_t& unchanged, const wxString& originroot/*=wxT("")*/, bool dirs_only/*=false*/)
+{
+if (DoWhich != arc_add || IsCompressed()) return false;  // A compressed tar has to be recompressed anyway, and other edits shift the data
+                // An uncompressed tar is just a sequence of header+data blocks, ended by blocks of zeros. So to add, find the first of those
+                // and write the new entries over it; everything before stays as it is
+const unsigned char* data = (const unsigned char*)m_membuf->GetData(); size_t len = m_membuf->GetDataLen();
+size_t pos = 0;
+while (true)
+  { if (pos + TAR_BLOCKSIZE > len) return false;  // No end-of-archive marker, which is odd; so leave it to DoAlteration
+    const unsigned char* header = data + pos;
+    size_t n = 0; while (n < TAR_BLOCKSIZE && header[n] == 0) ++n;
+    if (n == TAR_BLOCKSIZE) break;              // Found it
+    
+    wxUint64 checksum, sum = 0, size;           // Check this really is a header, not something we've misparsed
+    for (n=0; n < TAR_BLOCKSIZE; ++n) sum += (n >= 148 && n < 156) ? ' ' : header[n];  // The checksum is calculated with its own field as spaces
+    if (!TarOctal(header + 148, 8, checksum) || checksum != sum || !TarOctal(header + 124, 12, size)) return false;
+    if (size > len) return false;
+    pos += TAR_BLOCKSIZE + ((size + TAR_BLOCKSIZE - 1) / TAR_BLOCKSIZE) * TAR_BLOCKSIZE;  // The data is padded to a whole block
+  }
+
+wxMemoryOutputStream memoutstream;
+  { wxTarOutputStream taroutstream(memoutstream);
+    bool success = false;
+    for (size_t n=0; n < filepaths.GetCount(); ++n)
+      { if (DoAdd(filepaths[n], taroutstream, originroot, dirs_only))  success = true;  }
+    if (!success || !taroutstream.Close()) return false;  // Close() writes a fresh end-of-archive marker
+  }
+if (!memoutstream.Close()) return false;
+
+size_t size = memoutstream.GetSize();
+wxMemoryBuffer* newbuf = new wxMemoryBuffer(pos + size);
+newbuf->AppendData(data, pos);
+memoutstream.CopyTo(newbuf->GetAppendBuf(size), size); newbuf->UngetAppendBuf(size);
+delete m_membuf; m_membuf = newbuf;
+
+unchanged = pos;
+return true;
+}
+
 void TarArchiveStream::RefreshFromDirtyChild(wxString archivename, ArchiveStream* child)  // Used when a nested child archive has been altered; reload the altered version
 {
 if (archivename.IsEmpty() || child == NULL) return;
@@ -1533,10 +2522,32 @@ OutStreamPtr.reset(zlib);
 return true;
 }
 
+void GZArchiveStream::GetFromBufferForListing()  // As GetFromBuffer, but with a decompressor that records checkpoints, for ExtractToBuffer() to start from
+{
+if (!GzipSeekInputStream::IsAvailable()) { GetFromBuffer(); return; }
+
+ArchiveSeekIndex* record = (m_membuf->GetDataLen() >= ARCHIVE_INDEX_MINSIZE) ? &m_seekindex : NULL;  // Small archives don't need checkpoints
+InStreamPtr.reset(); MemInStreamPtr.reset();
+zlibInStreamPtr.reset(new GzipSeekInputStream((const unsigned char*)m_membuf->GetData(), m_membuf->GetDataLen(), NULL, record));
+InStreamPtr.reset(new wxTarInputStream(*zlibInStreamPtr.get()));
+}
+
+bool GZArchiveStream::GetFromBufferAt(wxUint64 headerpos)
+{
+const ArchiveSeekPoint* point = m_seekindex.FindPoint(headerpos);
+if (!point || !GzipSeekInputStream::IsAvailable()) return false;  // Starting from the beginning would be no quicker than the usual way
+
+InStreamPtr.reset();
+zlibInStreamPtr.reset(new GzipSeekInputStream((const unsigned char*)m_membuf->GetData(), m_membuf->GetDataLen(), point));
+if (!zlibInStreamPtr->IsOk() || !ArchiveSkip(*zlibInStreamPtr.get(), headerpos - point->out)) return false;
+InStreamPtr.reset(new wxTarInputStream(*zlibInStreamPtr.get()));
+return true;
+}
+
 void GZArchiveStream::ListContentsFromBuffer(wxString archivename)
 {
 wxBusyCursor busy;
-GetFromBuffer();
+GetFromBufferForListing();
 ListContents(archivename);
 }
 
@@ -1616,6 +2627,27 @@ OutStreamPtr.reset(xz);                     // Use the member wxScopedPtr to 're
 return true;
 }
 
+bool XZArchiveStream::GetFromBufferAt(wxUint64 headerpos)  // Decompress from the start of the xz block containing headerpos
+{
+const ArchiveSeekPoint* point = (m_zt == zt_tarxz) ? m_seekindex.FindPoint(headerpos) : NULL;
+if (!point || !point->out) return false;      // The first block is no improvement on the usual way
+
+const unsigned char* data = (const unsigned char*)m_membuf->GetData(); size_t len = m_membuf->GetDataLen();
+if (point->in >= len) return false;
+InStreamPtr.reset();            // The decoder needs a stream header first, so give it the real one, followed by the block and everything after it
+MemInStreamPtr.reset(new ArchiveSpliceInputStream(data, 12, data + point->in, len - point->in));
+zlibInStreamPtr.reset(new XzInputStream(*MemInStreamPtr.get()));
+if (!ArchiveSkip(*zlibInStreamPtr.get(), headerpos - point->out)) return false;
+InStreamPtr.reset(new wxTarInputStream(*zlibInStreamPtr.get()));
+return true;
+}
+
+void XZArchiveStream::AddNativeSeekPoints()
+{
+if (m_zt == zt_tarxz)
+  m_seekindex.AddXzBlocks((const unsigned char*)m_membuf->GetData(), m_membuf->GetDataLen());
+}
+
 void XZArchiveStream::ListContentsFromBuffer(wxString archivename)
 {
 wxBusyCursor busy;
@@ -1623,6 +2655,78 @@ GetFromBuffer();
 ListContents(archivename);
 }
 #endif // ndef NO_LZMA_ARCHIVE_STREAMS
+//-----------------------------------------------------------------------------------------------------------------------
+void ZstdArchiveStream::GetFromBuffer(bool dup)  // Get the stored archive from membuf into the stream
+{
+ZstdInputStream* zlib; wxTarInputStream* tar;
+wxMemoryInputStream* meminstream = new wxMemoryInputStream(m_membuf->GetData(), m_membuf->GetDataLen());  // The archive is in the memory buffer membuf. Stream it to a memory stream
+if (!dup) 
+  { MemInStreamPtr.reset(meminstream);
+    zlib = new ZstdInputStream(*MemInStreamPtr.get());            // Then pass it thru the filter
+    zlibInStreamPtr.reset(zlib);
+    tar = new wxTarInputStream(*zlibInStreamPtr.get());           // into a wxTarInputStream
+  }
+  else
+  { DupMemInStreamPtr.reset(meminstream);
+    zlib = new ZstdInputStream(*DupMemInStreamPtr.get());         // If we're duplicating, use DupMemInStreamPtr/DupzlibInStreamPtr the second time around
+    DupzlibInStreamPtr.reset(zlib);
+    tar = new wxTarInputStream(*DupzlibInStreamPtr.get());
+  }
+
+InStreamPtr.reset(tar);                                           // Use this member wxScopedPtr to 'return' the stream
+}
+
+bool ZstdArchiveStream::CompressStream(wxOutputStream* outstream) // Compress this stream, ready to be put into membuf
+{
+ZstdOutputStream* zstd = new ZstdOutputStream(*outstream, 9);     // Pass the outstream thru the filter. It's multithreaded, so we can afford to squeeze harder than the default
+OutStreamPtr.reset(zstd);                                         // Use the member wxScopedPtr to 'return' the stream
+
+return true;
+}
+
+void ZstdArchiveStream::ListContentsFromBuffer(wxString archivename)
+{
+wxBusyCursor busy;
+GetFromBuffer();
+ListContents(archivename);
+}
+
+//-----------------------------------------------------------------------------------------------------------------------
+void Lz4ArchiveStream::GetFromBuffer(bool dup)  // Get the stored archive from membuf into the stream
+{
+Lz4InputStream* zlib; wxTarInputStream* tar;
+wxMemoryInputStream* meminstream = new wxMemoryInputStream(m_membuf->GetData(), m_membuf->GetDataLen());  // The archive is in the memory buffer membuf. Stream it to a memory stream
+if (!dup) 
+  { MemInStreamPtr.reset(meminstream);
+    zlib = new Lz4InputStream(*MemInStreamPtr.get());             // Then pass it thru the filter
+    zlibInStreamPtr.reset(zlib);
+    tar = new wxTarInputStream(*zlibInStreamPtr.get());           // into a wxTarInputStream
+  }
+  else
+  { DupMemInStreamPtr.reset(meminstream);
+    zlib = new Lz4InputStream(*DupMemInStreamPtr.get());          // If we're duplicating, use DupMemInStreamPtr/DupzlibInStreamPtr the second time around
+    DupzlibInStreamPtr.reset(zlib);
+    tar = new wxTarInputStream(*DupzlibInStreamPtr.get());
+  }
+
+InStreamPtr.reset(tar);                                           // Use this member wxScopedPtr to 'return' the stream
+}
+
+bool Lz4ArchiveStream::CompressStream(wxOutputStream* outstream)  // Compress this stream, ready to be put into membuf
+{
+Lz4OutputStream* lz4 = new Lz4OutputStream(*outstream);           // Pass the outstream thru the filter
+OutStreamPtr.reset(lz4);                                          // Use the member wxScopedPtr to 'return' the stream
+
+return true;
+}
+
+void Lz4ArchiveStream::ListContentsFromBuffer(wxString archivename)
+{
+wxBusyCursor busy;
+GetFromBuffer();
+ListContents(archivename);
+}
+
 //-----------------------------------------------------------------------------------------------------------------------
 
 void ArchiveStreamMan::Push()  // Make a new ArchiveStruct and save it on the array
@@ -1732,7 +2836,33 @@ switch(NewArchiveType)
                     }
                    ((XZArchiveStream*)newarc)->ListContentsFromBuffer(filepath); break;
 #endif // ndef NO_LZMA_ARCHIVE_STREAMS
-      case zt_gzip: case zt_bzip: case zt_lzma: case zt_xz: case zt_lzop: case zt_compress:
+      case zt_tarzst: if (!LIBZSTD_LOADED)
+                      { wxMessageBox(_("I can't peek inside that sort of archive unless you install libzstd."), _("Missing library")); delete stat; return false; }
+                   if (!IsArchive())  newarc = new ZstdArchiveStream(stat);
+                    else
+                      { wxMemoryBuffer* membuf; membuf = arc->ExtractToBuffer(filepath);
+                        if (membuf == NULL) { delete stat; return false; }
+                        newarc = new ZstdArchiveStream(membuf, filepath);
+                      }
+                   if (!(newarc && newarc->IsValid()))
+                    { wxLogError(_("For some reason, the archive failed to open  :(")); 
+                      delete stat; delete newarc; return false;
+                    }
+                   ((ZstdArchiveStream*)newarc)->ListContentsFromBuffer(filepath); break;
+      case zt_tarlz4: if (!LIBLZ4_LOADED)
+                      { wxMessageBox(_("I can't peek inside that sort of archive unless you install liblz4."), _("Missing library")); delete stat; return false; }
+                   if (!IsArchive())  newarc = new Lz4ArchiveStream(stat);
+                    else
+                      { wxMemoryBuffer* membuf; membuf = arc->ExtractToBuffer(filepath);
+                        if (membuf == NULL) { delete stat; return false; }
+                        newarc = new Lz4ArchiveStream(membuf, filepath);
+                      }
+                   if (!(newarc && newarc->IsValid()))
+                    { wxLogError(_("For some reason, the archive failed to open  :(")); 
+                      delete stat; delete newarc; return false;
+                    }
+                   ((Lz4ArchiveStream*)newarc)->ListContentsFromBuffer(filepath); break;
+      case zt_gzip: case zt_bzip: case zt_lzma: case zt_xz: case zt_lzop: case zt_compress: case zt_zstd: case zt_lz4:
                     wxMessageBox(_("This file is compressed, but it's not an archive so you can't peek inside."), _("Sorry")); delete stat; return false;
        default:     wxMessageBox(_("I'm afraid I can't peek inside that sort of archive."), _("Sorry")); delete stat; return false;
     }
@@ -1757,6 +2887,8 @@ switch(ztype)
 #ifndef NO_LZMA_ARCHIVE_STREAMS
     case zt_tarlzma: case zt_tarxz: return LIBLZMA_LOADED;
 #endif // ndef NO_LZMA_ARCHIVE_STREAMS
+    case zt_tarzst: return LIBZSTD_LOADED;
+    case zt_tarlz4: return LIBLZ4_LOADED;
 
     default: return false; // zt_invalid, zt_tar7z, zt_tarlzop, zt_taZ, zt_7z, zt_cpio, zt_rpm, zt_ar, zt_deb
   }
@@ -13,9 +13,15 @@
 #include "wx/txtstrm.h"
 #include "wx/dir.h"
 #include "wx/tarstrm.h"
+#include "wx/hashmap.h"
+#include "wx/hashset.h"
+#include "wx/progdlg.h"
 
 #include <wx/mstream.h>
 
+#include <vector>
+#include <deque>
+
 enum DB_filetype{ REGTYPE, HDLNKTYPE, SYMTYPE, CHRTYPE, BLKTYPE, DIRTYPE, FIFOTYPE, SOCTYPE };
 
 enum ffscomp { ffsParent, ffsEqual, ffsChild, ffsCousin, ffsRubbish, ffsDealtwith  };    // Used to return result of comparison within 'dir' tree
@@ -185,6 +191,213 @@ class MyGenericDirCtrl;
 wxDECLARE_SCOPED_PTR(wxInputStream, wxInputStreamPtr)
 wxDECLARE_SCOPED_PTR(wxOutputStream, wxOutputStreamPtr)
 
+WX_DECLARE_STRING_HASH_MAP(int, ArchiveNameIndex);  // A within-archive name, and its index in WithinArchiveNames
+WX_DECLARE_HASH_SET(wxString, wxStringHash, wxStringEqual, ArchiveDirSet);
+
+struct ArchiveWriteJob  // An extracted file's data, waiting to be written
+{
+wxString filepath;
+int mode;
+std::vector<char> data;
+};
+
+class ArchiveFileWriter  // Writes extracted files on a pool of threads, so that decompression needn't wait for the disk
+{
+public:
+ArchiveFileWriter();
+~ArchiveFileWriter() { Finish(); }
+
+bool Add(const wxString& filepath, int mode, std::vector<char>& data); // Takes over data. Blocks while too much is already queued. False once anything has failed
+void Drain();                             // Waits until everything queued so far has been written
+bool Finish();                            // Waits for the queue to empty, then stops the threads. False if any write failed
+void Cancel();                            // Abandons anything not yet written
+
+ArchiveWriteJob* TakeJob();               // For the writer threads. Waits for a job; NULL when there'll be no more
+void JobDone(ArchiveWriteJob* job, bool success);
+static bool WriteFile(const wxString& filepath, int mode, const std::vector<char>& data); // Preallocates, writes, and sets the permissions on the open fd
+static bool StreamFile(wxInputStream& in, const wxString& filepath, int mode, wxFileOffset size); // The same, but a chunk at a time, for members too big to hold in memory
+static bool IsTooBigToQueue(wxFileOffset size) { return (size < 0) || (size > (wxFileOffset)ARCHIVE_WRITER_STREAMSIZE); } // Unknown sizes too
+
+enum { ARCHIVE_WRITER_STREAMSIZE = 8 * 1024 * 1024 }; // Members bigger than this are streamed to disk by the reading thread, not queued
+
+protected:
+wxMutex m_mutex;
+wxCondition m_changed;                    // Broadcast whenever a job is queued or finished, and on finishing or failing
+std::deque<ArchiveWriteJob*> m_queue;
+size_t m_queuedbytes;                     // Of the jobs queued or being written
+size_t m_inflight;                        // Jobs being written
+bool m_finishing;
+bool m_failed;
+std::vector<wxThread*> m_threads;
+};
+
+class ArchiveWriterThread : public wxThread
+{
+public:
+ArchiveWriterThread(ArchiveFileWriter& writer) : wxThread(wxTHREAD_JOINABLE), m_writer(writer) {}
+
+protected:
+void* Entry();
+
+ArchiveFileWriter& m_writer;
+};
+
+class ArchiveExtractProgress  // A cancellable progress dialog, shown only once an extraction has taken long enough to need one
+{
+public:
+ArchiveExtractProgress(size_t total) : m_total(total), m_dlg(NULL), m_start(wxGetLocalTimeMillis()), m_lastupdate(m_start), m_cancelled(false) {}
+~ArchiveExtractProgress();
+
+bool Update(size_t done);                 // False if the user has cancelled
+
+protected:
+size_t m_total;
+wxProgressDialog* m_dlg;
+wxLongLong m_start;
+wxLongLong m_lastupdate;
+bool m_cancelled;
+};
+
+struct ZipExtractShared  // What the ZipExtractThreads share: the next entry to claim, and how they're getting on
+{
+ZipExtractShared() : next(0), extracted(0), running(0), finished(false), failed(false), cancelled(false) {}
+
+bool Claim(size_t& index);                // Claims the next entry in the central directory. False when there's no more to do
+void Done(bool success);
+void Finished(bool atend);                // A thread has stopped. atend means it ran out of entries, so the others can stop too
+
+wxCriticalSection lock;
+size_t next;
+size_t extracted;
+size_t running;
+bool finished, failed, cancelled;
+};
+
+class ZipExtractThread : public wxThread  // Each has its own stream over the (in-memory) zip, so they can decompress different entries at the same time
+{
+public:
+ZipExtractThread(const wxMemoryBuffer* membuf, const ArchiveNameIndex& wanted, const ArchiveNameIndex& lastentry, const wxArrayString& destinations, ZipExtractShared& shared)
+  : wxThread(wxTHREAD_JOINABLE), m_membuf(membuf), m_wanted(wanted), m_lastentry(lastentry), m_destinations(destinations), m_shared(shared) {}
+
+static void ExtractClaimed(const wxMemoryBuffer* membuf, const ArchiveNameIndex& wanted, const ArchiveNameIndex& lastentry, const wxArrayString& destinations, ZipExtractShared& shared);
+
+protected:
+void* Entry();
+
+const wxMemoryBuffer* m_membuf;
+const ArchiveNameIndex& m_wanted;
+const ArchiveNameIndex& m_lastentry;      // Each wanted name's last position in the zip. If a name is there twice, only the later one is extracted
+const wxArrayString& m_destinations;
+ZipExtractShared& m_shared;
+};
+
+struct ArchiveSeekPoint  // A place in a compressed tar from which decompression can restart, without going back to the beginning
+{
+wxUint64 out;                             // Its offset in the uncompressed stream
+wxUint64 in;                              // and in the compressed one. For gzip, the first byte not wholly used
+int bits;                                 // gzip only: how many bits of the byte before 'in' are still unused
+std::vector<unsigned char> window;        // gzip only: the 32K of output before 'out', which may be back-referenced
+};
+
+struct ArchiveIndexEntry  // What ListContents() needs to know about a tar member, and where its header starts in the uncompressed stream
+{
+wxString name;
+wxString target;
+wxUint64 headerpos;
+wxUint64 size;
+wxInt64 time;
+int mode;
+int type;
+};
+
+WX_DECLARE_STRING_HASH_MAP(size_t, ArchiveIndexNames);  // A member's name, and its index in ArchiveSeekIndex::m_entries
+
+class ArchiveSeekIndex  // Lets ExtractToBuffer() jump to a member of a (compressed) tar, instead of decompressing everything before it
+{
+public:
+ArchiveSeekIndex() { Clear(); }
+void Clear();
+
+void AddEntry(const ArchiveIndexEntry& entry);
+const ArchiveIndexEntry* FindEntry(const wxString& name) const;  // If a name occurs more than once, this is the first, as in a tar it's what a scan would find
+const std::vector<ArchiveIndexEntry>& GetEntries() const { return m_entries; }
+
+bool WantPoint(wxUint64 out) const { return m_points.empty() || out - m_points.back().out >= m_span; } // Is it far enough since the last checkpoint to be worth another?
+void AddPoint(ArchiveSeekPoint& point);   // Takes point's window, to save copying it
+const ArchiveSeekPoint* FindPoint(wxUint64 out) const;  // The last checkpoint at or before out, or NULL
+bool AddXzBlocks(const unsigned char* data, size_t len);  // An xz file already contains an index of its blocks. Make each a checkpoint
+
+bool Load(const wxString& archivepath, size_t len);  // from the cache, but only if the archive hasn't changed since it was saved
+bool Save(const wxString& archivepath, size_t len);
+
+protected:
+static wxString GetCacheFilepath(const wxString& archivepath);
+static void PruneCache(const wxString& dir);  // Keep only the most-recently-saved few
+
+std::vector<ArchiveIndexEntry> m_entries;
+ArchiveIndexNames m_names;
+std::vector<ArchiveSeekPoint> m_points;
+wxUint64 m_span;                          // The uncompressed distance between gzip checkpoints. It doubles whenever there get to be too many
+};
+
+class ArchiveCountingInputStream  :  public wxFilterInputStream  // Passes data through, counting it. Used to find where each tar header starts
+{
+public:
+ArchiveCountingInputStream(wxInputStream& stream) : wxFilterInputStream(stream), m_count(0) {}
+wxUint64 GetCount() const { return m_count; }
+bool IsSeekable() const { return m_parent_i_stream->IsSeekable(); }  // So a plain tar's data can still be skipped, not read
+
+protected:
+size_t OnSysRead(void* buffer, size_t size);
+wxFileOffset OnSysSeek(wxFileOffset pos, wxSeekMode mode);
+wxFileOffset OnSysTell() const { return m_count; }
+
+wxUint64 m_count;
+};
+
+class ArchiveSpliceInputStream  :  public wxInputStream  // Presents a header from one place followed by data from another, as a single stream
+{
+public:
+ArchiveSpliceInputStream(const unsigned char* head, size_t headlen, const unsigned char* tail, size_t taillen)
+  : m_head(head), m_headlen(headlen), m_tail(tail), m_taillen(taillen), m_pos(0) {}
+
+protected:
+size_t OnSysRead(void* buffer, size_t size);
+wxFileOffset OnSysTell() const { return m_pos; }
+
+const unsigned char* m_head; size_t m_headlen;
+const unsigned char* m_tail; size_t m_taillen;
+size_t m_pos;
+};
+
+class GzipSeekInputStream  :  public wxInputStream  // Decompresses an in-memory gzip, either recording checkpoints as it goes, or starting from one
+{
+public:
+GzipSeekInputStream(const unsigned char* data, size_t len, const ArchiveSeekPoint* start = NULL, ArchiveSeekIndex* record = NULL);
+~GzipSeekInputStream();
+static bool IsAvailable();                // False if zlib couldn't be loaded
+
+protected:
+size_t OnSysRead(void* buffer, size_t size);
+wxFileOffset OnSysTell() const { return m_out; }
+bool Restart(size_t pos, bool raw);       // (Re)initialise inflation at pos. raw means there's no gzip header there
+void RecordPoint();
+
+enum { WINDOWSIZE = 32768 };
+const unsigned char* m_data;
+size_t m_len;
+ArchiveSeekIndex* m_record;
+void* m_zStream;
+bool m_open;                              // m_zStream was successfully initialised
+bool m_raw;                               // We're inflating raw deflate data, having started from a checkpoint, so there's no gzip header or trailer handling
+bool m_finished;
+size_t m_inpos;                           // The next compressed byte for inflate()
+wxUint64 m_out;                           // How much has been inflated so far (including any before the starting checkpoint)
+size_t m_filled;                          // How much of m_window holds output
+size_t m_served;                          //  and how much of that has been passed on
+unsigned char m_window[WINDOWSIZE];       // Inflation is done into this, circularly, so the last 32K is there to be saved with a checkpoint
+};
+
 class ArchiveStream
 {
 public:
@@ -217,6 +430,8 @@ FakeFilesystem* Getffs() { return ffs; }
 wxMemoryBuffer* GetBuffer(){ return m_membuf; } // Used in RefreshFromDirtyChild()
 
 static bool IsStreamable(enum ziptype ztype);
+static bool ReadEntryData(wxInputStream& in, std::vector<char>& data, wxFileOffset size); // Reads the current entry's data into memory. size may be wxInvalidOffset if unknown
+static bool MakeDir(const wxString& dirpath, ArchiveDirSet& made); // Mkdir, but remembering what's been made, so a dir with many files isn't re-stat()ed for each
 bool IsWithin(wxString filepath);
 bool IsDirty(){ return Dirty; }
 bool IsNested(){ return Nested; }
@@ -227,15 +442,20 @@ protected:
 bool SortOutNames(const wxString& filepath);  // Subroutine used in Extract etc, so made into a function in the name of code reuse
 bool AdjustFilepaths(const wxArrayString& filepaths, const wxString& destpath, wxArrayString& newnames, adjFPs whichtype=afp_neither, bool dirs_only = false, bool files_only = false);  // Similar for multiple strings, but recursive for dirs
 bool SaveBuffer();                            // Saves the compressed archive in buffer back to the filesystem
+bool SaveBufferTail(size_t unchanged, size_t oldlen); // Ditto, but writes only what follows the first 'unchanged' bytes, which an in-place edit didn't touch, plus any m_patches
+int FindWithinArchiveName(const wxString& name); // A hashed WithinArchiveNames.Index(), as that's searched for every entry in the archive
 
 virtual void GetFromBuffer(bool dup = false)=0;     // Get the stored archive from membuf into the stream, through the uncompressing filter
 virtual bool DoAlteration(wxArrayString& filepaths, enum alterarc DoWhich, const wxString& originroot=wxT(""), bool dirs_only = false)=0;  // Implement add remove del or rename, depending on the enum
+            // Edits that can be made by patching the end of m_membuf, without rewriting the whole archive. False means this one can't, so use DoAlteration
+virtual bool AlterInPlace(wxArrayString& WXUNUSED(filepaths), enum alterarc WXUNUSED(DoWhich), size_t& WXUNUSED(unchanged), const wxString& WXUNUSED(originroot)=wxT(""), bool WXUNUSED(dirs_only) = false) { return false; }
 virtual void ListContents(wxString archivename)=0;  // Used by ListContentsFromBuffer
 
 wxString archivename;
 wxString WithinArchiveName;
 wxArrayString WithinArchiveNames;
 wxArrayString WithinArchiveNewNames;      // Used if Rename()ing
+ArchiveNameIndex WithinArchiveIndex;      // Built on demand by FindWithinArchiveName(). Clear it whenever WithinArchiveNames is cleared
 bool IsDir;
 
 wxInputStreamPtr MemInStreamPtr;          // Using this avoids contorsions to prevent memory leaks
@@ -246,6 +466,7 @@ wxInputStreamPtr InStreamPtr;             // Used to hold instreams to pass betw
 wxOutputStreamPtr OutStreamPtr;           // Ditto outstreams
 
 wxMemoryBuffer* m_membuf;
+std::vector< std::pair<size_t, size_t> > m_patches; // The offset and length of anything before 'unchanged' that AlterInPlace() also altered e.g. a renamed zip entry's local header
 FakeFilesystem* ffs;                      // The root dir, or subdir, within the archive that is currently the startdir of the dirview
 bool Valid;
 bool Nested;
@@ -267,6 +488,7 @@ virtual void RefreshFromDirtyChild(wxString archivename, ArchiveStream* child);
 
 protected:
 bool DoAlteration(wxArrayString& filepaths, enum alterarc DoWhich, const wxString& originroot=wxT(""), bool dirs_only = false);  // Implement add remove del or rename, depending on the enum
+bool AlterInPlace(wxArrayString& filepaths, enum alterarc DoWhich, size_t& unchanged, const wxString& originroot=wxT(""), bool dirs_only = false); // Remove entries at the end, or Rename to same-length names, by rewriting the central directory (and local headers)
 virtual void GetFromBuffer(bool dup = false);               // Get the stored archive from membuf into the stream, through the uncompressing filter
 virtual void ListContents(wxString archivename);            // Used by ListContentsFromBuffer
 };
@@ -287,9 +509,16 @@ virtual void RefreshFromDirtyChild(wxString archivename, ArchiveStream* child);
 protected:
 void ListContents(wxString archivename);                    // Used by ListContentsFromBuffer
 virtual void GetFromBuffer(bool dup = false);               // Get the stored archive from membuf into the stream. No filter in baseclass
+virtual void GetFromBufferForListing() { GetFromBuffer(); } // Ditto, but one that can record seek checkpoints as ListContents reads it
+virtual bool GetFromBufferAt(wxUint64 headerpos);           // Ditto, but starting at the tar header at headerpos in the uncompressed stream. False if that can't be done quickly
+virtual void AddNativeSeekPoints() {}                       // For formats with their own block index, add it to m_seekindex
 virtual bool CompressStream(wxOutputStream* outstream);     // Does nothing, but we need this in GZArchiveStream etc
+virtual bool IsCompressed() const { return false; }         // Overridden in GZArchiveStream etc
+bool AlterInPlace(wxArrayString& filepaths, enum alterarc DoWhich, size_t& unchanged, const wxString& originroot=wxT(""), bool dirs_only = false); // Add by appending at the end-of-archive marker, if uncompressed
 bool DoAlteration(wxArrayString& filepaths, enum alterarc DoWhich, const wxString& originroot=wxT(""), bool dirs_only = false);  // Implement add remove del or rename, depending on the enum
 bool DoAdd(const wxString& filepath, wxTarOutputStream& taroutstream, const wxString& originroot, bool dirs_only = false); // Adds an entry to a tarstream
+
+ArchiveSeekIndex m_seekindex;                               // Where each member is, and for big compressed archives, where decompression can restart
 };
 
 
@@ -303,7 +532,10 @@ virtual void ListContentsFromBuffer(wxString archivename);  // Extract m_membuf
 
 protected:
 virtual void GetFromBuffer(bool dup = false);               // Get the stored archive from membuf into the stream, through the uncompressing filter
+void GetFromBufferForListing();                             // Uses a GzipSeekInputStream, which records checkpoints
+bool GetFromBufferAt(wxUint64 headerpos);
 bool CompressStream(wxOutputStream* outstream);             // Used to compress appropriately the output stream following Add, Rename etc
+bool IsCompressed() const { return true; }
 };
 
 class BZArchiveStream  :  public TarArchiveStream
@@ -317,6 +549,7 @@ virtual void ListContentsFromBuffer(wxString archivename);  // Extract m_membuf
 protected:
 virtual void GetFromBuffer(bool dup = false);               // Get the stored archive from membuf into the stream, through the uncompressing filter
 bool CompressStream(wxOutputStream* outstream);             // Used to compress appropriately the output stream following Add, Rename etc
+bool IsCompressed() const { return true; }
 };
 
 #ifndef NO_LZMA_ARCHIVE_STREAMS
@@ -330,11 +563,42 @@ virtual void ListContentsFromBuffer(wxString archivename);    // Extract m_membu
 
 protected:
 virtual void GetFromBuffer(bool dup = false);                 // Get the stored archive from membuf into the stream, through the uncompressing filter
+bool GetFromBufferAt(wxUint64 headerpos);
+void AddNativeSeekPoints();                                   // Uses the xz block index
 bool CompressStream(wxOutputStream* outstream);               // Used to compress appropriately the output stream following Add, Rename etc
+bool IsCompressed() const { return true; }
 enum ziptype m_zt;
 };
 #endif // ndef NO_LZMA_ARCHIVE_STREAMS
 
+class ZstdArchiveStream  :  public TarArchiveStream
+{
+public:
+ZstdArchiveStream(DataBase* archive) : TarArchiveStream(archive) {}
+ZstdArchiveStream(wxMemoryBuffer* membuf, wxString archivename) : TarArchiveStream(membuf, archivename) {}
+~ZstdArchiveStream(){}
+virtual void ListContentsFromBuffer(wxString archivename);  // Extract m_membuf and list the contents
+
+protected:
+virtual void GetFromBuffer(bool dup = false);               // Get the stored archive from membuf into the stream, through the uncompressing filter
+bool CompressStream(wxOutputStream* outstream);             // Used to compress appropriately the output stream following Add, Rename etc
+bool IsCompressed() const { return true; }
+};
+
+class Lz4ArchiveStream  :  public TarArchiveStream
+{
+public:
+Lz4ArchiveStream(DataBase* archive) : TarArchiveStream(archive) {}
+Lz4ArchiveStream(wxMemoryBuffer* membuf, wxString archivename) : TarArchiveStream(membuf, archivename) {}
+~Lz4ArchiveStream(){}
+virtual void ListContentsFromBuffer(wxString archivename);  // Extract m_membuf and list the contents
+
+protected:
+virtual void GetFromBuffer(bool dup = false);               // Get the stored archive from membuf into the stream, through the uncompressing filter
+bool CompressStream(wxOutputStream* outstream);             // Used to compress appropriately the output stream following Add, Rename etc
+bool IsCompressed() const { return true; }
+};
+
 class DirBase  // Base for mywxDir and ArcDir, so that I can use base pointers
 {
 public:
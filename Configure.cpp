@@ -1916,6 +1916,10 @@ wxConfigBase* config = wxConfigBase::Get();  if (config==NULL)  return;
 MAX_COMMAND_HISTORY = (size_t)config->Read(wxT("/Misc/MaxCommandHistory"), 15l);
 config->Read(wxT("/Misc/RETAIN_REL_TARGET"), &RETAIN_REL_TARGET, 1);  // Whether, when a relative symlink is moved, its target remains unchanged
 config->Read(wxT("/Misc/RETAIN_MTIME_ON_PASTE"), &RETAIN_MTIME_ON_PASTE, 0); // Do we want Move/Paste to keep the modification time of the origin file
+config->Read(wxT("/Misc/PERSISTENT_UNDO"), &PERSISTENT_UNDO, 0);    // Should Undo/Redo still work after a restart
+config->Read(wxT("/Misc/USE_DIR_CACHE"), &USE_DIR_CACHE, 0);        // Should dir listings be cached between sessions
+config->Read(wxT("/Misc/DURABLE_PASTE"), &DURABLE_PASTE, 0);        // Should each pasted file be synced to disk before it appears under its real name
+DIR_CACHE_MAX_ENTRIES = (size_t)config->Read(wxT("/Misc/DIR_CACHE_MAX_ENTRIES"), 200000l);
 
 config->SetPath(wxT("/History/FilterHistory/"));
 size_t count = config->GetNumberOfEntries();        // Count the entries
@@ -1941,6 +1945,10 @@ if (config==NULL)  { wxLogError(_("Couldn't load configuration!?")); return; }
 
 config->Write(wxT("/Misc/RETAIN_REL_TARGET"), RETAIN_REL_TARGET);  // Whether, when a relative symlink is moved, its target remains unchanged
 config->Write(wxT("/Misc/RETAIN_MTIME_ON_PASTE"), RETAIN_MTIME_ON_PASTE); // Do we want Move/Paste to keep the modification time of the origin file
+config->Write(wxT("/Misc/PERSISTENT_UNDO"), PERSISTENT_UNDO);      // Should Undo/Redo still work after a restart
+config->Write(wxT("/Misc/USE_DIR_CACHE"), USE_DIR_CACHE);          // Should dir listings be cached between sessions
+config->Write(wxT("/Misc/DURABLE_PASTE"), DURABLE_PASTE);          // Should each pasted file be synced to disk before it appears under its real name
+config->Write(wxT("/Misc/DIR_CACHE_MAX_ENTRIES"), (long)DIR_CACHE_MAX_ENTRIES);
 
 config->DeleteGroup(wxT("/History/FilterHistory"));   // Delete current info, otherwise we'll end up with duplicates or worse
 config->SetPath(wxT("/History/FilterHistory/"));
@@ -3570,8 +3578,11 @@ wxConfigBase::Get()->Write(wxT("Devices/Misc/ASK_BEFORE_UMOUNT_ON_EXIT"), ASK_BE
 wxConfigBase::Get()->Write(wxT("Devices/Misc/CHECK_USB_TIMEINTERVAL"), (long)CHECK_USB_TIMEINTERVAL);
 wxConfigBase::Get()->Flush();
 
-MyFrame::mainframe->Layout->m_notebook->DeviceMan->usbtimer->Stop();
-MyFrame::mainframe->Layout->m_notebook->DeviceMan->usbtimer->Start(CHECK_USB_TIMEINTERVAL * 1000, wxTIMER_CONTINUOUS);  // Restart with new value
+MyUsbDevicesTimer* usbtimer = MyFrame::mainframe->Layout->m_notebook->DeviceMan->usbtimer;
+if (!usbtimer->IsEventDriven())                     // If it is, the new value will be used for the next burst of post-uevent checks
+  { usbtimer->Stop();
+    usbtimer->Start(CHECK_USB_TIMEINTERVAL * 1000, wxTIMER_CONTINUOUS);  // Restart with new value
+  }
 }
 
 
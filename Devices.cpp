@@ -31,6 +31,12 @@
 #include "Misc.h"
 #include "Configure.h"
 
+#if wxVERSION_NUMBER < 2900
+  DEFINE_EVENT_TYPE(UeventType)
+#else
+  wxDEFINE_EVENT(UeventType, wxCommandEvent);
+#endif
+
   // If Path, prepend it to Command, and wrap with sh -c quote
 enum PPath_returncodes PrependPathToCommand(const wxString& Path, const wxString& Command, wxChar quote, wxString& FinalCommand, bool ThereWillBeParameters)
 {
@@ -1346,6 +1352,385 @@ while ((tempstruct = GetNextDevice(count, child)) != NULL) // Use GetNextDevice(
 return NULL;  // If we're here, GetNextDevice() ran out of devices without finding a match
 }
 
+//---------------------------------------------------------------------------------------------------------------------------
+const size_t USB_FOLLOWUP_CHECKS = 5;      // After a uevent, how many times to look for an automounter's mount
+const size_t GVFS_POLL_TICKS = 10;         // When nothing has happened, look every this-many ticks anyway, for gvfs mounts
+
+void MyUsbDevicesTimer::Notify()
+{
+if (m_busy) return;                        // We're still inside the last check, probably showing a dialog
+
+if (m_EventDriven)
+  { if (m_followups) --m_followups;
+     else if (!MountsChanged() && (++m_idleticks < GVFS_POLL_TICKS)) return;
+  }
+
+Check();
+}
+
+void MyUsbDevicesTimer::Check()
+{
+if (m_busy) return;
+
+m_busy = true;
+devman->CheckForOtherDevices();
+m_busy = false;
+
+m_idleticks = 0;
+MountsChanged();                           // Don't let the check's own reparse of the table trigger another one
+}
+
+bool MyUsbDevicesTimer::MountsChanged()
+{
+#ifdef __linux__
+  size_t generation = MountTable::Get().GetGeneration(); // This polls mountinfo for POLLPRI, so it's cheap unless something was (un)mounted
+  if (generation == m_mountgeneration) return false;
+  m_mountgeneration = generation;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void MyUsbDevicesTimer::StartFollowups(size_t count)
+{
+m_followups = count;
+if (!IsRunning())
+  Start(CHECK_USB_TIMEINTERVAL * 1000, wxTIMER_CONTINUOUS);
+}
+
+void MyUsbDevicesTimer::OnUevent(wxCommandEvent& WXUNUSED(event))
+{
+if (m_busy)                                // We're already inside CheckForOtherDevices(), probably showing a dialog. The followups will catch this one
+  { m_followups = USB_FOLLOWUP_CHECKS; return; }
+
+Check();                                   // Look now, rather than waiting for the next timer tick
+StartFollowups(USB_FOLLOWUP_CHECKS);       // and keep looking for a while, as the device may not be mounted yet
+}
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <fcntl.h>
+#include <algorithm>
+
+void UeventSource::Close()
+{
+if (m_fd != -1) { close(m_fd); m_fd = -1; }
+}
+
+bool NetlinkUeventSource::Open()  // Join the kernel's uevent multicast group. No root needed, but some sandboxes don't allow it
+{
+m_fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+if (m_fd == -1) return false;
+
+struct sockaddr_nl addr; memset(&addr, 0, sizeof(addr));
+addr.nl_family = AF_NETLINK;
+addr.nl_groups = 1;                        // The kernel group. udev rebroadcasts on group 2, but those are in its own format
+if (bind(m_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+  { Close(); return false; }
+
+return true;
+}
+
+static wxString DevpathFromSysLink(const wxString& link)  // e.g. /sys/class/block/sdb1 -> /devices/pci0000:00/.../block/sdb/sdb1, which is what a uevent's DEVPATH holds
+{
+char buf[PATH_MAX];
+ssize_t len = readlink(link.mb_str(wxConvUTF8), buf, sizeof(buf)-1);
+if (len <= 0) return wxEmptyString;
+buf[len] = '\0';
+
+wxString target(buf, wxConvUTF8);
+int pos = target.Find(wxT("/devices/"));
+return (pos == wxNOT_FOUND) ? wxString() : target.Mid(pos);
+}
+
+bool UeventMonitor::Start()
+{
+if (!m_source || !m_source->Open()) return false;
+LoadSysDevices();                          // Do this before Run(), so that there's no need to lock m_devices
+
+wxThreadError error;
+#if wxVERSION_NUMBER < 2905
+  error = Create();
+  if (error == wxTHREAD_NO_ERROR)
+     error = Run();
+#else
+  error = Run();
+#endif
+
+return error == wxTHREAD_NO_ERROR;
+}
+
+void UeventMonitor::LoadSysDevices()  // Initialise the model with what's already there, so that coldplug 'add's aren't mistaken for novelties
+{
+wxLogNull WeDontWantMissingDirMsgs;
+wxString eachFilename;
+
+wxDir blockdir; blockdir.Open(wxT("/sys/class/block"));
+if (blockdir.IsOpened() && blockdir.GetFirst(&eachFilename))
+  do { wxString path = wxT("/sys/class/block/") + eachFilename;
+       wxString devpath = DevpathFromSysLink(path);
+       if (devpath.IsEmpty()) continue;
+       UeventDevice dev; dev.subsystem = wxT("block");
+       dev.devtype = wxFileExists(path + wxT("/partition")) ? wxT("partition") : wxT("disk");
+       dev.devname = eachFilename; dev.devname.Replace(wxT("!"), wxT("/")); // sysfs names e.g. cciss/c0d0 as cciss!c0d0
+       m_devices[devpath] = dev;
+     }
+    while (blockdir.GetNext(&eachFilename));
+
+wxDir usbdir; usbdir.Open(wxT("/sys/bus/usb/devices"));
+if (usbdir.IsOpened() && usbdir.GetFirst(&eachFilename))
+  do { if (eachFilename.Contains(wxT(":"))) continue; // That's an interface, not a device
+       wxString devpath = DevpathFromSysLink(wxT("/sys/bus/usb/devices/") + eachFilename);
+       if (devpath.IsEmpty()) continue;
+       UeventDevice dev; dev.subsystem = wxT("usb"); dev.devtype = wxT("usb_device");
+       m_devices[devpath] = dev;
+     }
+    while (usbdir.GetNext(&eachFilename));
+}
+
+void* UeventMonitor::Entry()
+{
+char buf[8192];
+struct pollfd pfd; pfd.fd = m_source->GetFd(); pfd.events = POLLIN;
+
+while (!TestDestroy())
+  { pfd.revents = 0;
+    int ans = poll(&pfd, 1, 500);          // Time out every 500ms so that TestDestroy() gets a look-in
+    if (ans < 0 && errno != EINTR) break;
+    if (ans <= 0 || !(pfd.revents & POLLIN)) continue;
+
+    ssize_t len = recv(pfd.fd, buf, sizeof(buf)-1, MSG_DONTWAIT);
+    if (len <= 0) continue;
+    buf[len] = '\0';                       // Make sure the last property is terminated, even if the message was truncated
+
+    wxString change;
+    if (ProcessUevent(buf, len, change))
+      { wxCommandEvent event(UeventType);
+        event.SetString(change);
+        wxPostEvent(m_sink, event);
+      }
+  }
+
+return NULL;
+}
+
+bool UeventMonitor::ProcessUevent(const char* buf, size_t len, wxString& change)
+{
+if (!strchr(buf, '@')) return false;      // The header should be "action@devpath". If not, it's not from the kernel
+
+wxString action, devpath, subsystem, devtype, devname; bool mediachange(false);
+for (size_t n = strlen(buf) + 1; n < len; n += strlen(buf + n) + 1)
+  { wxString property(buf + n, wxConvUTF8);
+    wxString key = property.BeforeFirst(wxT('=')), value = property.AfterFirst(wxT('='));
+    if (key == wxT("ACTION")) action = value;
+     else if (key == wxT("DEVPATH")) devpath = value;
+     else if (key == wxT("SUBSYSTEM")) subsystem = value;
+     else if (key == wxT("DEVTYPE")) devtype = value;
+     else if (key == wxT("DEVNAME")) devname = value;
+     else if (key == wxT("DISK_MEDIA_CHANGE")) mediachange = (value == wxT("1"));
+  }
+
+if (devpath.IsEmpty()) return false;
+if (subsystem == wxT("block"))
+  { if (devtype != wxT("disk") && devtype != wxT("partition")) return false; }
+ else if (subsystem != wxT("usb") || devtype != wxT("usb_device")) return false;  // We don't care about usb interfaces, nor about other subsystems
+
+std::map<wxString, UeventDevice>::iterator iter = m_devices.find(devpath);
+if (action == wxT("add"))
+  { if (iter != m_devices.end()) return false;  // Old news
+    UeventDevice dev; dev.subsystem = subsystem; dev.devtype = devtype; dev.devname = devname;
+    m_devices[devpath] = dev;
+  }
+ else if (action == wxT("remove"))
+  { if (iter == m_devices.end()) return false;  // We never knew about it, so neither does the UI
+    m_devices.erase(iter);
+  }
+ else if (action == wxT("change"))
+  { if (!mediachange) return false;       // Most 'change's are just udev rewriting properties. A cdrom or cardreader getting/losing its media is what matters
+  }
+ else return false;                        // e.g. bind, move, online
+
+change = action + wxT(' ') + (devname.IsEmpty() ? devpath : devname);
+return true;
+}
+
+MountTable::MountTable() : m_parsed(false), m_generation(0)
+{
+m_fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+memset(&m_mntent, 0, sizeof(m_mntent));
+}
+
+MountTable::~MountTable()
+{
+if (m_fd != -1) close(m_fd);
+}
+
+void MountTable::Refresh()
+{
+if (m_fd == -1) { Parse(); return; }       // We've no way of knowing if mtab has changed, so we must reread it each time
+
+struct pollfd pfd; pfd.fd = m_fd; pfd.events = POLLPRI; pfd.revents = 0;
+if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLPRI | POLLERR)))  // This is how the kernel says that something was mounted or unmounted. It's reset by the poll() itself
+  m_parsed = false;
+
+if (!m_parsed) Parse();
+}
+
+static std::string UnescapeMountinfo(const std::string& field)  // mountinfo octal-escapes spaces, tabs, newlines and backslashes e.g. \040
+{
+std::string result;
+for (size_t n=0; n < field.size(); ++n)
+  { if (field[n] == '\\' && n+3 < field.size()
+          && field[n+1] >= '0' && field[n+1] <= '7' && field[n+2] >= '0' && field[n+2] <= '7' && field[n+3] >= '0' && field[n+3] <= '7')
+      { result += (char)(((field[n+1]-'0') << 6) | ((field[n+2]-'0') << 3) | (field[n+3]-'0')); n += 3; }
+     else result += field[n];
+  }
+return result;
+}
+
+static void SplitOnSpaces(const std::string& str, std::vector<std::string>& fields)
+{
+fields.clear();
+size_t start = 0;
+while (start < str.size())
+  { size_t end = str.find(' ', start);
+    if (end == std::string::npos) end = str.size();
+    if (end > start) fields.push_back(str.substr(start, end - start));
+    start = end + 1;
+  }
+}
+
+void MountTable::Parse()
+{
+m_entries.clear(); m_bymountpt.clear(); m_bydevice.clear(); m_bytype.clear();
+m_parsed = true; ++m_generation;
+
+if (m_fd == -1)
+  { FILE* fmp = setmntent (_PATH_MOUNTED, "r");           // Get a file* to (probably) /etc/mtab
+    if (fmp==NULL) return;
+    struct mntent* mnt;
+    while ((mnt = getmntent(fmp)) != NULL)
+      { MountEntry entry;
+        entry.fsname = mnt->mnt_fsname; entry.dir = mnt->mnt_dir; entry.type = mnt->mnt_type; entry.opts = mnt->mnt_opts;
+        AddEntry(entry);
+      }
+    endmntent(fmp); return;
+  }
+
+std::string contents; char buf[16384]; ssize_t len;
+if (lseek(m_fd, 0, SEEK_SET) == -1) return;
+while ((len = read(m_fd, buf, sizeof(buf))) > 0)       // It's a seq_file, so the kernel may give us only a page at a time
+  contents.append(buf, len);
+
+std::vector<std::string> before, after;
+size_t start = 0;
+while (start < contents.size())
+  { size_t end = contents.find('\n', start);
+    if (end == std::string::npos) end = contents.size();
+    std::string line = contents.substr(start, end - start); start = end + 1;
+
+      // e.g. 36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw,errors=continue
+      // Before the " - " are the mount id, parent id, major:minor, root, mountpt, mount options, then 0 or more optional fields. After it, fstype, source, superblock options
+    size_t sep = line.find(" - ");
+    if (sep == std::string::npos) continue;
+    SplitOnSpaces(line.substr(0, sep), before); SplitOnSpaces(line.substr(sep + 3), after);
+    if (before.size() < 6 || after.size() < 2) continue;
+
+    MountEntry entry;
+    entry.dir = UnescapeMountinfo(before[4]);
+    entry.type = after[0];
+    entry.fsname = UnescapeMountinfo(after[1]);
+    entry.opts = before[5];
+    if (after.size() > 2) entry.opts += ',' + after[2];
+    AddEntry(entry);
+  }
+}
+
+void MountTable::AddEntry(const MountEntry& newentry)
+{
+m_entries.push_back(newentry);
+size_t index = m_entries.size() - 1;
+MountEntry& entry = m_entries.back();
+entry.device = wxString(entry.fsname.c_str(), wxConvUTF8);
+entry.mountpt = wxString(entry.dir.c_str(), wxConvUTF8);
+entry.fstype = wxString(entry.type.c_str(), wxConvUTF8);
+
+m_bymountpt[entry.mountpt] = index;                    // Later entries are mounted on top of earlier ones, so they win
+m_bydevice.insert(std::make_pair(entry.device, index));
+m_bytype.insert(std::make_pair(entry.fstype, index));
+}
+
+const MountEntry* MountTable::FindByMountpt(const wxString& mountpt)
+{
+Refresh();
+std::map<wxString, size_t>::const_iterator iter = m_bymountpt.find(mountpt);
+return (iter == m_bymountpt.end()) ? NULL : &m_entries[iter->second];
+}
+
+const MountEntry* MountTable::FindByDevice(const wxString& device)
+{
+Refresh();
+std::multimap<wxString, size_t>::const_iterator iter = m_bydevice.lower_bound(device); // Not find(), which needn't return the first of several
+return (iter == m_bydevice.end() || iter->first != device) ? NULL : &m_entries[iter->second];
+}
+
+size_t MountTable::FindAllByDevice(const wxString& device, std::vector<const MountEntry*>& entries)
+{
+Refresh(); entries.clear();
+std::pair<std::multimap<wxString, size_t>::const_iterator, std::multimap<wxString, size_t>::const_iterator> range = m_bydevice.equal_range(device);
+for (std::multimap<wxString, size_t>::const_iterator iter = range.first; iter != range.second; ++iter)
+  entries.push_back(&m_entries[iter->second]);
+return entries.size();
+}
+
+size_t MountTable::FindByDevicePrefix(const wxString& prefix, std::vector<const MountEntry*>& entries)
+{
+Refresh(); entries.clear();
+std::vector<size_t> indices;
+for (std::multimap<wxString, size_t>::const_iterator iter = m_bydevice.lower_bound(prefix); iter != m_bydevice.end() && iter->first.StartsWith(prefix); ++iter)
+  indices.push_back(iter->second);
+
+std::sort(indices.begin(), indices.end());             // Return them in mtab order, as a scan would have
+for (size_t n=0; n < indices.size(); ++n)
+  entries.push_back(&m_entries[indices[n]]);
+return entries.size();
+}
+
+size_t MountTable::FindAllByType(const wxString& fstype, std::vector<const MountEntry*>& entries)
+{
+Refresh(); entries.clear();
+std::pair<std::multimap<wxString, size_t>::const_iterator, std::multimap<wxString, size_t>::const_iterator> range = m_bytype.equal_range(fstype);
+for (std::multimap<wxString, size_t>::const_iterator iter = range.first; iter != range.second; ++iter)
+  entries.push_back(&m_entries[iter->second]);
+return entries.size();
+}
+
+void MountTable::GetTypes(wxArrayString& fstypes)
+{
+Refresh(); fstypes.Empty();
+for (std::multimap<wxString, size_t>::const_iterator iter = m_bytype.begin(); iter != m_bytype.end(); iter = m_bytype.upper_bound(iter->first))
+  fstypes.Add(iter->first);
+}
+
+struct mntent* MountTable::AsMntent(const MountEntry* entry)
+{
+if (entry == NULL) return NULL;
+
+m_mntent.mnt_fsname = const_cast<char*>(entry->fsname.c_str());
+m_mntent.mnt_dir = const_cast<char*>(entry->dir.c_str());
+m_mntent.mnt_type = const_cast<char*>(entry->type.c_str());
+m_mntent.mnt_opts = const_cast<char*>(entry->opts.c_str());
+return &m_mntent;
+}
+#endif // def __linux__
+
 //---------------------------------------------------------------------------------------------------------------------------
 wxArrayString DeviceAndMountManager::RealFilesystemsArray;
 
@@ -1355,6 +1740,37 @@ deviceman = new DeviceManager(this);
 m_gvfsinfo = new GvfsInfo();
 PartitionArray = new ArrayofPartitionStructs;
 
+wxGetApp().DoAfterFirstIdle(wxT("Locate blkid etc"), [this] { LocateTools(); }); // Searching may mean running 'which', so don't make the first frame wait for it
+
+// These are plausible 1st 3 letters of DVD-RAM filesystems
+const wxChar* DvdRamFilesystems[] = { wxT("aut"), wxT("ext"), wxT("rei"), wxT("xfs"), wxT("btr"), wxT("jfs") }; 
+for (size_t n=0; n < sizeof(DvdRamFilesystems)/sizeof(wxChar*); ++n)      // Transfer them to wxArrayString for ease of use & addition
+  RealFilesystemsArray.Add(DvdRamFilesystems[n]);
+  
+deviceman->LoadDevices();
+
+usbtimer = new MyUsbDevicesTimer; usbtimer->Init(this);                   // Set up the timer that checks for usb drives
+m_ueventmonitor = NULL;
+#ifdef __linux__
+m_ueventmonitor = new UeventMonitor(usbtimer, new NetlinkUeventSource);  // If we can hear the kernel announce devices, there's no need to keep polling
+if (m_ueventmonitor->Start())
+  { usbtimer->Connect(wxID_ANY, UeventType, wxCommandEventHandler(MyUsbDevicesTimer::OnUevent), NULL, usbtimer);
+    usbtimer->SetEventDriven(true);
+    usbtimer->StartFollowups(1);                                          // Still do a single check, for anything plugged in before we started
+  }
+ else
+  { delete m_ueventmonitor; m_ueventmonitor = NULL; }
+#endif
+if (!usbtimer->IsEventDriven())
+  usbtimer->Start(CHECK_USB_TIMEINTERVAL * 1000, wxTIMER_CONTINUOUS);
+
+#if wxVERSION_NUMBER < 3000
+    m_MtabpollTimer = new MtabPollTimer(this);                            // The timer that polls for a successful sshfs mount
+#endif
+}
+
+void DeviceAndMountManager::LocateTools()  // Find lsblk, blkid etc. They're only needed for user-requested mounting, so this is done after startup
+{
 BLKID = wxT("/sbin/blkid");  // See if blkid is installed. It should be, and most likely here
 if (!wxFileExists(BLKID))
   { BLKID.Clear();
@@ -1397,7 +1813,7 @@ if (!wxFileExists(FINDMNT))
 
 FUSERMOUNT = wxT("/bin/fusermount");  // Similarly fusermount
 if (!wxFileExists(FUSERMOUNT))
-  { FINDMNT.Clear();
+  { FUSERMOUNT.Clear();
     if (wxFileExists(wxT("/sbin/fusermount"))) FUSERMOUNT = wxT("/sbin/fusermount");
      else
       { wxArrayString output, errors;
@@ -1406,20 +1822,6 @@ if (!wxFileExists(FUSERMOUNT))
       }
   }
 #endif
-
-// These are plausible 1st 3 letters of DVD-RAM filesystems
-const wxChar* DvdRamFilesystems[] = { wxT("aut"), wxT("ext"), wxT("rei"), wxT("xfs"), wxT("btr"), wxT("jfs") }; 
-for (size_t n=0; n < sizeof(DvdRamFilesystems)/sizeof(wxChar*); ++n)      // Transfer them to wxArrayString for ease of use & addition
-  RealFilesystemsArray.Add(DvdRamFilesystems[n]);
-  
-deviceman->LoadDevices();
-
-usbtimer = new MyUsbDevicesTimer; usbtimer->Init(this);                   // Set up the timer that checks for usb drives
-usbtimer->Start(CHECK_USB_TIMEINTERVAL * 1000, wxTIMER_CONTINUOUS);
-
-#if wxVERSION_NUMBER < 3000
-    m_MtabpollTimer = new MtabPollTimer(this);                            // The timer that polls for a successful sshfs mount
-#endif
 }
 
 DeviceAndMountManager::~DeviceAndMountManager()  // Apart from cleaning up, this unmounts any devices that we mounted, & then forgot to unmount
@@ -1447,6 +1849,10 @@ while ((item = deviceman->GetNextDevice(count, child)) != NULL)         // Use G
 delete deviceman;                                      // Delete the arrays
 for (int n = (int)PartitionArray->GetCount();  n > 0; --n)  { PartitionStruct* item = PartitionArray->Item(n-1); delete item; PartitionArray->RemoveAt(n-1); }
 delete PartitionArray;
+#ifdef __linux__
+if (m_ueventmonitor)
+  { m_ueventmonitor->Delete(); delete m_ueventmonitor; } // It's joinable, so Delete() waits for it to finish
+#endif
 delete usbtimer;
 delete m_gvfsinfo;
 
@@ -1594,53 +2000,44 @@ bool DeviceAndMountManager::Checkmtab(wxString& mountpoint, wxString device /*=w
   return DeviceAndMountManager::GnuCheckmtab(mountpoint, device);
 #endif
 
-#ifdef __linux__
-struct mntent* mnt = NULL;
+wxString mountpt(mountpoint); FileData mp(mountpt);
+if (mp.IsSymlink()) mountpt = mp.GetUltimateDestination(); // Cope with a symlink
 
-FILE* fmp = setmntent (_PATH_MOUNTED, "r");                // Get a file* to (probably) /etc/mtab
-if (fmp==NULL) return false;
+#ifdef __linux__
+  // The kernel has already resolved any symlinks in its mountpts, so there's no need to lstat them; which is as well, as a stale nfs mount hangs lstat!
+const MountEntry* entry = MountTable::Get().FindByMountpt(mountpt);
+if (entry == NULL) return false;
+if (device.IsEmpty()) return true;                         // If we don't care which device is mounted there
+
+wxString mntfsname(entry->device);                         // in case we DO care
+FileData dev(device); FileData mntfs(mntfsname);           // Cope with any symlinks
+if (dev.IsSymlink()) device = dev.GetUltimateDestination();
+if (mntfs.IsSymlink()) mntfsname = mntfs.GetUltimateDestination();
+return  (mntfsname ==  device);
 #else
 struct statfs* fslist;
 
 int numfs = getmntinfo(&fslist, MNT_NOWAIT);
 if (numfs < 1) return false;
-#endif
-
-wxString mountpt(mountpoint); FileData mp(mountpt);
-if (mp.IsSymlink()) mountpt = mp.GetUltimateDestination(); // Cope with a symlink
-
-#ifdef __linux__
-while (1)                                                  // For every mtab entry
-  { mnt = getmntent(fmp);                                  // Get a struct representing a mounted partition
-    if (mnt == NULL)
-      { endmntent(fmp); return false; }                    // If it's null, we've run out of candidates.  Return false
 
-    wxString mntdir(mnt->mnt_dir, wxConvUTF8);
-    wxString type(mnt->mnt_type, wxConvUTF8); type.MakeLower();
-#else
 for (int i = 0; i < numfs; ++i)
   { wxString mntdir(fslist[i].f_mntonname, wxConvUTF8);
     wxString type(fslist[i].f_fstypename, wxConvUTF8); type.MakeLower();
-#endif
     // Don't try to create a FileData if we're testing a network mount. It's less likely to be symlinked, and e.g. a stale nfs mount hangs lstat!
     if (!type.StartsWith(wxT("nfs")) && !type.Contains(wxT("sshfs")) && type != wxT("cifs") && type != wxT("smbfs"))
       { FileData mt(mntdir); if (mt.IsSymlink()) mntdir = mt.GetUltimateDestination(); } // Cope with a symlink
     if (mntdir == mountpt)                                 // This is the one we're looking for
-#ifdef __linux__
-      { endmntent(fmp);
-        if (device.IsEmpty()) return true;                 // If we don't care which device is mounted there
-
-        wxString mntfsname(mnt->mnt_fsname, wxConvUTF8);   // in case we DO care
-#else
       { if (device.IsEmpty()) return true;
         wxString mntfsname(fslist[i].f_mntfromname, wxConvUTF8);
-#endif
         FileData dev(device); FileData mntfs(mntfsname);   // Cope with any symlinks
         if (dev.IsSymlink()) device = dev.GetUltimateDestination();
         if (mntfs.IsSymlink()) mntfsname = mntfs.GetUltimateDestination();
         return  (mntfsname ==  device);                  
       }
   }
+
+return false;
+#endif
 }
 
 #ifdef __GNU_HURD__
@@ -1672,17 +2069,8 @@ return !failure;
 wxString DeviceAndMountManager::WhereIsDeviceMounted(wxString device, size_t type)
 {
 #ifdef __linux__
-struct mntent* mnt = NULL;
-
-FILE* fmp = setmntent (_PATH_MOUNTED, "r");             // Get a file* to (probably) /etc/mtab
-if (fmp==NULL) return wxEmptyString;
-
-while (1)                                               // For every mtab entry
-  { mnt = getmntent(fmp);                               // Get a struct representing a mounted partition
-    if (mnt == NULL)  break;                            // If it's null, we've run out of candidates
-    wxString mntfsname(mnt->mnt_fsname, wxConvUTF8);
-    if (mntfsname == device)
-      { endmntent(fmp); return wxString(mnt->mnt_dir, wxConvUTF8); }  // If it's the one we're looking for, return the associated mountpt
+const MountEntry* entry = MountTable::Get().FindByDevice(device);
+if (entry != NULL) return entry->mountpt;               // If it's the one we're looking for, return the associated mountpt
 #else
 struct statfs* fslist;
 
@@ -1693,8 +2081,8 @@ for (int i = 0; i < numfs; ++i)
   { wxString mntfsname(fslist[i].f_mntfromname, wxConvUTF8);
     if (mntfsname == device)
       return wxString(fslist[i].f_mntonname, wxConvUTF8);
-#endif
   }
+#endif
 
             // If we're here, the device wasn't found.  See if it's actually a symlink for a different device  eg /dev/dvd -> /dev/hdc.  If so, try that
 FileData stat(device);
@@ -1715,10 +2103,7 @@ return wxEmptyString;                                   // If we're here, everyt
 #ifdef __linux__
 struct mntent* DeviceAndMountManager::ReadMtab(const wxString& partition, bool DvdRamFS /*=false*/)    // Is 'partition' currently mounted? Returns struct of data if it is, NULL if it isn't
 {
-struct mntent* mnt = NULL;
-
-FILE* fmp = setmntent (_PATH_MOUNTED, "r");           // Get a file* to (probably) /etc/mtab
-if (fmp==NULL) return mnt;
+MountTable& table = MountTable::Get();
 #else
 struct statfs* DeviceAndMountManager::ReadMtab(const wxString& partition, bool DvdRamFS /*=false*/)
 {
@@ -1733,23 +2118,20 @@ if (partition.Right(1) == wxFILE_SEP_PATH) partitionwithout = partition.BeforeLa
  else partitionwithsep << wxFILE_SEP_PATH;
 
 #ifdef __linux__
-while (1)                                             // For every mtab entry
-  { mnt = getmntent(fmp);                             // Get a struct representing a mounted partition
-    if (mnt == NULL)  break;                          // If it's null, we've run out of candidates.  Return null as flag
-    wxString mntfsname(mnt->mnt_fsname, wxConvUTF8);
-    if (!mntfsname.empty() && ((mntfsname == partitionwithsep) || (mntfsname == partitionwithout))) // If it's the one we're looking for, return it
-      { if (!DvdRamFS) { endmntent(fmp); return mnt; }
-        wxString mnttype(mnt->mnt_type, wxConvUTF8);
-        for (size_t n=0; n < RealFilesystemsArray.GetCount(); ++n)  // For DVD-RAM, we're only interested in filesystems like ext2 not eg subfs
-          if (mnttype.Left(3) == RealFilesystemsArray.Item(n).Left(3)) { endmntent(fmp); return mnt; }  // Found one
-      }                                               // If we're here, this was something irrelevant like a subfs mount, so ignore
-  }
-
-endmntent(fmp);        // If we're here, the device wasn't found.  See if it's actually a symlink for a different device  eg /dev/dvd -> /dev/hdc.  If so, try that
+std::vector<const MountEntry*> entries;
+if (!partition.empty() && !table.FindAllByDevice(partitionwithout, entries))
+  table.FindAllByDevice(partitionwithsep, entries);
+for (size_t e=0; e < entries.size(); ++e)             // If it's the one we're looking for, return it
+  { if (!DvdRamFS) return table.AsMntent(entries[e]);
+    for (size_t n=0; n < RealFilesystemsArray.GetCount(); ++n)  // For DVD-RAM, we're only interested in filesystems like ext2 not eg subfs
+      if (entries[e]->fstype.Left(3) == RealFilesystemsArray.Item(n).Left(3)) return table.AsMntent(entries[e]);  // Found one
+  }                                                   // If we're here, this was something irrelevant like a subfs mount, so ignore
+
+                       // If we're here, the device wasn't found.  See if it's actually a symlink for a different device  eg /dev/dvd -> /dev/hdc.  If so, try that
 FileData stat(partition);
 if (stat.IsSymlink())   { wxString target = stat.GetSymlinkDestination(); return ReadMtab(target, DvdRamFS); }
 
-mnt = NULL; return mnt;                               // If we're here, it failed. Return null as flag
+return NULL;                                          // If we're here, it failed. Return null as flag
 #else
 for (int i = 0; i < numfs; ++i)
   { wxString mntfsname(fslist[i].f_mntfromname, wxConvUTF8);
@@ -2099,15 +2481,9 @@ return (PartitionArray->GetCount() > 0);
 void DeviceAndMountManager::FindMountedImages()  // Add mounted iso-images from mtab to array
 {
 #ifdef __linux__
-FILE* fmp = setmntent (_PATH_MOUNTED, "r");                 // Get a file* to (probably) /etc/mtab
-if (fmp==NULL) return;
-
-while (1)                                                   // For every mtab entry
-  { struct mntent* mnt = getmntent(fmp);                    //  get a struct representing a mounted partition
-    if (mnt == NULL)  
-      { endmntent(fmp);  return; }                          // If it's null, we've finished mtab
-    
-    wxString device(mnt->mnt_fsname, wxConvUTF8);           // Make the 'device' into a wxString for convenience
+const std::vector<MountEntry>& entries = MountTable::Get().GetEntries();
+for (size_t e=0; e < entries.size(); ++e)                   // For every mtab entry
+  { wxString device(entries[e].device);
 #else
 struct statfs* fslist;
 
@@ -2122,8 +2498,8 @@ for (int i = 0; i < numfs; ++i)
                             !(device.Left(5) == wxT("/dev/") || device.Left(2) == wxT("//"))))
       { struct PartitionStruct* newmnt = new struct PartitionStruct;  // store in structarray
 #ifdef __linux__
-        newmnt->device = wxString(mnt->mnt_fsname, wxConvUTF8);
-        newmnt->mountpt = wxString(mnt->mnt_dir, wxConvUTF8);
+        newmnt->device = entries[e].device;
+        newmnt->mountpt = entries[e].mountpt;
 #else
         newmnt->device = wxString(fslist[i].f_mntfromname, wxConvUTF8);
         newmnt->mountpt = wxString(fslist[i].f_mntonname, wxConvUTF8);
@@ -2240,19 +2616,9 @@ for (size_t n=0; n < partitions.GetCount(); ++n)
   { wxString item = partitions.Item(n);
     if (item == dev || item == symtarget)
 #ifdef __linux__
-      { struct mntent* mnt = NULL;             // Found an entry.  Look for it in mtab
-        FILE* fmp = setmntent (_PATH_MOUNTED, "r"); if (fmp==NULL) { endfsent(); return answerarray.GetCount() > 0; }
-        while (1)                    
-          { mnt = getmntent(fmp);
-            if (mnt == NULL)                   // If it's null, we've run out of candidates, so this entry can't be mounted
-              { answerarray.Add(mountpts.Item(n));
-                endmntent(fmp); break; 
-              }
-
-            if (wxString(mnt->mnt_fsname,wxConvUTF8) == dev || wxString(mnt->mnt_fsname,wxConvUTF8) == symtarget) // Found the device
-              if (wxString(mnt->mnt_dir,wxConvUTF8) == mountpts.Item(n))                                          //   but it's already mounted here
-                  { endmntent(fmp);  break; }  // so look in 'partitions' array for another entry
-          }
+      { const MountEntry* mnt = MountTable::Get().FindByMountpt(mountpts.Item(n));  // Found an entry.  Look for its mountpt in mtab
+        if (mnt == NULL || (mnt->device != dev && mnt->device != symtarget)) // If there's nothing there, or a different device, this entry can't be mounted
+          answerarray.Add(mountpts.Item(n));  // Otherwise it's already mounted here, so look in 'partitions' array for another entry
 #else
       { struct statfs* fslist;
         int numfs = getmntinfo(&fslist, MNT_NOWAIT);
@@ -3077,18 +3443,13 @@ for (size_t n=0; n < count; n++)
 
 void DeviceAndMountManager::SearchMtab(wxArrayString& partitions, wxArrayString& mountpts,  wxString dev /*=wxEmptyString*/)  // Loads arrays with data for the named device, or for all devices. NB Only finds mounted partitions
 {
-#ifdef __linux__
-struct mntent* mnt = NULL;
-#else
+#ifndef __linux__
 struct statfs* fslist;
 #endif
 
 partitions.Empty(); mountpts.Empty();               // Empty the arrays of any old data:  we don't want to append!
 
-#ifdef __linux__
-FILE* fmp = setmntent (_PATH_MOUNTED, "r");         // Get a file* to (probably) /etc/mtab
-if (fmp==NULL) return;
-#else
+#ifndef __linux__
 int numfs = getmntinfo(&fslist, MNT_NOWAIT);
 if (numfs < 1) return;
 #endif
@@ -3098,29 +3459,25 @@ if (dev.IsEmpty()) mask = AUTOMOUNT_USB_PREFIX;     // We normally search for al
   else mask = dev;                                  //   but if dev isn't empty, use this instead
 
 #ifdef __linux__
-while (1)                                           // For every mtab entry
-  { mnt = getmntent(fmp);                           // Get a struct representing a mounted partition
-    if (mnt == NULL) { endmntent(fmp); return; }    // If it's null, we've run out of candidates
-    
-                          // See if this mount's device begins with the appropriate letters
-    if (wxString(mnt->mnt_fsname, wxConvUTF8).Left(mask.Len()) == mask)
-      { partitions.Add(wxString(mnt->mnt_fsname, wxConvUTF8));  // If so, store the devnode and mountpt
-        mountpts.Add(wxString(mnt->mnt_dir, wxConvUTF8));
+std::vector<const MountEntry*> entries;             // The mounts whose device begins with the appropriate letters
+MountTable::Get().FindByDevicePrefix(mask, entries);
+for (size_t e=0; e < entries.size(); ++e)
+  { partitions.Add(entries[e]->device);             // Store the devnode and mountpt
+    mountpts.Add(entries[e]->mountpt);
+  }
 #else
 for (int i = 0; i < numfs; ++i)
   { if (wxString(fslist[i].f_mntfromname, wxConvUTF8).Left(mask.Len()) == mask)
       { partitions.Add(wxString(fslist[i].f_mntfromname, wxConvUTF8));
         mountpts.Add(wxString(fslist[i].f_mntonname, wxConvUTF8));
-#endif
       }
   }
+#endif
 }
 
 void DeviceAndMountManager::SearchMtabForStandardMounts(wxString& device, wxArrayString& mountpts)  // Finds ext2 etc mountpts for the device ie not subfs. Used for DVD-RAM
 {
-#ifdef __linux__
-struct mntent* mnt = NULL;
-#else
+#ifndef __linux__
 struct statfs* fslist;
 #endif
 mountpts.Empty();                                   // Empty the array of any old data:  we don't want to append!
@@ -3129,16 +3486,12 @@ wxString symtarget; FileData fd(device);            // Beware of the symlink
 if (fd.IsSymlink()) symtarget = fd.GetUltimateDestination();
 
 #ifdef __linux__
-FILE* fmp = setmntent (_PATH_MOUNTED, "r");         // Get a file* to (probably) /etc/mtab
-if (fmp==NULL) return;
-
-while (1)                                           // For every mtab entry
-  { mnt = getmntent(fmp);                           // Get a struct representing a mounted partition
-    if (mnt == NULL) { endmntent(fmp); return; }    // If it's null, we've run out of candidates
-    
+const std::vector<MountEntry>& entries = MountTable::Get().GetEntries();
+for (size_t e=0; e < entries.size(); ++e)           // For every mtab entry
+  { const MountEntry* mnt = &entries[e];
     bool found = false;
-    if (wxString(mnt->mnt_fsname, wxConvUTF8).Left(device.Len()) == device)  found=true;   // See if this is a mount for the device we're interested in
-     else if (!symtarget.IsEmpty() && wxString(mnt->mnt_fsname, wxConvUTF8).Left(symtarget.Len()) == symtarget)  found=true;   // Try again with any symlink target
+    if (mnt->device.Left(device.Len()) == device)  found=true;   // See if this is a mount for the device we're interested in
+     else if (!symtarget.IsEmpty() && mnt->device.Left(symtarget.Len()) == symtarget)  found=true;   // Try again with any symlink target
 #else
 int numfs = getmntinfo(&fslist, MNT_NOWAIT);
 if (numfs < 1) return;
@@ -3153,8 +3506,8 @@ for (int i = 0; i < numfs; ++i)
      
     for (size_t n=0; n < RealFilesystemsArray.GetCount(); ++n)  // For DVD-RAM, we're only interested in filesystems like ext2 not eg subfs
 #ifdef __linux__
-      if (wxString(mnt->mnt_type, wxConvUTF8).Left(3) == RealFilesystemsArray.Item(n).Left(3))
-          { mountpts.Add(wxString(mnt->mnt_dir, wxConvUTF8)); break; } // If the type is right,  this mountpt is one we want to store  
+      if (mnt->fstype.Left(3) == RealFilesystemsArray.Item(n).Left(3))
+          { mountpts.Add(mnt->mountpt); break; }    // If the type is right,  this mountpt is one we want to store  
 #else
       if (wxString(fslist[i].f_fstypename, wxConvUTF8).Left(3) == RealFilesystemsArray.Item(n).Left(3))
           { mountpts.Add(wxString(fslist[i].f_mntonname, wxConvUTF8)); break; }
@@ -11,6 +11,7 @@
 
 #include "wx/wx.h"
 #include "wx/config.h"
+#include "wx/thread.h"
 
 #include <fstab.h>
 #ifdef __linux__
@@ -21,6 +22,16 @@
 
 #include "Externs.h"
 
+#include <map>
+#include <vector>
+#include <string>
+
+#if wxVERSION_NUMBER < 2900
+  DECLARE_EVENT_TYPE(UeventType, wxID_ANY)
+#else
+  wxDECLARE_EVENT(UeventType, wxCommandEvent);
+#endif
+
 class MyButtonDialog : public wxDialog
 {
 protected:
@@ -284,8 +295,49 @@ ArrayofDeviceStructs* DeviceStructArray;          // To hold array of DevicesStr
 DeviceAndMountManager* parent;
 };
 
+#ifdef __linux__
+struct MountEntry     // One line of /proc/self/mountinfo
+{
+std::string fsname, dir, type, opts;  // As bytes, so that a struct mntent can point into them
+wxString device, mountpt, fstype;     // The same as wxStrings, for comparing
+};
+
+class MountTable  // A cached copy of the mount table. It's reparsed only when poll() on /proc/self/mountinfo says that something was (un)mounted
+{
+public:
+static MountTable& Get() { static MountTable table; return table; }
+
+const std::vector<MountEntry>& GetEntries() { Refresh(); return m_entries; }
+size_t GetGeneration() { Refresh(); return m_generation; }  // Changes whenever the table is reparsed, so a caller can tell if something was (un)mounted since it last looked. Without mountinfo, that's every call
+const MountEntry* FindByMountpt(const wxString& mountpt);  // The topmost mount there, or NULL. The kernel resolves symlinks in its mountpts, so the caller should too
+const MountEntry* FindByDevice(const wxString& device);    // The first mount of device, or NULL
+size_t FindAllByDevice(const wxString& device, std::vector<const MountEntry*>& entries);
+size_t FindByDevicePrefix(const wxString& prefix, std::vector<const MountEntry*>& entries);  // e.g. all the /dev/sd* mounts
+size_t FindAllByType(const wxString& fstype, std::vector<const MountEntry*>& entries);
+void GetTypes(wxArrayString& fstypes);                     // Each fstype that's currently mounted, once
+struct mntent* AsMntent(const MountEntry* entry);          // What getmntent() would have returned. Like that, it's only valid until the next call
+
+protected:
+MountTable();
+~MountTable();
+void Refresh();                       // Reparse if the kernel says the table has changed
+void Parse();                         // from /proc/self/mountinfo, or from mtab if that can't be opened
+void AddEntry(const MountEntry& entry);
+
+int m_fd;                             // An open fd for /proc/self/mountinfo. -1 means we couldn't, so reparse mtab every time
+bool m_parsed;
+size_t m_generation;                  // Incremented by each Parse()
+std::vector<MountEntry> m_entries;    // In mount order, which is also mtab order
+std::map<wxString, size_t> m_bymountpt;       // Indices into m_entries. An overmount replaces what's beneath
+std::multimap<wxString, size_t> m_bydevice;
+std::multimap<wxString, size_t> m_bytype;
+struct mntent m_mntent;
+};
+#endif // def __linux__
+
 #include "wx/textfile.h"
 class MyUsbDevicesTimer;
+class UeventMonitor;
 #if wxVERSION_NUMBER < 3000
     class MtabPollTimer;
 #endif
@@ -340,6 +392,7 @@ GvfsInfo* m_gvfsinfo;                             // Detects & displays gvfs mou
 ArrayofPartitionStructs* PartitionArray;          // To hold partitions, mountpt, status
 wxString DefaultUsbDevicename;                    // If there's ever an unattached device to configure, use this as its /dev location
 MyUsbDevicesTimer* usbtimer;
+UeventMonitor* m_ueventmonitor;                   // If non-null, kernel uevents tell us when to look for devices, so usbtimer needn't poll
 
 protected:
 void CheckForNovelDevices();                      // Look thru proc/scsi/usb-storage*, checking for unknown devices
@@ -354,6 +407,7 @@ void AddLVMDevice(wxArrayString& array, wxString& dev);       // Called by GetPa
 void FillPartitionArray(bool justpartitions = true);          // Load all known partitions into PartitionArray, find their mountpts etc. Optionally mounted iso-images too
 bool FillPartitionArrayUsingLsblk(bool fixed_only = false);   // Ditto, using lsblk
 bool FillPartitionArrayUsingBlkid();                          // Ditto, using blkid
+void LocateTools();                                           // Find LSBLK etc. Done once startup's finished
 void FindMountedImages();                                     // Add mounted iso-images from mtab to array
 bool MkDir(wxString& mountpt);                                // Make a dir onto which to mount
 bool WeCanUseSmbmnt(wxString& mountpt, bool TestUmount = false);  // Do we have enough kudos to (u)mount with smb
@@ -379,12 +433,72 @@ MtabPollTimer* m_MtabpollTimer;                               // When active, po
 class MyUsbDevicesTimer  :   public wxTimer  // Used by DeviceManager.  Notify() looks for attached Usb drives when the timer 'fires'
 {
 public:
+MyUsbDevicesTimer() : m_EventDriven(false), m_followups(0), m_busy(false), m_idleticks(0), m_mountgeneration(0) {}
 void Init(DeviceAndMountManager* dman){ devman = dman; }
-void Notify(){ devman->CheckForOtherDevices(); }
+void SetEventDriven(bool driven) { m_EventDriven = driven; }
+bool IsEventDriven() const { return m_EventDriven; }
+void Notify();
+void StartFollowups(size_t count);           // Check count times, CHECK_USB_TIMEINTERVAL secs apart. After that, only when the mount table changes, or occasionally for gvfs
+void OnUevent(wxCommandEvent& event);        // A UeventMonitor has seen a device come, go or change its media
 
 protected:
+void Check();                                // Calls CheckForOtherDevices(), unless we're already inside it
+bool MountsChanged();                        // Has anything been (un)mounted since the last Check()? Automounts that produce no uevent are still in the mount table
+
 DeviceAndMountManager* devman;
+bool m_EventDriven;                          // If so we look every tick only for a while after a uevent, as an automounter may take a few seconds to mount the device
+size_t m_followups;                          // How many more every-tick checks to do
+bool m_busy;                                 // CheckForOtherDevices() may show a dialog, during which neither a tick nor a uevent may re-enter it
+size_t m_idleticks;                          // Ticks since the last check. Nothing announces a gvfs mount, so every so often we look anyway
+size_t m_mountgeneration;                    // MountTable's generation when we last looked
+};
+
+#ifdef __linux__
+class UeventSource  // Where a UeventMonitor gets its uevents: the kernel's netlink socket
+{
+public:
+UeventSource() : m_fd(-1) {}
+virtual ~UeventSource() {}
+virtual bool Open() = 0;
+virtual void Close();
+int GetFd() const { return m_fd; }
+
+protected:
+int m_fd;
+};
+
+class NetlinkUeventSource : public UeventSource
+{
+public:
+~NetlinkUeventSource() { Close(); }
+bool Open();
+};
+
+struct UeventDevice   // The monitor's model of a block device, partition or usb device
+{
+wxString subsystem;   // "block" or "usb"
+wxString devtype;     // "disk", "partition" or "usb_device"
+wxString devname;     // e.g. sdb1. Empty for usb devices, which are known only by their devpath
+};
+
+class UeventMonitor : public wxThread  // Listens for uevents on its own thread, keeps a model of the block devices, and tells the UI only about real changes
+{
+public:
+UeventMonitor(wxEvtHandler* sink, UeventSource* source) : wxThread(wxTHREAD_JOINABLE), m_sink(sink), m_source(source) {}
+~UeventMonitor() { delete m_source; }
+
+bool Start();                                 // Opens the source, loads the current devices from /sys, and runs the thread. False if there are no uevents to be had
+
+protected:
+void* Entry();
+void LoadSysDevices();                        // Initialise the model from /sys/class/block
+bool ProcessUevent(const char* buf, size_t len, wxString& change); // Updates the model. Returns true, & fills change with e.g. "add sdb1", if the UI should know
+
+wxEvtHandler* m_sink;
+UeventSource* m_source;
+std::map<wxString, UeventDevice> m_devices;   // Keyed by devpath e.g. /devices/pci0000:00/.../block/sdb/sdb1
 };
+#endif // def __linux__
 
 #if wxVERSION_NUMBER < 3000
 class MtabPollTimer  :   public wxTimer  // Used by DeviceAndMountManager::OnMountSshfs.  Notify() looks for a newly-mounted sshfs mount
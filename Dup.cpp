@@ -282,7 +282,7 @@ switch(Whattodo)                 // NB For Dirs, 'Overwrite' isn't a valid answe
     case DR_Skip:      return CDR_skip;
     case DR_RenameAll: WhattodoifClash = DR_RenameAll;          // Store this in variable, then fall thru into:
     case DR_Rename:    if (!GetNewName(stubpath, lastseg)) return CDR_skip; // Ask for a new name for the terminal segment of path
-                       if (dup)                                      // If we're duping, we don't actually want to rename the original dir, just dup it
+                       if (dup && (!m_tsb || m_tsb->GetCollectorIsMoves())) // If we're duping, we don't actually want to rename the original dir, just dup it. Inside a Paste, though, the dup is just a paste under the new name
                         { wxString origfilepath = stubpath + lastseg, newfilepath = stubpath + newname;
                           int answer = RenameDir(origfilepath, newfilepath, true);
                           if (answer)                               // If the dup worked, make a new UnRedoDup
@@ -360,7 +360,7 @@ switch(Whattodo)
                           
     case DR_RenameAll: WhattodoifClash = DR_RenameAll;              // Store this in variable, then fall thru into:
     case DR_Rename:  if (!GetNewName(destpath, destname)) return CDR_skip;
-                  if (dup)                                          // If we're duping, we don't actually want to rename the original file, just dup it
+                  if (dup && (!m_tsb || m_tsb->GetCollectorIsMoves())) // If we're duping, we don't actually want to rename the original file, just dup it. Inside a Paste, though, the dup is just a paste under the new name
                     { int answer = RenameFile(destpath, destname, newname, true);
                       if (answer)                                   // If the dup worked, make a new UnRedoDup
                         { wxArrayInt IDs; IDs.Add(parent->GetId());
@@ -506,12 +506,17 @@ return false;   // Just to avoid compiler warnings
 }
 
 //static
-int CheckDupRen::RenameFile(wxString& originpath, wxString& originname, wxString& newname, bool dup)  // Renames or Duplicates
+int CheckDupRen::RenameFile(wxString& originpath, wxString& originname, wxString& newname, bool dup, PasteThreadSuperBlock* tsb /*=NULL*/)  // Renames or Duplicates
 {
 wxString oldpath = originpath; if (oldpath.Last() != wxFILE_SEP_PATH) oldpath += wxFILE_SEP_PATH;  // We need the '/' to make the filepaths below
 
 if (!dup) return (wxRenameFile(oldpath+originname, oldpath+newname) ? 2 : false);  // If success, return 2 to tell caller it's a rename, not a dup
                             // If we're here, we're duplicating
+if (tsb)                                    // If there's a superblock, let Paste() do it: a regular file is then queued for a paste thread
+  { wxFileName From(oldpath + originname), To(oldpath);
+    return (MyGenericDirCtrl::Paste(&From, &To, newname, false, false, false, tsb) != MPR_fail);
+  }
+
 FileData stat(oldpath+originname);          // Stat the file, to make sure it's not something else eg a symlink
 if (stat.IsSymlink())                       // If it's a symlink, make a new one
   { if (!stat.IsBrokenSymlink())
@@ -536,7 +541,7 @@ return 1;                                   // to flag a successful dup (as oppo
 }
 
 //static 
-int CheckDupRen::RenameDir(wxString& destpath, wxString& newpth, bool dup)  // Renames or Duplicates
+int CheckDupRen::RenameDir(wxString& destpath, wxString& newpth, bool dup, PasteThreadSuperBlock* tsb /*=NULL*/)  // Renames or Duplicates
 {
 if (!dup)    // If we're renaming rather than duplicating, just do it
      return (wxRenameFile(destpath, newpth) ? 2 : false);  // If success, return 2 to tell caller it's a rename, not a dup
@@ -546,14 +551,21 @@ wxString origpath = destpath, newpath = newpth; // Copy strings: we' re using re
 if (origpath.Last() != wxFILE_SEP_PATH) origpath += wxFILE_SEP_PATH;  // Seem to be needed
 if (newpath.Last() != wxFILE_SEP_PATH) newpath += wxFILE_SEP_PATH;
 
-if (!CheckDupRen::DoDup(origpath, newpath))     // Now do the dup in sub-method
+if (!CheckDupRen::DoDup(origpath, newpath, tsb)) // Now do the dup in sub-method
   return false;
   
 return true;                                    // Return 1 to flag a successful Dup
 }
 
-bool CheckDupRen::DoDup(wxString& originalpath, wxString& newpath)  // Used by DoRename to duplicate dirs
+//static
+bool CheckDupRen::DoDup(wxString& originalpath, wxString& newpath, PasteThreadSuperBlock* tsb /*=NULL*/)  // Used by DoRename to duplicate dirs
 {
+if (tsb)            // If there's a superblock, use Paste(). That makes the subdirs, symlinks and oddities now, and queues the files to be copied by the paste threads
+  { wxString dest = StripSep(newpath);
+    wxFileName From(originalpath), To(dest.BeforeLast(wxFILE_SEP_PATH) + wxFILE_SEP_PATH);
+    return (MyGenericDirCtrl::Paste(&From, &To, dest.AfterLast(wxFILE_SEP_PATH), true, false, false, tsb) != MPR_fail);
+  }
+                    // Otherwise do it here, the slow way
 if (!wxFileName::Mkdir(newpath, 0777, wxPATH_MKDIR_FULL))  // Make the new dir. wxPATH_MKDIR_FULL means intermediate dirs are created too
   { wxLogError(_("Sorry, I couldn't make room for the incoming directory.  A permissions problem maybe?")); return false; }
 
@@ -613,6 +625,130 @@ if (!CreateSymlink(destfilepath, linkfilepath))  return false; // Create a new s
 return true;
 }
 
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#ifndef RENAME_NOREPLACE
+  #define RENAME_NOREPLACE (1 << 0)
+#endif
+
+static int RenameNoReplace(int dirfd, const wxString& from, const wxString& to)  // Within dirfd. Fails with EEXIST rather than overwrite
+{
+#if defined(__LINUX__) && defined(SYS_renameat2)
+  if (syscall(SYS_renameat2, dirfd, (const char*)from.mb_str(wxConvUTF8), dirfd, (const char*)to.mb_str(wxConvUTF8), RENAME_NOREPLACE) == 0) return 0;
+  if ((errno != ENOSYS) && (errno != EINVAL)) return -1;  // EINVAL means this filesystem can't do RENAME_NOREPLACE, so fall back to check-then-rename
+#endif
+struct stat st;
+if (fstatat(dirfd, to.mb_str(wxConvUTF8), &st, AT_SYMLINK_NOFOLLOW) == 0)
+  { errno = EEXIST; return -1; }
+return renameat(dirfd, from.mb_str(wxConvUTF8), dirfd, to.mb_str(wxConvUTF8));
+}
+
+struct RenameBatchStep { int dirfd; wxString from; wxString to; };
+
+static bool DeeperPath(const std::pair<size_t, size_t>& a, const std::pair<size_t, size_t>& b) { return a.first > b.first; }
+
+//static
+bool CheckDupRen::RenameBatch(const wxArrayString& OldFilepaths, const wxArrayString& NewFilepaths, wxString& failure)
+{
+wxCHECK_MSG(OldFilepaths.GetCount() == NewFilepaths.GetCount(), false, wxT("Mismatch in numbers of old/new names"));
+
+  // Do the deepest first, so that a dir's contents are renamed before the dir is. As each rename stays in its own dir, a new name can only
+  // clash with a sibling's old one, which must be at the same depth; so each depth can be completed before the next
+std::vector< std::pair<size_t, size_t> > order;   // depth, index
+for (size_t n=0; n < OldFilepaths.GetCount(); ++n)
+  order.push_back(std::make_pair((size_t)StripSep(OldFilepaths[n]).Freq(wxFILE_SEP_PATH), n));
+std::stable_sort(order.begin(), order.end(), DeeperPath);
+
+std::map<wxString, int> dirfds;                 // Each dir is opened once, and the renames done relative to it. The fd stays valid even if the dir is itself renamed later
+std::vector<RenameBatchStep> done;              // What's been done so far, so that it can be undone if something fails
+unsigned int tempcount = 0;
+int error = 0;
+
+for (size_t start=0; !error && start < order.size(); )
+  { size_t end = start;
+    while (end < order.size() && order[end].first == order[start].first) ++end;
+
+    RenameFilepathSet pending;                  // Old filepaths at this depth that haven't yet moved
+    for (size_t n=start; n < end; ++n)
+      pending.insert(StripSep(OldFilepaths[order[n].second]));
+
+    std::vector<RenameBatchStep> viatemp;       // Renames that had to wait for their new name to be vacated, so went to a temporary name first
+    for (size_t n=start; !error && n < end; ++n)
+      { wxString from = StripSep(OldFilepaths[order[n].second]), to = StripSep(NewFilepaths[order[n].second]);
+        if (from == to) { pending.erase(from); continue; }
+
+        wxString dir = from.BeforeLast(wxFILE_SEP_PATH);
+        if (dir.IsEmpty()) dir = wxFILE_SEP_PATH;
+        if (!dirfds.count(dir))
+          dirfds[dir] = open(dir.mb_str(wxConvUTF8), O_RDONLY | O_DIRECTORY);
+        RenameBatchStep step; step.dirfd = dirfds[dir];
+        step.from = from.AfterLast(wxFILE_SEP_PATH); step.to = to.AfterLast(wxFILE_SEP_PATH);
+        if (step.dirfd == -1 || to.BeforeLast(wxFILE_SEP_PATH) != from.BeforeLast(wxFILE_SEP_PATH))
+          { error = (step.dirfd == -1) ? errno : EXDEV; failure = from; break; }
+
+        if (pending.count(to))                  // Its new name is a sibling's that hasn't moved yet e.g. a->b, b->a. So move aside for now
+          { RenameBatchStep later(step);
+            int ans;
+            do { step.to = wxString::Format(wxT(".4Pane-rename-%lu-%u"), (unsigned long)getpid(), tempcount++);
+                 ans = RenameNoReplace(step.dirfd, step.from, step.to);
+               }
+             while (ans == -1 && errno == EEXIST);
+            if (ans == -1) { error = errno; failure = from; break; }
+            later.from = step.to;
+            viatemp.push_back(later);
+          }
+         else if (RenameNoReplace(step.dirfd, step.from, step.to) == -1)
+          { error = errno; failure = from; break; }
+        done.push_back(step);
+        pending.erase(from);
+      }
+
+    for (size_t n=0; !error && n < viatemp.size(); ++n)   // By now all the old names at this depth have been vacated
+      { if (RenameNoReplace(viatemp[n].dirfd, viatemp[n].from, viatemp[n].to) == -1)
+          { error = errno; failure = viatemp[n].to; break; }
+        done.push_back(viatemp[n]);
+      }
+
+    start = end;
+  }
+
+if (error)                                      // Put back everything that was done, latest first, so a failure doesn't leave things half-renamed
+  { for (size_t n = done.size(); n > 0; --n)
+      RenameNoReplace(done[n-1].dirfd, done[n-1].to, done[n-1].from);
+    failure = wxString::Format(_("Renaming %s failed: %s"), failure.c_str(), wxSysErrorMsg(error));
+  }
+
+for (std::map<wxString, int>::iterator iter = dirfds.begin(); iter != dirfds.end(); ++iter)
+  if (iter->second != -1) close(iter->second);
+
+return !error;
+}
+
+static wxString BatchedPath(const wxString& oldpath, const std::map<wxString, wxString>& renames)  // Rebuild oldpath from the top, giving each segment that was renamed its new name
+{
+if (oldpath.IsEmpty()) return oldpath;
+
+wxString name = oldpath.AfterLast(wxFILE_SEP_PATH);
+std::map<wxString, wxString>::const_iterator iter = renames.find(oldpath);
+if (iter != renames.end()) name = iter->second;
+
+return BatchedPath(oldpath.BeforeLast(wxFILE_SEP_PATH), renames) + wxFILE_SEP_PATH + name;
+}
+
+//static
+void CheckDupRen::BatchedPaths(const wxArrayString& OldFilepaths, const wxArrayString& NewFilepaths, wxArrayString& actual)
+{
+std::map<wxString, wxString> renames;           // Old filepath -> new name
+for (size_t n=0; n < OldFilepaths.GetCount(); ++n)
+  renames[StripSep(OldFilepaths[n])] = StripSep(NewFilepaths[n]).AfterLast(wxFILE_SEP_PATH);
+
+actual.Clear();
+for (size_t n=0; n < OldFilepaths.GetCount(); ++n)
+  actual.Add(BatchedPath(StripSep(OldFilepaths[n]), renames));
+}
+
 //--------------------------------------------------------------------------------------------------------------------------------------
 
 wxArrayString MultipleRename::DoRename()
@@ -647,9 +783,21 @@ do
         if (dlg.ReplaceAllRadio->GetValue()) matches = 0;
           else matches = dlg.MatchSpin->GetValue();
 
+        wxString Repl(ReplaceThis);
+        if (Repl.IsEmpty())                                 // Assume that an empty Replace & non-empty With means replace the whole name
+          { Repl = wxT("^.*$"); matches = 1; }
+          // I'm not sure if it's a bug, or a bug in my regex understanding, but
+          // trying to replace ".*" or ".?" will cause an infinite loop if match==0
+        if ((matches==0) && (Repl==wxT(".*") || Repl==wxT(".?")))
+          matches = 1;
+
+        wxLogNull WeDontWantwxRegExErrorMessages;
+        wxRegEx Expr(Repl);                                 // Compile it just once, not once per file
+        bool UseRegex = Expr.IsValid() && !(ReplaceThis.IsEmpty() && WithThis.IsEmpty());
+
         for (size_t n=0; n < OldFilepaths.GetCount(); ++n)
           { wxFileName fn(OldFilepaths[n]); wxString name = fn.GetFullName();
-            if (DoRegEx(name, ReplaceThis, WithThis, matches))
+            if (UseRegex && DoRegEx(name, Expr, WithThis, matches))
                 { fn.SetFullName(name); NewFilepaths.Add(fn.GetFullPath()); 
                   tempOldFilepaths.Add(OldFilepaths[n]); 
                 }
@@ -667,7 +815,21 @@ do
     wxString Append = ((wxComboBox*)dlg.AppendCombo)->GetValue();
     DoPrependAppend(body, Prepend, Append);
     
+    m_Sources = tempOldFilepaths;
     DoInc(body, dlg.Inc, dlg.IncWith, alwaysinc);
+
+    wxString badname;                                                       // A '/' in a new name e.g. from the regex, would make it a move into another dir
+    for (size_t n=0; n < NewFilepaths.GetCount() && badname.IsEmpty(); ++n)
+      { wxString dir = StripSep(tempOldFilepaths[n]).BeforeLast(wxFILE_SEP_PATH);
+        if (StripSep(NewFilepaths[n]).BeforeLast(wxFILE_SEP_PATH) != dir)
+          badname = StripSep(NewFilepaths[n]).Mid(dir.Len() + 1);
+      }
+    if (!badname.IsEmpty())
+      { wxMessageDialog dialog(parent, wxString::Format(_("The new name \"%s\" contains a '/'. That can't be part of a filename.\nPlease try again"), badname.c_str()),
+                                                              _("Oops!"), wxOK | wxICON_ERROR);
+        dialog.ShowModal();
+        confirm = wxID_NO; continue;                                        // so that the loop offers the dialog again
+      }
     
     MyButtonDialog confirmdlg;                                              // Give the user a chance to reconsider
     wxXmlResource::Get()->LoadDialog(&confirmdlg, MyFrame::mainframe->GetActivePane(),  wxT("ConfirmMultiRenameDlg"));
@@ -692,21 +854,11 @@ OldFilepaths = tempOldFilepaths; // OldFilepaths is a reference, so this keeps t
 return NewFilepaths;
 }
 
-bool MultipleRename::DoRegEx(wxString& String, wxString& ReplaceThis, wxString& WithThis, size_t matches)
+bool MultipleRename::DoRegEx(wxString& String, wxRegEx& Expr, const wxString& WithThis, size_t matches)  // Expr is already compiled by the caller
 {
-if (String.IsEmpty() || (ReplaceThis.IsEmpty() && WithThis.IsEmpty())) return false;
+if (String.IsEmpty()) return false;
 
-wxString Repl(ReplaceThis);                                           // Switch to a local wxString because:
-if (Repl.IsEmpty()) Repl = String;                                    // Assume that an empty Replace & non-empty With means replace whole String
-
-  // I'm not sure if it's a bug, or a bug in my regex understanding, but
-  // trying to replace ".*" or ".?" will cause an infinite loop if match==0
-if ((matches==0) && (Repl==wxT(".*") || Repl==wxT(".?")))
-  matches = 1;
-
-wxLogNull WeDontWantwxRegExErrorMessages;
-wxRegEx Expr(Repl);
-if (Expr.IsValid() && Expr.Matches(String))  
+if (Expr.Matches(String))  
   { Expr.Replace(&String, WithThis, matches);
     return true;
   }
@@ -716,6 +868,11 @@ return false; // Not a match
 
 bool MultipleRename::DoInc(bool body, int InitialValue, int type, bool AlwaysInc)
 {
+m_Taken.clear(); m_Vacated.clear();
+if (!dup)
+  for (size_t n=0; n < m_Sources.GetCount(); ++n)
+    m_Vacated.insert(StripSep(m_Sources[n]));
+
 for (size_t n=0; n < NewFilepaths.GetCount(); ++n)
   { wxString name; wxFileName fn; int start = InitialValue;
     if (AlwaysInc  || CheckForClash(NewFilepaths[n], n))            // If we're always to inc, or if there's a clash
@@ -729,6 +886,7 @@ for (size_t n=0; n < NewFilepaths.GetCount(); ++n)
           
         NewFilepaths[n] = fn.GetFullPath();                         // Write the altered string back to the array
       }
+    m_Taken.insert(StripSep(NewFilepaths[n]));                      // so that later names can't clash with it
   }
 
 return true;
@@ -750,15 +908,32 @@ for (size_t n=0; n < NewFilepaths.GetCount(); ++n)
 return true;
 }
 
-bool MultipleRename::CheckForClash(wxString Filepath, size_t index)       // See if there's already a 'file' with this filepath
+bool MultipleRename::CheckForClash(const wxString& Filepath, size_t index)  // See if there's already a 'file' with this filepath, or there will be
 {
-FileData fd(Filepath);
-if (fd.IsValid()) return true;                                            // Yes, there is
+wxString filepath = StripSep(Filepath);
+if (m_Taken.count(filepath)) return true;                                 // A prior (potential) rename has already claimed it
 
-for (size_t n=0; n < index; ++n)                                          // Now check that a prior (potential) rename won't clash
-  if (NewFilepaths[n] == Filepath) return true;
+ListDir(filepath.BeforeLast(wxFILE_SEP_PATH));
+if (!m_Existing.count(filepath)) return false;
+  // It exists. That's only OK if we're renaming it out of the way; but a file keeping its own name would be a no-op, so that counts as a clash too
+return dup || !m_Vacated.count(filepath) || (index < m_Sources.GetCount() && filepath == StripSep(m_Sources[index]));
+}
+
+void MultipleRename::ListDir(const wxString& dir)
+{
+if (m_ListedDirs.Index(dir) != wxNOT_FOUND) return;
+m_ListedDirs.Add(dir);
 
-return false;
+wxLogNull NoErrorMessages;
+wxDir d(dir.IsEmpty() ? wxString(wxFILE_SEP_PATH) : dir);
+if (!d.IsOpened()) return;
+
+wxString filename;
+bool cont = d.GetFirst(&filename, wxEmptyString, wxDIR_FILES | wxDIR_DIRS | wxDIR_HIDDEN);
+while (cont)
+  { m_Existing.insert(dir + wxFILE_SEP_PATH + filename);
+    cont = d.GetNext(&filename);
+  }
 }
 
 //static
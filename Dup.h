@@ -10,8 +10,12 @@
 #define DUPH
 #include "wx/wx.h"
 #include <wx/spinctrl.h>
+#include "wx/hashset.h"
 
 class PasteThreadSuperBlock;
+class wxRegEx;
+
+WX_DECLARE_HASH_SET(wxString, wxStringHash, wxStringEqual, RenameFilepathSet);
 
 class CheckDupRen
 {
@@ -23,9 +27,11 @@ bool CheckForAccess(bool recurse = true);   // This is a convenient place to che
 bool CheckForIncest();                      // Ensure we don't try to move a dir onto a descendant --- which would cause an indef loop
 enum CDR_Result CheckForPreExistence();     // Ensure we don't accidentally overwrite
 int CheckForPreExistenceInArchive();        // Should we overwrite or dup inside an archive
-static int RenameFile(wxString& originpath, wxString& originname, wxString& newname, bool dup);  // The ultimate mechanisms.  Static as used by UnRedo too
-static int RenameDir(wxString& destpath, wxString& newpath, bool dup);
+static int RenameFile(wxString& originpath, wxString& originname, wxString& newname, bool dup, PasteThreadSuperBlock* tsb = NULL);  // The ultimate mechanisms.  Static as used by UnRedo too
+static int RenameDir(wxString& destpath, wxString& newpath, bool dup, PasteThreadSuperBlock* tsb = NULL);  // If a tsb is passed, a dup's files are queued in it to be copied by threads
 static bool MultipleRename(wxWindow* parent, wxArrayString& OldFilepaths, wxArrayString& NewFilepaths, bool dup);
+static bool RenameBatch(const wxArrayString& OldFilepaths, const wxArrayString& NewFilepaths, wxString& failure); // Renames them all, or if one fails, none. Copes with permutations e.g. a->b, b->a
+static void BatchedPaths(const wxArrayString& OldFilepaths, const wxArrayString& NewFilepaths, wxArrayString& actual); // Where each item really is after RenameBatch(): a child's NewFilepath still has its parent's old name
 static bool ChangeLinkTarget(wxString& linkfilepath, wxString& destfilepath);    // Here for convenience:  change the target of a symlink
 void SetTSB(PasteThreadSuperBlock* tsb) { m_tsb = tsb; }
 wxString finalpath;
@@ -62,7 +68,7 @@ CDR_Result FileAdjustForPreExistence(bool intoArchive = false, time_t modtime =
 enum DupRen OfferToRename(int dialogversion, bool intoArchive = false, time_t modtime = 0);
 bool GetNewName(wxString& destpath, wxString& destname);
 
-static bool DoDup(wxString& originalpath, wxString& newpath);  // Used by RenameDir to duplicate dirs, so must be static too
+static bool DoDup(wxString& originalpath, wxString& newpath, PasteThreadSuperBlock* tsb = NULL);  // Used by RenameDir to duplicate dirs, so must be static too
 };
 
 class MultipleRenameDlg  :  public wxDialog
@@ -103,10 +109,11 @@ MultipleRename(wxWindow* dad, wxArrayString& OldFP, bool duplicate) : parent(dad
 wxArrayString DoRename();
 static wxString IncText(int type, int start);
 protected:
-bool DoRegEx(wxString& String, wxString& ReplaceThis, wxString& WithThis, size_t matches );
+bool DoRegEx(wxString& String, wxRegEx& Expr, const wxString& WithThis, size_t matches);
 bool DoPrependAppend(bool body, wxString& Prepend, wxString& Append);
 bool DoInc(bool body, int InitialValue, int type, bool AlwaysInc);
-bool CheckForClash(wxString Filepath, size_t index);
+bool CheckForClash(const wxString& Filepath, size_t index);
+void ListDir(const wxString& dir);          // Add dir's contents to m_Existing, if they're not there already
 void LoadHistory();
 void SaveHistory();
 
@@ -114,8 +121,14 @@ enum { digit, upper, lower };
 wxWindow* parent;
 wxArrayString& OldFilepaths; // This must be a reference, otherwise an only-alter-matching-files situation will make caller lose registration
 wxArrayString NewFilepaths;
+wxArrayString m_Sources;     // The filepaths that NewFilepaths will be renamed from
 bool dup;
 MultipleRenameDlg dlg;
+
+RenameFilepathSet m_Existing;  // Every filepath in the dirs we're renaming in, read once rather than stat-ing each candidate name
+wxArrayString m_ListedDirs;
+RenameFilepathSet m_Vacated;   // For a rename, the current filepaths: they'll all be free by the time the renames finish
+RenameFilepathSet m_Taken;     // The new filepaths already allotted
 };
 
 #endif
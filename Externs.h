@@ -58,7 +58,6 @@ extern enum emptyable CanFoldertreeBeEmptied(wxString path);      // In Filetype
 extern bool HasThisDirSubdirs(wxString& dirname);                 // In Filetypes, used in DirGenericDirCtrl::ReloadTree()
 extern bool ReallyIsDir(const wxString& path, const wxString& item); // In Filetypes, used in DirGenericDirCtrl::ExpandDir
 extern bool RecursivelyGetFilepaths(wxString path, wxArrayString& array);  // Global recursively to fill array with all descendants of this dir
-extern wxULongLong GetDirSizeRecursively(wxString& dirname);      // Get the recursive size of the dir's contents  Used by FileGenericDirCtrl::UpdateStatusbarInfo
 extern wxULongLong GetDirSize(wxString& dirname);                 // Get the non-recursive size of the dir's contents  Used by FileGenericDirCtrl::UpdateStatusbarInfo
 extern bool ContainsRelativeSymlinks(wxString fd);                // Used by MyGenericDirCtrl::Move to see if a relative symlink is present (as it Moves differently)
 
@@ -140,6 +139,9 @@ extern sutype WHICH_EXTERNAL_SU;                      // If WHICH_SU == mysu, th
 extern wxString OTHER_SU_COMMAND;                     // A user-provided kdesu-equivalent, used when WHICH_SU==othersu
 
 extern bool LIBLZMA_LOADED;
+extern bool LIBZ_LOADED;
+extern bool LIBZSTD_LOADED;
+extern bool LIBLZ4_LOADED;
 
 extern const bool ISLEFT;         // The flag for a directory window
 extern const bool ISRIGHT;        //  as opposed to a file window
@@ -147,7 +149,11 @@ extern const bool ISRIGHT;        //  as opposed to a file window
 extern bool SHOW_RECURSIVE_FILEVIEW_SIZE;
 extern bool RETAIN_REL_TARGET;              // If we Move a relative symlink, keep the original target
 extern bool RETAIN_MTIME_ON_PASTE;          // Should Move/Paste keep the modification time of the origin file
+extern bool DURABLE_PASTE;                  // Should Paste write to a temporary file, sync it, then rename it into place
 extern size_t MAX_NUMBER_OF_UNDOS;          // Amount of memory to allocate for UnRedo
+extern bool PERSISTENT_UNDO;                // Should the UnRedo history survive a restart
+extern bool USE_DIR_CACHE;                  // Should dirs' stat data be cached between sessions, so panes fill without a stat per file
+extern size_t DIR_CACHE_MAX_ENTRIES;        // If so, how many files' data to keep before discarding the least-recently-used dirs
 extern size_t MAX_NUMBER_OF_PREVIOUSDIRS;   // Similarly for previously-visited dirs
 extern size_t MAX_DROPDOWN_DISPLAY;         // How many to display at a time on a dropdown menu
 extern size_t MAX_COMMAND_HISTORY;          // How many recent commands from eg grep or locate, should be stored
@@ -337,6 +343,22 @@ enum                  //  menuitem IDs
   SHCUT_NAVIGATE_DIR_PREVIOUS,
   SHCUT_NAVIGATE_DIR_NEXT,
 
+  SHCUT_PERSISTENT_UNDO, // Keep the Undo history between sessions
+
+  SHCUT_FLAT_VIEW, // In the current fileview, list every file below the dir, not just its children
+
+  SHCUT_DIR_CACHE, // Cache dir listings between sessions
+
+  SHCUT_PASTE_DEDUP, // Paste, merging into existing dirs & skipping files that the dest already has
+
+  SHCUT_TOOL_DUPLICATES, // Find files with identical contents
+
+  SHCUT_SHOW_JOBS, // Show the panel of queued & running background jobs
+
+  SHCUT_DURABLE_PASTE, // Paste each file to disk before it gets its real name, so a crash can't leave a truncated one
+
+  SHCUT_RESUME_PASTE, // Resume a paste that was interrupted by a crash, an exit or a vanished disk
+
 
   // *****
 
@@ -428,9 +450,9 @@ enum devicestructignore { DS_false = 0, DS_true, DS_defer };     // Do we wish t
 enum ConfigDeviceType { CDT_fixed = 0, CDT_removable };          // Makes it easier to reuse a dialog class for both fixed and usb devices
 
 enum ziptype
- { zt_gzip, zt_bzip, zt_lzma, zt_xz, zt_lzop, zt_compress, zt_lastcompressed = zt_compress,
+ { zt_gzip, zt_bzip, zt_lzma, zt_xz, zt_lzop, zt_compress, zt_zstd, zt_lz4, zt_lastcompressed = zt_lz4,
    zt_firstarchive, zt_taronly = zt_firstarchive, zt_cpio, zt_rpm, zt_ar, zt_deb,
-   zt_firstcompressedarchive, zt_targz = zt_firstcompressedarchive, zt_tarbz, zt_tarlzma, zt_tarxz, zt_tar7z, zt_tarlzop, zt_taZ, zt_7z, zt_zip, zt_rar, zt_htb, zt_lastcompressedarchive = zt_htb,
+   zt_firstcompressedarchive, zt_targz = zt_firstcompressedarchive, zt_tarbz, zt_tarlzma, zt_tarxz, zt_tar7z, zt_tarlzop, zt_taZ, zt_tarzst, zt_tarlz4, zt_7z, zt_zip, zt_rar, zt_htb, zt_lastcompressedarchive = zt_htb,
    zt_invalid 
  };
 
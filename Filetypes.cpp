@@ -109,6 +109,16 @@ if (!defererence)
 SetType();
 }
 
+FileData::FileData(const wxString& filepath, const struct stat& st)  :  Filepath(filepath)
+{
+IsFake = false;
+statstruct = new struct stat(st);
+symlinkdestination = NULL;                                        // A symlink would need its target's data too, so DirCache doesn't store them
+result = 0;
+
+SetType();
+}
+
 void FileData::SetType()  // Called in ctor to set DataBase::Type
 {
 if (IsDir())    { Type = DIRTYPE; return; }
@@ -662,45 +672,15 @@ closedir(dirp); return false;
 }
 
 
-wxULongLong globalcumsize;                // Threads? What are threads...? :p
-
-#include <ftw.h>
-int AddToCumSize(const char *filename, const struct stat *statptr, int flags, struct FTW *unused)
-{
-if ((flags & FTW_F) == FTW_F)                                 // If this is a regular file or similar, add its size to the total
-  globalcumsize += statptr->st_size;
-return 0;
-}
-
-wxULongLong GetDirSizeRecursively(wxString& dirname)  // Get the recursive size of the dir's contents  Used by FileGenericDirCtrl::UpdateStatusbarInfo
-{
-globalcumsize = 0;
-int result = nftw(dirname.mb_str(wxConvUTF8), AddToCumSize, 5,  FTW_PHYS | FTW_MOUNT);
-if (result==0) return globalcumsize;
- else return 0;
-}
-
 wxULongLong GetDirSize(wxString& dirname)  // Get the, non-recursive, size of the dir's contents (or the file's size if a file is passed)  Used by FileGenericDirCtrl::UpdateStatusbarInfo
 {
-DIR* dp;
-struct dirent* ep;
 wxULongLong cumsize = 0;
 
 FileData filepath(dirname);
 if (!filepath.IsValid()) return cumsize;  // which will be 0
 if (!filepath.IsDir() && !filepath.IsSymlinktargetADir(true)) return (cumsize = filepath.Size());  // If it's not a dir, return the file's size
 
-dp = opendir (dirname.mb_str(wxConvUTF8));
-if (dp != NULL)
-  { while  ((ep = readdir (dp)) != NULL)
-      { wxString fname(ep->d_name, wxConvUTF8);
-        if (fname == wxT(".") || fname == wxT("..")) continue;// Check we're not trying to count . or ..
-        FileData fd(dirname + wxFILE_SEP_PATH + fname);       // Make a filedata with the filepath in question
-        if (fd.IsValid())   cumsize += fd.Size();             //  and add its size to cumsize
-      }
-    (void) closedir (dp);
-  }
-
+DirSizeService::ScanDir(dirname, cumsize, true);  // Add the size of every child
 return cumsize;
 }
 
@@ -1448,51 +1428,50 @@ if (NoOfExts > 1)          // If there are >1 ext.s, allow the user to chose whi
 for (size_t sel=0; sel < selections.GetCount(); ++sel)        // For every ext that found its way into the int-array
   { wxString Ext = choices[ selections[sel] ].Lower();        // Get the string from string-array
     flag=false;    
-    for (size_t n=0; n < Extdata.GetCount(); ++n)             // Go thru Extdata array, trying to match 1 of its known ext.s to the given one
-      { if (Extdata[n]->Ext.Lower() == Ext)                   // Found it, so see if we're really changing the default applic, or just editing the old one
-          { wxString ftypecommand = ftype.Command;            // Comparison is much easier if we don't have to worry about InTerminal  prefixes in either comparator
-            if (ftypecommand.Contains(wxT("$OPEN_IN_TERMINAL ")))     ftypecommand.Replace(wxT("$OPEN_IN_TERMINAL "), wxT(""));
-            wxString defaultcommand = Extdata[n]->Default.Command;
-            if (defaultcommand.Contains(wxT("$OPEN_IN_TERMINAL ")))   defaultcommand.Replace(wxT("$OPEN_IN_TERMINAL "), wxT(""));
-            
-            if (!defaultcommand.IsEmpty()  &&  defaultcommand != ftypecommand)  // See if the current DefaultCommand is the same as the new one.  If so, nothing to do
-              { wxString msg; msg.Printf(_("Replace %s\nwith %s\nas the default command for files of type %s?"),
-                  Extdata[n]->Default.Label.c_str(), ftype.AppName.c_str(), Ext.c_str());  // If different command, check it was intended
-
-                int result(0);
-                if (!noconfirm)
-                  { MyButtonDialog ApplyToAllDlg;
-                    wxLogNull nocantfindmessagesthanks;
-                    bool ATAdlgFound = wxXmlResource::Get()->LoadDialog(&ApplyToAllDlg, mydlg, wxT("ApplyToAllDlg"));
-                    if (ATAdlgFound)
-                      { ((wxStaticText*)ApplyToAllDlg.FindWindow(wxT("m_MessageTxt")))->SetLabel(msg);
-                        ApplyToAllDlg.Fit();
-                        result = ApplyToAllDlg.ShowModal();
-                        if (((wxCheckBox*)ApplyToAllDlg.FindWindow(wxT("m_ApplyToAllCheck")))->IsChecked()) // If the user doesn't want to be asked multiple times...
-                          { if (result == wxID_YES)  noconfirm = true;  // this will accept all
-                             else 
-                               { sel=selections.GetCount(); flag=true;  break; } // If this one wasn't wanted, apply-to-all means 'no to all the rest'
-                          }
-                      }
-                     else // Old xrc file, so use the original way
-                      { wxMessageDialog dialog(mydlg, msg, _("Are you sure?"), wxYES_NO | wxICON_QUESTION);
-                        result = dialog.ShowModal();
+    int n = FindExt(Ext);                                     // See if it's one of Extdata's known ext.s
+    if (n != wxNOT_FOUND)                                     // Found it, so see if we're really changing the default applic, or just editing the old one
+      { wxString ftypecommand = ftype.Command;            // Comparison is much easier if we don't have to worry about InTerminal  prefixes in either comparator
+        if (ftypecommand.Contains(wxT("$OPEN_IN_TERMINAL ")))     ftypecommand.Replace(wxT("$OPEN_IN_TERMINAL "), wxT(""));
+        wxString defaultcommand = Extdata[n]->Default.Command;
+        if (defaultcommand.Contains(wxT("$OPEN_IN_TERMINAL ")))   defaultcommand.Replace(wxT("$OPEN_IN_TERMINAL "), wxT(""));
+      
+        if (!defaultcommand.IsEmpty()  &&  defaultcommand != ftypecommand)  // See if the current DefaultCommand is the same as the new one.  If so, nothing to do
+          { wxString msg; msg.Printf(_("Replace %s\nwith %s\nas the default command for files of type %s?"),
+              Extdata[n]->Default.Label.c_str(), ftype.AppName.c_str(), Ext.c_str());  // If different command, check it was intended
+
+            int result(0);
+            if (!noconfirm)
+              { MyButtonDialog ApplyToAllDlg;
+                wxLogNull nocantfindmessagesthanks;
+                bool ATAdlgFound = wxXmlResource::Get()->LoadDialog(&ApplyToAllDlg, mydlg, wxT("ApplyToAllDlg"));
+                if (ATAdlgFound)
+                  { ((wxStaticText*)ApplyToAllDlg.FindWindow(wxT("m_MessageTxt")))->SetLabel(msg);
+                    ApplyToAllDlg.Fit();
+                    result = ApplyToAllDlg.ShowModal();
+                    if (((wxCheckBox*)ApplyToAllDlg.FindWindow(wxT("m_ApplyToAllCheck")))->IsChecked()) // If the user doesn't want to be asked multiple times...
+                      { if (result == wxID_YES)  noconfirm = true;  // this will accept all
+                         else 
+                           { sel=selections.GetCount(); flag=true;  break; } // If this one wasn't wanted, apply-to-all means 'no to all the rest'. The break leaves the selections loop
                       }
                   }
-
-                if (noconfirm || (result == wxID_YES))
-                  { Extdata[n]->Default.Label = ftype.AppName; // If intended, substitute the new command
-                    Extdata[n]->Default.Command = ftype.Command;
-                    Extdata[n]->Default.WorkingDir = ftype.WorkingDir;
+                 else // Old xrc file, so use the original way
+                  { wxMessageDialog dialog(mydlg, msg, _("Are you sure?"), wxYES_NO | wxICON_QUESTION);
+                    result = dialog.ShowModal();
                   }
               }
-             else 
-              { Extdata[n]->Default.Command = ftype.Command;  // If there wasn't a default command before, there is now!
+
+            if (noconfirm || (result == wxID_YES))
+              { Extdata[n]->Default.Label = ftype.AppName; // If intended, substitute the new command
+                Extdata[n]->Default.Command = ftype.Command;
                 Extdata[n]->Default.WorkingDir = ftype.WorkingDir;
-                Extdata[n]->Default.Label = ftype.AppName;
               }
-            flag=true; break;                                 // Flag we've done it
           }
+         else 
+          { Extdata[n]->Default.Command = ftype.Command;  // If there wasn't a default command before, there is now!
+            Extdata[n]->Default.WorkingDir = ftype.WorkingDir;
+            Extdata[n]->Default.Label = ftype.AppName;
+          }
+        flag=true;                                        // Flag we've done it
       }
     if (flag) continue;    
     
@@ -1507,7 +1486,7 @@ for (size_t sel=0; sel < selections.GetCount(); ++sel)        // For every ext t
     app->Command = ftype.Command;                             //  & Command
     app->WorkingDir = ftype.WorkingDir;                       //  & WorkingDir
     extstruct->Applics.Add(app);                              //  & add to extstruct
-    Extdata.Add(extstruct);                                   // Add struct to main structarray
+    AddExtdata(extstruct);                                    // Add struct to main structarray
   }
   
 return true;
@@ -1518,9 +1497,9 @@ void FiletypeManager::RemoveDefaultApplication(struct Filetype_Struct& ftype)  /
 wxStringTokenizer tkz(ftype.Ext, wxT(","));                   // First tokenise ftype.Ext, in case there's more than one extension
 while (tkz.HasMoreTokens())                                   // Do every ext in a loop
   { wxString Ext = tkz.GetNextToken().Strip(wxString::both);  // Get an ext, removing surrounding white space
-    for (size_t n=0; n < Extdata.GetCount(); ++n)             // Go thru Extdata array, trying to match ext
-      if (Extdata[n]->Ext.Lower() == Ext.Lower())
-        { Extdata[n]->Default.Clear(); break; }               // Clear default data
+    int n = FindExt(Ext);
+    if (n != wxNOT_FOUND)
+      Extdata[n]->Default.Clear();                            // Clear default data
   }
 }
 
@@ -1531,21 +1510,20 @@ wxStringTokenizer tkz(ftype.Ext, wxT(","));                   // First tokenise
 while (tkz.HasMoreTokens())                                   // Do every ext in a loop
   { wxString Ext = tkz.GetNextToken().Strip(wxString::both);  // Get an ext, removing surrounding white space
     flag=false;
-    for (size_t n=0; n < Extdata.GetCount(); ++n)             // Go thru Extdata array, trying to match 1 of its known ext.s to the given one
-      { bool found = false;
-        if (Extdata[n]->Ext.Lower() == Ext.Lower())           // Found ext
-          { for (size_t a=0; a < Extdata[n]->Applics.GetCount(); ++a)// Now look thru its applics
-              if (Extdata[n]->Applics[a]->Label == ftype.AppName)  // If labels match, don't add.  Even if the commands differ, we list by label
-                { found = true; break; }
-            if (!found)                                       // If the applic isn't already there, add it
-              { struct Applicstruct* app = new struct Applicstruct;  // Make a new struct for the applic bits
-                app->Label = ftype.AppName;                   // Store the label bit
-                app->Command = ftype.Command;                 //  & Command
-                app->WorkingDir = ftype.WorkingDir;           //  & WorkingDir
-                Extdata[n]->Applics.Add(app);                 //  & add to extstruct
-              }
-            flag=true; break;                                 // Flag we've done it
+    int n = FindExt(Ext);                                     // See if it's one of Extdata's known ext.s
+    bool found = false;
+    if (n != wxNOT_FOUND)                                     // Found ext
+      { for (size_t a=0; a < Extdata[n]->Applics.GetCount(); ++a)// Now look thru its applics
+          if (Extdata[n]->Applics[a]->Label == ftype.AppName)  // If labels match, don't add.  Even if the commands differ, we list by label
+            { found = true; break; }
+        if (!found)                                       // If the applic isn't already there, add it
+          { struct Applicstruct* app = new struct Applicstruct;  // Make a new struct for the applic bits
+            app->Label = ftype.AppName;                   // Store the label bit
+            app->Command = ftype.Command;                 //  & Command
+            app->WorkingDir = ftype.WorkingDir;           //  & WorkingDir
+            Extdata[n]->Applics.Add(app);                 //  & add to extstruct
           }
+        flag=true;                                        // Flag we've done it
       }
     if (flag) continue;                        
                 
@@ -1559,7 +1537,7 @@ while (tkz.HasMoreTokens())                                   // Do every ext in
     app->WorkingDir = ftype.WorkingDir;                       //  & WorkingDir
     extstruct->Applics.Add(app);                              //  & add to extstruct
     
-    Extdata.Add(extstruct);                                   // Add extstruct to main structarray
+    AddExtdata(extstruct);                                    // Add extstruct to main structarray
   }
 }
 
@@ -1570,16 +1548,14 @@ wxStringTokenizer tkz(ftype.Ext, wxT(","));                   // First tokenise
 while (tkz.HasMoreTokens())                                   // Do every ext in a loop
   { wxString Ext = tkz.GetNextToken().Strip(wxString::both);  // Get an ext, removing surrounding white space
 
-    for (size_t n=0; n < Extdata.GetCount(); ++n)             // Go thru Extdata array, trying to match ext
-      if (Extdata[n]->Ext.Lower() == Ext.Lower())             // Found ext
-        { for (size_t a=0; a < Extdata[n]->Applics.GetCount(); ++a)// Now look thru its applics
-            if (Extdata[n]->Applics[a]->Label == ftype.AppName)    // If labels match, delete.  Even if the commands differ, we list by label
-              { struct Applicstruct* temp = Extdata[n]->Applics[a];  // Store applic while it's removed
-                Extdata[n]->Applics.RemoveAt(a);              // Remove it from array
-                delete temp;                                  //   & delete it
-              }
-          break;                         // If we're here, no such applic in the ext.  Break: there won't be another match for this ext
-        }
+    int n = FindExt(Ext);
+    if (n != wxNOT_FOUND)                                     // Found ext
+      for (size_t a=0; a < Extdata[n]->Applics.GetCount(); ++a)  // Now look thru its applics
+        if (Extdata[n]->Applics[a]->Label == ftype.AppName)   // If labels match, delete.  Even if the commands differ, we list by label
+          { struct Applicstruct* temp = Extdata[n]->Applics[a];  // Store applic while it's removed
+            Extdata[n]->Applics.RemoveAt(a);                  // Remove it from array
+            delete temp;                                      //   & delete it
+          }
   }
 }
 
@@ -1840,9 +1816,80 @@ for (size_t n=0; n < count; ++n)
     Extdata.Add(extstruct);                                   // Finished this ext.  Add struct to main structarray
   }
 
+RebuildExtIndex();
 ExtdataLoaded = true;
 }
 
+int FiletypeManager::FindExt(const wxString& Ext) const  // Returns Ext's index in Extdata, or wxNOT_FOUND
+{
+ExtIndexHash::const_iterator iter = m_ExtIndex.find(Ext.Lower());
+return (iter == m_ExtIndex.end()) ? wxNOT_FOUND : iter->second;
+}
+
+void FiletypeManager::AddExtdata(struct FiletypeExts* extstruct)  // Append to Extdata, & index it
+{
+Extdata.Add(extstruct);
+int index = (int)Extdata.GetCount() - 1;
+wxString ext = extstruct->Ext.Lower();
+if (m_ExtIndex.find(ext) == m_ExtIndex.end())                // If an ext is there twice (e.g. historical 'txt' and 'TXT') the first wins, as it always did
+  m_ExtIndex[ext] = index;
+m_ExtTrie.Add(ext, index);
+}
+
+void FiletypeManager::RebuildExtIndex()
+{
+m_ExtIndex.clear(); m_ExtTrie.Clear();
+for (size_t n=0; n < Extdata.GetCount(); ++n)
+  { wxString ext = Extdata[n]->Ext.Lower();
+    if (m_ExtIndex.find(ext) == m_ExtIndex.end())
+      m_ExtIndex[ext] = (int)n;
+    m_ExtTrie.Add(ext, (int)n);
+  }
+}
+
+void ExtSuffixTrie::Add(const wxString& ext, int index)  // ext must be lower-case. If it's already there, the earlier index is kept
+{
+if (ext.empty()) return;
+
+size_t node = 0;
+wxString rest(ext);
+while (true)
+  { wxString part = rest.AfterLast(wxT('.'));                // The rightmost part first
+    std::map<wxString, size_t>::const_iterator iter = m_nodes[node].children.find(part);
+    if (iter != m_nodes[node].children.end())
+      node = iter->second;
+     else
+      { m_nodes.push_back(Node());                            // NB this may invalidate references into m_nodes, so don't hold any
+        m_nodes[node].children[part] = m_nodes.size() - 1;
+        node = m_nodes.size() - 1;
+      }
+    if (rest.Find(wxT('.')) == wxNOT_FOUND) break;
+    rest = rest.BeforeLast(wxT('.'));
+  }
+
+if (m_nodes[node].index == -1) m_nodes[node].index = index;
+}
+
+void ExtSuffixTrie::Find(const wxString& filename, wxArrayInt& indices) const  // Fills indices with filename's known exts' Extdata indices, longest first
+{
+indices.Clear();
+if (filename.empty()) return;
+                  // As in FiletypeManager::DeduceExt(), the candidates are everything after each dot or, if there's no dot, the whole filename
+wxString rest = filename.Lower();
+bool hasdot = (rest.Find(wxT('.')) != wxNOT_FOUND);
+size_t node = 0;
+while (true)
+  { bool lastpart = (rest.Find(wxT('.')) == wxNOT_FOUND);   // i.e. the part before the first dot
+    std::map<wxString, size_t>::const_iterator iter = m_nodes[node].children.find(rest.AfterLast(wxT('.')));
+    if (iter == m_nodes[node].children.end()) break;
+    node = iter->second;
+    if (lastpart && hasdot) break;                            // This would be the whole filename, which isn't a candidate if there's an ext
+    if (m_nodes[node].index != -1) indices.Insert(m_nodes[node].index, 0); // Insert, so that the longer match comes first
+    if (lastpart) break;
+    rest = rest.BeforeLast(wxT('.'));
+  }
+}
+
 
 void FiletypeManager::SaveExtdata(wxConfigBase* conf /*= NULL*/)  // Save the file containing preferred Ext:Applic data
 {
@@ -2019,8 +2066,7 @@ wxCHECK_MSG(false, false, wxT("Unreachable code"));
 
 bool FiletypeManager::OpenUsingBuiltinMethod(const wxString& filepath, wxArrayString& commands, bool JustOpen)
 {
-if (DeduceExt())
-  if (GetLaunchCommandFromExt())                              // If true, Array[0] now contains the launch command eg kedit %s
+if (GetLaunchCommandFromExt())                                // If true, Array[0] now contains the launch command eg kedit %s
     { wxString open = ParseCommand();                         //  Parse combines this with filepath eg  kedit '/home/david/my.txt'
       bool usingsu = (force_kdesu || (!stat->CanTHISUserRead())); // While we still have stat-access, check if we'll need kdesu
       Openfunction(open, usingsu);                            // Do the rest in submethod, shared by 'Open with'
@@ -2176,24 +2222,25 @@ do                                // There IS a .ext
 return true;
 }
 
-bool FiletypeManager::GetLaunchCommandFromExt()  // FiletypeManager::Array contains a list of possible ext.s, created in DeduceExt()
+bool FiletypeManager::GetLaunchCommandFromExt()  // Find the default command for filepath's longest known ext, & put it in Array
 {
-if (!Array.GetCount()) return false;                    // Shouldn't happen
-
-for (size_t e=0; e < Extdata.GetCount(); ++e)           // Go thru Extdata array, trying to match 1 of its known ext.s to one of the file's ones
-  for (size_t n=0; n < Array.GetCount(); ++n)           // There may be >1 offerings in Array
-    if (Array[n].Lower() == Extdata[e]->Ext.Lower())    // Got one
-      if (!Extdata[e]->Default.Command.IsEmpty())       // See if there's a default command
-        { Array.Clear();                                // If so, put it in the Array, flagging its presence by returning true
-          wxString command;
-            // If there's a working dir to cd into first, we need a shell + dquotes. The next global function does that
-          PPath_returncodes ans = PrependPathToCommand(Extdata[e]->Default.WorkingDir, Extdata[e]->Default.Command, wxT('\"'), command, true);
-          if (ans == Oops) return false;
-          if (ans == needsquote) command << wxT('\"');  // The command now starts with sh -c, so we need to close the quote
+if (filepath.IsEmpty()) return false;
 
-          Array.Add(command);
-          return true;
-        }   // Otherwise carry on thru the Array, in case a later entry works eg prog.0.3.1.tar.gz might succeed with tar.gz, but not 0.3.1.tar.gz
+wxArrayInt candidates; m_ExtTrie.Find(filepath.AfterLast(wxFILE_SEP_PATH), candidates);  // The file's known ext.s, longest first eg tar.gz, then gz
+for (size_t c=0; c < candidates.GetCount(); ++c)
+  { int e = candidates[c];
+    if (!Extdata[e]->Default.Command.IsEmpty())       // See if there's a default command
+      { Array.Clear();                                // If so, put it in the Array, flagging its presence by returning true
+        wxString command;
+          // If there's a working dir to cd into first, we need a shell + dquotes. The next global function does that
+        PPath_returncodes ans = PrependPathToCommand(Extdata[e]->Default.WorkingDir, Extdata[e]->Default.Command, wxT('\"'), command, true);
+        if (ans == Oops) return false;
+        if (ans == needsquote) command << wxT('\"');  // The command now starts with sh -c, so we need to close the quote
+
+        Array.Add(command);
+        return true;
+      }   // Otherwise carry on thru the candidates, in case a shorter one has a default eg prog.tar.gz might succeed with gz, but not tar.gz
+  }
 
 return false;                                           // No match
 }
@@ -2224,14 +2271,10 @@ LoadExtdata();                                              // Save & reload the
 
 int FiletypeManager::GetDefaultApplicForExt(const wxString& Ext)  // Given an ext, find its default applic, if any. Returns -1 if none
 {
-for (size_t e=0; e < Extdata.GetCount(); ++e)               // Go thru Extdata array, trying to match 1 of its known ext.s to Ext
-  if (Extdata[e]->Ext.Lower() == Ext.Lower())                               // Got it
-    { if (Extdata[e]->Default.Command.IsEmpty())            // See if there's a default command
-        return -1;                                          // Nope
-      return e;                                             // There is, so return its index
-    }
-    
-return -1;
+int e = FindExt(Ext);
+if (e == wxNOT_FOUND || Extdata[e]->Default.Command.IsEmpty())  // See if there's a default command
+  return -1;                                                // Nope
+return e;                                                   // There is, so return its index
 }
 
 bool FiletypeManager::GetApplicExtsDefaults(const struct Filetype_Struct& ftype, wxTextCtrl* text)  // Fill textctrl, & see if applic is default for any of its ext.s
@@ -2277,14 +2320,10 @@ wxString ext = Ext.BeforeFirst(wxT(','));                   // The passed Ext ma
 wxString command = ftype.Command;  // The stored command may start with the InTerminal flag, but this would have been temporarily stripped during OnEditApplication()
 if (command.Contains(wxT("$OPEN_IN_TERMINAL "))) command.Replace(wxT("$OPEN_IN_TERMINAL "), wxT("")); // So provide the trucated version for the comparison too
 
-for (size_t e=0; e < Extdata.GetCount(); ++e)               // Go thru Extdata array, trying to find ext
-  if (Extdata[e]->Ext.Lower() == ext.Lower())
-    { if (Extdata[e]->Default.Label == ftype.AppName && (Extdata[e]->Default.Command == ftype.Command || Extdata[e]->Default.Command == command))
-            return true;                                    // If everything matches, return the Ext
-       else   return false;
-    }
-    
-return false;                                               // No match
+int e = FindExt(ext);
+if (e == wxNOT_FOUND) return false;                         // No match
+
+return (Extdata[e]->Default.Label == ftype.AppName && (Extdata[e]->Default.Command == ftype.Command || Extdata[e]->Default.Command == command));
 }
 
 void FiletypeManager::UpdateDefaultApplics(const struct Filetype_Struct& oldftype, const struct Filetype_Struct& newftype)  // Update default data after Edit
@@ -2307,8 +2346,8 @@ wxString ext = filepath.AfterLast(wxFILE_SEP_PATH);
 ext = ext.AfterLast(wxT('.'));                            // Use the LAST dot to get the ext  (otherwise what if myprog.3.0.1.tar ?)
             // If no dot, try using the whole filename, in case of eg makefile having an association
 
-for (size_t n=0; n < Extdata.GetCount(); ++n)             // Go thru Extdata array, trying to match 1 of its known ext.s to the file's one
-  if (Extdata[n]->Ext.Lower() == ext.Lower())
+int n = FindExt(ext);                                     // See if it's one of Extdata's known ext.s
+if (n != wxNOT_FOUND)
     { Array.Clear();
       for (size_t c=0; c < Extdata[n]->Applics.GetCount(); ++c)  // Add all the associated applic names to an array
         { Array.Add(Extdata[n]->Applics[c]->Label);       // This application's name goes into FiletypeManager::Array
@@ -2340,10 +2379,8 @@ if ((!stat->CanTHISUserRead() || !stat->CanTHISUserWrite()) // If either are mis
 
 if (!buf[1] && stat->CanTHISUserRead())    // Finally, if we haven't already flagged Open for executable reasons, & we can read, see if we have a default launcher
   { if (!ExtdataLoaded) LoadExtdata();                    // Load the ext/command data
-    Array.Add(filepath);                                  // Put filepath in 1st slot of Array
-    if (DeduceExt())                                      // if DeduceExts returns true, Array will now be filled with 1 or more ext.s to check
-      if (GetLaunchCommandFromExt())                      // If this is true, there is a launch command available, so flag Open
-        buf[1] = true;
+    if (GetLaunchCommandFromExt())                        // If this is true, there is a launch command available, so flag Open
+      buf[1] = true;
   }
 return true;
 }
@@ -2351,9 +2388,7 @@ return true;
 bool FiletypeManager::QueryCanOpenArchiveFile(wxString& filepath) // A cutdown QueryCanOpen() for use within archives
 {
 if (!ExtdataLoaded) LoadExtdata();                        // Load the ext/command data
-Array.Add(filepath);                                      // Put filepath in 1st slot of Array
-if (DeduceExt())                                          // if DeduceExts returns true, Array will now be filled with 1 or more ext.s to check
-  if (GetLaunchCommandFromExt())  return true;            // If this is true, there is a launch command available, so flag Open
+if (GetLaunchCommandFromExt())  return true;              // If this is true, there is a launch command available, so flag Open. NB this uses the member filepath, set by Init()
 
 return false;      
 }
@@ -14,11 +14,14 @@
 #include "wx/wx.h"
 #include "wx/config.h"
 #include "wx/longlong.h"
+#include "wx/hashmap.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <vector>
+#include <map>
 
 #include "Externs.h"  
 #include "ArchiveStream.h"
@@ -27,6 +30,7 @@ class FileData  :  public DataBase // Does lstat, stores the data, has accessor
 {
 public:
 FileData(wxString Filename, bool defererence = false);                  // If dereference, use stat instead of lstat
+FileData(const wxString& Filename, const struct stat& st);             // Use an already-known lstat result e.g. from DirCache. Not for symlinks
 ~FileData(){ if (symlinkdestination != NULL) delete symlinkdestination; delete statstruct; }
 
 FileData& operator=(const FileData& fd)
@@ -286,6 +290,25 @@ struct FiletypeExts      // Struct to match Exts with default applics to use for
               }
   };
   
+WX_DECLARE_STRING_HASH_MAP(int, ExtIndexHash);  // A lower-case ext, and its index in FiletypeManager::Extdata
+
+class ExtSuffixTrie  // Exts split at their dots, last part first, so 'tar.gz' is found under 'gz'. Gives a filename's known exts, longest first, in one pass
+{
+public:
+ExtSuffixTrie() { Clear(); }
+void Clear() { m_nodes.clear(); m_nodes.push_back(Node()); }
+void Add(const wxString& ext, int index);                       // ext must be lower-case. If it's already there, the earlier index is kept
+void Find(const wxString& filename, wxArrayInt& indices) const; // Fills indices with the Extdata indices of filename's known exts, longest first
+
+protected:
+struct Node
+  { int index;                          // -1 if no ext ends here
+    std::map<wxString, size_t> children;// Keyed by the next dot-separated part, leftwards. The size_t is into m_nodes
+    Node() : index(-1) {}
+  };
+std::vector<Node> m_nodes;              // m_nodes[0] is the root
+};
+
 class FiletypeManager
 {
 public:
@@ -314,17 +337,22 @@ wxString filepath;                          // The one we're dealing with
 protected:
 
 wxString ParseCommand(const wxString& command = wxT(""));       // Goes thru command, looking for %s to replace with filename. command may be in Array[0]
-bool DeduceExt();                         // Which bit of a filepath should we call 'ext' for GetLaunchCommandFromExt()
-bool GetLaunchCommandFromExt();
+bool DeduceExt();                         // Fill Array with filepath's possible ext.s, longest first. Used for the mimetype lookup
+bool GetLaunchCommandFromExt();           // Find the default command for filepath's longest known ext
 void AddApplicationToExtdata(struct Filetype_Struct& ftype);    // Add submenu application for a particular extension, adding ext if needed
 void RemoveApplicationFromExtdata(struct Filetype_Struct& ftype); // Remove application described by ftype from the Extdata structarray
 int GetDefaultApplicForExt(const wxString& Ext);                // Given an ext, find its default applic, if any. Returns -1 if none
+int FindExt(const wxString& Ext) const;                         // Returns Ext's index in Extdata, or wxNOT_FOUND
+void AddExtdata(struct FiletypeExts* extstruct);                // Append to Extdata, & index it
+void RebuildExtIndex();
 void UpdateDefaultApplics(const struct Filetype_Struct& oldftype, const struct Filetype_Struct& newftype);  // Update default data after Edit
 
 FileData *stat;
 bool force_kdesu;
 bool ExtdataLoaded;
 ArrayOfFiletypeExts Extdata;              // The array of structs containing Ext-orientated data
+ExtIndexHash m_ExtIndex;                  // Indexes Extdata by ext
+ExtSuffixTrie m_ExtTrie;                  //  & by the exts' parts, for matching the end of a filename
 
 //~~~~~~~~~~~~~~~ The OpenWith Dialog bits ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 public:
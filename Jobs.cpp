@@ -0,0 +1,788 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:       Jobs.cpp
+// Purpose:    Queues and runs long operations in the background, and the panel that lists them
+// Part of:    4Pane
+// Author:     David Hart
+// Copyright:  (c) 2016 David Hart
+// Licence:    GPL v3
+/////////////////////////////////////////////////////////////////////////////
+#include "wx/wxprec.h"
+
+#include "wx/log.h"
+#include "wx/app.h"
+#include "wx/config.h"
+#include "wx/dirctrl.h"
+#include "wx/stopwatch.h"
+
+#include "Externs.h"
+#include "MyGenericDirCtrl.h"
+#include "MyFrame.h"
+#include "Misc.h"
+#include "Jobs.h"
+
+#include <map>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <signal.h>
+#ifdef __linux__
+  #include <unistd.h>
+  #include <sys/syscall.h>
+#endif
+
+static const size_t MAX_FINISHED_JOBS(50);      // Finished jobs are kept for their output, but only this many
+static const size_t MAX_JOB_OUTPUT(1000000);    // Nor do we want all of tar -v's output for a huge archive
+
+#if defined(__linux__) && defined(__NR_ioprio_set)  // glibc has no wrapper for these, and no header for their constants
+  static const int IOPRIO_WHO_PROCESS(1);       // With a 'who' of 0, this means the calling thread
+  static const int IOPRIO_CLASS_SHIFT(13);
+  static const int IOPRIO_CLASS_BE(2);
+  static const int IOPRIO_CLASS_IDLE(3);
+  static const int IOPRIO_BE_LOWEST(7);
+#endif
+
+void JobGate::SetIOPolicy(enum jobioclass ioclass, wxULongLong bytespersec, bool pacewriteback)
+{
+wxMutexLocker locker(m_mutex);
+m_ioclass = ioclass;
+m_rate = (wxLongLong_t)bytespersec.GetValue();
+m_tokens = 0;
+m_last = wxGetLocalTimeMillis();
+m_pacewriteback = pacewriteback;
+}
+
+bool JobGate::WaitForWorkers(long milliseconds)
+{
+wxMutexLocker locker(m_mutex);
+wxLongLong giveup = wxGetLocalTimeMillis() + milliseconds;
+while (m_workers)
+  { wxLongLong left = giveup - wxGetLocalTimeMillis();
+    if (left <= 0) return false;
+    m_condition.WaitTimeout((unsigned long)left.GetValue());
+  }
+return true;
+}
+
+void JobGate::ApplyIOPriority() const
+{
+int ioprio = JobManager::IOPriorityFor(m_ioclass);
+if (ioprio >= 0) JobManager::SetThreadIOPriority(ioprio); // Each thread has its own I/O priority, so this affects only the caller
+}
+
+void JobGate::Consume(size_t bytes)
+{
+long wait = 0;
+  { wxMutexLocker locker(m_mutex);
+    if (m_rate <= 0) return;
+
+    wxLongLong now = wxGetLocalTimeMillis();
+    m_tokens += (now - m_last) * m_rate / 1000;
+    if (m_tokens > m_rate) m_tokens = m_rate;   // Allow at most a second's burst, so that a pause or a slow patch can't be made up for all at once
+    m_last = now;
+
+    m_tokens -= (wxLongLong_t)bytes;            // All the threads share the bucket, so each reserves its bytes here even if it must then wait for them
+    if (m_tokens < 0)
+      wait = ((-m_tokens) * 1000 / m_rate).ToLong();
+  }
+
+if (wait > 0) wxMilliSleep(wait);               // Not while holding the mutex, or Pause() from the main thread would block too
+}
+
+Job::Job(const wxString& description, const wxString& path, enum jobpriority priority)
+  : m_ID(0), m_description(description), m_state(js_queued), m_priority(priority), m_started(0), m_done(0), m_total(0)
+{
+m_device = JobManager::GetDevice(path);
+}
+
+wxString Job::GetProgressString() const
+{
+if (m_total > 0)
+  { unsigned int percent = (m_done >= m_total) ? 100 : (m_done * 100 / m_total).GetLo();
+    return wxString::Format(_("%s of %s (%u%%)"), ParseSize(m_done, true).c_str(), ParseSize(m_total, true).c_str(), percent);
+  }
+
+if (!WasStarted() || IsFinished()) return wxEmptyString;
+
+long elapsed = wxGetLocalTime() - m_started;
+return wxString::Format(_("%ld:%02ld elapsed"), elapsed / 60, elapsed % 60);
+}
+
+void Job::AddOutput(const wxString& output)
+{
+m_output << output;
+if (m_output.Len() > MAX_JOB_OUTPUT)
+  m_output = m_output.Mid(m_output.Len() - MAX_JOB_OUTPUT/2); // Keep the end, which is where any error message will be
+}
+
+//-----------------------------------------------------------------------------------------------------------------------
+
+ProcessJob::ProcessJob(const wxString& command, const wxString& description, const wxString& path, enum jobpriority priority)
+  : Job(description, path, priority), m_command(command), m_process(NULL), m_pid(0), m_exitstatus(0), m_cancelled(false)
+{
+m_cwd = GetCwd();
+}
+
+ProcessJob::ProcessJob(const wxArrayString& argv, const wxString& description, const wxString& path, enum jobpriority priority)
+  : Job(description, path, priority), m_argv(argv), m_process(NULL), m_pid(0), m_exitstatus(0), m_cancelled(false)
+{
+for (size_t n=0; n < argv.GetCount(); ++n)
+  { if (n) m_command << wxT(' ');
+    m_command << argv[n];
+  }
+m_cwd = GetCwd();
+}
+
+ProcessJob::~ProcessJob()
+{
+if (m_process)                                  // We're being deleted while the command runs, which only happens on exit. Don't leave it running unwatched
+  { m_process->Orphan();
+    wxProcess::Kill(m_pid, wxSIGTERM, wxKILL_CHILDREN);
+    ::kill(-m_pid, SIGCONT);                    // In case it was paused
+  }
+}
+
+bool ProcessJob::Start()
+{
+if (m_command.empty()) return false;
+
+m_process = new JobProcess(this);
+wxString oldcwd = GetCwd();
+if (!m_cwd.empty()) SetWorkingDirectory(m_cwd);
+                                                // A child inherits its parent's I/O priority, as do its own children, so lower ours for the moment of the fork.
+int oldioprio = -1;                             // Setting the child's afterwards would race with sh's starting tar and gzip
+int ioprio = JobManager::IOPriorityFor(JobManager::Get().GetIOClass(GetPriority()));
+if (ioprio >= 0)
+  { oldioprio = JobManager::GetThreadIOPriority();
+    if (oldioprio >= 0) JobManager::SetThreadIOPriority(ioprio);
+  }
+if (m_argv.IsEmpty())
+  m_pid = wxExecute(m_command, wxEXEC_ASYNC | wxEXEC_MAKE_GROUP_LEADER, m_process); // Group leader, so that pausing or cancelling reaches e.g. both tar and gzip
+ else
+  { std::vector<const wchar_t*> argv;
+    for (size_t n=0; n < m_argv.GetCount(); ++n) argv.push_back(m_argv[n].wc_str());
+    argv.push_back(NULL);
+    m_pid = wxExecute(&argv[0], wxEXEC_ASYNC | wxEXEC_MAKE_GROUP_LEADER, m_process);
+  }
+if (oldioprio >= 0) JobManager::SetThreadIOPriority(oldioprio);
+SetWorkingDirectory(oldcwd);
+
+if (!m_pid)
+  { AddOutput(wxString::Format(_("Execution of '%s' failed.\n"), m_command.c_str()));
+    delete m_process; m_process = NULL;
+    return false;
+  }
+
+return true;
+}
+
+bool ProcessJob::Pause()
+{
+if (!m_process || !m_pid) return false;
+
+return ::kill(-m_pid, SIGSTOP) == 0;            // -pid, so the whole process group is stopped
+}
+
+void ProcessJob::Resume()
+{
+if (m_process && m_pid)
+  ::kill(-m_pid, SIGCONT);
+}
+
+void ProcessJob::Cancel()
+{
+if (!m_process || !m_pid) return;
+
+m_cancelled = true;
+  // As in DisplayProcess::OnKillProcess(), first send a SIGHUP in case the child is waiting for input
+wxProcess::Kill(m_pid, wxSIGHUP, wxKILL_CHILDREN);
+if (wxProcess::Kill(m_pid, wxSIGTERM, wxKILL_CHILDREN) != wxKILL_OK)
+  wxProcess::Kill(m_pid, wxSIGKILL, wxKILL_CHILDREN);
+::kill(-m_pid, SIGCONT);                        // A paused process can't act on the SIGTERM until it's continued
+                                                // JobProcess::OnTerminate() will be called once it's died, and that finishes the job
+}
+
+wxString ProcessJob::GetProgressString() const
+{
+wxString progress = Job::GetProgressString();
+if (!m_lastline.empty())
+  { if (!progress.empty()) progress << wxT("   ");
+    progress << m_lastline;
+  }
+
+return progress;
+}
+
+void ProcessJob::PollOutput()
+{
+if (m_process)
+  m_process->HasInput();
+}
+
+void ProcessJob::OnOutput(const wxString& line)
+{
+if (line.empty()) return;
+
+AddOutput(line);
+
+wxString last(line); last.Trim();
+if (!last.empty())
+  m_lastline = (last.Len() > 80) ? last.Left(80) : last; // For the panel's progress column. tar -v etc output the filepath they've reached
+}
+
+void ProcessJob::OnProcessTerminated(int status)
+{
+delete m_process; m_process = NULL; m_pid = 0;  // Called from inside m_process, but it does nothing after this
+m_exitstatus = status;
+
+if (m_cancelled) AddOutput(_("Process cancelled\n"));
+ else AddOutput(status ? _("Process failed\n") : _("Success\n"));
+
+JobManager::Get().OnJobFinished(this, m_cancelled ? js_cancelled : (status ? js_failed : js_done));
+}
+
+ReallyDeleteJob::ReallyDeleteJob(const wxArrayString& paths, const wxArrayString& updatepaths, const wxArrayString& newstartdirs, int paneID)
+  : ProcessJob(MakeArgv(paths), MakeDescription(paths), paths[0]), m_paths(paths), m_updatepaths(updatepaths), m_newstartdirs(newstartdirs), m_paneID(paneID)
+{
+}
+
+//static
+wxArrayString ReallyDeleteJob::MakeArgv(const wxArrayString& paths)
+{
+wxArrayString argv;
+argv.Add(wxT("rm")); argv.Add(wxT("-rf")); argv.Add(wxT("--"));
+for (size_t n=0; n < paths.GetCount(); ++n)
+  argv.Add(StripSep(paths[n]));               // Without a terminal '/', which for a symlink to a dir would mean its target's contents
+return argv;
+}
+
+//static
+wxString ReallyDeleteJob::MakeDescription(const wxArrayString& paths)
+{
+wxString description(_("Delete"));
+description << wxT(": ") << StripSep(paths[0]).AfterLast(wxFILE_SEP_PATH);
+if (paths.GetCount() > 1) description << wxString::Format(_(" and %u more"), (unsigned int)paths.GetCount() - 1);
+return description;
+}
+
+void ReallyDeleteJob::OnFinished()
+{
+size_t successes = 0;
+for (size_t n=0; n < m_paths.GetCount(); ++n)
+  { struct stat st;
+    if (lstat(StripSep(m_paths[n]).mb_str(wxConvUTF8), &st) == -1) ++successes;
+    if (!WasStarted()) continue;              // Even a cancelled job may have deleted something
+
+    wxArrayInt IDs; IDs.Add(m_paneID);
+    MyFrame::mainframe->OnUpdateTrees(m_updatepaths[n], IDs, m_newstartdirs[n]);
+  }
+
+if (successes) DoBriefLogStatus(successes, wxEmptyString, _("irrevocably deleted"));
+ else { BriefLogStatus bls(_("Deletion failed")); }
+
+if (successes < m_paths.GetCount() && GetState() == js_failed)
+  JobManager::Get().ShowPanel();              // So that rm's complaint can be read
+}
+
+bool JobProcess::HasInput()  // See DisplayProcess::HasInput() for why this reads into a memorybuffer rather than using wxTextInputStream
+{
+bool hasInput = false;
+
+while (IsInputAvailable())
+  { wxMemoryBuffer buf;
+    do
+      { char c = GetInputStream()->GetC();
+        if (GetInputStream()->Eof()) break;
+
+        buf.AppendByte(c);
+        if (c==wxT('\n')) break;
+      }
+      while (IsInputAvailable());
+    if (m_job) m_job->OnOutput(wxString((const char*)buf.GetData(), wxConvUTF8, buf.GetDataLen()));
+
+    hasInput = true;
+  }
+
+while (IsErrorAvailable())
+  { wxMemoryBuffer buf;
+    do
+      { char c = GetErrorStream()->GetC();
+        if (GetErrorStream()->Eof()) break;
+
+        buf.AppendByte(c);
+        if (c==wxT('\n')) break;
+      }
+      while (IsErrorAvailable());
+    if (m_job) m_job->OnOutput(wxString((const char*)buf.GetData(), wxConvUTF8, buf.GetDataLen()));
+
+    hasInput = true;
+  }
+
+return hasInput;
+}
+
+void JobProcess::OnTerminate(int WXUNUSED(pid), int status)
+{
+if (!m_job)                                     // The job has already gone, so there's nobody to tell
+  { delete this; return; }
+
+while (HasInput());
+m_job->OnProcessTerminated(status);             // This deletes us
+}
+
+//-----------------------------------------------------------------------------------------------------------------------
+
+PasteJob::PasteJob(PasteThreadSuperBlock* tsb, const wxString& description, const wxString& path)
+  : Job(description, path, jp_high), m_tsb(tsb), m_cancelled(false)
+{
+if (m_tsb) m_tsb->SetJob(this);
+}
+
+PasteJob::~PasteJob()
+{
+if (m_tsb) m_tsb->SetJob(NULL);
+}
+
+bool PasteJob::Start()
+{
+if (!m_tsb) return false;
+
+JobManager& manager = JobManager::Get();
+m_tsb->GetGate().SetIOPolicy(manager.GetIOClass(GetPriority()), manager.GetBandwidthLimit(), manager.GetPaceWriteback());
+m_tsb->GetCollector().LaunchThreads();
+return true;
+}
+
+bool PasteJob::Pause()
+{
+if (!m_tsb) return false;
+
+m_tsb->GetGate().Pause();                       // The PasteThreads will wait at the end of their current chunk
+return true;
+}
+
+void PasteJob::Resume()
+{
+if (m_tsb) m_tsb->GetGate().Resume();
+}
+
+void PasteJob::Cancel()
+{
+if (!m_tsb) return;
+
+m_cancelled = true;
+m_tsb->Cancel();                                // which also lets any waiting thread go, or it would never notice it had been deleted
+}
+
+void PasteJob::OnThreadsCompleted(bool failures)
+{
+m_tsb = NULL;
+JobManager::Get().OnJobFinished(this, m_cancelled ? js_cancelled : (failures ? js_failed : js_done));
+}
+
+//-----------------------------------------------------------------------------------------------------------------------
+
+JobManager* JobManager::ms_instance = NULL;
+
+JobManager::JobManager() : m_nextID(1), m_panel(NULL)
+{
+wxConfigBase* config = wxConfigBase::Get();
+m_maxjobs = (size_t)config->Read(wxT("/Misc/MaxConcurrentJobs"), (long)ThreadsManager::GetCPUCount());
+m_maxperdevice = (size_t)config->Read(wxT("/Misc/MaxJobsPerDevice"), 1l); // More than one job at a time on a hard disk makes each slower, and the total little faster
+if (!m_maxjobs) m_maxjobs = 1;
+if (!m_maxperdevice) m_maxperdevice = 1;
+
+long ioclass = config->Read(wxT("/Misc/JobIOClass"), (long)jio_background); // By default jobs give way to the panes' lstat()s and readdir()s, but aren't starved by them
+m_ioclass = (ioclass >= jio_normal && ioclass <= jio_idle) ? (enum jobioclass)ioclass : jio_background;
+long mbps = config->Read(wxT("/Misc/JobBandwidthLimit"), 0l); // Stored in MB/s. 0 means unlimited
+m_bandwidth = (mbps > 0) ? wxULongLong((wxULongLong_t)mbps * 1024 * 1024) : wxULongLong(0);
+m_pacewriteback = config->Read(wxT("/Misc/JobPacedWriteback"), true);
+
+m_timer.SetOwner(this);
+Connect(wxID_ANY, wxEVT_TIMER, wxTimerEventHandler(JobManager::OnTimer), NULL, this);
+}
+
+JobManager::~JobManager()
+{
+m_timer.Stop();
+
+for (size_t n=0; n < m_jobs.size(); ++n)
+  { if (m_jobs[n]->GetState() == js_paused)
+      m_jobs[n]->Resume();                      // Otherwise a paste's threads would wait forever on a gate that's about to be deleted
+    delete m_jobs[n];
+  }
+m_jobs.clear();
+}
+
+unsigned int JobManager::Submit(Job* job, bool immediately /*=false*/)
+{
+wxCHECK_MSG(job, 0, wxT("Passed a NULL job"));
+
+job->m_ID = m_nextID++;
+m_jobs.push_back(job);
+
+if (immediately)
+  StartJob(job);
+Schedule();
+Changed();
+
+return job->m_ID;
+}
+
+void JobManager::Schedule()
+{
+while (true)
+  { size_t running = 0;
+    std::map<dev_t, size_t> perdevice;
+    for (size_t n=0; n < m_jobs.size(); ++n)
+      if (m_jobs[n]->GetState() == js_running)  // A paused job doesn't count: it isn't using the disk
+        { ++running; ++perdevice[m_jobs[n]->GetDevice()]; }
+    if (running >= m_maxjobs) return;
+
+    Job* next = NULL;
+    for (size_t n=0; n < m_jobs.size(); ++n)
+      { Job* job = m_jobs[n];
+        if (job->GetState() != js_queued || perdevice[job->GetDevice()] >= m_maxperdevice) continue;
+        if (!next || job->GetPriority() > next->GetPriority()) next = job; // '>' not '>=', so the earliest of equals wins
+      }
+    if (!next) return;
+
+    StartJob(next);
+  }
+}
+
+void JobManager::StartJob(Job* job)
+{
+job->m_state = js_running;
+job->m_started = wxGetLocalTime();
+if (!m_timer.IsRunning()) m_timer.Start(250);
+
+if (!job->Start())
+  FinishJob(job, js_failed);
+}
+
+void JobManager::FinishJob(Job* job, enum jobstate state)
+{
+job->m_state = state;
+job->OnFinished();
+}
+
+void JobManager::OnJobFinished(Job* job, enum jobstate state)
+{
+wxCHECK_RET(job, wxT("Passed a NULL job"));
+
+FinishJob(job, state);
+
+size_t finished = 0;                            // Forget the oldest finished jobs, if there are too many. Not this one though: it's still on the stack
+for (size_t n=m_jobs.size(); n > 0; --n)
+  if (m_jobs[n-1]->IsFinished() && ++finished > MAX_FINISHED_JOBS && m_jobs[n-1] != job)
+    { delete m_jobs[n-1]; m_jobs.erase(m_jobs.begin() + n-1); }
+
+Schedule();
+Changed();
+}
+
+void JobManager::Pause(unsigned int ID)
+{
+Job* job = FindJob(ID);
+if (!job || job->GetState() != js_running) return;
+
+if (job->Pause())
+  { job->m_state = js_paused;
+    Schedule();                                 // Its slot is now free
+  }
+Changed();
+}
+
+void JobManager::Resume(unsigned int ID)
+{
+Job* job = FindJob(ID);
+if (!job || job->GetState() != js_paused) return;
+
+job->Resume();
+job->m_state = js_running;
+Changed();
+}
+
+void JobManager::Cancel(unsigned int ID)
+{
+Job* job = FindJob(ID);
+if (!job || job->IsFinished()) return;
+
+if (job->GetState() == js_queued)
+  { FinishJob(job, js_cancelled); Changed(); }
+ else
+  job->Cancel();                                // The job will call OnJobFinished() once it's actually stopped
+}
+
+void JobManager::SetPriority(unsigned int ID, enum jobpriority priority)
+{
+Job* job = FindJob(ID);
+if (!job || job->IsFinished()) return;
+
+job->m_priority = priority;
+Changed();
+}
+
+void JobManager::ClearFinished()
+{
+for (size_t n=m_jobs.size(); n > 0; --n)
+  if (m_jobs[n-1]->IsFinished())
+    { delete m_jobs[n-1]; m_jobs.erase(m_jobs.begin() + n-1); }
+
+Changed();
+}
+
+Job* JobManager::FindJob(unsigned int ID) const
+{
+for (size_t n=0; n < m_jobs.size(); ++n)
+  if (m_jobs[n]->GetID() == ID)
+    return m_jobs[n];
+
+return NULL;
+}
+
+bool JobManager::IsActive() const
+{
+for (size_t n=0; n < m_jobs.size(); ++n)
+  if (!m_jobs[n]->IsFinished())
+    return true;
+
+return false;
+}
+
+void JobManager::Changed()
+{
+if (m_panel)
+  m_panel->UpdateList();
+}
+
+void JobManager::OnTimer(wxTimerEvent& WXUNUSED(event))
+{
+for (size_t n=0; n < m_jobs.size(); ++n)
+  { ProcessJob* job = dynamic_cast<ProcessJob*>(m_jobs[n]);
+    if (job && job->GetState() == js_running)
+      job->PollOutput();
+  }
+
+if (!IsActive())
+  m_timer.Stop();
+Changed();
+}
+
+void JobManager::ShowPanel()
+{
+if (!m_panel)
+  m_panel = new JobsPanel(MyFrame::mainframe);
+
+m_panel->Show();
+m_panel->Raise();
+m_panel->UpdateList();
+}
+
+//static
+dev_t JobManager::GetDevice(const wxString& path)
+{
+wxString dir(path);
+while (!dir.empty())
+  { struct stat st;
+    if (stat(dir.fn_str(), &st) == 0)
+      return st.st_dev;
+    if (dir == wxT("/")) break;
+
+    dir = dir.BeforeLast(wxFILE_SEP_PATH);      // It may not exist yet e.g. a new archive, so try its parent
+    if (dir.empty() && path.GetChar(0) == wxFILE_SEP_PATH) dir = wxT("/");
+  }
+
+return 0;
+}
+
+//static
+int JobManager::GetThreadIOPriority()
+{
+#if defined(__linux__) && defined(__NR_ioprio_set)
+  return (int)syscall(__NR_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+#else
+  return -1;
+#endif
+}
+
+//static
+bool JobManager::SetThreadIOPriority(int ioprio)
+{
+#if defined(__linux__) && defined(__NR_ioprio_set)
+  return syscall(__NR_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio) == 0;
+#else
+  wxUnusedVar(ioprio);
+  return false;
+#endif
+}
+
+//static
+int JobManager::IOPriorityFor(enum jobioclass ioclass)
+{
+#if defined(__linux__) && defined(__NR_ioprio_set)
+  switch(ioclass)
+    { case jio_background: return (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | IOPRIO_BE_LOWEST;
+      case jio_idle:       return IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT; // The idle class has no levels
+      default:             return -1;
+    }
+#else
+  wxUnusedVar(ioclass);
+  return -1;
+#endif
+}
+
+//-----------------------------------------------------------------------------------------------------------------------
+
+wxString JobsListCtrl::OnGetItemText(long item, long column) const
+{
+Job* job = JobManager::Get().GetJob(item);
+if (!job) return wxEmptyString;
+
+switch(column)
+  { case 0: return job->GetDescription();
+    case 1: switch(job->GetState())
+              { case js_queued:    return _("Queued");
+                case js_running:   return _("Running");
+                case js_paused:    return _("Paused");
+                case js_done:      return _("Done");
+                case js_failed:    return _("Failed");
+                case js_cancelled: return _("Cancelled");
+              }
+            break;
+    case 2: return job->GetProgressString();
+    case 3: switch(job->GetPriority())
+              { case jp_low:    return _("Low");
+                case jp_normal: return _("Normal");
+                case jp_high:   return _("High");
+              }
+            break;
+  }
+
+return wxEmptyString;
+}
+
+JobsPanel::JobsPanel(wxWindow* parent)
+  : wxFrame(parent, wxID_ANY, _("Jobs"), wxDefaultPosition, wxDefaultSize, wxDEFAULT_FRAME_STYLE | wxFRAME_TOOL_WINDOW | wxFRAME_FLOAT_ON_PARENT)
+{
+wxPanel* panel = new wxPanel(this);
+wxBoxSizer* mainsizer = new wxBoxSizer(wxVERTICAL);
+
+m_list = new JobsListCtrl(panel);
+m_list->InsertColumn(0, _("Job")); m_list->InsertColumn(1, _("Status")); m_list->InsertColumn(2, _("Progress")); m_list->InsertColumn(3, _("Priority"));
+m_list->SetColumnWidth(0, 300); m_list->SetColumnWidth(1, 80); m_list->SetColumnWidth(2, 300); m_list->SetColumnWidth(3, 70);
+mainsizer->Add(m_list, 1, wxALL | wxEXPAND, 5);
+
+wxBoxSizer* buttonsizer = new wxBoxSizer(wxHORIZONTAL);
+m_pause = new wxButton(panel, wxID_ANY, _("&Pause"));
+m_resume = new wxButton(panel, wxID_ANY, _("&Resume"));
+m_cancel = new wxButton(panel, wxID_ANY, _("&Cancel Job"));
+m_higher = new wxButton(panel, wxID_ANY, _("&Higher Priority"));
+m_lower = new wxButton(panel, wxID_ANY, _("&Lower Priority"));
+m_output = new wxButton(panel, wxID_ANY, _("Show &Output"));
+m_clear = new wxButton(panel, wxID_ANY, _("Clear &Finished"));
+buttonsizer->Add(m_pause); buttonsizer->Add(m_resume, 0, wxLEFT, 5); buttonsizer->Add(m_cancel, 0, wxLEFT, 5);
+buttonsizer->Add(m_higher, 0, wxLEFT, 15); buttonsizer->Add(m_lower, 0, wxLEFT, 5);
+buttonsizer->Add(m_output, 0, wxLEFT, 15); buttonsizer->Add(m_clear, 0, wxLEFT, 5);
+buttonsizer->AddStretchSpacer();
+buttonsizer->Add(new wxButton(panel, wxID_CLOSE));
+mainsizer->Add(buttonsizer, 0, wxLEFT | wxRIGHT | wxBOTTOM | wxEXPAND, 5);
+
+panel->SetSizer(mainsizer);
+if (!LoadPreviousSize(this, wxT("JobsPanel")))
+  { wxSize displaysize = wxGetDisplaySize();
+    SetSize(displaysize.x / 2, displaysize.y / 4);
+  }
+
+Connect(wxID_ANY, wxEVT_COMMAND_BUTTON_CLICKED, wxCommandEventHandler(JobsPanel::OnButton), NULL, this);
+Connect(wxID_ANY, wxEVT_UPDATE_UI, wxUpdateUIEventHandler(JobsPanel::OnUpdateUI), NULL, this);
+Connect(wxID_ANY, wxEVT_CLOSE_WINDOW, wxCloseEventHandler(JobsPanel::OnClose), NULL, this);
+}
+
+JobsPanel::~JobsPanel()
+{
+JobManager::Get().OnPanelDestroyed();
+}
+
+void JobsPanel::UpdateList()
+{
+if (!IsShown()) return;
+
+size_t count = JobManager::Get().GetCount();
+if ((size_t)m_list->GetItemCount() != count)
+  m_list->SetItemCount(count);
+m_list->Refresh();                              // The list is virtual, so this is all that's needed to show the current progress
+}
+
+Job* JobsPanel::GetSelectedJob() const
+{
+long item = m_list->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+if (item == -1) return NULL;
+
+return JobManager::Get().GetJob(item);
+}
+
+void JobsPanel::OnButton(wxCommandEvent& event)
+{
+int id = event.GetId();
+if (id == wxID_CLOSE) { Close(); return; }
+if (id == m_clear->GetId()) { JobManager::Get().ClearFinished(); return; }
+
+Job* job = GetSelectedJob();
+if (!job) { event.Skip(); return; }
+
+if (id == m_pause->GetId()) JobManager::Get().Pause(job->GetID());
+ else if (id == m_resume->GetId()) JobManager::Get().Resume(job->GetID());
+ else if (id == m_cancel->GetId()) JobManager::Get().Cancel(job->GetID());
+ else if (id == m_higher->GetId()) JobManager::Get().SetPriority(job->GetID(), (enum jobpriority)(job->GetPriority() + 1));
+ else if (id == m_lower->GetId()) JobManager::Get().SetPriority(job->GetID(), (enum jobpriority)(job->GetPriority() - 1));
+ else if (id == m_output->GetId()) ShowOutput(job);
+ else event.Skip();
+}
+
+void JobsPanel::OnUpdateUI(wxUpdateUIEvent& event)
+{
+Job* job = GetSelectedJob();
+int id = event.GetId();
+
+if (id == m_pause->GetId()) event.Enable(job && job->GetState() == js_running);
+ else if (id == m_resume->GetId()) event.Enable(job && job->GetState() == js_paused);
+ else if (id == m_cancel->GetId()) event.Enable(job && !job->IsFinished());
+ else if (id == m_higher->GetId()) event.Enable(job && job->GetState() == js_queued && job->GetPriority() < jp_high); // Priority only affects which queued job starts next
+ else if (id == m_lower->GetId()) event.Enable(job && job->GetState() == js_queued && job->GetPriority() > jp_low);
+ else if (id == m_output->GetId()) event.Enable(job && !job->GetOutput().empty());
+ else if (id == m_clear->GetId())
+  { bool any = false;
+    for (size_t n=0; n < JobManager::Get().GetCount() && !any; ++n)
+      any = JobManager::Get().GetJob(n)->IsFinished();
+    event.Enable(any);
+  }
+ else event.Skip();
+}
+
+void JobsPanel::OnClose(wxCloseEvent& event)
+{
+SaveCurrentSize(this, wxT("JobsPanel"));
+
+if (event.CanVeto())
+  { event.Veto(); Hide(); }                     // Just hide, so that it's quick to show again
+ else
+  Destroy();
+}
+
+void JobsPanel::ShowOutput(Job* job)
+{
+wxDialog dlg(this, wxID_ANY, job->GetDescription(), wxDefaultPosition, wxDefaultSize, wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER);
+wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+wxTextCtrl* text = new wxTextCtrl(&dlg, wxID_ANY, job->GetOutput(), wxDefaultPosition, wxDefaultSize, wxTE_MULTILINE | wxTE_READONLY);
+sizer->Add(text, 1, wxALL | wxEXPAND, 10);
+sizer->Add(dlg.CreateButtonSizer(wxOK), 0, wxLEFT | wxRIGHT | wxBOTTOM | wxEXPAND, 10);
+dlg.SetSizer(sizer);
+if (!LoadPreviousSize(&dlg, wxT("OutputDlg")))  // It replaces OutputDlg for these commands, so share its size
+  { wxSize displaysize = wxGetDisplaySize();
+    dlg.SetSize(displaysize.x / 2, displaysize.y / 2);
+  }
+
+text->ShowPosition(text->GetLastPosition());    // Any error message will be at the end
+dlg.ShowModal();
+SaveCurrentSize(&dlg, wxT("OutputDlg"));
+}
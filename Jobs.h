@@ -0,0 +1,273 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:       Jobs.h
+// Purpose:    Queues and runs long operations in the background, and the panel that lists them
+// Part of:    4Pane
+// Author:     David Hart
+// Copyright:  (c) 2016 David Hart
+// Licence:    GPL v3
+/////////////////////////////////////////////////////////////////////////////
+#ifndef JOBSH
+#define JOBSH
+
+#include "wx/wx.h"
+#include "wx/process.h"
+#include "wx/listctrl.h"
+#include "wx/thread.h"
+
+#include <vector>
+#include <sys/types.h>
+
+enum jobstate { js_queued, js_running, js_paused, js_done, js_failed, js_cancelled }; // Keep the finished states last: see Job::IsFinished()
+enum jobpriority { jp_low, jp_normal, jp_high };
+enum jobioclass { jio_normal, jio_background, jio_idle }; // How a job's disk access competes with the panes': as an equal, at the lowest best-effort level, or only when the disk is otherwise idle
+
+class JobGate  // Holds a job's worker threads while the job is paused, and paces their I/O
+{
+public:
+JobGate() : m_condition(m_mutex), m_paused(false), m_stopped(false), m_workers(0), m_ioclass(jio_normal), m_rate(0), m_tokens(0), m_last(0), m_pacewriteback(false) {}
+
+void Pause() { wxMutexLocker locker(m_mutex); m_paused = true; }
+void Resume() { wxMutexLocker locker(m_mutex); m_paused = false; m_condition.Broadcast(); }
+void WaitWhilePaused() { wxMutexLocker locker(m_mutex); while (m_paused && !m_stopped) m_condition.Wait(); } // Called by the workers between chunks of work
+void StopForExit() { wxMutexLocker locker(m_mutex); m_stopped = true; m_condition.Broadcast(); } // On exit: the workers should stop as soon as they can, without it counting as a cancel
+bool IsStoppingForExit() { wxMutexLocker locker(m_mutex); return m_stopped; }
+
+void AddWorker() { wxMutexLocker locker(m_mutex); ++m_workers; } // Called before each worker thread is started
+void WorkerFinished() { wxMutexLocker locker(m_mutex); if (m_workers) --m_workers; m_condition.Broadcast(); } // Called by each as the last thing it does
+bool WaitForWorkers(long milliseconds);  // Waits up to that long for them all to finish. False if any are still running
+
+void SetIOPolicy(enum jobioclass ioclass, wxULongLong bytespersec, bool pacewriteback); // Called before the workers start
+void ApplyIOPriority() const;           // Called by each worker thread as it starts
+void Consume(size_t bytes);             // A worker has just read/written this much. If that's over the bandwidth limit, sleep until it isn't
+bool GetPaceWriteback() const { return m_pacewriteback; }
+
+protected:
+wxMutex m_mutex;
+wxCondition m_condition;
+bool m_paused;
+bool m_stopped;
+size_t m_workers;          // How many worker threads are still running, so that what they use isn't deleted under them
+
+enum jobioclass m_ioclass;
+wxLongLong m_rate;         // The token-bucket: bytes per second, or 0 for no limit
+wxLongLong m_tokens;       // How many bytes may be transferred now. Negative means we're in debt, and must wait
+wxLongLong m_last;         // When the tokens were last topped up, in ms
+bool m_pacewriteback;      // Should the workers flush what they write every few MB, rather than leaving it to pile up as dirty pages
+};
+
+class Job  // Something slow that JobManager queues, starts when there's a free slot, and can pause or cancel. All its methods are called in the main thread
+{
+public:
+Job(const wxString& description, const wxString& path, enum jobpriority priority = jp_normal);
+virtual ~Job() {}
+
+virtual bool Start() = 0;               // False if it couldn't be started, which counts as a failure
+virtual bool Pause() { return false; }  // False if this sort of job can't be paused
+virtual void Resume() {}
+virtual void Cancel() = 0;              // Only called for a running or paused job. It must still report to JobManager::OnJobFinished() when it stops
+virtual void OnFinished() {}            // Called once the job has stopped, whatever the reason, after its state has been set
+virtual wxString GetProgressString() const;
+
+unsigned int GetID() const { return m_ID; }
+const wxString& GetDescription() const { return m_description; }
+enum jobstate GetState() const { return m_state; }
+enum jobpriority GetPriority() const { return m_priority; }
+dev_t GetDevice() const { return m_device; }
+bool IsFinished() const { return m_state >= js_done; }
+bool WasStarted() const { return m_started != 0; }
+
+void SetTotal(wxULongLong total) { m_total = total; }
+void AddProgress(wxULongLong done) { m_done += done; }
+void AddOutput(const wxString& output);
+const wxString& GetOutput() const { return m_output; }
+
+protected:
+friend class JobManager;
+
+unsigned int m_ID;
+wxString m_description;
+enum jobstate m_state;
+enum jobpriority m_priority;
+dev_t m_device;            // The filesystem it mostly reads or writes. JobManager limits how many jobs may use each one at once
+time_t m_started;
+wxULongLong m_done;
+wxULongLong m_total;       // If 0, the job can't tell how much there is to do
+wxString m_output;
+};
+
+class JobProcess;
+
+class ProcessJob : public Job  // Runs a shell command, collecting what it outputs
+{
+public:
+ProcessJob(const wxString& command, const wxString& description, const wxString& path, enum jobpriority priority = jp_normal);
+ProcessJob(const wxArrayString& argv, const wxString& description, const wxString& path, enum jobpriority priority = jp_normal); // Runs argv[0] directly, so filepaths needn't be quoted
+virtual ~ProcessJob();
+
+virtual bool Start();
+virtual bool Pause();
+virtual void Resume();
+virtual void Cancel();
+virtual wxString GetProgressString() const;
+
+void PollOutput();                      // Called by JobManager's timer
+void OnOutput(const wxString& line);    // Called by JobProcess for each line of stdout or stderr
+void OnProcessTerminated(int status);   // Called by JobProcess
+int GetExitStatus() const { return m_exitstatus; }
+
+protected:
+wxString m_command;
+wxArrayString m_argv;      // If not empty, what's run instead of m_command, which is then just for display
+wxString m_cwd;            // The cwd when the job was submitted, in case the command uses relative paths
+JobProcess* m_process;
+long m_pid;
+int m_exitstatus;
+bool m_cancelled;
+wxString m_lastline;
+};
+
+class ReallyDeleteJob : public ProcessJob  // Permanently deletes filepaths with rm -rf, then refreshes the panes that showed them
+{
+public:
+ReallyDeleteJob(const wxArrayString& paths, const wxArrayString& updatepaths, const wxArrayString& newstartdirs, int paneID);
+
+virtual void OnFinished();
+
+protected:
+static wxArrayString MakeArgv(const wxArrayString& paths);
+static wxString MakeDescription(const wxArrayString& paths);
+
+wxArrayString m_paths;
+wxArrayString m_updatepaths;  // For each path, the branch that must be refreshed afterwards
+wxArrayString m_newstartdirs; // and, if the path was a pane's startdir, the one to replace it. Otherwise empty
+int m_paneID;              // The pane it was deleted from, which must be refreshed whether or not it's showing the branch
+};
+
+class JobProcess : public wxProcess  // Similar to DisplayProcess, but reports to a ProcessJob instead of a dialog
+{
+public:
+JobProcess(ProcessJob* job) : wxProcess(wxPROCESS_REDIRECT), m_job(job) {}
+
+bool HasInput();
+void Orphan() { m_job = NULL; }         // The job is being deleted, so the process must clear up after itself
+
+protected:
+void OnTerminate(int pid, int status);
+
+ProcessJob* m_job;
+};
+
+class PasteThreadSuperBlock;
+
+class PasteJob : public Job  // A paste, move, delete etc, whose PasteThreads are paused and cancelled through it
+{
+public:
+PasteJob(PasteThreadSuperBlock* tsb, const wxString& description, const wxString& path);
+virtual ~PasteJob();
+
+virtual bool Start();
+virtual bool Pause();
+virtual void Resume();
+virtual void Cancel();
+
+void OnThreadsCompleted(bool failures); // Called by the superblock
+
+protected:
+PasteThreadSuperBlock* m_tsb;           // NULL once the superblock has completed, as it'll soon be deleted
+bool m_cancelled;
+};
+
+class JobsPanel;
+
+class JobManager : public wxEvtHandler  // Starts queued Jobs in priority order, while there are free slots: so many overall, and so many per filesystem
+{
+public:
+unsigned int Submit(Job* job, bool immediately = false); // Takes ownership. 'immediately' is for work the user is already waiting for e.g. a paste. It still takes a slot, so queued jobs wait for it
+void Pause(unsigned int ID);
+void Resume(unsigned int ID);
+void Cancel(unsigned int ID);
+void SetPriority(unsigned int ID, enum jobpriority priority);
+void ClearFinished();
+void OnJobFinished(Job* job, enum jobstate state); // Called by a job when it stops
+
+size_t GetCount() const { return m_jobs.size(); }
+Job* GetJob(size_t index) const { return (index < m_jobs.size()) ? m_jobs[index] : NULL; }
+Job* FindJob(unsigned int ID) const;
+
+void ShowPanel();
+void OnPanelDestroyed() { m_panel = NULL; }
+
+enum jobioclass GetIOClass(enum jobpriority priority) const { return (priority == jp_low) ? jio_idle : m_ioclass; }
+wxULongLong GetBandwidthLimit() const { return m_bandwidth; }
+bool GetPaceWriteback() const { return m_pacewriteback; }
+
+static dev_t GetDevice(const wxString& path); // The device of path or, if it doesn't exist yet, of its nearest existing ancestor
+static int GetThreadIOPriority();       // The calling thread's raw ioprio value, or -1 if that can't be done here
+static bool SetThreadIOPriority(int ioprio);
+static int IOPriorityFor(enum jobioclass ioclass); // The raw ioprio value, or -1 for 'leave it alone'
+
+static JobManager& Get() { if (!ms_instance) ms_instance = new JobManager; return *ms_instance; }
+static void Release() { delete ms_instance; ms_instance = NULL; }
+static bool HasUnfinishedJobs() { return ms_instance && ms_instance->IsActive(); } // Without creating a JobManager just to ask
+
+protected:
+void Schedule();                        // Starts whatever the limits allow
+void StartJob(Job* job);
+void FinishJob(Job* job, enum jobstate state);
+bool IsActive() const;
+void Changed();                         // Tells any panel to redraw
+void OnTimer(wxTimerEvent& event);      // Collects process output, and updates the panel's progress column
+
+std::vector<Job*> m_jobs;               // In the order of submission, so that equal priorities are first-come first-served
+unsigned int m_nextID;
+size_t m_maxjobs;
+size_t m_maxperdevice;
+enum jobioclass m_ioclass;
+wxULongLong m_bandwidth;                // Each job's limit in bytes per second, or 0 for none
+bool m_pacewriteback;
+wxTimer m_timer;
+JobsPanel* m_panel;
+
+private:
+JobManager();
+~JobManager();
+
+static JobManager* ms_instance;
+};
+
+class JobsListCtrl : public wxListCtrl  // A virtual listctrl that displays JobManager's jobs
+{
+public:
+JobsListCtrl(wxWindow* parent) : wxListCtrl(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxLC_REPORT | wxLC_VIRTUAL | wxLC_SINGLE_SEL) {}
+
+protected:
+virtual wxString OnGetItemText(long item, long column) const;
+};
+
+class JobsPanel : public wxFrame  // Floats over the main frame, listing the jobs and letting them be paused, reprioritised or cancelled
+{
+public:
+JobsPanel(wxWindow* parent);
+~JobsPanel();
+
+void UpdateList();
+
+protected:
+Job* GetSelectedJob() const;
+void OnButton(wxCommandEvent& event);
+void OnUpdateUI(wxUpdateUIEvent& event);
+void OnClose(wxCloseEvent& event);
+void ShowOutput(Job* job);
+
+JobsListCtrl* m_list;
+wxButton* m_pause;
+wxButton* m_resume;
+wxButton* m_cancel;
+wxButton* m_higher;
+wxButton* m_lower;
+wxButton* m_output;
+wxButton* m_clear;
+};
+
+#endif
+    //JOBSH
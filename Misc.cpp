@@ -451,9 +451,13 @@ void UnexecuteImages(const wxString& filepath) // See if it's an image or text f
 FileData fd(filepath);
 wxCHECK_RET(fd.IsValid(), wxT("Passed an invalid file"));
 if (fd.IsRegularFile())
-  { // See if it's likely to be an image or a text file; just quick'n'simple, it's not important enough for mimetypes or wxImage::CanRead
+  { if (!(fd.GetPermissions() & (S_IXUSR | S_IXGRP | S_IXOTH))) return; // Nothing to remove, so don't bother reading it
+    // See if it's an image or a text file. Go by the content where there's a decision to make, so that e.g. a foo.txt that's really a script keeps its x
   wxString ext = filepath.AfterLast(wxT('.')).Lower();
-  if (!(ext==wxT("png") || ext==wxT("jpg") || ext==wxT("jpeg") || ext==wxT("bmp") || ext==wxT("tiff") || ext==wxT("txt")))
+  SniffedType sniffed = FileClassifier::SniffFile(filepath);  // Not Classify(): we're often in a PasteThread, and the cache is the main thread's
+  bool image = (sniffed.kind == sk_image) || (sniffed.kind == sk_svg);
+  bool text = (sniffed.kind == sk_text) && (ext==wxT("txt"));   // Other text may be a shellscript without a #!, so leave it alone
+  if (!image && !text)
     return;
 
   static const mode_t mask = ~(S_IXUSR | S_IXGRP | S_IXOTH) & 07777;
@@ -1109,10 +1113,28 @@ ThreadsManager* ThreadsManager::ms_instance = NULL;
 ThreadsManager::~ThreadsManager()
 {
 for (size_t n=0; n < m_sblocks.size(); ++n)
-  delete m_sblocks.at(n);
+  { PasteThreadSuperBlock* ptsb = dynamic_cast<PasteThreadSuperBlock*>(m_sblocks.at(n));
+    if (ptsb && !ptsb->GetGate().WaitForWorkers(0))
+      continue;       // A thread that wouldn't stop in StopPastes() is still using it. We're exiting anyway, so leak it rather than delete it from under the thread
+    delete m_sblocks.at(n);
+  }
 m_sblocks.clear();
 }
 
+void ThreadsManager::StopPastes()
+{
+for (size_t n=0; n < m_sblocks.size(); ++n)
+  { PasteThreadSuperBlock* ptsb = dynamic_cast<PasteThreadSuperBlock*>(m_sblocks.at(n));
+    if (ptsb) ptsb->StopForExit();
+  }
+
+wxLongLong giveup = wxGetLocalTimeMillis() + 5000; // Each thread stops at the end of its current chunk, so this is plenty unless e.g. an NFS server has gone away
+for (size_t n=0; n < m_sblocks.size(); ++n)
+  { PasteThreadSuperBlock* ptsb = dynamic_cast<PasteThreadSuperBlock*>(m_sblocks.at(n));
+    if (ptsb) ptsb->GetGate().WaitForWorkers(wxMax((giveup - wxGetLocalTimeMillis()).ToLong(), 0l));
+  }
+}
+
 ThreadSuperBlock* ThreadsManager::StartSuperblock(const wxString& type)
 {
 ThreadSuperBlock* tsb;
@@ -1195,7 +1217,7 @@ for (size_t n=0; n < m_sblocks.size(); ++n)
   if (!m_sblocks.at(n)->IsCompleted())
     { if (/*(threadtype & ThT_text && dynamic_cast<TextThreadSuperBlock*>(m_sblocks.at(n)) *** future-proofing)
        || */(threadtype & ThT_paste && dynamic_cast<PasteThreadSuperBlock*>(m_sblocks.at(n))))
-        m_sblocks.at(n)->AbortThreads();
+        static_cast<PasteThreadSuperBlock*>(m_sblocks.at(n))->Cancel();
     }
 }
 
@@ -1263,6 +1285,16 @@ for (size_t n=0; n < m_UnRedos.size(); ++n)
 
 m_UnRedos.clear();
 m_StatusWriter.PasteFinished();
+
+if (m_journal)                // We're being deleted before completing, which only happens on exit. Leave the journal, so the paste can be resumed next time
+  { m_journal->Close(); delete m_journal; }
+}
+
+void PasteThreadSuperBlock::Cancel()
+{
+m_cancelled = true;
+m_gate.Resume();              // A paused thread would never notice it had been deleted
+AbortThreads();
 }
 
 ThreadSuperBlock::~ThreadSuperBlock()
@@ -1272,6 +1304,21 @@ for (size_t n=0; n < m_blocks.size(); ++n)
 m_blocks.clear();
 }
 
+wxString ThreadSuperBlock::GetMessageVerb() const
+{
+switch(m_messagetype)
+  { case tsbm_pasted:     return _("pasted");
+    case tsbm_moved:      return _("moved");
+    case tsbm_cut:        return _("cut");
+    case tsbm_deleted:    return _("deleted");
+    case tsbm_trashed:    return _("trashed");
+    case tsbm_duplicated: return _("duplicated");
+    case tsbm_undone:     return _("undone");
+    case tsbm_redone:     return _("redone");
+    default:              return _("completed");
+  }
+}
+
 void ThreadSuperBlock::StoreBlock(ThreadBlock* block)
 {
 m_FirstThreadID = wxMin(m_FirstThreadID, block->GetFirstID());
@@ -1341,8 +1388,42 @@ wxCHECK_RET(m_trashdir.empty(), wxT("Trying to set an already-set trashdir"));
 m_trashdir = trashdir; 
 }
 
+bool PasteThreadSuperBlock::DeferHardlink(FileData& stat, const wxString& origin, const wxString& dest, const wxString& overwrittenfile)
+{
+if (stat.GetHardLinkNo() < 2) return false;
+  // Unredos, and pastes that overwrite, have enough complications already. Just copy those
+if (GetUnRedoType() != URT_notunredo || !overwrittenfile.empty() || !m_trashdir.empty()) return false;
+
+std::pair<dev_t, ino_t> inode(stat.GetDeviceID(), stat.GetInodeNo());
+std::map< std::pair<dev_t, ino_t>, std::pair<wxString, wxString> >::const_iterator it = m_Inodes.find(inode);
+if (it == m_Inodes.end())
+  { m_Inodes[inode] = std::make_pair(origin, dest); // The first link we've seen, so this one gets copied
+    return false;
+  }
+
+m_Hardlinks.push_back(HardlinkData(origin, it->second.first, it->second.second, dest));
+return true;
+}
+
 void PasteThreadSuperBlock::OnCompleted()
 {
+  // Any further links to a pasted inode were held back. Now that the first one has been copied, link to the copy. Not if we're exiting though: the journal has them
+for (size_t n=0; n < m_Hardlinks.size() && !m_gate.IsStoppingForExit(); ++n)
+  { const HardlinkData& hl = m_Hardlinks.at(n);
+    bool linked = m_SuccessfullyPastedFilepaths.Index(hl.firstorigin) != wxNOT_FOUND
+                    && link(hl.firstdest.fn_str(), hl.dest.fn_str()) == 0;
+    if (!linked)                      // If the first copy failed or was cancelled, or link() did, fall back to a plain copy
+      linked = wxCopyFile(hl.origin, hl.dest, false);
+    if (linked)
+      { if (GetCollectorIsMoves())
+          wxRemoveFile(hl.origin);    // For a Move, the thread would have deleted the origin
+        m_SuccessfullyPastedFilepaths.Add(hl.origin);
+        AddSuccesses(1);
+      }
+     else AddFailures(1);
+  }
+m_Hardlinks.clear();
+
   // First deal with setting any modification times. This is needed when pasting a dir with contents, retaining the original mtimes;
   // We can't set the time when creating the dir, as it'll be modified later when contents are added. So do it now the dust has settled
 while (m_ChangeMtimes.size())
@@ -1358,7 +1439,7 @@ while (m_UnRedos.size())
   { UnRedo* entry = m_UnRedos.front().first;
     if (m_SuccessfullyPastedFilepaths.Index(m_UnRedos.front().second) == wxNOT_FOUND)
       { m_UnRedos.pop_front(); continue; } // The corresponding thread must have failed or been cancelled
-    if (dynamic_cast<UnRedoPaste*>(entry) || dynamic_cast<UnRedoMove*>(entry))
+    if (dynamic_cast<UnRedoPaste*>(entry) || dynamic_cast<UnRedoMove*>(entry) || dynamic_cast<UnRedoDup*>(entry))
       UnRedoManager::AddEntry(entry);
      else 
       { wxASSERT(false); }
@@ -1366,7 +1447,8 @@ while (m_UnRedos.size())
     m_UnRedos.pop_front();
   }
 
-for (size_t n=0; n < m_DeleteAfter.GetCount(); ++n) // A Moved dir's contents will have been deleted, but the dir itself will need deleting here
+bool keeporigins = m_gate.IsStoppingForExit() || (m_journal && m_journal->HasRetryableFailures()); // If we were stopped, or the disk filled or went away, some contents weren't moved. A resume will finish the job
+for (size_t n=0; n < m_DeleteAfter.GetCount() && !keeporigins; ++n) // A Moved dir's contents will have been deleted, but the dir itself will need deleting here
   { FileData fd(m_DeleteAfter.Item(n));
     if (fd.IsValid())
       { wxFileName fn(m_DeleteAfter.Item(n));
@@ -1397,14 +1479,14 @@ if (UnRedoManager::ClusterIsOpen)
   UnRedoManager::EndCluster(); // This may call UpdateTrees() internally
  else
   MyFrame::mainframe->UpdateTrees();
-if (m_messagetype != _("cut"))
+if (m_messagetype != tsbm_cut)
   UnRedoManager::CloseSuperCluster(); // Close any supercluster; we want Cut/Paste/Paste to be undone in 2 stages, not 1
 
 wxString msg;
 if (m_failures) // If there were individual failures e.g. files inside dirs didn't paste, report the individual numbers
-  msg << wxString::Format(_("%zu items "), m_successes) << m_messagetype <<  wxString::Format(wxT(" successfully, %zu failed"), m_failures);
+  msg << wxString::Format(_("%zu items "), m_successes) << GetMessageVerb() <<  wxString::Format(wxT(" successfully, %zu failed"), m_failures);
  else           // Otherwise provide the complete list, so a 1000-file dir will report 1000 items
-  { msg << wxString::Format(_("%zu items "), m_overallsuccesses) << m_messagetype;
+  { msg << wxString::Format(_("%zu items "), m_overallsuccesses) << GetMessageVerb();
     if (m_overallfailures) msg << wxString::Format(wxT(" successfully, %zu failed"), m_overallfailures);
   }
 
@@ -1413,6 +1495,18 @@ if (GetUnRedoType() != URT_notunredo)
  else
   BriefLogStatus bls(msg);
 
+if (m_journal)                // If we're exiting, or something failed in a way a resume might get past e.g. the disk went away, keep the journal so the rest can be resumed
+  { if (!m_cancelled && (m_gate.IsStoppingForExit() || m_journal->HasRetryableFailures()))
+      m_journal->Close();
+     else
+      m_journal->Discard();   // It all arrived, the user cancelled, or what failed would only fail again
+    delete m_journal; m_journal = NULL;
+  }
+
+if (m_job)                    // Let the Jobs panel know too
+  { PasteJob* job = m_job; m_job = NULL;
+    job->OnThreadsCompleted(m_failures || m_overallfailures);
+  }
 }
 
 bool ThreadBlock::Contains(unsigned int ID) const
@@ -1480,3 +1574,1615 @@ wxCriticalSectionLocker locker(ThreadsManager::Get().GetPasteCriticalSection());
 if (thread)
   thread->Kill(); 
 }
+
+//-----------------------------------------------------------------------------------------------------------------------
+#include "MyFiles.h"
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#if wxVERSION_NUMBER < 2900
+  DEFINE_EVENT_TYPE(DirSizeType)
+#else
+  wxDEFINE_EVENT(DirSizeType, wxCommandEvent);
+#endif
+
+DirSizeService* DirSizeService::ms_instance = NULL;
+
+DirSizeService::DirSizeService() : m_workcondition(m_mutex), m_generation(0), m_requester(NULL), m_workers(0), m_expanding(0), m_EventPending(false)
+{
+Connect(wxID_ANY, DirSizeType, wxCommandEventHandler(DirSizeService::OnProgress), NULL, this);
+}
+
+void DirSizeService::Request(FileGenericDirCtrl* requester, const wxArrayString& selections)
+{
+Cancel();
+
+wxMutexLocker locker(m_mutex);
+m_requester = requester; m_total = 0; m_workers = 0; m_expanding = 0;
+
+for (size_t n=0; n < selections.GetCount(); ++n)
+  { struct stat st;
+    if (lstat(selections[n].mb_str(wxConvUTF8), &st) == -1) continue;
+    if (S_ISDIR(st.st_mode))
+      { wxString path = StripSep(selections[n]); if (path.empty()) path = wxFILE_SEP_PATH; // as StripSep turns / into ""
+        m_queue.push_back(DirSizeWork(path, st.st_dev, true));
+      }
+     else if (!S_ISLNK(st.st_mode))
+      m_total += st.st_size;                  // A file can be counted here and now
+  }
+
+size_t threads = wxMin(ThreadsManager::GetCPUCount(), wxMax(m_queue.size(), (size_t)1));
+if (m_queue.empty()) threads = 0;             // There's nothing for them to do
+for (size_t n=0; n < threads; ++n)
+  { DirSizeThread* thread = new DirSizeThread(m_generation);
+    wxThreadError error;
+#if wxVERSION_NUMBER < 2905
+    error = thread->Create();
+    if (error == wxTHREAD_NO_ERROR)
+      error = thread->Run();
+#else
+    error = thread->Run(); // >2.9.5 Run() calls Create() itself
+#endif
+    if (error == wxTHREAD_NO_ERROR) ++m_workers;
+     else delete thread;                      // A detached thread that never ran has to be deleted by us
+  }
+
+if (!m_workers)                               // Either there were no dirs, or no thread would start. Either way, report what we have
+  { m_queue.clear();
+    if (!m_EventPending)
+      { m_EventPending = true;
+        wxCommandEvent event(DirSizeType); event.SetInt(m_generation);
+        wxPostEvent(this, event);
+      }
+  }
+}
+
+void DirSizeService::Cancel(const MyGenericDirCtrl* requester /*= NULL*/)
+{
+wxMutexLocker locker(m_mutex);
+if (requester && requester != (const MyGenericDirCtrl*)m_requester) return; // It's someone else's request, so leave it alone
+
+++m_generation;                               // Any threads still running will see this, and stop
+m_requester = NULL;
+m_queue.clear();
+m_workcondition.Broadcast();                  // including any waiting for work
+}
+
+void DirSizeService::Invalidate(const wxString& filepath)
+{
+wxMutexLocker locker(m_mutex);
+if (m_cache.empty()) return;
+
+wxString path = StripSep(filepath);          // The ancestors' entries hold only their own files, so are unaffected
+Uncache(path);
+Uncache(path.BeforeLast(wxFILE_SEP_PATH));
+}
+
+void DirSizeService::Uncache(const wxString& dirname)  // Call with m_mutex held
+{
+std::map<wxString, DirSizeCacheEntry>::iterator iter = m_cache.find(dirname);
+if (iter == m_cache.end()) return;
+m_lru.erase(iter->second.lru);
+m_cache.erase(iter);
+}
+
+bool DirSizeService::GetWork(unsigned int generation, DirSizeWork& work)
+{
+wxMutexLocker locker(m_mutex);
+while (true)
+  { if (generation != m_generation) return false;
+    if (!m_queue.empty())
+      { work = m_queue.front(); m_queue.pop_front();
+        if (work.expand) ++m_expanding;
+        return true;
+      }
+    if (!m_expanding) return false;           // Nothing queued, and nobody is about to queue anything
+    m_workcondition.Wait();                   // Another thread is listing a selected dir, so there may be work soon
+  }
+}
+
+void DirSizeService::AddWork(unsigned int generation, const DirSizeWork& work)
+{
+wxMutexLocker locker(m_mutex);
+if (generation == m_generation)
+  { m_queue.push_back(work); m_workcondition.Signal(); }
+}
+
+void DirSizeService::FinishedExpanding(unsigned int generation)
+{
+wxMutexLocker locker(m_mutex);
+if (generation == m_generation && m_expanding)
+  { --m_expanding;
+    if (!m_expanding) m_workcondition.Broadcast(); // Anyone still waiting can now give up
+  }
+}
+
+void DirSizeService::AddProgress(unsigned int generation, wxULongLong size, bool finished)
+{
+wxMutexLocker locker(m_mutex);
+if (generation != m_generation) return;
+
+m_total += size;
+if (finished && m_workers) --m_workers;
+
+if (!m_EventPending)                          // Don't flood the eventloop: one pending event can report any number of updates
+  { m_EventPending = true;
+    wxCommandEvent event(DirSizeType); event.SetInt(m_generation);
+    wxPostEvent(this, event);
+  }
+}
+
+bool DirSizeService::IsCancelled(unsigned int generation)
+{
+wxMutexLocker locker(m_mutex);
+return generation != m_generation;
+}
+
+bool DirSizeService::GetCachedDir(const wxString& dirname, const struct stat& st, std::string& files, std::vector<wxString>& subdirs)
+{
+wxMutexLocker locker(m_mutex);
+std::map<wxString, DirSizeCacheEntry>::iterator iter = m_cache.find(dirname);
+if (iter == m_cache.end()) return false;
+
+DirSizeCacheEntry& entry = iter->second;
+if (entry.dev != st.st_dev || entry.ino != st.st_ino || entry.mtime != st.st_mtime) // It's been replaced, or had children added or removed, since
+  { Uncache(dirname); return false; }
+
+m_lru.splice(m_lru.begin(), m_lru, entry.lru);
+files = entry.files; subdirs = entry.subdirs;
+return true;
+}
+
+void DirSizeService::CacheDir(const wxString& dirname, const struct stat& st, const std::string& files, const std::vector<wxString>& subdirs)
+{
+if ((time(NULL) - st.st_mtime) < 2) return;  // It's just been changed, and may be again within the same second without its mtime altering. DirCache has the same rule
+
+wxMutexLocker locker(m_mutex);
+std::map<wxString, DirSizeCacheEntry>::iterator iter = m_cache.find(dirname);
+if (iter == m_cache.end())
+  { iter = m_cache.insert(std::make_pair(dirname, DirSizeCacheEntry())).first;
+    m_lru.push_front(dirname);
+  }
+ else m_lru.splice(m_lru.begin(), m_lru, iter->second.lru);
+
+DirSizeCacheEntry& entry = iter->second;
+entry.dev = st.st_dev; entry.ino = st.st_ino; entry.mtime = st.st_mtime; entry.files = files; entry.subdirs = subdirs;
+entry.lru = m_lru.begin();
+
+while (m_cache.size() > DIRSIZE_CACHE_MAX)    // Forget the least recently used
+  Uncache(m_lru.back());
+}
+
+void DirSizeService::OnProgress(wxCommandEvent& event)
+{
+FileGenericDirCtrl* requester; wxULongLong total; bool finished;
+{ wxMutexLocker locker(m_mutex);
+  m_EventPending = false;
+  if ((unsigned int)event.GetInt() != m_generation || !m_requester) return; // Stale
+  requester = m_requester; total = m_total; finished = (m_workers == 0);
+  if (finished) m_requester = NULL;
+}
+
+requester->OnDirSizeProgress(total, finished); // Outside the lock, as this updates the statusbar
+}
+
+//static
+bool DirSizeService::ScanDir(const wxString& dirname, wxULongLong& size, bool countall, std::vector<wxString>* subdirs /*= NULL*/, dev_t dev /*= 0*/, std::string* files /*= NULL*/)
+{   // If countall, add the size of every child, as FileData::Size() would. Otherwise, as nftw's FTW_F, only those of non-dirs and non-symlinks
+int dirfd = open(dirname.mb_str(wxConvUTF8), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+if (dirfd == -1) return false;
+DIR* dp = fdopendir(dirfd);
+if (!dp) { close(dirfd); return false; }
+
+wxString prefix(dirname); if (!prefix.EndsWith(wxT("/"))) prefix << wxFILE_SEP_PATH;
+struct dirent* ep;
+while ((ep = readdir(dp)) != NULL)
+  { if (ep->d_name[0] == '.' && (!ep->d_name[1] || (ep->d_name[1] == '.' && !ep->d_name[2]))) continue; // Ignore . and ..
+
+    struct stat st;
+    if (fstatat(dirfd, ep->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) continue;  // Relative to the open dir, so no path to build and resolve
+
+    if (S_ISDIR(st.st_mode))
+      { if (countall) size += st.st_size;
+        if (subdirs && st.st_dev == dev)      // Don't wander onto other filesystems
+          subdirs->push_back(prefix + wxString(ep->d_name, wxConvUTF8));
+      }
+     else if (countall || !S_ISLNK(st.st_mode))
+      { size += st.st_size;
+        if (files) { files->append(ep->d_name); files->push_back('\0'); }
+      }
+  }
+
+closedir(dp);                                 // This closes dirfd too
+return true;
+}
+
+//static
+void DirSizeService::StatFiles(const wxString& dirname, const std::string& files, wxULongLong& size)
+{
+int dirfd = open(dirname.mb_str(wxConvUTF8), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+if (dirfd == -1) return;
+
+for (size_t pos = 0; pos < files.size(); pos = files.find('\0', pos) + 1)
+  { struct stat st;                           // No readdir() needed, as the dir's mtime says nothing's been added or removed
+    if (fstatat(dirfd, files.c_str() + pos, &st, AT_SYMLINK_NOFOLLOW) == 0 && !S_ISDIR(st.st_mode) && !S_ISLNK(st.st_mode))
+      size += st.st_size;
+  }
+close(dirfd);
+}
+
+void* DirSizeThread::Entry()
+{
+DirSizeService& service = DirSizeService::Get();
+m_lastreport = wxGetLocalTimeMillis();
+
+DirSizeWork work(wxT(""), 0, false);
+while (!TestDestroy() && service.GetWork(m_generation, work))
+  { if (work.expand)                          // A selected dir. Count its files, and share out its subdirs
+      { wxULongLong size; std::vector<wxString> subdirs;
+        DirSizeService::ScanDir(work.path, size, false, &subdirs, work.dev);
+        m_unreported += size;
+        for (size_t n=0; n < subdirs.size(); ++n)
+          service.AddWork(m_generation, DirSizeWork(subdirs[n], work.dev, false));
+        service.FinishedExpanding(m_generation);
+      }
+     else if (!Walk(work.path, work.dev)) break;
+    Report(false);
+  }
+
+Report(true);
+return NULL;
+}
+
+bool DirSizeThread::Walk(const wxString& dirname, dev_t dev)
+{
+DirSizeService& service = DirSizeService::Get();
+if (TestDestroy() || service.IsCancelled(m_generation)) return false;
+
+struct stat st;
+if (lstat(dirname.mb_str(wxConvUTF8), &st) == -1) return true;
+
+wxULongLong total; std::vector<wxString> subdirs; std::string files;
+if (service.GetCachedDir(dirname, st, files, subdirs))  // If nothing's been added or removed since we last listed it, its files need only be stat()ed
+  DirSizeService::StatFiles(dirname, files, total);
+ else if (DirSizeService::ScanDir(dirname, total, false, &subdirs, dev, &files))
+  service.CacheDir(dirname, st, files, subdirs);
+m_unreported += total;
+
+for (size_t n=0; n < subdirs.size(); ++n)
+  if (!Walk(subdirs[n], dev)) return false;
+
+Report(false);
+return true;
+}
+
+void DirSizeThread::Report(bool finished)
+{
+wxLongLong now = wxGetLocalTimeMillis();
+if (!finished && (now - m_lastreport) < 200) return; // Often enough for the statusbar to look alive
+
+DirSizeService::Get().AddProgress(m_generation, m_unreported, finished);
+m_unreported = 0; m_lastreport = now;
+}
+
+#if wxVERSION_NUMBER < 2900
+  DEFINE_EVENT_TYPE(FlatWalkType)
+#else
+  wxDEFINE_EVENT(FlatWalkType, wxCommandEvent);
+#endif
+
+FlatWalkService* FlatWalkService::ms_instance = NULL;
+
+FlatWalkService::FlatWalkService() : m_nextid(1)
+{
+Connect(wxID_ANY, FlatWalkType, wxCommandEventHandler(FlatWalkService::OnResults), NULL, this);
+}
+
+void FlatWalkService::Request(FileGenericDirCtrl* requester, const wxString& dirname, bool showhidden, const wxArrayString& filters, bool incremental /*= false*/)
+{
+wxCHECK_RET(requester, wxT("A flat walk needs a requester"));
+if (!incremental) Cancel(requester);          // A fresh walk supersedes any earlier one. Incremental ones add to it
+
+struct stat st;
+if ((lstat(dirname.mb_str(wxConvUTF8), &st) == -1) || !S_ISDIR(st.st_mode)) return;
+
+FlatWalkJob* job = new FlatWalkJob;
+job->requester = requester; job->incremental = incremental; job->showhidden = showhidden; job->filters = filters;
+job->busy = 0; job->workers = 0; job->cancelled = false; job->EventPending = false;
+wxString path = StripSep(dirname); if (path.empty()) path = wxFILE_SEP_PATH; // as StripSep turns / into ""
+job->queue.push_back(std::make_pair(path, st.st_dev));
+
+wxCriticalSectionLocker locker(m_CritSection);
+unsigned int id = m_nextid++;
+m_jobs[id] = job;
+
+size_t threads = incremental ? 1 : wxMax(ThreadsManager::GetCPUCount(), (size_t)1); // A new dir is usually small; a whole subtree may not be
+for (size_t n=0; n < threads; ++n)
+  { FlatWalkThread* thread = new FlatWalkThread(id);
+    wxThreadError error;
+#if wxVERSION_NUMBER < 2905
+    error = thread->Create();
+    if (error == wxTHREAD_NO_ERROR)
+      error = thread->Run();
+#else
+    error = thread->Run(); // >2.9.5 Run() calls Create() itself
+#endif
+    if (error == wxTHREAD_NO_ERROR) ++job->workers;
+     else delete thread;                      // A detached thread that never ran has to be deleted by us
+  }
+
+if (!job->workers)
+  { m_jobs.erase(id); delete job; }
+}
+
+void FlatWalkService::Cancel(const MyGenericDirCtrl* requester)
+{
+wxCriticalSectionLocker locker(m_CritSection);
+std::map<unsigned int, FlatWalkJob*>::iterator iter = m_jobs.begin();
+while (iter != m_jobs.end())
+  { FlatWalkJob* job = iter->second;
+    if ((const MyGenericDirCtrl*)job->requester != requester) { ++iter; continue; }
+
+    job->cancelled = true; job->requester = NULL; // Any threads still running will see this, and stop
+    job->queue.clear();
+    for (size_t n=0; n < job->entries.size(); ++n) delete job->entries[n];
+    job->entries.clear();
+
+    if (!job->workers)                        // Nobody is left to use it
+      { delete job; m_jobs.erase(iter++); }
+     else ++iter;                             // The last worker will delete it
+  }
+}
+
+bool FlatWalkService::GetWork(unsigned int id, wxString& dirname, dev_t& dev)
+{
+while (true)
+  { { wxCriticalSectionLocker locker(m_CritSection);
+      std::map<unsigned int, FlatWalkJob*>::iterator iter = m_jobs.find(id);
+      if (iter == m_jobs.end() || iter->second->cancelled) return false;
+      FlatWalkJob* job = iter->second;
+      if (!job->queue.empty())
+        { dirname = job->queue.front().first; dev = job->queue.front().second; job->queue.pop_front();
+          ++job->busy;
+          return true;
+        }
+      if (!job->busy) return false;           // Nothing queued, and nobody is about to queue anything
+    }
+    wxMilliSleep(10);                         // Another thread is listing a dir, so there may be work soon
+  }
+}
+
+void FlatWalkService::AddWork(unsigned int id, const std::vector<wxString>& subdirs, dev_t dev, std::vector<DataBase*>& entries, const wxString& dirname)
+{
+wxCriticalSectionLocker locker(m_CritSection);
+std::map<unsigned int, FlatWalkJob*>::iterator iter = m_jobs.find(id);
+if (iter == m_jobs.end() || iter->second->cancelled)
+  { for (size_t n=0; n < entries.size(); ++n) delete entries[n];
+    entries.clear();
+    if (iter != m_jobs.end() && iter->second->busy) --iter->second->busy;
+    return;
+  }
+
+FlatWalkJob* job = iter->second;
+for (size_t n=0; n < subdirs.size(); ++n)
+  job->queue.push_back(std::make_pair(subdirs[n], dev));
+job->entries.insert(job->entries.end(), entries.begin(), entries.end());
+entries.clear();                              // They're the job's now
+job->dirs.Add(dirname);
+if (job->busy) --job->busy;
+
+PostIfNeeded(id, job);
+}
+
+bool FlatWalkService::GetSettings(unsigned int id, bool& showhidden, wxArrayString& filters)
+{
+wxCriticalSectionLocker locker(m_CritSection);
+std::map<unsigned int, FlatWalkJob*>::iterator iter = m_jobs.find(id);
+if (iter == m_jobs.end() || iter->second->cancelled) return false;
+
+showhidden = iter->second->showhidden; filters = iter->second->filters;
+return true;
+}
+
+void FlatWalkService::WorkerFinished(unsigned int id)
+{
+wxCriticalSectionLocker locker(m_CritSection);
+std::map<unsigned int, FlatWalkJob*>::iterator iter = m_jobs.find(id);
+if (iter == m_jobs.end()) return;
+
+FlatWalkJob* job = iter->second;
+if (job->workers) --job->workers;
+if (job->workers) return;
+
+if (job->cancelled)
+  { delete job; m_jobs.erase(iter); }
+ else
+  PostIfNeeded(id, job);                      // Even if there's nothing new, the requester needs to know we've finished
+}
+
+void FlatWalkService::PostIfNeeded(unsigned int id, FlatWalkJob* job) // Must be called with m_CritSection locked
+{
+if (job->EventPending) return;                // Don't flood the eventloop: one pending event can deliver any number of entries
+
+job->EventPending = true;
+wxCommandEvent event(FlatWalkType); event.SetInt(id);
+wxPostEvent(this, event);
+}
+
+void FlatWalkService::OnResults(wxCommandEvent& event)
+{
+FileGenericDirCtrl* requester; bool finished, incremental;
+std::vector<DataBase*> entries; wxArrayString dirs;
+{ wxCriticalSectionLocker locker(m_CritSection);
+  std::map<unsigned int, FlatWalkJob*>::iterator iter = m_jobs.find((unsigned int)event.GetInt());
+  if (iter == m_jobs.end()) return;           // Stale
+  FlatWalkJob* job = iter->second;
+  job->EventPending = false;
+  if (job->cancelled || !job->requester) return;
+
+  requester = job->requester; incremental = job->incremental;
+  entries.swap(job->entries); dirs = job->dirs; job->dirs.Clear();
+  finished = (job->workers == 0);
+  if (finished) { delete job; m_jobs.erase(iter); }
+}
+
+requester->OnFlatWalkResults(entries, dirs, finished, incremental); // Outside the lock, as this adds to the tree. It takes ownership of the entries
+}
+
+//static
+bool FlatWalkService::IsWanted(const wxString& name, bool showhidden, const wxArrayString& filters)
+{
+if (!showhidden && name.StartsWith(wxT("."))) return false;
+if (filters.IsEmpty() || ((filters.GetCount() == 1) && (filters[0].empty() || filters[0] == wxT("*")))) return true;
+
+for (size_t n=0; n < filters.GetCount(); ++n) // As in ExpandDir, a match with any of the filters will do
+  if (wxMatchWild(filters[n], name)) return true;
+return false;
+}
+
+void* FlatWalkThread::Entry()
+{
+FlatWalkService& service = FlatWalkService::Get();
+bool showhidden; wxArrayString filters;
+if (!service.GetSettings(m_id, showhidden, filters))
+  { service.WorkerFinished(m_id); return NULL; }
+
+wxString dirname; dev_t dev;
+while (!TestDestroy() && service.GetWork(m_id, dirname, dev))
+  { std::vector<wxString> subdirs; std::vector<DataBase*> entries;
+    int dirfd = open(dirname.mb_str(wxConvUTF8), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR* dp = (dirfd != -1) ? fdopendir(dirfd) : NULL;
+    if (!dp && dirfd != -1) close(dirfd);
+    if (dp)
+      { wxString prefix(dirname); if (!prefix.EndsWith(wxT("/"))) prefix << wxFILE_SEP_PATH;
+        struct dirent* ep;
+        while ((ep = readdir(dp)) != NULL)
+          { if (ep->d_name[0] == '.' && (!ep->d_name[1] || (ep->d_name[1] == '.' && !ep->d_name[2]))) continue; // Ignore . and ..
+            wxString name(ep->d_name, wxConvUTF8);
+
+            bool isdir = (ep->d_type == DT_DIR);
+            if (ep->d_type == DT_DIR || ep->d_type == DT_UNKNOWN) // Some filesystems don't fill in d_type. For dirs we need the device anyway
+              { struct stat st;
+                if (fstatat(dirfd, ep->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) continue;
+                isdir = S_ISDIR(st.st_mode);
+                if (isdir)
+                  { if ((showhidden || !name.StartsWith(wxT("."))) && (st.st_dev == dev)) // Like find -xdev, don't wander onto other filesystems
+                      subdirs.push_back(prefix + name);
+                    continue;
+                  }
+              }
+
+            if (FlatWalkService::IsWanted(name, showhidden, filters))
+              entries.push_back(new FileData(prefix + name)); // This is what ExpandDir would store, symlink target and all
+          }
+        closedir(dp);                         // This closes dirfd too
+      }
+
+    service.AddWork(m_id, subdirs, dev, entries, dirname);
+  }
+
+service.WorkerFinished(m_id);
+return NULL;
+}
+
+#if wxVERSION_NUMBER < 2900
+  DEFINE_EVENT_TYPE(DirCacheCheckType)
+#else
+  wxDEFINE_EVENT(DirCacheCheckType, wxCommandEvent);
+#endif
+
+DirCache* DirCache::ms_instance = NULL;
+
+static const char DIRCACHE_MAGIC[4] = { '4', 'P', 'D', 'C' };
+static const wxUint32 DIRCACHE_VERSION = 1;
+
+DirCache::DirCache() : m_count(0), m_loaded(false), m_dirty(false), m_nextid(1)
+{
+Connect(wxID_ANY, DirCacheCheckType, wxCommandEventHandler(DirCache::OnCheckDone), NULL, this);
+}
+
+//static
+void DirCache::Shutdown()
+{
+if (!ms_instance) return;
+
+if (USE_DIR_CACHE && ms_instance->m_dirty) ms_instance->Save();
+{ wxCriticalSectionLocker locker(ms_instance->m_CritSection);
+  for (std::map<unsigned int, DirCacheCheck>::iterator iter = ms_instance->m_checks.begin(); iter != ms_instance->m_checks.end(); ++iter)
+    iter->second.requester = NULL;             // Any thread still running will find nothing to report to
+}
+}
+
+//static
+void DirCache::Discard()
+{
+DirCache& cache = Get();
+cache.m_dirs.clear(); cache.m_lru.clear(); cache.m_count = 0;
+cache.m_loaded = true; cache.m_dirty = false;  // There's nothing worth loading now
+
+wxString filepath = GetCacheFilepath();
+if (!filepath.empty() && wxFileExists(filepath)) wxRemoveFile(filepath);
+}
+
+//static
+wxString DirCache::GetCacheFilepath()
+{
+wxString dir;
+if (!wxGetEnv(wxT("XDG_CACHE_HOME"), &dir) || dir.empty())
+  dir = wxGetHomeDir() + wxT("/.cache");
+return StrWithSep(dir) + wxT("4Pane/dircache");
+}
+
+void DirCache::Begin(const wxString& dirname, DirCacheListing& listing)
+{
+listing.valid = (stat(dirname.mb_str(wxConvUTF8), &listing.dirst) == 0); // stat not lstat, as dirname may be a symlink-to-dir
+if (!USE_DIR_CACHE || !listing.valid) return;
+
+if (!m_loaded) Load();
+
+wxString key = StripSep(dirname);
+std::map<wxString, DirCacheEntry>::iterator iter = m_dirs.find(key);
+if (iter == m_dirs.end()) return;
+
+DirCacheEntry& entry = iter->second;
+if (entry.dev != listing.dirst.st_dev || entry.ino != listing.dirst.st_ino
+          || entry.mtime != listing.dirst.st_mtime || entry.ctime != listing.dirst.st_ctime)
+  { Remove(iter); m_dirty = true; return; }    // Something's been added, removed or renamed since, so start again
+
+Touch(key, entry);
+listing.cached = &entry.children;
+}
+
+FileData* DirCache::NewFileData(const wxString& dirname, const wxString& name, DirCacheListing& listing)
+{
+wxString filepath(dirname + name);             // ExpandDir's dirname already has its terminal '/'
+if (listing.cached)
+  { DirCacheChildren::const_iterator iter = listing.cached->find(name);
+    if (iter != listing.cached->end())
+      { listing.used.push_back(name);
+        return new FileData(filepath, iter->second);
+      }
+  }
+
+FileData* fd = new FileData(filepath);
+if (USE_DIR_CACHE && listing.valid && fd->IsValid() && !fd->IsSymlink()) // A symlink's FileData holds its target's data too, so don't cache those
+  listing.fresh[name] = *fd->GetStatstruct();
+return fd;
+}
+
+void DirCache::End(const wxString& dirname, DirCacheListing& listing, FileGenericDirCtrl* requester /*= NULL*/)
+{
+if (!USE_DIR_CACHE || !listing.valid) return;
+
+if (requester && !listing.used.empty())        // The cached children were right when the dir last changed, but a file may since have been written to
+  { wxCriticalSectionLocker locker(m_CritSection);
+    unsigned int id = m_nextid++;
+    DirCacheCheck& check = m_checks[id];
+    check.requester = requester; check.dirname = dirname;
+    for (size_t n=0; n < listing.used.size(); ++n)
+      check.todo.push_back(std::make_pair(listing.used[n], listing.cached->find(listing.used[n])->second));
+
+    DirCacheCheckThread* thread = new DirCacheCheckThread(id);
+    wxThreadError error;
+#if wxVERSION_NUMBER < 2905
+    error = thread->Create();
+    if (error == wxTHREAD_NO_ERROR)
+      error = thread->Run();
+#else
+    error = thread->Run(); // >2.9.5 Run() calls Create() itself
+#endif
+    if (error != wxTHREAD_NO_ERROR)
+      { delete thread; m_checks.erase(id); }   // A detached thread that never ran has to be deleted by us. Never mind; the cached data is probably fine
+  }
+
+if (listing.fresh.empty()) return;
+
+time_t now = time(NULL);                       // If the dir changed within the last couple of seconds, a further change might not alter its mtime. So don't trust it yet
+if ((now - listing.dirst.st_mtime) < 2 || (now - listing.dirst.st_ctime) < 2) return;
+
+wxString key = StripSep(dirname);
+std::map<wxString, DirCacheEntry>::iterator iter = m_dirs.find(key);
+if (iter == m_dirs.end())
+  { DirCacheEntry newentry;
+    newentry.dev = listing.dirst.st_dev; newentry.ino = listing.dirst.st_ino;
+    newentry.mtime = listing.dirst.st_mtime; newentry.ctime = listing.dirst.st_ctime;
+    m_lru.push_front(key);
+    newentry.lru = m_lru.begin();
+    iter = m_dirs.insert(std::make_pair(key, newentry)).first;
+  }
+ else Touch(key, iter->second);
+
+DirCacheChildren& children = iter->second.children;
+for (DirCacheChildren::const_iterator child = listing.fresh.begin(); child != listing.fresh.end(); ++child)
+  { if (children.find(child->first) == children.end()) ++m_count;
+    children[child->first] = child->second;
+  }
+listing.cached = NULL;                         // as Evict() might remove it
+m_dirty = true;
+
+Evict();
+}
+
+void DirCache::Cancel(const MyGenericDirCtrl* requester)
+{
+wxCriticalSectionLocker locker(m_CritSection);
+for (std::map<unsigned int, DirCacheCheck>::iterator iter = m_checks.begin(); iter != m_checks.end(); ++iter)
+  if ((const MyGenericDirCtrl*)iter->second.requester == requester)
+    iter->second.requester = NULL;
+}
+
+bool DirCache::GetCheck(unsigned int id, wxString& dirname, std::vector< std::pair<wxString, struct stat> >& todo)
+{
+wxCriticalSectionLocker locker(m_CritSection);
+std::map<unsigned int, DirCacheCheck>::iterator iter = m_checks.find(id);
+if (iter == m_checks.end() || !iter->second.requester) return false;
+
+dirname = iter->second.dirname; todo = iter->second.todo;
+return true;
+}
+
+void DirCache::CheckDone(unsigned int id, const std::vector< std::pair<wxString, struct stat> >& changed, const std::vector<wxString>& vanished)
+{
+wxCriticalSectionLocker locker(m_CritSection);
+std::map<unsigned int, DirCacheCheck>::iterator iter = m_checks.find(id);
+if (iter == m_checks.end()) return;
+
+iter->second.changed = changed; iter->second.vanished = vanished;
+wxCommandEvent event(DirCacheCheckType); event.SetInt(id);
+wxPostEvent(this, event);
+}
+
+void DirCache::OnCheckDone(wxCommandEvent& event)
+{
+DirCacheCheck check;
+{ wxCriticalSectionLocker locker(m_CritSection);
+  std::map<unsigned int, DirCacheCheck>::iterator iter = m_checks.find((unsigned int)event.GetInt());
+  if (iter == m_checks.end()) return;
+  check = iter->second;
+  m_checks.erase(iter);
+}
+
+std::map<wxString, DirCacheEntry>::iterator entry = m_dirs.find(StripSep(check.dirname));
+if (entry != m_dirs.end())
+  { for (size_t n=0; n < check.changed.size(); ++n)
+      entry->second.children[check.changed[n].first] = check.changed[n].second;
+    for (size_t n=0; n < check.vanished.size(); ++n)
+      if (entry->second.children.erase(check.vanished[n])) --m_count;
+    if (!check.changed.empty() || !check.vanished.empty()) m_dirty = true;
+  }
+
+if (!check.requester || (StripSep(check.requester->startdir) != StripSep(check.dirname))) return; // The pane's gone, or has moved on
+
+for (size_t n=0; n < check.changed.size(); ++n)
+  check.requester->QueueResort(check.dirname + check.changed[n].first); // This re-stats, and moves the entry if its sort position has changed
+for (size_t n=0; n < check.vanished.size(); ++n)
+  check.requester->QueueResort(check.dirname + check.vanished[n]);
+}
+
+void DirCache::Touch(const wxString& dirname, DirCacheEntry& entry)
+{
+m_lru.erase(entry.lru);
+m_lru.push_front(dirname);
+entry.lru = m_lru.begin();
+}
+
+void DirCache::Remove(std::map<wxString, DirCacheEntry>::iterator iter)
+{
+m_count -= wxMin(m_count, iter->second.children.size());
+m_lru.erase(iter->second.lru);
+m_dirs.erase(iter);
+}
+
+void DirCache::Evict()
+{
+while ((m_count > DIR_CACHE_MAX_ENTRIES) && (m_lru.size() > 1)) // Always keep the most recent, however big
+  { std::map<wxString, DirCacheEntry>::iterator iter = m_dirs.find(m_lru.back());
+    if (iter == m_dirs.end()) { m_lru.pop_back(); continue; } // Shouldn't happen
+    Remove(iter);
+  }
+}
+
+static bool DirCacheRead(FILE* fp, void* buf, size_t len) { return fread(buf, 1, len, fp) == len; }
+
+static bool DirCacheReadString(FILE* fp, wxString& str)
+{
+wxUint32 len;
+if (!DirCacheRead(fp, &len, sizeof(len)) || len > 65536) return false;
+std::vector<char> buf(len + 1, 0);
+if (len && !DirCacheRead(fp, &buf[0], len)) return false;
+str = wxString(&buf[0], wxConvUTF8, len);
+return true;
+}
+
+static bool DirCacheWriteString(FILE* fp, const wxString& str)
+{
+wxCharBuffer buf = str.utf8_str();
+wxUint32 len = strlen(buf.data());
+return (fwrite(&len, sizeof(len), 1, fp) == 1) && (fwrite(buf.data(), 1, len, fp) == len);
+}
+
+void DirCache::Load()
+{
+m_loaded = true;
+FILE* fp = fopen(GetCacheFilepath().mb_str(wxConvUTF8), "rb");
+if (!fp) return;
+
+char magic[4]; wxUint32 version, statsize, dircount;
+bool ok = DirCacheRead(fp, magic, 4) && !memcmp(magic, DIRCACHE_MAGIC, 4)
+            && DirCacheRead(fp, &version, sizeof(version)) && (version == DIRCACHE_VERSION)
+            && DirCacheRead(fp, &statsize, sizeof(statsize)) && (statsize == sizeof(struct stat)) // Otherwise it was written by a different build
+            && DirCacheRead(fp, &dircount, sizeof(dircount));
+
+for (wxUint32 d=0; ok && d < dircount; ++d)   // The dirs were saved most-recently-used first
+  { wxString dirname; wxInt64 fields[4]; wxUint32 childcount;
+    ok = DirCacheReadString(fp, dirname) && DirCacheRead(fp, fields, sizeof(fields)) && DirCacheRead(fp, &childcount, sizeof(childcount));
+    if (!ok) break;
+
+    DirCacheEntry entry;
+    entry.dev = (dev_t)fields[0]; entry.ino = (ino_t)fields[1]; entry.mtime = (time_t)fields[2]; entry.ctime = (time_t)fields[3];
+    for (wxUint32 c=0; ok && c < childcount; ++c)
+      { wxString name; struct stat st;
+        ok = DirCacheReadString(fp, name) && DirCacheRead(fp, &st, sizeof(st));
+        if (ok) entry.children[name] = st;
+      }
+    if (!ok || m_dirs.count(dirname)) break;
+
+    m_lru.push_back(dirname);
+    entry.lru = --m_lru.end();
+    m_count += entry.children.size();
+    m_dirs.insert(std::make_pair(dirname, entry));
+  }
+fclose(fp);
+
+if (!ok)                                       // A corrupt or incompatible file is just ignored, and will be overwritten
+  { m_dirs.clear(); m_lru.clear(); m_count = 0; }
+Evict();                                       // in case DIR_CACHE_MAX_ENTRIES has been reduced
+}
+
+bool DirCache::Save()
+{
+wxString filepath = GetCacheFilepath();
+wxString dir = filepath.BeforeLast(wxFILE_SEP_PATH);
+if (!wxDirExists(dir) && !wxFileName::Mkdir(dir, 0700, wxPATH_MKDIR_FULL)) return false;
+
+wxString tempfilepath = filepath + wxT(".tmp");
+FILE* fp = fopen(tempfilepath.mb_str(wxConvUTF8), "wb");
+if (!fp) return false;
+
+wxUint32 version = DIRCACHE_VERSION, statsize = sizeof(struct stat), dircount = m_lru.size();
+bool ok = (fwrite(DIRCACHE_MAGIC, 4, 1, fp) == 1) && (fwrite(&version, sizeof(version), 1, fp) == 1)
+            && (fwrite(&statsize, sizeof(statsize), 1, fp) == 1) && (fwrite(&dircount, sizeof(dircount), 1, fp) == 1);
+
+for (std::list<wxString>::const_iterator iter = m_lru.begin(); ok && iter != m_lru.end(); ++iter)
+  { const DirCacheEntry& entry = m_dirs[*iter];
+    wxInt64 fields[4] = { (wxInt64)entry.dev, (wxInt64)entry.ino, (wxInt64)entry.mtime, (wxInt64)entry.ctime };
+    wxUint32 childcount = entry.children.size();
+    ok = DirCacheWriteString(fp, *iter) && (fwrite(fields, sizeof(fields), 1, fp) == 1) && (fwrite(&childcount, sizeof(childcount), 1, fp) == 1);
+    for (DirCacheChildren::const_iterator child = entry.children.begin(); ok && child != entry.children.end(); ++child)
+      ok = DirCacheWriteString(fp, child->first) && (fwrite(&child->second, sizeof(struct stat), 1, fp) == 1);
+  }
+
+if (fclose(fp) != 0) ok = false;
+if (ok) ok = (rename(tempfilepath.mb_str(wxConvUTF8), filepath.mb_str(wxConvUTF8)) == 0); // so a crash mid-save can't leave a truncated cache
+if (!ok) { wxRemoveFile(tempfilepath); return false; }
+
+m_dirty = false;
+return true;
+}
+
+void* DirCacheCheckThread::Entry()
+{
+wxString dirname; std::vector< std::pair<wxString, struct stat> > todo;
+if (!DirCache::Get().GetCheck(m_id, dirname, todo)) return NULL;
+
+std::vector< std::pair<wxString, struct stat> > changed; std::vector<wxString> vanished;
+for (size_t n=0; n < todo.size() && !TestDestroy(); ++n)
+  { struct stat st;
+    if (lstat((dirname + todo[n].first).mb_str(wxConvUTF8), &st) == -1)
+      { vanished.push_back(todo[n].first); continue; }
+
+    const struct stat& old = todo[n].second;
+    if (st.st_size != old.st_size || st.st_mtime != old.st_mtime || st.st_ctime != old.st_ctime || st.st_mode != old.st_mode
+          || st.st_ino != old.st_ino || st.st_uid != old.st_uid || st.st_gid != old.st_gid || st.st_nlink != old.st_nlink)
+      changed.push_back(std::make_pair(todo[n].first, st));
+  }
+
+DirCache::Get().CheckDone(m_id, changed, vanished);
+return NULL;
+}
+
+#include "Archive.h"
+
+#if wxVERSION_NUMBER < 2900
+  DEFINE_EVENT_TYPE(FileSniffType)
+#else
+  wxDEFINE_EVENT(FileSniffType, wxCommandEvent);
+#endif
+
+const size_t FILESNIFF_WINDOW = 512;           // Enough for all the magic numbers we look for, including tar's at offset 257
+const size_t FILESNIFF_BATCH = 32;             // How many files at a time to ask the kernel to read ahead
+const size_t FILESNIFF_MAX_PER_DIR = 2000;     // The most of a fileview's files to sniff in the background
+const size_t FILESNIFF_MAX_CACHED = 50000;     // Beyond that the cache is just emptied. Refilling it is cheap
+
+FileClassifier* FileClassifier::ms_instance = NULL;
+
+FileClassifier::FileClassifier() : m_nextid(1)
+{
+Connect(wxID_ANY, FileSniffType, wxCommandEventHandler(FileClassifier::OnJobDone), NULL, this);
+}
+
+static bool SniffMatch(const unsigned char* buf, size_t len, size_t offset, const char* magic, size_t magiclen)
+{
+return (offset + magiclen <= len) && !memcmp(buf + offset, magic, magiclen);
+}
+
+static bool SniffContains(const unsigned char* buf, size_t len, const char* str)
+{
+size_t strlength = strlen(str);
+for (size_t n=0; n + strlength <= len; ++n)
+  if (!memcmp(buf + n, str, strlength)) return true;
+return false;
+}
+
+static int ZipFamily(enum ziptype zt)            // Lumps together the zts that share a magic number e.g. foo.gz and foo.tar.gz
+{
+switch(zt)
+  { case zt_targz:   return zt_gzip;
+    case zt_tarbz:   return zt_bzip;
+    case zt_tarlzma: return zt_lzma;
+    case zt_tarxz:   return zt_xz;
+    case zt_tarlzop: return zt_lzop;
+    case zt_taZ:     return zt_compress;
+    case zt_tarzst:  return zt_zstd;
+    case zt_tarlz4:  return zt_lz4;
+    case zt_tar7z:   return zt_7z;
+    case zt_deb:     return zt_ar;                 // A .deb is an ar archive
+    case zt_htb:     return zt_zip;                // and a .htb a zip
+     default:        return zt;
+  }
+}
+
+//static
+SniffedType FileClassifier::Sniff(const unsigned char* buf, size_t len)
+{
+if (!len) return SniffedType(sk_empty);
+
+if (SniffMatch(buf, len, 0, "\x1f\x8b", 2))                 return SniffedType(sk_archive, zt_gzip);
+if (SniffMatch(buf, len, 0, "BZh", 3) && len > 3 && buf[3] >= '1' && buf[3] <= '9') return SniffedType(sk_archive, zt_bzip);
+if (SniffMatch(buf, len, 0, "\xfd" "7zXZ\0", 6))            return SniffedType(sk_archive, zt_xz);
+if (SniffMatch(buf, len, 0, "\x89" "LZO\0\r\n\x1a\n", 9))   return SniffedType(sk_archive, zt_lzop);
+if (SniffMatch(buf, len, 0, "\x1f\x9d", 2))                 return SniffedType(sk_archive, zt_compress);
+if (SniffMatch(buf, len, 0, "\x28\xb5\x2f\xfd", 4))         return SniffedType(sk_archive, zt_zstd);
+if (SniffMatch(buf, len, 0, "\x04\x22\x4d\x18", 4))         return SniffedType(sk_archive, zt_lz4);
+if (SniffMatch(buf, len, 0, "7z\xbc\xaf\x27\x1c", 6))       return SniffedType(sk_archive, zt_7z);
+if (SniffMatch(buf, len, 0, "Rar!\x1a\x07", 6))             return SniffedType(sk_archive, zt_rar);
+if (SniffMatch(buf, len, 0, "PK\x03\x04", 4) || SniffMatch(buf, len, 0, "PK\x05\x06", 4)) return SniffedType(sk_archive, zt_zip); // The latter is an empty zip
+if (SniffMatch(buf, len, 0, "!<arch>\n", 8))                return SniffedType(sk_archive, zt_ar);
+if (SniffMatch(buf, len, 0, "\xed\xab\xee\xdb", 4))         return SniffedType(sk_archive, zt_rpm);
+if (SniffMatch(buf, len, 0, "07070", 5) && len > 5 && (buf[5] == '1' || buf[5] == '2' || buf[5] == '7')) return SniffedType(sk_archive, zt_cpio);
+if (SniffMatch(buf, len, 257, "ustar", 5))                  return SniffedType(sk_archive, zt_taronly);
+if (len >= 13 && buf[0] == 0x5d && buf[1] == 0 && buf[2] == 0) return SniffedType(sk_archive, zt_lzma); // lzma has no real magic, but this is what the usual settings produce
+
+if (SniffMatch(buf, len, 0, "\x7f" "ELF", 4))               return SniffedType(sk_elf);
+
+if (SniffMatch(buf, len, 0, "\x89PNG\r\n\x1a\n", 8) || SniffMatch(buf, len, 0, "\xff\xd8\xff", 3)
+      || SniffMatch(buf, len, 0, "GIF87a", 6) || SniffMatch(buf, len, 0, "GIF89a", 6)
+      || SniffMatch(buf, len, 0, "II*\0", 4) || SniffMatch(buf, len, 0, "MM\0*", 4)
+      || SniffMatch(buf, len, 0, "/* XPM */", 9))
+  return SniffedType(sk_image);
+if (SniffMatch(buf, len, 0, "BM", 2) && len >= 26 && !buf[6] && !buf[7] && !buf[8] && !buf[9]) // A bmp's 'reserved' bytes are always 0, which weeds out text starting "BM"
+  return SniffedType(sk_image);
+if (len >= 6 && !buf[0] && !buf[1] && (buf[2] == 1 || buf[2] == 2) && !buf[3] && (buf[4] || buf[5])) // .ico or .cur, with a non-zero number of images
+  return SniffedType(sk_image);
+
+if (SniffMatch(buf, len, 0, "#!", 2))                       return SniffedType(sk_script);
+
+size_t start = SniffMatch(buf, len, 0, "\xef\xbb\xbf", 3) ? 3 : 0; // Skip any utf-8 BOM
+while (start < len && isspace(buf[start])) ++start;
+if (start < len && buf[start] == '<' && SniffContains(buf + start, len - start, "<svg"))
+  return SniffedType(sk_svg);
+
+size_t controls(0);
+for (size_t n=0; n < len; ++n)                 // Otherwise it's text if there are no NULs and few control chars. Anything non-ascii is assumed to be utf-8 or a legacy 8-bit charset
+  { unsigned char c = buf[n];
+    if (!c) return SniffedType(sk_data);
+    if ((c < 0x20 && c != '\t' && c != '\n' && c != '\r' && c != '\f' && c != '\v' && c != '\b' && c != 0x1b) || c == 0x7f)
+      ++controls;
+  }
+return SniffedType((controls * 10 > len) ? sk_data : sk_text);
+}
+
+//static
+void FileClassifier::SniffBatch(const std::vector<wxString>& filepaths, std::vector<SniffedFile>& results)
+{
+for (size_t start=0; start < filepaths.size(); start += FILESNIFF_BATCH)
+  { size_t end = wxMin(start + FILESNIFF_BATCH, filepaths.size());
+    std::vector<int> fds;
+    for (size_t n=start; n < end; ++n)         // Open the whole batch and ask for each's first bytes, so that the reads can be serviced together rather than one seek at a time
+      { int fd = open(filepaths[n].mb_str(wxConvUTF8), O_RDONLY | O_NONBLOCK); // O_NONBLOCK in case it's been replaced by a fifo
+        if (fd != -1) posix_fadvise(fd, 0, FILESNIFF_WINDOW, POSIX_FADV_WILLNEED);
+        fds.push_back(fd);
+      }
+
+    for (size_t n=start; n < end; ++n)
+      { int fd = fds[n - start];
+        if (fd == -1) continue;
+
+        struct stat st; unsigned char buf[FILESNIFF_WINDOW];
+        if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode))  // fstat, not the caller's stat, so that the data matches what we read
+          { ssize_t len = pread(fd, buf, sizeof(buf), 0);
+            if (len >= 0)
+              { SniffedFile file;
+                file.filepath = filepaths[n];
+                file.dev = st.st_dev; file.ino = st.st_ino; file.mtime = st.st_mtime; file.size = st.st_size;
+                file.type = Sniff(buf, len);
+                results.push_back(file);
+              }
+          }
+        close(fd);
+      }
+  }
+}
+
+SniffedType FileClassifier::Classify(const wxString& filepath)
+{
+struct stat st;
+if ((stat(filepath.mb_str(wxConvUTF8), &st) == -1) || !S_ISREG(st.st_mode)) return SniffedType();
+
+SniffedType type;
+if (Lookup(st, type)) return type;
+
+SniffedFile file;
+type = SniffFile(filepath, &file);
+if (type.kind != sk_unknown) Store(file);
+return type;
+}
+
+//static
+SniffedType FileClassifier::SniffFile(const wxString& filepath, SniffedFile* file /*= NULL*/)
+{
+std::vector<wxString> filepaths(1, filepath); std::vector<SniffedFile> results;
+SniffBatch(filepaths, results);
+if (results.empty()) return SniffedType();
+
+if (file) *file = results[0];
+return results[0].type;
+}
+
+bool FileClassifier::Lookup(const struct stat& st, SniffedType& type) const
+{
+std::map<FileSniffKey, SniffedFile>::const_iterator iter = m_cache.find(FileSniffKey(st.st_dev, st.st_ino));
+if ((iter == m_cache.end()) || (iter->second.mtime != st.st_mtime) || (iter->second.size != st.st_size)) return false;
+
+type = iter->second.type;
+return true;
+}
+
+void FileClassifier::Store(const SniffedFile& file)
+{
+if ((time(NULL) - file.mtime) < 2) return;     // It may still be being written to, and a further change within the same second wouldn't alter its mtime
+
+if (m_cache.size() >= FILESNIFF_MAX_CACHED) m_cache.clear();
+m_cache[FileSniffKey(file.dev, file.ino)] = file;
+}
+
+bool FileClassifier::Contradicts(const wxString& filepath, enum ziptype zt)
+{
+if (zt == zt_invalid) return false;
+return !IsConsistent(zt, Classify(filepath));
+}
+
+//static
+bool FileClassifier::IsConsistent(enum ziptype zt, const SniffedType& type)
+{
+switch(type.kind)
+  { case sk_unknown: case sk_empty: case sk_data:
+                     return true;              // We can't tell, so give the name the benefit of the doubt. Remember that a pre-posix tar has no magic number
+    case sk_archive: return ZipFamily(type.zt) == ZipFamily(zt);
+     default:        return false;             // Text, images, executables aren't archives
+  }
+}
+
+//static
+enum ziptype FileClassifier::ArchiveType(const wxString& filepath, const SniffedType& type)
+{
+enum ziptype zt = Archive::Categorise(filepath);
+if (zt != zt_invalid) return IsConsistent(zt, type) ? zt : zt_invalid;
+
+  // Only believe the content of a file whose name has no ext at all; otherwise every .odt and .jar would look like a zip
+if ((type.kind == sk_archive) && !filepath.AfterLast(wxFILE_SEP_PATH).Contains(wxT(".")))
+  return type.zt;
+return zt_invalid;
+}
+
+void FileClassifier::SniffInBackground(FileGenericDirCtrl* requester, const wxString& dirname, FileDataObjArray& files)
+{
+std::vector<wxString> todo;
+for (size_t n=0; (n < files.GetCount()) && (todo.size() < FILESNIFF_MAX_PER_DIR); ++n)
+  { DataBase& file = files[n];
+    if (file.IsFake || !file.IsValid() || !file.IsRegularFile()) continue;
+
+    wxString name = file.GetFilename();
+    if (name.Contains(wxT(".")) && (Archive::Categorise(name) == zt_invalid)) continue; // Its content won't change its icon, so don't bother
+
+    SniffedType type;
+    if (!Lookup(*((FileData&)file).GetStatstruct(), type))
+      todo.push_back(dirname + name);
+  }
+if (todo.empty()) return;
+
+wxCriticalSectionLocker locker(m_CritSection);
+unsigned int id = m_nextid++;
+FileSniffJob& job = m_jobs[id];
+job.requester = requester; job.dirname = dirname; job.todo = todo;
+
+FileSniffThread* thread = new FileSniffThread(id);
+wxThreadError error;
+#if wxVERSION_NUMBER < 2905
+  error = thread->Create();
+  if (error == wxTHREAD_NO_ERROR)
+    error = thread->Run();
+#else
+  error = thread->Run(); // >2.9.5 Run() calls Create() itself
+#endif
+if (error != wxTHREAD_NO_ERROR)
+  { delete thread; m_jobs.erase(id); }       // A detached thread that never ran has to be deleted by us. The icons will just be the name-based ones
+}
+
+void FileClassifier::Cancel(const MyGenericDirCtrl* requester)
+{
+wxCriticalSectionLocker locker(m_CritSection);
+for (std::map<unsigned int, FileSniffJob>::iterator iter = m_jobs.begin(); iter != m_jobs.end(); ++iter)
+  if ((const MyGenericDirCtrl*)iter->second.requester == requester)
+    iter->second.requester = NULL;
+}
+
+bool FileClassifier::GetJob(unsigned int id, std::vector<wxString>& todo)
+{
+wxCriticalSectionLocker locker(m_CritSection);
+std::map<unsigned int, FileSniffJob>::iterator iter = m_jobs.find(id);
+if (iter == m_jobs.end() || !iter->second.requester) return false;
+
+todo = iter->second.todo;
+return true;
+}
+
+void FileClassifier::JobDone(unsigned int id, const std::vector<SniffedFile>& results)
+{
+wxCriticalSectionLocker locker(m_CritSection);
+std::map<unsigned int, FileSniffJob>::iterator iter = m_jobs.find(id);
+if (iter == m_jobs.end()) return;
+
+iter->second.results = results;
+wxCommandEvent event(FileSniffType); event.SetInt(id);
+wxPostEvent(this, event);
+}
+
+void FileClassifier::OnJobDone(wxCommandEvent& event)
+{
+FileSniffJob job;
+{ wxCriticalSectionLocker locker(m_CritSection);
+  std::map<unsigned int, FileSniffJob>::iterator iter = m_jobs.find((unsigned int)event.GetInt());
+  if (iter == m_jobs.end()) return;
+  job = iter->second;
+  m_jobs.erase(iter);
+}
+
+for (size_t n=0; n < job.results.size(); ++n)
+  Store(job.results[n]);
+
+if (!job.requester || (StripSep(job.requester->startdir) != StripSep(job.dirname))) return; // The pane's gone, or has moved on
+
+for (size_t n=0; n < job.results.size(); ++n)  // Only bother the tree about files whose content gives them a different icon from their name
+  if (ArchiveType(job.results[n].filepath, job.results[n].type) != Archive::Categorise(job.results[n].filepath))
+    job.requester->RefreshFileIcon(job.results[n].filepath, job.results[n].type);
+}
+
+void* FileSniffThread::Entry()
+{
+std::vector<wxString> todo;
+if (!FileClassifier::Get().GetJob(m_id, todo)) return NULL;
+
+std::vector<SniffedFile> results;
+FileClassifier::SniffBatch(todo, results);
+
+FileClassifier::Get().JobDone(m_id, results);
+return NULL;
+}
+
+#include "wx/ffile.h"
+#include <time.h>
+
+std::vector<StartupTraceEvent> StartupTracer::ms_events;
+wxString StartupTracer::ms_filepath;
+bool StartupTracer::ms_finished = false;
+
+//static
+void StartupTracer::Add(const wxString& name, char phase)
+{
+if (ms_finished) return;                       // Recording is cheap, so it always happens until startup's over; we only find out later whether it's wanted
+
+struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+StartupTraceEvent event;
+event.name = name; event.phase = phase;
+event.usec = wxLongLong(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+ms_events.push_back(event);
+}
+
+//static
+bool StartupTracer::Finish()
+{
+if (ms_finished) return false;
+ms_finished = true;
+
+std::vector<StartupTraceEvent> events; events.swap(ms_events);
+if (ms_filepath.empty() || events.empty()) return false;
+
+wxString json(wxT("{\"traceEvents\":[\n"));
+wxLongLong start = events[0].usec;             // Make the first event time 0, so the timeline starts at OnInit
+for (size_t n=0; n < events.size(); ++n)
+  { wxString name(events[n].name); name.Replace(wxT("\\"), wxT("\\\\")); name.Replace(wxT("\""), wxT("\\\""));
+    json << wxT("{\"name\":\"") << name << wxT("\",\"cat\":\"startup\",\"ph\":\"") << wxString(events[n].phase, 1)
+         << wxT("\",\"ts\":") << (events[n].usec - start).ToString() << wxT(",\"pid\":") << (long)getpid() << wxT(",\"tid\":1");
+    if (events[n].phase == 'i') json << wxT(",\"s\":\"g\"");
+    json << ((n+1 < events.size()) ? wxT("},\n") : wxT("}\n"));
+  }
+json << wxT("],\"displayTimeUnit\":\"ms\"}\n");
+
+wxFFile file(ms_filepath, wxT("w"));
+if (!file.IsOpened() || !file.Write(json, wxConvUTF8))
+  { wxLogWarning(_("Couldn't write the startup trace to %s"), ms_filepath.c_str()); return false; }
+return file.Close();
+}
+
+//-----------------------------------------------------------------------------------------------------------------------
+
+#include "wx/datstrm.h"
+#include "wx/dir.h"
+#include "wx/filename.h"
+#include <sys/file.h>                           // For flock()
+
+static const char PASTEJOURNAL_MAGIC[] = "4PPASTE1";  // The journal starts with these 8 chars (not the terminator)
+static const size_t PASTEJOURNAL_MAGICLEN = 8;
+static const size_t PASTEJOURNAL_FRAMELEN = 8;        // Each record is prefixed by its length and checksum, as in the UnRedoLog
+
+//static
+wxString PasteJournal::GetJournalDir()
+{
+return DirectoryForDeletions::GetPasteJournalDir();
+}
+
+PasteJournal::~PasteJournal()
+{
+Close();
+for (size_t n=0; n < m_unredos.size(); ++n) delete m_unredos[n].first;
+}
+
+bool PasteJournal::Create(bool moving)
+{
+Close();
+wxString dir = GetJournalDir();
+if (dir.empty() || (!wxDirExists(dir) && !wxFileName::Mkdir(dir, 0700, wxPATH_MKDIR_FULL)))
+  return false;
+
+m_created = time(NULL);
+for (int n=0; n < 100 && m_fd == -1; ++n)       // The name only has to be unique, and to sort in order of creation
+  { m_filepath = dir + wxString::Format(wxT("%010lu-%lu-%i.journal"), (unsigned long)m_created, wxGetProcessId(), n);
+    m_fd = open(m_filepath.fn_str(), O_RDWR | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0600);
+  }
+if (m_fd == -1) return false;
+if (flock(m_fd, LOCK_EX | LOCK_NB) != 0)        // Held for as long as the paste runs, so no other instance tries to resume it
+  { Discard(); return false; }
+
+m_moving = moving;
+m_buffer.SetDataLen(0);
+m_buffer.AppendData(PASTEJOURNAL_MAGIC, PASTEJOURNAL_MAGICLEN);
+wxMemoryOutputStream mos; wxDataOutputStream out(mos);
+out.Write8(PJ_header); out.Write8(moving); out.Write64((wxUint64)m_created);
+AppendRecord(mos, m_buffer);
+return true;
+}
+
+void PasteJournal::AddItem(const PasteData& data, wxULongLong size, time_t mtime)
+{
+if (m_fd == -1) return;
+
+wxMemoryOutputStream mos; wxDataOutputStream out(mos);
+out.Write8(PJ_item); out.Write32(data.index);
+out.WriteString(data.origin); out.WriteString(data.dest); out.WriteString(data.del); out.WriteString(data.overwrite);
+out.Write8(data.precreated); out.Write64(size.GetValue()); out.Write64((wxUint64)mtime);
+AppendRecord(mos, m_buffer);
+}
+
+void PasteJournal::AddHardlink(const HardlinkData& link)
+{
+if (m_fd == -1) return;
+
+wxMemoryOutputStream mos; wxDataOutputStream out(mos);
+out.Write8(PJ_link); out.Write32((wxUint32)m_links.size());
+out.WriteString(link.origin); out.WriteString(link.firstorigin); out.WriteString(link.firstdest); out.WriteString(link.dest);
+AppendRecord(mos, m_buffer);
+m_links.push_back(link);                        // Only for its count: the index lets a replay check they're in order
+}
+
+void PasteJournal::AddUnRedo(const UnRedo* entry, const wxString& filepath)
+{
+if (m_fd == -1 || !entry) return;
+
+wxMemoryOutputStream mos; wxDataOutputStream out(mos);
+out.Write8(PJ_unredo); out.Write32((wxUint32)m_unredocount++);
+out.WriteString(filepath);
+UnRedoLog::WriteEntry(out, entry);
+AppendRecord(mos, m_buffer);
+}
+
+void PasteJournal::AddDeleteAfter(const wxString& dirname)
+{
+if (m_fd == -1) return;
+
+wxMemoryOutputStream mos; wxDataOutputStream out(mos);
+out.Write8(PJ_deleteafter); out.Write32((wxUint32)m_deleteafter.GetCount());
+out.WriteString(dirname);
+AppendRecord(mos, m_buffer);
+m_deleteafter.Add(dirname);                     // Again only for its count
+}
+
+bool PasteJournal::Commit()
+{
+if (m_fd == -1) return false;
+
+bool ok = UnRedoLog::WriteAll(m_fd, m_buffer.GetData(), m_buffer.GetDataLen()) && (fdatasync(m_fd) == 0);
+m_buffer = wxMemoryBuffer();                    // A big paste's work list may be many MB, and it's not needed again
+if (!ok)
+  { Discard(); return false; }
+
+int dirfd = open(GetJournalDir().fn_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC); // A new file isn't safely there until its dir has been synced too
+if (dirfd != -1)
+  { fsync(dirfd); close(dirfd); }
+return true;
+}
+
+void PasteJournal::Close()
+{
+wxCriticalSectionLocker locker(m_lock);
+if (m_fd != -1)
+  { close(m_fd); m_fd = -1; }                   // which also releases the flock
+}
+
+void PasteJournal::Discard()
+{
+if (!m_filepath.empty())                        // Unlink before closing, so no other instance can take the lock of a finished journal
+  { wxLogNull shh;
+    wxRemoveFile(m_filepath);
+    m_filepath.clear();
+  }
+Close();
+}
+
+void PasteJournal::AppendRecord(wxMemoryOutputStream& payload, wxMemoryBuffer& buf)
+{
+size_t len = payload.GetLength();
+std::vector<char> data(len);
+payload.CopyTo(&data[0], len);
+
+wxUint32 frame[2];
+frame[0] = wxUINT32_SWAP_ON_BE((wxUint32)len);
+frame[1] = wxUINT32_SWAP_ON_BE(UnRedoLog::Checksum(&data[0], len));
+buf.AppendData(frame, PASTEJOURNAL_FRAMELEN);
+buf.AppendData(&data[0], len);
+}
+
+void PasteJournal::Write(wxMemoryOutputStream& payload)
+{
+wxMemoryBuffer buf;
+AppendRecord(payload, buf);
+
+wxCriticalSectionLocker locker(m_lock);
+if (m_fd != -1 && !UnRedoLog::WriteAll(m_fd, buf.GetData(), buf.GetDataLen()))
+  { close(m_fd); m_fd = -1; }                   // Carry on without it: the paste matters more than being able to resume it. Anything already written will still be checked before it's trusted
+}
+
+void PasteJournal::FileStarted(int index)
+{
+if (index == wxNOT_FOUND) return;
+
+wxMemoryOutputStream mos; wxDataOutputStream out(mos);
+out.Write8(PJ_started); out.Write32(index);
+Write(mos);
+}
+
+void PasteJournal::Checkpoint(int index, wxULongLong offset)
+{
+if (index == wxNOT_FOUND) return;
+
+wxMemoryOutputStream mos; wxDataOutputStream out(mos);
+out.Write8(PJ_checkpoint); out.Write32(index); out.Write64(offset.GetValue());
+Write(mos);
+}
+
+void PasteJournal::FileFailed(int index, int error)
+{
+if (index == wxNOT_FOUND) return;
+
+switch(error)
+  { case EIO: case ENOSPC: case EDQUOT: case ENOENT: case ENODEV: case ENXIO: case ESTALE: case ENOTCONN: case ETIMEDOUT: case EROFS: case EINTR: case EAGAIN:
+      { wxCriticalSectionLocker locker(m_lock);
+        ++m_retryablefailures; return;          // The disk filled, went away or went read-only. Once that's sorted out, a resume should succeed
+      }
+  }
+
+wxMemoryOutputStream mos; wxDataOutputStream out(mos);
+out.Write8(PJ_failed); out.Write32(index);      // Permission denied or similar, which trying again won't help. Don't let it keep the journal, or be retried by a resume
+Write(mos);
+}
+
+bool PasteJournal::HasRetryableFailures()
+{
+wxCriticalSectionLocker locker(m_lock);
+return m_retryablefailures > 0;
+}
+
+void PasteJournal::FileDone(int index)          // Not synced: if this record is lost, a resume just checks the file, and finds it complete
+{
+if (index == wxNOT_FOUND) return;
+
+wxMemoryOutputStream mos; wxDataOutputStream out(mos);
+out.Write8(PJ_done); out.Write32(index);
+Write(mos);
+}
+
+bool PasteJournal::Open(const wxString& filepath)
+{
+Close();
+int fd = open(filepath.fn_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+if (fd == -1) return false;
+if (flock(fd, LOCK_EX | LOCK_NB) != 0)          // Its paste is still running, in this instance or another
+  { close(fd); return false; }
+m_fd = fd; m_filepath = filepath;
+
+off_t size = lseek(m_fd, 0, SEEK_END);
+if (size < (off_t)PASTEJOURNAL_MAGICLEN) return false;
+std::vector<char> data(size);
+if ((pread(m_fd, &data[0], size, 0) != (ssize_t)size) || memcmp(&data[0], PASTEJOURNAL_MAGIC, PASTEJOURNAL_MAGICLEN))
+  return false;
+
+bool header(false);
+size_t offset = PASTEJOURNAL_MAGICLEN;
+while (offset + PASTEJOURNAL_FRAMELEN <= (size_t)size)
+  { wxUint32 frame[2];
+    memcpy(frame, &data[offset], PASTEJOURNAL_FRAMELEN);
+    size_t len = wxUINT32_SWAP_ON_BE(frame[0]);
+    if (!len || (len > (size_t)size - offset - PASTEJOURNAL_FRAMELEN)) break;  // A record torn by a crash. Everything before it is still good
+    const char* payload = &data[offset + PASTEJOURNAL_FRAMELEN];
+    if (UnRedoLog::Checksum(payload, len) != wxUINT32_SWAP_ON_BE(frame[1])) break;
+    offset += PASTEJOURNAL_FRAMELEN + len;
+
+    wxMemoryInputStream mis(payload, len); wxDataInputStream in(mis);
+    int op = in.Read8();
+    if (op == PJ_header)
+      { m_moving = in.Read8(); m_created = (time_t)in.Read64(); header = true; continue; }
+
+    size_t index = in.Read32();
+    if (op == PJ_item)
+      { if (index != m_items.size()) break;     // The items are written in order, all at once, so this is garbage
+        wxString origin = in.ReadString(); wxString dest = in.ReadString();
+        wxString del = in.ReadString(); wxString overwrite = in.ReadString();
+        bool precreated = in.Read8();
+        PasteData item(origin, dest, del, overwrite, precreated); item.index = (int)index;
+        m_items.push_back(item);
+        m_sizes.push_back(wxULongLong(in.Read64()));
+        m_mtimes.push_back((time_t)in.Read64());
+        m_states.push_back(pjs_pending); m_offsets.push_back(0);
+        continue;
+      }
+    if (op == PJ_link)
+      { if (index != m_links.size()) break;     // Like the items, these are written in order
+        wxString origin = in.ReadString(); wxString firstorigin = in.ReadString();
+        wxString firstdest = in.ReadString(); wxString dest = in.ReadString();
+        m_links.push_back(HardlinkData(origin, firstorigin, firstdest, dest));
+        continue;
+      }
+    if (op == PJ_unredo)
+      { if (index != m_unredocount) break;
+        ++m_unredocount;
+        wxString filepath = in.ReadString(); size_t clusterno;
+        UnRedo* entry = UnRedoLog::ReadEntry(in, clusterno);
+        if (entry) m_unredos.push_back(std::make_pair(entry, filepath));
+        continue;
+      }
+    if (op == PJ_deleteafter)
+      { if (index != m_deleteafter.GetCount()) break;
+        m_deleteafter.Add(in.ReadString());
+        continue;
+      }
+    if (index >= m_items.size()) continue;
+
+    switch(op)
+      { case PJ_started:    if (m_states[index] == pjs_pending) m_states[index] = pjs_started;
+                            break;
+        case PJ_checkpoint: { wxULongLong reached(in.Read64());
+                              if (m_states[index] != pjs_done) m_states[index] = pjs_started;
+                              if (reached > m_offsets[index]) m_offsets[index] = reached;
+                              break;
+                            }
+        case PJ_done:         m_states[index] = pjs_done; break;
+        case PJ_failed:       if (m_states[index] != pjs_done) m_states[index] = pjs_failed;
+                              break;
+      }
+  }
+
+return header && !m_items.empty();
+}
+
+bool PasteJournal::Plan(PasteThreadSuperBlock* tsb)
+{
+bool checkcontents = wxConfigBase::Get()->Read(wxT("/Misc/ResumeVerifyContents"), 0l) != 0; // Size and mtime are usually enough. This compares the bytes too, which is slow
+size_t queued(0), alreadydone(0), failures(0);
+
+wxArrayString& successes = tsb->GetSuccessfullyPastedFilepaths(); // Whatever arrived before the interruption, so that OnCompleted() keeps its unredo
+for (size_t n=0; n < m_items.size(); ++n)
+  { PasteData item = m_items[n];
+    if (item.precreated)                        // A dir, which was made before the paste started
+      { successes.Add(item.origin); continue; }
+    if (m_states[n] == pjs_failed)              // It failed in a way that trying again wouldn't fix
+      { ++failures; continue; }
+
+    FileData orig(item.origin), dest(item.dest);
+    if (!orig.IsValid())
+      { if (m_moving && dest.IsValid()) { successes.Add(item.origin); ++alreadydone; } // A Move deletes each origin once it's been copied
+         else ++failures;
+        continue;
+      }
+    bool unchanged = (orig.Size() == m_sizes[n]) && (orig.ModificationTime() == m_mtimes[n]);
+
+    if (m_states[n] == pjs_done && unchanged)   // Check it really did arrive. It's our copy if it was written since the paste started, or it kept the origin's mtime
+      { bool verified = dest.IsValid() && (dest.Size() == m_sizes[n])
+                          && (dest.ModificationTime() >= m_created || dest.ModificationTime() == m_mtimes[n])
+                          && (!checkcontents || DedupPastePlanner::SameContents(item.origin, item.dest));
+        if (verified)
+          { if (m_moving) wxRemoveFile(item.origin); // It was copied, but the origin's deletion didn't happen
+            successes.Add(item.origin);         // This also makes OnCompleted() link to its copy, rather than copying again
+            ++alreadydone; continue;
+          }
+      }
+
+    if (m_states[n] == pjs_pending)             // Nothing's happened to it yet, so any overwrite still needs doing. Its trash dir may have been emptied on exit though
+      { if (!item.overwrite.empty())
+          wxFileName::Mkdir(item.overwrite.BeforeLast(wxFILE_SEP_PATH), 0777, wxPATH_MKDIR_FULL);
+      }
+     else
+      { item.overwrite.Clear();                 // Whatever was overwritten was dealt with before the copy started, and dest is now our own partial copy
+        if (m_states[n] == pjs_started && unchanged && dest.IsValid() && dest.Size() >= m_offsets[n])
+          item.resumefrom = m_offsets[n];       // Carry on from the last checkpoint
+      }
+
+    tsb->GetCollector().AddResumed(item);
+    ++queued;
+  }
+
+for (size_t n=0; n < m_links.size(); ++n)       // The hardlinks are made after the copies, so these are the last things that might not have happened
+  { const HardlinkData& link = m_links[n];
+    FileData orig(link.origin), dest(link.dest);
+    if (!orig.IsValid())
+      { if (m_moving && dest.IsValid()) { successes.Add(link.origin); ++alreadydone; }
+         else ++failures;
+        continue;
+      }
+    if (dest.IsValid() && dest.Size() == orig.Size())
+      { if (m_moving) wxRemoveFile(link.origin);
+        successes.Add(link.origin); ++alreadydone; continue;
+      }
+    tsb->AddResumedHardlink(link);
+    ++queued;
+  }
+
+for (size_t n=0; n < m_unredos.size(); ++n)     // The superblock adds those whose origins arrive, as a single cluster
+  tsb->StoreUnRedoPaste(m_unredos[n].first, m_unredos[n].second);
+m_unredos.clear();
+for (size_t n=0; n < m_deleteafter.GetCount(); ++n)
+  tsb->DeleteAfter(m_deleteafter[n]);
+
+tsb->AddOverallSuccesses(queued + alreadydone);
+tsb->AddOverallFailures(failures);
+return queued > 0;
+}
+
+//static
+wxArrayString PasteJournal::FindInterrupted()
+{
+wxArrayString journals, found;
+wxString dir = GetJournalDir();
+if (dir.empty() || !wxDirExists(dir)) return journals;
+
+wxLogNull shh;
+wxDir::GetAllFiles(dir, &found, wxT("*.journal"), wxDIR_FILES);
+found.Sort();                                   // The names start with the creation time, so this is oldest first
+for (size_t n=0; n < found.GetCount(); ++n)
+  { int fd = open(found[n].fn_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) continue;
+    if (flock(fd, LOCK_EX | LOCK_NB) == 0)      // If we can lock it, no running paste owns it
+      journals.Add(found[n]);
+    close(fd);
+  }
+return journals;
+}
+
+//static
+size_t PasteJournal::CountInterrupted()
+{
+return FindInterrupted().GetCount();
+}
+
+//static
+bool PasteJournal::ResumeInterrupted()
+{
+if (ThreadsManager::Get().PasteIsActive()) return false;
+
+wxArrayString journals = FindInterrupted();
+for (size_t n=0; n < journals.GetCount(); ++n)
+  { PasteJournal* journal = new PasteJournal;
+    if (!journal->Open(journals[n]))
+      { if (journal->m_fd != -1) journal->Discard(); // We got the lock but can't make sense of it, so it's no use to anyone
+        delete journal; continue;
+      }
+
+    PasteThreadSuperBlock* tsb = static_cast<PasteThreadSuperBlock*>(ThreadsManager::Get().StartSuperblock(journal->m_moving ? wxT("move") : wxT("paste")));
+    tsb->SetMessageType(journal->m_moving ? tsbm_moved : tsbm_pasted);
+    UnRedoManager::StartClusterIfNeeded();      // OnCompleted() ends it, so the resumed paste is undone in one go
+    if (journal->Plan(tsb))
+      tsb->SetJournal(journal);                 // Keep using the same journal, so that if this is interrupted too, it can be resumed again
+     else
+      { journal->Discard(); delete journal; }   // Everything had already arrived
+    tsb->StartThreads();                        // With nothing queued, this just reports
+    return true;
+  }
+
+return false;
+}
+
+//static
+void PasteJournal::OfferToResume(wxWindow* parent)
+{
+wxArrayString journals = FindInterrupted();
+if (journals.IsEmpty()) return;
+
+wxString msg;
+if (journals.GetCount() == 1)
+  msg = _("A paste or move was interrupted before it finished, perhaps by a crash or by a disk going away.\n\nResume it now?");
+ else
+  msg = wxString::Format(_("%zu pastes or moves were interrupted before they finished, perhaps by a crash or by a disk going away.\n\nResume the oldest now?"), journals.GetCount());
+msg << _("\n\n(No discards them. Cancel keeps them, to be resumed later from Edit > Resume Interrupted Paste)");
+
+int answer = wxMessageBox(msg, _("Interrupted paste"), wxYES_NO | wxCANCEL | wxICON_QUESTION, parent);
+if (answer == wxYES)
+  ResumeInterrupted();
+ else if (answer == wxNO)
+  for (size_t n=0; n < journals.GetCount(); ++n)
+    { int fd = open(journals[n].fn_str(), O_RDONLY | O_CLOEXEC);
+      if (fd == -1) continue;
+      if (flock(fd, LOCK_EX | LOCK_NB) == 0)    // Make sure it hasn't been taken meanwhile
+        unlink(journals[n].fn_str());
+      close(fd);
+    }
+}
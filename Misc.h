@@ -11,12 +11,22 @@
 
 #include "wx/wx.h"
 #include "wx/dirctrl.h"
+#include "wx/thread.h"
+#include "wx/file.h"
+#include "wx/mstream.h"
 #if wxVERSION_NUMBER >= 3000
   #include <wx/html/helpctrl.h>
 #endif
 
 #include <vector>
 #include <deque>
+#include <map>
+#include <list>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "Externs.h"
+#include "Jobs.h"
 
 extern wxString GetCwd();
 extern bool SetWorkingDirectory(const wxString& dir);
@@ -161,34 +171,124 @@ void OnCloseWindow(wxCloseEvent& evt);
 class ThreadSuperBlock;
 class ThreadBlock;
 class UnRedo;
+class FileData;
 
 struct PasteData
 {
 PasteData(const wxString& o, const wxString& d, const wxString& dl, const wxString& ow, bool p = false)
-  : origin(o.c_str()), dest(d.c_str()), del(dl.c_str()), overwrite(ow.c_str()), precreated(p) {}
+  : origin(o.c_str()), dest(d.c_str()), del(dl.c_str()), overwrite(ow.c_str()), precreated(p), index(wxNOT_FOUND), resumefrom(0) {}
 PasteData& operator=(const PasteData& pdata) 
-  { origin=pdata.origin; dest=pdata.dest; del=pdata.del; overwrite=pdata.overwrite; precreated= pdata.precreated; return *this; }
+  { origin=pdata.origin; dest=pdata.dest; del=pdata.del; overwrite=pdata.overwrite; precreated= pdata.precreated;
+    index = pdata.index; resumefrom = pdata.resumefrom; return *this; }
 
 wxString origin;
 wxString dest;
 wxString del;
 wxString overwrite;
 bool     precreated;
+int      index;         // Its place in the paste's PasteJournal, if there is one
+wxULongLong resumefrom; // For a resumed paste, how much of the file is already safely copied
+};
+
+class PasteThreadSuperBlock;
+
+struct HardlinkData   // A further link to an inode that's already being pasted. It's recreated as a link, once the first one has been copied
+{
+HardlinkData(const wxString& o, const wxString& fo, const wxString& fd, const wxString& d)
+  : origin(o), firstorigin(fo), firstdest(fd), dest(d) {}
+
+wxString origin;
+wxString firstorigin;
+wxString firstdest;
+wxString dest;
+};
+
+class PasteJournal  // Keeps a paste's work list on disk with each file's progress, so that a paste interrupted by a crash, an exit or a vanished disk can be resumed
+{
+public:
+PasteJournal() : m_fd(-1), m_moving(false), m_created(0), m_retryablefailures(0), m_unredocount(0) {}
+~PasteJournal();
+
+bool Create(bool moving);                   // Starts a new journal in GetJournalDir(). Then AddItem() each file, and Commit()
+void AddItem(const PasteData& data, wxULongLong size, time_t mtime); // The origin's size and mtime, so that a resume can tell if it's changed since
+void AddHardlink(const HardlinkData& link); // A link that the superblock will make once the threads are done
+void AddUnRedo(const UnRedo* entry, const wxString& filepath); // One of the superblock's unredos, and the origin whose success makes it valid
+void AddDeleteAfter(const wxString& dirname); // A Moved dir, to be removed once its contents have gone
+bool Commit();                              // Writes the whole work list in one go, and syncs it
+void Close();                               // Leaves the journal for a later resume
+void Discard();                             // The paste is over, so the journal's no longer needed
+
+  // Called by the PasteThreads
+void FileStarted(int index);                // Any overwritten file has been dealt with, and the copy is starting
+void Checkpoint(int index, wxULongLong offset); // The dest has been synced to disk this far
+void FileDone(int index);
+void FileFailed(int index, int error);      // If error is something a resume might get past e.g. the disk filled or went away, the journal will be kept. Otherwise a resume skips the file
+bool HasRetryableFailures();
+
+static size_t CountInterrupted();           // How many journals are on disk that no running instance owns
+static bool ResumeInterrupted();            // Resumes the oldest of them. False if there wasn't one, or it couldn't be
+static void OfferToResume(wxWindow* parent);// At startup, ask the user what to do with any interrupted pastes
+
+protected:
+enum { PJ_header = 1, PJ_item, PJ_started, PJ_checkpoint, PJ_done, PJ_link, PJ_failed, PJ_unredo, PJ_deleteafter };
+enum { pjs_pending, pjs_started, pjs_done, pjs_failed };
+
+bool Open(const wxString& filepath);        // Takes an orphaned journal's lock, and replays it. False if it's in use or unreadable
+void AppendRecord(wxMemoryOutputStream& payload, wxMemoryBuffer& buf);
+void Write(wxMemoryOutputStream& payload);  // Appends a single record, without syncing. Thread-safe
+bool Plan(PasteThreadSuperBlock* tsb);      // Compares the replayed journal with what's on disk, and queues whatever's still to be done
+static wxString GetJournalDir();
+static wxArrayString FindInterrupted();     // Oldest first
+
+wxString m_filepath;
+int m_fd;                                   // Also holds the flock that tells other instances the journal is in use
+bool m_moving;
+time_t m_created;
+wxMemoryBuffer m_buffer;                    // The work list, until it's committed
+wxCriticalSection m_lock;                   // The threads write their records through this
+size_t m_retryablefailures;
+
+std::vector<PasteData> m_items;             // These are only filled by a replay
+std::vector<wxULongLong> m_sizes;
+std::vector<time_t> m_mtimes;
+std::vector<char> m_states;
+std::vector<wxULongLong> m_offsets;
+std::vector<HardlinkData> m_links;
+std::vector< std::pair<UnRedo*, wxString> > m_unredos; // Owned by us until Plan() hands them to the superblock
+size_t m_unredocount;
+wxArrayString m_deleteafter;
 };
 
 class PasteThread : public wxThread
 {
 public:
   PasteThread(wxWindow* caller, int ID, const std::vector<PasteData>& pdata, bool ismoving = false)
-                        : wxThread(), m_caller(caller), m_ID(ID), m_PasteData(pdata), m_ismoving(ismoving) {}
+                        : wxThread(), m_caller(caller), m_ID(ID), m_PasteData(pdata), m_ismoving(ismoving), m_gate(NULL),
+                          m_journal(NULL), m_current(wxNOT_FOUND), m_resumefrom(0), m_lastcheckpoint(0) {}
   virtual ~PasteThread() { m_PasteData.clear(); }
   void SetUnRedoType(enum UnRedoType type) { m_fromunredo = type; }
+  void SetGate(JobGate* gate) { m_gate = gate; }
+  void SetJournal(PasteJournal* journal) { m_journal = journal; }
+  void SetNewDirParents(const wxArrayString& dirs) { for (size_t n=0; n < dirs.GetCount(); ++n) m_newdirparents.Add(dirs[n].c_str()); } // Deep copies, as they're for another thread
   void* Entry();
+  static bool IsStalePartFile(const wxString& filepath); // Is this a DURABLE_PASTE temporary file that a crashed or killed 4Pane left behind?
   void OnExit();
 
 protected:
   virtual bool ProcessEntry(const PasteData& data);
   bool CopyFile(const wxString& origin, const wxString& destination); // Does an interruptable copy
+  bool CopyContents(wxFile& in, wxFile& out, wxULongLong filesize, const wxString& destination, wxULongLong from = 0); // The data part of CopyFile(). 'from' is where a resumed copy restarts
+  bool CommitDurably(wxFile& out, const wxString& temp, const wxString& destination); // Syncs a DURABLE_PASTE's temporary file, then renames it into place
+  void SyncDirs();                // Syncs, once each, the dirs into which CommitDurably() renamed files, then does any Move deletions that were waiting for that
+  void AddUnsyncedDir(const wxString& dir); // The first time a dir is seen, also removes any stale temporary files from it
+  int KernelCopy(int infd, int outfd, wxULongLong filesize, const wxString& destination, wxULongLong from = 0); // Tries a reflink, then copy_file_range(). Returns wxNOT_FOUND if CopyFile must do it the old way
+  int SparseCopy(int infd, int outfd, wxULongLong filesize, const wxString& destination, wxULongLong from = 0); // Copies only the data extents, so that holes are preserved
+  void PostProgress(wxULongLong bytes); // Tells the statusbar throbber that this many more bytes are done
+  bool Interrupted() { if (m_gate) m_gate->WaitWhilePaused(); return Stopping(); } // Waits while the job is paused, then says if it's been cancelled
+  bool Stopping() { return (m_gate && m_gate->IsStoppingForExit()) || TestDestroy(); } // Cancelled, or 4Pane is exiting
+  bool StoppingForExit() { return m_gate && m_gate->IsStoppingForExit() && !TestDestroy(); } // Exiting, so a partial file should be left for the journal to resume
+  void Throttle(size_t bytes) { if (m_gate) m_gate->Consume(bytes); } // Sleeps if the job is over its bandwidth limit
+  void Checkpoint(int outfd, wxULongLong done); // Every so often, syncs what's been copied of the current file, and tells the journal
 
   wxWindow* m_caller;
   int m_ID;
@@ -197,6 +297,14 @@ protected:
   bool m_ismoving;
   enum UnRedoType m_fromunredo;
   wxArrayString m_needsrefreshes; // For passing overwritten filepaths that FSWatcher may fail with, as a delete is followed by a paste
+  JobGate* m_gate;                // The superblock's, through which its PasteJob pauses us
+  wxArrayString m_unsynceddirs;   // For DURABLE_PASTE: dirs whose new entries aren't yet on disk
+  wxArrayString m_pendingremovals;//  and Move origins that mustn't be deleted until they are
+  wxArrayString m_newdirparents;  //  and the parents of the dirs the paste created, so that those dirs' own entries are on disk too
+  PasteJournal* m_journal;        // The superblock's, if the paste is being journalled
+  int m_current;                  // The journal index of the file being pasted, or wxNOT_FOUND while e.g. an overwritten file is saved to trash
+  wxULongLong m_resumefrom;       //  and where that copy should start
+  wxULongLong m_lastcheckpoint;
 };
 
 class PastesCollector // Collects a clipboardful of Paste/Move data and, when fully loaded, feeds it to PasteThread
@@ -210,7 +318,11 @@ bool GetIsMoves() const { return m_moving; }
 void Add(const wxString& origin, const wxString& dest, const wxString& originaldest, bool createddir = false);
 void AddPreCreatedItem(const wxString& origin, const wxString& dest) 
   { Add(origin, dest, wxT(""), true); }
-void StartThreads();
+void AddOverwrite(const wxString& origin, const wxString& dest, const wxString& trash) // For a dest that must first be saved to 'trash'. Used by DedupPastePlanner, which finds its own trash filepath
+  { m_PasteData.push_back( PasteData(origin, dest, GetIsMoves() ? origin : wxString(), trash) ); }
+void AddResumed(const PasteData& data) { m_PasteData.push_back(data); } // Used by PasteJournal, whose items already know what was decided, and how far they got
+void StartThreads();                // Submits a PasteJob, which calls LaunchThreads()
+void LaunchThreads();
 
 size_t GetCount() const { return m_PasteData.size(); }
   
@@ -218,10 +330,66 @@ protected:
 void DoStartThread(const std::vector<PasteData>& pastedata, ThreadBlock* block, int threadID);
 
 bool m_moving; // Is it for Moves instead of Pastes?
+wxArrayString m_newdirparents; // For DURABLE_PASTE: the parent of each precreated dir, for every thread to sync before its Move deletions
 std::vector<PasteData> m_PasteData;
 ThreadSuperBlock* m_tsb;
 };
 
+class PasteThreadSuperBlock;
+
+struct DedupPasteItem  // Something that a deduplicating paste will copy, overwrite or skip
+{
+enum action { dp_copy, dp_compare, dp_overwrite, dp_skip };
+DedupPasteItem(const wxString& o, const wxString& d, size_t own, bool dir, wxULongLong sz, enum action a)
+  : origin(o), dest(d), owner(own), isdir(dir), size(sz), what(a) {}
+
+wxString origin;
+wxString dest;      // The full dest filepath
+size_t owner;       // Which of the planner's clipboard items this is, or is inside
+bool isdir;
+wxULongLong size;   // For a dir that's being copied, the total size of its files
+enum action what;
+};
+
+class DedupPastePlanner  // Finds which parts of a paste the destination already holds, rsync-style, so that only the rest need be copied
+{
+public:
+DedupPastePlanner() : m_donecondition(m_donemutex), m_done(0) {}
+
+bool AddItem(const wxString& origin, const wxString& destdir); // Plans one clipboard item. False means it can't be merged e.g. it's being pasted onto itself, so do it the usual way
+bool Compare();                    // Reads, in parallel threads, any same-sized pairs whose mtimes differ. False if nothing needs doing after all
+bool Confirm(wxWindow* parent) const; // Tells the user how much will really be transferred. False means they'd rather not
+size_t Execute(PasteThreadSuperBlock* tsb, const wxArrayInt& IDs); // Queues the copies & overwrites in tsb. Returns how many clipboard items succeeded
+
+size_t GetCount() const { return m_destdirs.GetCount(); }
+void CompareItem(size_t index);    // Called by DedupCompareThread
+
+static bool SameContents(const wxString& first, const wxString& second); // Compares them block by block, stopping at the first difference
+
+protected:
+void PlanDir(const wxString& origin, const wxString& dest, size_t owner);
+void PlanEntry(const wxString& origin, const wxString& dest, size_t owner);
+static wxULongLong SubtreeSize(const wxString& dirpath);
+
+std::vector<DedupPasteItem> m_items;
+wxArrayString m_destdirs;          // For each clipboard item, the dir it's being pasted into
+wxMutex m_donemutex;
+wxCondition m_donecondition;       // Signalled as each comparison finishes
+size_t m_done;                     // How many comparisons have finished. Protected by m_donemutex
+};
+
+class DedupCompareThread : public wxThread // Compares a share of a DedupPastePlanner's same-sized pairs
+{
+public:
+DedupCompareThread(DedupPastePlanner* planner, const std::vector<size_t>& indices)
+  : wxThread(wxTHREAD_JOINABLE), m_planner(planner), m_indices(indices) {}
+void* Entry();
+
+protected:
+DedupPastePlanner* m_planner;
+std::vector<size_t> m_indices;
+};
+
 class ThreadData
 { 
 public:
@@ -264,11 +432,13 @@ ThreadSuperBlock* m_parent;
 ThreadData* m_data;
 };
 
+enum tsbmessage { tsbm_completed, tsbm_pasted, tsbm_moved, tsbm_cut, tsbm_deleted, tsbm_trashed, tsbm_duplicated, tsbm_undone, tsbm_redone };
+
 class ThreadSuperBlock  // Manages a collection of items to be threaded
 {
 public:
 ThreadSuperBlock(unsigned int firstID)
-        : m_count(0), m_FirstThreadID(firstID), m_fromunredo(URT_notunredo), m_redoID(-1), m_successes(0), m_failures(0), m_overallsuccesses(0), m_overallfailures(0), m_messagetype(_("completed"))
+        : m_count(0), m_FirstThreadID(firstID), m_fromunredo(URT_notunredo), m_redoID(-1), m_successes(0), m_failures(0), m_overallsuccesses(0), m_overallfailures(0), m_messagetype(tsbm_completed)
           { m_collector.SetParent(this); }
 virtual ~ThreadSuperBlock();
 
@@ -286,7 +456,9 @@ void AddSuccesses(size_t successes) { m_successes += successes; }
 void AddFailures(size_t failures) { m_failures += failures; }
 void AddOverallSuccesses(size_t successes) { m_overallsuccesses += successes; }
 void AddOverallFailures(size_t failures) { m_overallfailures += failures; }
-void SetMessageType(const wxString& type) { m_messagetype = type; }
+void SetMessageType(enum tsbmessage type) { m_messagetype = type; }
+enum tsbmessage GetMessageType() const { return m_messagetype; }
+wxString GetMessageVerb() const;  // The translated past participle for the status message e.g. "pasted"
 virtual void OnCompleted() {}      // Any action to be taken when all the blocks have completed
 
 void AbortThreads() const;
@@ -311,7 +483,7 @@ size_t m_successes;        // The individual successes/failures i.e. every file,
 size_t m_failures;
 size_t m_overallsuccesses; // Overall successes/failures of the items initially passed to the superblock i.e. +/-1 for a file, and +/-1 for a dir too, ignoring its contents
 size_t m_overallfailures;
-wxString m_messagetype;    // Is it a paste, is it an unredo...?
+enum tsbmessage m_messagetype; // Is it a paste, is it an unredo...?
 };
 
 class PasteThreadStatuswriter : public wxEvtHandler
@@ -339,18 +511,29 @@ class PasteThreadSuperBlock : public ThreadSuperBlock  // Manages a clipboardful
 public:
 virtual ~PasteThreadSuperBlock();
 
-PasteThreadSuperBlock(unsigned int firstID) : ThreadSuperBlock(firstID), m_DestID(0) {}
+PasteThreadSuperBlock(unsigned int firstID) : ThreadSuperBlock(firstID), m_DestID(0), m_job(NULL), m_journal(NULL), m_cancelled(false) {}
 
 wxArrayString& GetSuccessfullyPastedFilepaths() { return m_SuccessfullyPastedFilepaths; }
 void StoreUnRedoPaste(UnRedo* entry, const wxString& filepath) { m_UnRedos.push_back( std::make_pair(entry, filepath) ); }
 void StoreChangeMtimes(const wxString& filepath, time_t referencetime) { m_ChangeMtimes.push_back( std::make_pair(filepath, referencetime) ); }
-void ReportProgress(unsigned int size) { m_StatusWriter.OnProgress(size); }
+void ReportProgress(unsigned int size) { m_StatusWriter.OnProgress(size); if (m_job) m_job->AddProgress(size); }
 virtual void OnCompleted();      // Any action to be taken when all the blocks have completed
 void DeleteAfter(const wxString& dirname) { if (!dirname.empty()) m_DeleteAfter.Add(dirname); } // In a Move, a dir will need 2b deleted in OnCompleted()
 const wxString GetTrashdir() const { return m_trashdir; }
 void SetTrashdir(const wxString& trashdir);
 void StartThreadTimer() { m_StatusWriter.StartTimer(); }
-void SetTotalExpectedSize(wxULongLong total) { m_StatusWriter.SetTotalSize(total); }
+void SetTotalExpectedSize(wxULongLong total) { m_StatusWriter.SetTotalSize(total); if (m_job) m_job->SetTotal(total); }
+void SetJob(PasteJob* job) { m_job = job; }
+JobGate& GetGate() { return m_gate; }
+void SetJournal(PasteJournal* journal) { m_journal = journal; } // Takes ownership
+PasteJournal* GetJournal() const { return m_journal; }
+void Cancel();                // The user doesn't want this paste, so stop the threads, and don't keep a journal for resuming it
+bool DeferHardlink(FileData& stat, const wxString& origin, const wxString& dest, const wxString& overwrittenfile); // Returns true if origin is another link to an inode already in this paste
+const std::vector<HardlinkData>& GetHardlinks() const { return m_Hardlinks; }
+const std::deque< std::pair<UnRedo*, const wxString> >& GetUnRedos() const { return m_UnRedos; }
+const wxArrayString& GetDeleteAfter() const { return m_DeleteAfter; }
+void AddResumedHardlink(const HardlinkData& link) { m_Hardlinks.push_back(link); }
+void StopForExit() { m_gate.StopForExit(); } // Like Cancel(), but the journal is kept so that the paste can be resumed next time
 
 protected:
 
@@ -361,7 +544,13 @@ wxString m_trashdir;          // Used to store/coordinate any trashdir used when
 wxArrayString m_SuccessfullyPastedFilepaths;
 std::deque< std::pair<UnRedo*, const wxString> > m_UnRedos;
 std::vector< std::pair<const wxString, time_t> > m_ChangeMtimes; // Stores original mod-times for pasted fpaths for feeding to FileData::ModifyFileTimes
+std::map< std::pair<dev_t, ino_t>, std::pair<wxString, wxString> > m_Inodes; // The origin & dest of the first-pasted link to each multiply-linked inode
+std::vector<HardlinkData> m_Hardlinks; // The later links, to be made in OnCompleted()
 PasteThreadStatuswriter m_StatusWriter;
+PasteJob* m_job;              // The JobManager's record of this paste. Told when we complete
+JobGate m_gate;               // Holds our threads while the job is paused
+PasteJournal* m_journal;      // NULL unless the paste is being journalled
+bool m_cancelled;
 };
 
 class ThreadsManager /*: public wxEvtHandler*/
@@ -373,6 +562,7 @@ void AbortThreadSuperblock(ThreadSuperBlock* tsb); // Kill a tsb that's not goin
 
 bool IsActive() const;
 bool PasteIsActive() const;
+void StopPastes();            // On exit: stops the paste threads, and waits a while for them to finish, so that they don't outlive their superblocks
 void CancelThread(int threadtype) const;
 
 void OnThreadProgress(unsigned int ID, unsigned int size);
@@ -404,5 +594,349 @@ static ThreadsManager* ms_instance;
 };
 
 
+#if wxVERSION_NUMBER < 2900
+  DECLARE_EVENT_TYPE(DirSizeType, wxID_ANY)
+#else
+  wxDECLARE_EVENT(DirSizeType, wxCommandEvent);
+#endif
+
+class FileGenericDirCtrl;
+class MyGenericDirCtrl;
+
+struct DirSizeWork   // A dir waiting for a DirSizeThread
+{
+DirSizeWork(const wxString& p, dev_t d, bool e) : path(p), dev(d), expand(e) {}
+wxString path;
+dev_t dev;           // The device of the selected item. Like nftw's FTW_MOUNT, we don't count other filesystems mounted beneath it
+bool expand;         // If true, this is a selected dir. Its subdirs are queued for all the threads to share, rather than being walked by just one
+};
+
+struct DirSizeCacheEntry
+{
+dev_t dev; ino_t ino; time_t mtime; // If the dir still has these, its listing is reusable
+std::string files;                  // The names of the dir's own files, each followed by a NUL. Not their sizes: appending to a file doesn't alter its dir's mtime, so each is re-stat()ed
+std::vector<wxString> subdirs;      // Those on the same device. A change deeper down doesn't alter this dir's mtime either, so each subdir is validated separately
+std::list<wxString>::iterator lru;  // Its place in DirSizeService::m_lru
+};
+
+enum { DIRSIZE_CACHE_MAX = 20000 }; // Selecting / would otherwise cache every dir on the filesystem
+
+class DirSizeService : public wxEvtHandler  // Calculates the recursive size of a fileview's selection on worker threads, caching each subdir's listing
+{
+public:
+void Request(FileGenericDirCtrl* requester, const wxArrayString& selections); // Cancels any current request, and starts counting these
+void Cancel(const MyGenericDirCtrl* requester = NULL); // Cancel the current request, if it was made by requester (or by anyone if NULL)
+void Invalidate(const wxString& filepath);   // Something changed in filepath, so forget what we know of it and of its parent
+
+  // Worker-thread calls
+bool GetWork(unsigned int generation, DirSizeWork& work); // Returns false when there's nothing left to do
+void AddWork(unsigned int generation, const DirSizeWork& work);
+void FinishedExpanding(unsigned int generation);
+void AddProgress(unsigned int generation, wxULongLong size, bool finished); // Adds to the total, and tells the requester
+bool IsCancelled(unsigned int generation);
+bool GetCachedDir(const wxString& dirname, const struct stat& st, std::string& files, std::vector<wxString>& subdirs);
+void CacheDir(const wxString& dirname, const struct stat& st, const std::string& files, const std::vector<wxString>& subdirs);
+
+static bool ScanDir(const wxString& dirname, wxULongLong& size, bool countall, std::vector<wxString>* subdirs = NULL, dev_t dev = 0, std::string* files = NULL); // Adds the sizes of dirname's children with an fstatat() each, rather than a FileData each
+static void StatFiles(const wxString& dirname, const std::string& files, wxULongLong& size); // Adds the current sizes of a cached listing's files
+
+static DirSizeService& Get() { if (!ms_instance) ms_instance = new DirSizeService; return *ms_instance; }
+
+protected:
+void OnProgress(wxCommandEvent& event);
+
+wxMutex m_mutex;                             // Protects everything below
+wxCondition m_workcondition;                 // Signalled when work is queued, when a dir has been expanded, or on cancellation
+unsigned int m_generation;                   // Incremented by each request or cancellation, so that workers can tell if their results are still wanted
+FileGenericDirCtrl* m_requester;
+wxULongLong m_total;
+size_t m_workers;                            // How many threads are still running for this request
+size_t m_expanding;                          // How many are listing a selected dir, so may yet add work
+bool m_EventPending;
+std::deque<DirSizeWork> m_queue;
+std::map<wxString, DirSizeCacheEntry> m_cache;
+std::list<wxString> m_lru;                   // The cached dirs, most recently used first
+
+void Uncache(const wxString& dirname);
+
+private:
+DirSizeService();
+
+static DirSizeService* ms_instance;
+};
+
+class DirSizeThread : public wxThread
+{
+public:
+DirSizeThread(unsigned int generation) : wxThread(wxTHREAD_DETACHED), m_generation(generation), m_lastreport(0) {}
+
+protected:
+void* Entry();
+bool Walk(const wxString& dirname, dev_t dev); // Returns false if cancelled
+void Report(bool finished);                  // Pass on any size found since the last report, if it's been a while or we've finished
+
+unsigned int m_generation;
+wxULongLong m_unreported;
+wxLongLong m_lastreport;
+};
+
+
+#if wxVERSION_NUMBER < 2900
+  DECLARE_EVENT_TYPE(FlatWalkType, wxID_ANY)
+#else
+  wxDECLARE_EVENT(FlatWalkType, wxCommandEvent);
+#endif
+
+class DataBase;
+
+struct FlatWalkJob   // One walk of a subtree, shared by the FlatWalkThreads doing it
+{
+FileGenericDirCtrl* requester;
+bool incremental;                            // True for a walk of a newly-appeared dir, whose entries should be inserted in sorted order
+bool showhidden;
+wxArrayString filters;
+std::deque< std::pair<wxString, dev_t> > queue; // Dirs waiting to be listed, and the device they must be on
+size_t busy;                                 // How many threads are listing a dir, so may yet add to the queue
+size_t workers;                              // How many threads are still running
+bool cancelled;
+bool EventPending;
+std::vector<DataBase*> entries;              // Found, but not yet collected by the requester
+wxArrayString dirs;                          // Ditto the dirs that were listed, so that they can be watched
+};
+
+class FlatWalkService : public wxEvtHandler  // Recursively lists a subtree for a 'flat' fileview, on worker threads, streaming the results back
+{
+public:
+void Request(FileGenericDirCtrl* requester, const wxString& dirname, bool showhidden, const wxArrayString& filters, bool incremental = false);
+void Cancel(const MyGenericDirCtrl* requester); // Cancel all of requester's walks
+
+  // Worker-thread calls
+bool GetWork(unsigned int id, wxString& dirname, dev_t& dev); // Returns false when there's nothing left to do
+void AddWork(unsigned int id, const std::vector<wxString>& subdirs, dev_t dev, std::vector<DataBase*>& entries, const wxString& dirname); // Also finishes dirname
+bool GetSettings(unsigned int id, bool& showhidden, wxArrayString& filters);
+void WorkerFinished(unsigned int id);
+
+static bool IsWanted(const wxString& name, bool showhidden, const wxArrayString& filters); // Does a file called name belong in the view?
+
+static FlatWalkService& Get() { if (!ms_instance) ms_instance = new FlatWalkService; return *ms_instance; }
+
+protected:
+void PostIfNeeded(unsigned int id, FlatWalkJob* job);
+void OnResults(wxCommandEvent& event);
+
+wxCriticalSection m_CritSection;             // Protects everything below
+unsigned int m_nextid;
+std::map<unsigned int, FlatWalkJob*> m_jobs;
+
+private:
+FlatWalkService();
+
+static FlatWalkService* ms_instance;
+};
+
+class FlatWalkThread : public wxThread
+{
+public:
+FlatWalkThread(unsigned int id) : wxThread(wxTHREAD_DETACHED), m_id(id) {}
+
+protected:
+void* Entry();
+
+unsigned int m_id;
+};
+
+
+#if wxVERSION_NUMBER < 2900
+  DECLARE_EVENT_TYPE(DirCacheCheckType, wxID_ANY)
+#else
+  wxDECLARE_EVENT(DirCacheCheckType, wxCommandEvent);
+#endif
+
+class FileData;
+typedef std::map<wxString, struct stat> DirCacheChildren;  // A dir's children's names, and their lstat data
+
+struct DirCacheListing   // Used by ExpandDir while it lists a dir
+{
+DirCacheListing() : valid(false), cached(NULL) {}
+bool valid;                                  // dirst holds the dir's current data
+struct stat dirst;
+const DirCacheChildren* cached;              // If non-NULL, the cached children are still trustworthy
+DirCacheChildren fresh;                      // Children that had to be lstat-ed
+std::vector<wxString> used;                  // Children taken from the cache. They'll need rechecking in the background
+};
+
+struct DirCacheEntry
+{
+dev_t dev; ino_t ino; time_t mtime; time_t ctime; // If the dir still has these, its list of children is unchanged
+DirCacheChildren children;
+std::list<wxString>::iterator lru;           // Where the dir is in DirCache::m_lru
+};
+
+struct DirCacheCheck  // A background recheck of the cached data that a fileview was filled from
+{
+FileGenericDirCtrl* requester;
+wxString dirname;
+std::vector< std::pair<wxString, struct stat> > todo;
+std::vector< std::pair<wxString, struct stat> > changed;
+std::vector<wxString> vanished;
+};
+
+class DirCache : public wxEvtHandler  // Keeps dirs' children's lstat data between sessions, so panes can be filled without a stat per file (slow on e.g. NFS)
+{
+public:
+void Begin(const wxString& dirname, DirCacheListing& listing); // Call before listing dirname
+FileData* NewFileData(const wxString& dirname, const wxString& name, DirCacheListing& listing); // From the cache if possible, otherwise lstat it
+void End(const wxString& dirname, DirCacheListing& listing, FileGenericDirCtrl* requester = NULL); // Store what was learnt. For a fileview, recheck the cached data used
+void Cancel(const MyGenericDirCtrl* requester); // Forget any rechecks for requester
+
+  // Worker-thread calls
+bool GetCheck(unsigned int id, wxString& dirname, std::vector< std::pair<wxString, struct stat> >& todo);
+void CheckDone(unsigned int id, const std::vector< std::pair<wxString, struct stat> >& changed, const std::vector<wxString>& vanished);
+
+static DirCache& Get() { if (!ms_instance) ms_instance = new DirCache; return *ms_instance; }
+static void Shutdown();                      // On exit, save the cache if it's been used
+static void Discard();                       // Throw away the cache, and its file
+
+protected:
+void Load();
+bool Save();
+static wxString GetCacheFilepath();
+void Touch(const wxString& dirname, DirCacheEntry& entry); // Mark dirname as the most-recently-used
+void Remove(std::map<wxString, DirCacheEntry>::iterator iter);
+void Evict();                                // Drop the least-recently-used dirs until we're within DIR_CACHE_MAX_ENTRIES
+void OnCheckDone(wxCommandEvent& event);
+
+std::map<wxString, DirCacheEntry> m_dirs;    // These are only used by the main thread
+std::list<wxString> m_lru;                   // Most-recently-used first
+size_t m_count;                              // The total number of cached children
+bool m_loaded;
+bool m_dirty;
+
+wxCriticalSection m_CritSection;             // Protects the rechecks
+unsigned int m_nextid;
+std::map<unsigned int, DirCacheCheck> m_checks;
+
+private:
+DirCache();
+
+static DirCache* ms_instance;
+};
+
+class DirCacheCheckThread : public wxThread
+{
+public:
+DirCacheCheckThread(unsigned int id) : wxThread(wxTHREAD_DETACHED), m_id(id) {}
+
+protected:
+void* Entry();
+
+unsigned int m_id;
+};
+
+#if wxVERSION_NUMBER < 2900
+  DECLARE_EVENT_TYPE(FileSniffType, wxID_ANY)
+#else
+  wxDECLARE_EVENT(FileSniffType, wxCommandEvent);
+#endif
+
+class FileDataObjArray;
+
+enum sniffedkind { sk_unknown, sk_empty, sk_text, sk_script, sk_image, sk_svg, sk_elf, sk_archive, sk_data }; // sk_unknown means we couldn't look; sk_data that we looked but didn't recognise it
+
+struct SniffedType   // What a file's first few hundred bytes say it is
+{
+SniffedType(enum sniffedkind k = sk_unknown, enum ziptype z = zt_invalid) : kind(k), zt(z) {}
+enum sniffedkind kind;
+enum ziptype zt;                             // For sk_archive, the outermost format: so a foo.tar.gz is zt_gzip, as only decompressing would reveal the tar
+};
+
+struct SniffedFile
+{
+wxString filepath;
+dev_t dev; ino_t ino; time_t mtime; off_t size; // The file's state when it was sniffed. If any has changed, so might the type
+SniffedType type;
+};
+
+struct FileSniffJob  // A background sniff of the files a fileview is showing
+{
+FileGenericDirCtrl* requester;
+wxString dirname;
+std::vector<wxString> todo;
+std::vector<SniffedFile> results;
+};
+
+class FileClassifier : public wxEvtHandler  // Decides what a file is from its magic bytes, not its name, and remembers the answer per inode
+{
+public:
+SniffedType Classify(const wxString& filepath);  // From the cache if possible, otherwise sniff it now. Follows symlinks
+bool Lookup(const struct stat& st, SniffedType& type) const; // Cache only: never touches the file, so it's cheap enough for a repaint
+bool Contradicts(const wxString& filepath, enum ziptype zt); // Does filepath's content show it can't be the zt its name suggests?
+void SniffInBackground(FileGenericDirCtrl* requester, const wxString& dirname, FileDataObjArray& files); // Sniff those of files whose icon might depend on it
+void Cancel(const MyGenericDirCtrl* requester);
+
+static enum ziptype ArchiveType(const wxString& filepath, const SniffedType& type); // What to treat filepath as, taking both its name and content into account
+static bool IsConsistent(enum ziptype zt, const SniffedType& type); // Could a file with content type be a zt?
+static SniffedType Sniff(const unsigned char* buf, size_t len); // Identify a file from its first len bytes
+static SniffedType SniffFile(const wxString& filepath, SniffedFile* file = NULL); // Read and identify filepath, bypassing the cache, so it's safe from any thread
+static void SniffBatch(const std::vector<wxString>& filepaths, std::vector<SniffedFile>& results); // Sniff several files, letting the kernel read them all ahead at once
+
+  // Worker-thread calls
+bool GetJob(unsigned int id, std::vector<wxString>& todo);
+void JobDone(unsigned int id, const std::vector<SniffedFile>& results);
+
+static FileClassifier& Get() { if (!ms_instance) ms_instance = new FileClassifier; return *ms_instance; }
+
+protected:
+void Store(const SniffedFile& file);
+void OnJobDone(wxCommandEvent& event);
+
+typedef std::pair<dev_t, ino_t> FileSniffKey;
+std::map<FileSniffKey, SniffedFile> m_cache; // Only used by the main thread. Worker threads must use SniffFile() instead
+
+wxCriticalSection m_CritSection;             // Protects the jobs
+unsigned int m_nextid;
+std::map<unsigned int, FileSniffJob> m_jobs;
+
+private:
+FileClassifier();
+
+static FileClassifier* ms_instance;
+};
+
+class FileSniffThread : public wxThread
+{
+public:
+FileSniffThread(unsigned int id) : wxThread(wxTHREAD_DETACHED), m_id(id) {}
+
+protected:
+void* Entry();
+
+unsigned int m_id;
+};
+
+struct StartupTraceEvent
+{
+wxString name;
+char phase;                                  // 'B'egin, 'E'nd, or 'i'nstant, as in the Chrome-trace format
+wxLongLong usec;
+};
+
+class StartupTracer  // Records a timeline of startup's phases. If asked to by --trace-startup, writes it as Chrome-trace json (view in chrome://tracing or Perfetto)
+{
+public:
+static void Begin(const wxString& name) { Add(name, 'B'); }
+static void End(const wxString& name) { Add(name, 'E'); }
+static void Mark(const wxString& name) { Add(name, 'i'); }
+static void SetFilepath(const wxString& filepath) { ms_filepath = filepath; }
+static bool Finish();                        // Stop recording and, if there's a filepath, write the timeline to it
+
+protected:
+static void Add(const wxString& name, char phase);
+
+static std::vector<StartupTraceEvent> ms_events;
+static wxString ms_filepath;
+static bool ms_finished;
+};
+
 #endif    //MISCH
 
@@ -1766,19 +1766,21 @@ return Mntarray.GetCount();
 void UnMountSambaDialog::SearchForNetworkMounts()  // Scans mtab for established NFS & samba mounts
 {
 #ifdef __linux__
-FILE* fmp = setmntent (_PATH_MOUNTED, "r");                   // Get a file* to (probably) /etc/mtab
-if (fmp==NULL) return;
-
-while (1)                                                     // For every mtab entry
-  { struct mntent* mnt = getmntent(fmp);                      //  get a struct representing a mounted partition
-    if (mnt == NULL)  
-      { endmntent(fmp);  return; }                            // If it's null, we've finished mtab
-
-    wxString type(mnt->mnt_type, wxConvUTF8);
-    if (ParseNetworkFstype(type) != MT_invalid)
+MountTable& table = MountTable::Get();
+wxArrayString types; table.GetTypes(types);                   // Look only at mounts of a network fstype, not at every bind-mount
+for (size_t t=0; t < types.GetCount(); ++t)
+  { wxString type(types[t]);
+    if (ParseNetworkFstype(type) == MT_invalid) continue;
+
+    std::vector<const MountEntry*> entries; table.FindAllByType(type, entries);
+    for (size_t e=0; e < entries.size(); ++e)
       { struct PartitionStruct* newmnt = new struct PartitionStruct;
-        newmnt->device = wxString(mnt->mnt_fsname, wxConvUTF8);
-        newmnt->mountpt = wxString(mnt->mnt_dir, wxConvUTF8);
+        newmnt->device = entries[e]->device;
+        newmnt->mountpt = entries[e]->mountpt;
+        newmnt->type = type;
+        Mntarray.Add(newmnt);                      
+      }
+  }
 #else
 struct statfs *fslist;
 
@@ -1791,11 +1793,11 @@ for (int i = 0; i < numfs; ++i)
       { struct PartitionStruct* newmnt = new struct PartitionStruct;
         newmnt->device = wxString(fslist[i].f_mntfromname, wxConvUTF8);
         newmnt->mountpt = wxString(fslist[i].f_mntonname, wxConvUTF8);
-#endif
         newmnt->type = type;
         Mntarray.Add(newmnt);                      
       }
   }
+#endif
 }
 
 UnMountSambaDialog::MtType UnMountSambaDialog::ParseNetworkFstype(const wxString& type) const // Is this a mount that we're interested in: nfs, sshfs or samba
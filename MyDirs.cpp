@@ -22,6 +22,8 @@
 #include "wx/file.h"
 #include <wx/ffile.h>
 
+#include <errno.h>
+
 
 #include "MyTreeCtrl.h"
 #include "MyFiles.h"
@@ -200,6 +202,68 @@ wxCHECK_RET(!ThreadsManager::Get().PasteIsActive(), wxT("Trying to start a paste
 if (!GetCount()) // We must be here just to cause the 'success' message to display in a non-thread situation
   { m_tsb->OnCompleted(); return; }
 
+  // Register the paste with the JobManager, so that it can be paused or cancelled from the Jobs panel, and so that queued archive jobs on the same device wait for it.
+  // It's started immediately though: the user is waiting for it, and can't do another paste meanwhile
+PasteThreadSuperBlock* tsb = static_cast<PasteThreadSuperBlock*>(m_tsb);
+wxString verb;
+switch(tsb->GetMessageType())
+  { case tsbm_deleted: case tsbm_cut: case tsbm_trashed:  verb = _("Delete"); break;
+    case tsbm_undone:     verb = _("Undo"); break;
+    case tsbm_redone:     verb = _("Redo"); break;
+    case tsbm_duplicated: verb = _("Duplicate"); break;
+    default:              verb = GetIsMoves() ? _("Move") : _("Paste");
+  }
+
+wxString destdir = m_PasteData.at(0).dest.BeforeLast(wxFILE_SEP_PATH);
+wxString description = wxString::Format(_("%s %u items to %s"), verb.c_str(), (unsigned int)GetCount(), destdir.c_str());
+JobManager::Get().Submit(new PasteJob(tsb, description, destdir), true);
+}
+
+void PastesCollector::LaunchThreads()
+{
+PasteThreadSuperBlock* ptsb = static_cast<PasteThreadSuperBlock*>(m_tsb);
+PasteJournal* journal = NULL;           // A resumed paste already has one, whose items already have their indices
+if (!ptsb->GetJournal() && m_tsb->GetUnRedoType() == URT_notunredo) // Journal an original paste, so that it can be resumed if interrupted. An unredo can just be done again
+  { journal = new PasteJournal;
+    if (!journal->Create(GetIsMoves()))
+      { delete journal; journal = NULL; }
+  }
+
+  // Stat everything first: the sizes are needed for the progress display, and a journal must be on disk before any thread starts
+wxULongLong totalsize=0;
+for (size_t p=0; p < m_PasteData.size(); ++p)
+  { FileData fd(m_PasteData.at(p).origin);
+    if (fd.IsValid()) totalsize += fd.Size();
+    if (journal)
+      { m_PasteData.at(p).index = (int)p;
+        journal->AddItem(m_PasteData.at(p), fd.IsValid() ? fd.Size() : wxULongLong(0), fd.IsValid() ? fd.ModificationTime() : 0);
+      }
+  }
+if (journal)                            // The held-back hardlinks too, or an interrupted paste would silently lose them. Likewise its unredos, and a Move's emptied dirs
+  { for (size_t n=0; n < ptsb->GetHardlinks().size(); ++n)
+      journal->AddHardlink(ptsb->GetHardlinks().at(n));
+    for (size_t n=0; n < ptsb->GetUnRedos().size(); ++n)
+      journal->AddUnRedo(ptsb->GetUnRedos().at(n).first, ptsb->GetUnRedos().at(n).second);
+    for (size_t n=0; n < ptsb->GetDeleteAfter().GetCount(); ++n)
+      journal->AddDeleteAfter(ptsb->GetDeleteAfter().Item(n));
+  }
+if (journal)
+  { if (journal->Commit()) ptsb->SetJournal(journal);
+     else                               // We can manage without one, but the indices must go, or the threads would report to a journal that isn't there
+      { delete journal;
+        for (size_t p=0; p < m_PasteData.size(); ++p) m_PasteData.at(p).index = wxNOT_FOUND;
+      }
+  }
+
+m_newdirparents.Clear();
+if (DURABLE_PASTE)                      // The dirs were made before we got here, but their entries in their parents may not be on disk yet
+  for (size_t p=0; p < m_PasteData.size(); ++p)
+    if (m_PasteData.at(p).precreated)
+      { wxString parent = StripSep(m_PasteData.at(p).dest).BeforeLast(wxFILE_SEP_PATH);
+        if (parent.empty()) parent = wxT("/");
+        if (m_newdirparents.Index(parent) == wxNOT_FOUND) m_newdirparents.Add(parent);
+      }
+
 size_t ThreadsToUse = wxMin(ThreadsManager::GetCPUCount(), GetCount()); // How widely can/should we spread the load?
 size_t count = GetCount() / ThreadsToUse;
 bool overflow = (GetCount() % ThreadsToUse) > 0;
@@ -216,26 +280,20 @@ wxCHECK_RET(threadID != wxNOT_FOUND, wxT("Invalid threadID"));
 static_cast<PasteThreadSuperBlock*>(m_tsb)->StartThreadTimer();
 
  // If the itemcount is exactly divisible by the cpu count, that's fine. Otherwise the last thread gets its normal quota plus the extras
-size_t p=0; wxULongLong totalsize=0;
+size_t p=0;
 for (size_t n=0; n < fullcount; ++n)
   { std::vector<PasteData> pastedata;
     for (size_t c=0; c < count; ++c, ++p)
-      { pastedata.push_back(m_PasteData.at(p));
-        FileData fd(m_PasteData.at(p).origin);
-        if (fd.IsValid()) totalsize += fd.Size();
-      }
+      pastedata.push_back(m_PasteData.at(p));
     DoStartThread(pastedata, block, threadID++);
   }
 if (overflow)    
   { std::vector<PasteData> pastedata;
     for (; p < m_PasteData.size(); ++p)
-      { pastedata.push_back(m_PasteData.at(p));
-        FileData fd(m_PasteData.at(p).origin);
-        if (fd.IsValid()) totalsize += fd.Size();
-      }
+      pastedata.push_back(m_PasteData.at(p));
     DoStartThread(pastedata, block, threadID++);
   }
-static_cast<PasteThreadSuperBlock*>(m_tsb)->SetTotalExpectedSize(totalsize);
+ptsb->SetTotalExpectedSize(totalsize);
 }
 
 void PastesCollector::DoStartThread(const std::vector<PasteData>& pastedata, ThreadBlock* block, int threadID)
@@ -244,6 +302,10 @@ enum wxThreadError error(wxTHREAD_NO_ERROR);
 
 PasteThread* thread = new PasteThread(MyFrame::mainframe, threadID, pastedata, GetIsMoves());
 thread->SetUnRedoType(m_tsb->GetUnRedoType());
+thread->SetGate(&static_cast<PasteThreadSuperBlock*>(m_tsb)->GetGate());
+thread->SetJournal(static_cast<PasteThreadSuperBlock*>(m_tsb)->GetJournal());
+static_cast<PasteThreadSuperBlock*>(m_tsb)->GetGate().AddWorker(); // Before it starts, so that on exit StopPastes() can't miss it
+thread->SetNewDirParents(m_newdirparents); // Each thread syncs them all. It's cheap if another already has, and a thread's Move deletions mustn't wait on the others
 
 #if wxVERSION_NUMBER < 2905
   error = thread->Create();
@@ -258,6 +320,7 @@ if (error == wxTHREAD_NO_ERROR)
   block->SetThreadPointer(threadID, thread); // All is well, so store the thread, in case it needs to be interrupted
  else
   { wxLogDebug(wxT("Can't create thread!")); // So do it the original, non-thread way
+    static_cast<PasteThreadSuperBlock*>(m_tsb)->GetGate().WorkerFinished();
     size_t successes(0), failures(0);
     for (size_t n=0; n < pastedata.size(); ++n)
       if (wxCopyFile(pastedata.at(n).origin, pastedata.at(n).dest, false))
@@ -278,10 +341,18 @@ void* PasteThread::Entry()
 {
 wxCHECK_MSG(m_caller && m_PasteData.size(), NULL, wxT("Passed dud parameters"));
 
+if (m_gate) m_gate->ApplyIOPriority();  // So that the panes' lstat()s and readdir()s don't queue behind our writes
+
 for (size_t n=0; n < m_PasteData.size(); ++n)
-  { if (ProcessEntry(m_PasteData.at(n)))
+  { if (m_gate && m_gate->IsStoppingForExit()) break; // 4Pane is exiting. The journal will let the rest be done next time
+    errno = 0;
+    if (ProcessEntry(m_PasteData.at(n)))
       m_successfulpastes.Add(m_PasteData.at(n).origin);
+     else if (m_journal && !Stopping())   // A failure, not an interruption. Tell the journal why, so it knows whether a resume could help
+      m_journal->FileFailed(m_PasteData.at(n).index, errno);
   }
+
+SyncDirs();                             // Even if we were cancelled: the files that did arrive should be made safe, and their origins removed
 return NULL;
 }
 
@@ -289,6 +360,8 @@ bool PasteThread::ProcessEntry(const PasteData& data)
 {
 if (data.precreated)
   return true;
+if (DURABLE_PASTE && IsStalePartFile(data.origin))
+  return true;          // Don't propagate the leftovers of an earlier crash; the dest dir's own ones are removed in AddUnsyncedDir()
   
 wxString origin = data.origin, dest = data.dest, trash = data.overwrite;
 FileData orig(origin);  // Check the origin filepath still exists i.e. nothing deleted it before we got here
@@ -318,7 +391,10 @@ if (m_fromunredo == URT_notunredo)
   }
 
   // Now the main event: the Paste
+m_current = data.index; m_resumefrom = data.resumefrom;
+if (m_journal) m_journal->FileStarted(m_current); // From now on, a resume mustn't redo the overwrite above: dest is ours
 bool result = CopyFile(origin, dest);
+m_current = wxNOT_FOUND; m_resumefrom = 0;
 if (result) 
   { UnexecuteImages(dest);
     KeepShellscriptsExecutable(dest, orig.GetPermissions());
@@ -326,48 +402,147 @@ if (result)
 if (RETAIN_MTIME_ON_PASTE)
   FileData::ModifyFileTimes(dest, origin);
 
+    bool restoring = (m_fromunredo == URT_undo) && !trash.empty();
       // The aftermath: for a Move() we need to delete the origin
     if (m_ismoving)
-      wxRemoveFile(origin); 
+      { if (DURABLE_PASTE && !restoring)
+          m_pendingremovals.Add(origin);  // but not until the dest's dir has been synced, or a crash could lose both
+         else
+          wxRemoveFile(origin);           // If restoring, this must go now: deleting it later would delete the file restored below
+      }
 
-    if ((m_fromunredo == URT_undo) && !trash.empty()) // For an Undo we need to retrieve any overwritten file from the trashcan & put it back where it used to be
+    if (restoring) // For an Undo we need to retrieve any overwritten file from the trashcan & put it back where it used to be
       { if (wxFileExists(origin))                     // First delete the pasted version, if it still exists
           wxRemoveFile(origin);
         CopyFile(trash, origin);                      // then replace it with the original
         m_needsrefreshes.Add(origin); // Mark for refresh, as the FSWatcher Delete event often arrives after the Create event so the file doesn't display
       }
+
+    if (m_journal) m_journal->FileDone(data.index);
   }
 
 return result;
 }
 
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <signal.h>
+#ifdef __linux__
+  #include <sys/ioctl.h>
+  #include <sys/stat.h>
+  #include <sys/syscall.h>
+  #include <errno.h>
+  #ifndef FICLONE
+    #define FICLONE _IOW(0x94, 9, int)  // From linux/fs.h, which doesn't play nicely with sys/mount.h
+  #endif
+#endif
+
+static const size_t ALIQUOT(1000000);   // Copy in chunks of this size, so that progress can be reported and a Cancel noticed
+static const off_t WRITEBACK_WINDOW(8 * 1024 * 1024); // How much a paced copy may leave dirty before starting its writeback
+static const wxULongLong_t CHECKPOINT_INTERVAL(64 * 1024 * 1024); // How much of a big file is copied between journal checkpoints. Each costs an fdatasync
+
+class WritebackPacer  // Starts the writeback of each few MB as soon as it's written, and waits for the lot before. Otherwise a big paste fills the page-cache with dirty pages, and every lstat() from the panes queues behind their flushing
+{
+public:
+WritebackPacer(int infd, int outfd, bool enabled) : m_infd(infd), m_outfd(outfd), m_enabled(enabled), m_started(0), m_previous(0) {}
+
+void Written(off_t upto)                // The file has now been written as far as 'upto'
+{
+#if defined(__linux__) && defined(SYNC_FILE_RANGE_WRITE)
+if (!m_enabled || upto - m_started < WRITEBACK_WINDOW) return;
+
+sync_file_range(m_outfd, m_started, upto - m_started, SYNC_FILE_RANGE_WRITE); // Start writing this window, without waiting for it
+if (m_started > m_previous)             // The previous window has had a window's worth of time to be written, so waiting for it should be brief
+  { sync_file_range(m_outfd, m_previous, m_started - m_previous, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(m_outfd, m_previous, m_started - m_previous, POSIX_FADV_DONTNEED); // Now it's clean, drop it, and the source too: neither is likely to be read again soon,
+    posix_fadvise(m_infd, m_previous, m_started - m_previous, POSIX_FADV_DONTNEED);  //   and keeping them would evict the dirs the panes are showing
+  }
+m_previous = m_started;
+m_started = upto;
+#else
+wxUnusedVar(upto);
+#endif
+}
+
+protected:
+int m_infd;
+int m_outfd;
+bool m_enabled;
+off_t m_started;                        // Writeback has been started for everything before this
+off_t m_previous;                       //  and has finished for everything before this
+};
+
 bool PasteThread::CopyFile(const wxString& origin, const wxString& destination)
 {
-static const size_t ALIQUOT(1000000);
-if (TestDestroy())
+if (Interrupted())
   return false;
 
 wxCHANGE_UMASK(0); // This turns off umask while in scope
 
 FileData orig(origin);
 wxULongLong filesize = orig.Size();
-if (filesize.ToULong() == 0)
+if (filesize.ToULong() == 0 && !DURABLE_PASTE)
   return wxCopyFile(origin, destination, false); // If it's a zero-sized file, just copy it. We won't need to interrupt ;)
 
 wxFile in(origin, wxFile::read);
 if (!in.IsOpened()) return false;
 
+if (DURABLE_PASTE)                      // Write to a hidden file alongside, which only gets the real name once it's safely on disk. So a crash leaves either the whole file, or no file
+  { wxString name = destination.AfterLast(wxFILE_SEP_PATH);
+    if (name.Len() > 200) name.Truncate(200); // Leave room for the suffix within NAME_MAX
+    wxString temp = destination.BeforeLast(wxFILE_SEP_PATH) + wxFILE_SEP_PATH + wxT('.') + name
+                      + wxString::Format(wxT(".%lu-%i.4Pane-part"), wxGetProcessId(), m_ID);
+
+    wxFile out;
+    if (!out.Create(temp, true, orig.GetPermissions()) || !out.IsOpened()) return false;
+    if (CopyContents(in, out, filesize, temp) && CommitDurably(out, temp, destination))
+      return true;
+
+    wxLogNull shh;
+    if (wxFileExists(temp)) wxRemoveFile(temp);
+    return false;
+  }
+
+wxULongLong from = m_resumefrom;        // Non-zero if a resumed paste has already copied this much
 wxFile out;
-if (!out.Create(destination, true, orig.GetPermissions()) ) return false;
+if (from > 0)                           // so keep what's there. Plan() checked it's big enough, but things may have changed since
+  { wxLogNull shh;
+    if (!out.Open(destination, wxFile::read_write) || out.Length() < (wxFileOffset)from.GetValue())
+      { out.Close(); from = 0; }
+  }
 if (!out.IsOpened())
-  { return false; }
+  { if (!out.Create(destination, true, orig.GetPermissions()) ) return false;
+    if (!out.IsOpened())
+      { return false; }
+  }
+
+return CopyContents(in, out, filesize, destination, from);
+}
+
+bool PasteThread::CopyContents(wxFile& in, wxFile& out, wxULongLong filesize, const wxString& destination, wxULongLong from /*=0*/)
+{
+if (filesize == 0)
+  return true;                          // Only a DURABLE_PASTE gets here with an empty file
+
+if (from > 0)
+  { if (in.Seek((wxFileOffset)from.GetValue()) == wxInvalidOffset || out.Seek((wxFileOffset)from.GetValue()) == wxInvalidOffset)
+      return false;
+    PostProgress(from);                 // Count what was copied before the interruption as done
+  }
+m_lastcheckpoint = from;
+
+int kernelcopy = KernelCopy(in.fd(), out.fd(), filesize, destination, from); // First see if the kernel can do it without the data passing through here
+if (kernelcopy != wxNOT_FOUND)
+  return kernelcopy == 1;
 
 char buffer[ALIQUOT + 1];
-wxULongLong total(0);
+wxULongLong total(from);
+WritebackPacer pacer(in.fd(), out.fd(), m_gate && m_gate->GetPaceWriteback());
 while (true)
-  { if (TestDestroy())
-      { wxLogNull shh;  // We've been aborted, so remove any partial file and exit
-        wxRemoveFile(destination); 
+  { if (Interrupted())
+      { wxLogNull shh;  // We've been aborted, so remove any partial file and exit. Not if we're exiting though: the journal will resume it from its last checkpoint
+        if (!StoppingForExit()) wxRemoveFile(destination); 
         return false; 
       }
     size_t read = in.Read(buffer, ALIQUOT);
@@ -383,6 +558,9 @@ while (true)
     wxPostEvent(MyFrame::mainframe, event);
 
     total += read;
+    pacer.Written((off_t)total.GetValue());
+    Checkpoint(out.fd(), total);
+    Throttle(read);
     if (total >= filesize)
       break;
   }
@@ -390,6 +568,182 @@ while (true)
 return true;
 }
 
+bool PasteThread::CommitDurably(wxFile& out, const wxString& temp, const wxString& destination)
+{
+if (fdatasync(out.fd()) != 0)           // fdatasync() includes the file's size, which is all the metadata that matters here
+  return false;
+out.Close();
+
+if (rename(temp.fn_str(), destination.fn_str()) != 0) // Atomic, and replaces any existing file in one step
+  return false;
+
+wxString dir = destination.BeforeLast(wxFILE_SEP_PATH);
+if (dir.empty()) dir = wxT("/");
+AddUnsyncedDir(dir);                    // The rename itself is only safe once the dir is synced. Do that once per dir, at the end, instead of once per file
+return true;
+}
+
+void PasteThread::AddUnsyncedDir(const wxString& dir)
+{
+if (m_unsynceddirs.Index(dir) != wxNOT_FOUND) return;
+m_unsynceddirs.Add(dir);
+
+wxLogNull shh;
+wxDir d(dir);                           // As it's the first time we've written here, look for any temporary files left by an earlier crash
+if (!d.IsOpened()) return;
+wxString filename; wxArrayString stale;
+for (bool cont = d.GetFirst(&filename, wxT(".*.4Pane-part"), wxDIR_FILES | wxDIR_HIDDEN); cont; cont = d.GetNext(&filename))
+  if (IsStalePartFile(filename)) stale.Add(dir + wxFILE_SEP_PATH + filename);
+for (size_t n=0; n < stale.GetCount(); ++n)
+  wxRemoveFile(stale[n]);
+}
+
+//static
+bool PasteThread::IsStalePartFile(const wxString& filepath)
+{
+wxString name = filepath.AfterLast(wxFILE_SEP_PATH);
+if (!name.StartsWith(wxT(".")) || !name.EndsWith(wxT(".4Pane-part"))) return false;
+
+unsigned long pid;                      // The name is .<name>.<pid>-<threadID>.4Pane-part
+if (!name.BeforeLast(wxT('.')).AfterLast(wxT('.')).BeforeFirst(wxT('-')).ToULong(&pid) || !pid) return false;
+if (pid == wxGetProcessId()) return false; // One of ours, which may well be in use
+return (kill((pid_t)pid, 0) == -1) && (errno == ESRCH); // Its 4Pane is no longer running. EPERM would mean someone else's process is
+}
+
+void PasteThread::SyncDirs()
+{
+for (size_t n=0; n < m_newdirparents.GetCount(); ++n)
+  if (m_unsynceddirs.Index(m_newdirparents[n]) == wxNOT_FOUND) m_unsynceddirs.Add(m_newdirparents[n]);
+
+for (size_t n=0; n < m_unsynceddirs.GetCount(); ++n)
+  { int fd = open(m_unsynceddirs[n].fn_str(), O_RDONLY | O_DIRECTORY);
+    if (fd == -1) continue;
+    fsync(fd);
+    close(fd);
+  }
+m_unsynceddirs.Clear();
+
+for (size_t n=0; n < m_pendingremovals.GetCount(); ++n)
+  wxRemoveFile(m_pendingremovals[n]);
+m_pendingremovals.Clear();
+}
+
+int PasteThread::KernelCopy(int infd, int outfd, wxULongLong filesize, const wxString& destination, wxULongLong from /*=0*/)
+{
+#ifdef __linux__
+if (from == 0 && ioctl(outfd, FICLONE, infd) == 0) // On e.g. btrfs or xfs a reflink is instant: the copy shares the original's extents until either is altered
+  { PostProgress(filesize);
+    return 1;
+  }
+
+struct stat st;                         // If fewer blocks are allocated than the size needs, there are holes e.g. a VM image. Copy only the data, so they stay holes
+if (fstat(infd, &st) == 0 && (unsigned long long)st.st_blocks * 512 < filesize.GetValue())
+  { int result = SparseCopy(infd, outfd, filesize, destination, from);
+    if (result != wxNOT_FOUND)
+      return result;
+  }
+
+  #ifdef __NR_copy_file_range           // Otherwise copy_file_range(), which at least keeps the data inside the kernel and may be offloaded by e.g. nfs
+wxULongLong total(from);                // copy_file_range() is passed NULL offsets, so it carries on from wherever CopyContents() seeked to
+WritebackPacer pacer(infd, outfd, m_gate && m_gate->GetPaceWriteback());
+while (true)
+  { if (Interrupted())
+      { wxLogNull shh;                  // We've been aborted, so remove any partial file and exit, unless it's to be resumed
+        if (!StoppingForExit()) wxRemoveFile(destination); 
+        return 0; 
+      }
+    long copied = syscall(__NR_copy_file_range, infd, NULL, outfd, NULL, ALIQUOT, 0);
+    if (copied < 0)
+      { if (total == from && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP || errno == EBADF))
+          return wxNOT_FOUND;           // The kernel or the filesystem can't do it, so use read/write. Nothing's been written, and both offsets are where they started
+        return 0;
+      }
+    if (!copied)
+      return (total == filesize);
+
+    PostProgress(copied);
+    total += copied;
+    pacer.Written((off_t)total.GetValue());
+    Checkpoint(outfd, total);
+    Throttle(copied);
+    if (total >= filesize)
+      return 1;
+  }
+  #endif // def __NR_copy_file_range
+#endif // def __linux__
+
+return wxNOT_FOUND;
+}
+
+int PasteThread::SparseCopy(int infd, int outfd, wxULongLong filesize, const wxString& destination, wxULongLong from /*=0*/)
+{
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+off_t size = (off_t)filesize.GetValue();
+off_t data = lseek(infd, (off_t)from.GetValue(), SEEK_DATA);
+if (data == -1 && errno != ENXIO)       // ENXIO means there's no data at all, only a hole. Anything else means the fs can't tell us
+  return wxNOT_FOUND;
+if (ftruncate(outfd, size) != 0)        // Set the final size now. Whatever isn't then written stays a hole. For a resumed copy, what's there already is kept
+  return wxNOT_FOUND;
+
+std::vector<char> buffer(ALIQUOT);
+off_t done = (off_t)from.GetValue();
+WritebackPacer pacer(infd, outfd, m_gate && m_gate->GetPaceWriteback());
+while (data != -1 && data < size)
+  { off_t hole = lseek(infd, data, SEEK_HOLE); // There's always an implicit hole at EOF, so this only fails if the file shrank
+    if (hole == -1) hole = size;
+    PostProgress(wxULongLong(data - done)); // Count any hole we skipped as done
+
+    while (data < hole)
+      { if (Interrupted())
+          { wxLogNull shh;              // We've been aborted, so remove any partial file and exit, unless it's to be resumed
+            if (!StoppingForExit()) wxRemoveFile(destination); 
+            return 0; 
+          }
+        ssize_t read = pread(infd, &buffer[0], (size_t)wxMin((off_t)ALIQUOT, hole - data), data);
+        if (read < 0) return 0;
+        if (!read) break;
+        if (pwrite(outfd, &buffer[0], read, data) != read) return 0;
+
+        PostProgress(wxULongLong(read));
+        data += read;
+        pacer.Written(data);
+        Checkpoint(outfd, wxULongLong(data));
+        Throttle(read);
+      }
+    done = data;
+
+    data = lseek(infd, hole, SEEK_DATA);
+    if (data == -1 && errno != ENXIO) return 0;
+  }
+
+if (size > done) PostProgress(wxULongLong(size - done)); // Any trailing hole
+return 1;
+#else
+return wxNOT_FOUND;
+#endif
+}
+
+void PasteThread::Checkpoint(int outfd, wxULongLong done)
+{
+if (!m_journal || m_current == wxNOT_FOUND || DURABLE_PASTE) return; // A durable paste's partial file has a temporary name, so couldn't be resumed anyway
+if (done - m_lastcheckpoint < wxULongLong(CHECKPOINT_INTERVAL)) return;
+
+if (fdatasync(outfd) == 0)              // The journal mustn't claim more than is really on disk
+  m_journal->Checkpoint(m_current, done);
+m_lastcheckpoint = done;
+}
+
+void PasteThread::PostProgress(wxULongLong bytes)
+{
+while (bytes > 0)                       // wxCommandEvent carries an int, so a big lump may need several events
+  { unsigned int lump = (bytes > wxULongLong(0x40000000)) ? 0x40000000 : bytes.GetLo();
+    wxCommandEvent event(PasteProgressEventType, m_ID);
+    event.SetInt(lump);
+    wxPostEvent(MyFrame::mainframe, event);
+    bytes -= lump;
+  }
+}
+
 void PasteThread::OnExit()
 {
 wxCriticalSectionLocker locker(ThreadsManager::Get().GetPasteCriticalSection());
@@ -406,8 +760,228 @@ if (m_caller)
     event.SetRefreshesArrayString(m_needsrefreshes);
     wxPostEvent(m_caller, event);
   }
+
+if (m_gate) m_gate->WorkerFinished();   // Last, as after this the superblock may be deleted
+}
+
+
+bool DedupPastePlanner::AddItem(const wxString& origin, const wxString& destdir)
+{
+wxString dir = StrWithSep(destdir), orig = StripSep(origin);
+wxString dest = dir + orig.AfterLast(wxFILE_SEP_PATH);
+if (dest == orig || (StrWithSep(dest)).StartsWith(StrWithSep(orig))) return false; // Pasting onto itself or into a descendant. Leave CheckDupRen to complain
+
+FileData from(orig), to(dest);
+if (!from.IsValid()) return false;
+if (to.IsValid())                 // Only like-onto-like can be merged. Anything else e.g. a file onto a dir needs the usual questions
+  { bool dirs = from.IsDir() && to.IsDir(), files = from.IsRegularFile() && to.IsRegularFile();
+    if (!dirs && !files) return false;
+  }
+
+m_destdirs.Add(dir);
+PlanEntry(orig, dest, m_destdirs.GetCount() - 1);
+return true;
+}
+
+void DedupPastePlanner::PlanEntry(const wxString& origin, const wxString& dest, size_t owner)
+{
+FileData from(origin), to(dest);
+if (!to.IsValid())                // The dest doesn't have it, so it gets copied whole
+  { if (from.IsDir())
+      m_items.push_back(DedupPasteItem(origin, dest, owner, true, SubtreeSize(origin), DedupPasteItem::dp_copy));
+     else
+      m_items.push_back(DedupPasteItem(origin, dest, owner, false, from.IsRegularFile() ? from.Size() : wxULongLong(0), DedupPasteItem::dp_copy));
+    return;
+  }
+
+if (from.IsDir() && to.IsDir())
+  { PlanDir(origin, dest, owner); return; }
+
+if (!from.IsRegularFile() || !to.IsRegularFile()) // e.g. a symlink, or a file where the dest has a dir. Don't second-guess; leave the dest alone
+  { m_items.push_back(DedupPasteItem(origin, dest, owner, false, wxULongLong(0), DedupPasteItem::dp_skip)); return; }
+
+enum DedupPasteItem::action what = DedupPasteItem::dp_overwrite;
+if (from.Size() == to.Size())     // The quick check: same size & mtime means the same file. Same size alone means we must look inside
+  what = (from.ModificationTime() == to.ModificationTime()) ? DedupPasteItem::dp_skip : DedupPasteItem::dp_compare;
+m_items.push_back(DedupPasteItem(origin, dest, owner, false, from.Size(), what));
+}
+
+void DedupPastePlanner::PlanDir(const wxString& origin, const wxString& dest, size_t owner)
+{
+wxLogNull shh;
+wxDir dir(origin);
+if (!dir.IsOpened()) return;
+
+wxString filename;
+bool cont = dir.GetFirst(&filename, wxEmptyString, wxDIR_FILES | wxDIR_DIRS | wxDIR_HIDDEN);
+while (cont)
+  { PlanEntry(StrWithSep(origin) + filename, StrWithSep(dest) + filename, owner);
+    cont = dir.GetNext(&filename);
+  }
 }
 
+//static
+wxULongLong DedupPastePlanner::SubtreeSize(const wxString& dirpath)
+{
+wxLogNull shh;
+wxULongLong total(0);
+wxDir dir(dirpath);
+if (!dir.IsOpened()) return total;
+
+wxString filename;
+bool cont = dir.GetFirst(&filename, wxEmptyString, wxDIR_FILES | wxDIR_DIRS | wxDIR_HIDDEN);
+while (cont)
+  { FileData fd(StrWithSep(dirpath) + filename);
+    if (fd.IsDir()) total += SubtreeSize(fd.GetFilepath()); // FileData uses lstat, so symlinks to dirs aren't followed
+     else if (fd.IsRegularFile()) total += fd.Size();
+    cont = dir.GetNext(&filename);
+  }
+return total;
+}
+
+bool DedupPastePlanner::Compare()
+{
+std::vector<size_t> tocompare;
+for (size_t n=0; n < m_items.size(); ++n)
+  if (m_items.at(n).what == DedupPasteItem::dp_compare) tocompare.push_back(n);
+
+if (!tocompare.empty())
+  { wxBusyCursor busy;
+    size_t ThreadsToUse = wxMin(ThreadsManager::GetCPUCount(), tocompare.size());
+    std::vector<DedupCompareThread*> threads;
+    for (size_t t=0; t < ThreadsToUse; ++t)    // Deal the pairs out round-robin, so that one thread doesn't get all the big ones
+      { std::vector<size_t> share;
+        for (size_t n=t; n < tocompare.size(); n += ThreadsToUse) share.push_back(tocompare.at(n));
+
+        DedupCompareThread* thread = new DedupCompareThread(this, share);
+        enum wxThreadError error(wxTHREAD_NO_ERROR);
+        #if wxVERSION_NUMBER < 2905
+          error = thread->Create();
+          if (error == wxTHREAD_NO_ERROR) error = thread->Run();
+        #else
+          error = thread->Run();
+        #endif
+        if (error == wxTHREAD_NO_ERROR)
+          threads.push_back(thread);
+         else
+          { delete thread;                     // So do this share here instead
+            for (size_t n=0; n < share.size(); ++n) CompareItem(share.at(n));
+          }
+      }
+
+    size_t done(0);
+    while (true)
+      { { wxMutexLocker locker(m_donemutex);
+          if (m_done == done && m_done < tocompare.size())
+            m_donecondition.WaitTimeout(250);  // Wake as soon as a comparison finishes. The timeout is just so that the display is repainted meanwhile
+          done = m_done;
+        }
+        if (done >= tocompare.size()) break;
+        MyFrame::mainframe->SetStatusText(wxString::Format(_("Comparing with the files already there: %u of %u"), (unsigned int)done, (unsigned int)tocompare.size()), 1);
+        wxSafeYield();                         // Keep the display alive. wxSafeYield() disables input, so nothing can start another paste meanwhile
+      }
+    for (size_t t=0; t < threads.size(); ++t)
+      { threads.at(t)->Wait(); delete threads.at(t); }
+    MyFrame::mainframe->SetStatusText(wxT(""), 1);
+  }
+
+for (size_t n=0; n < m_items.size(); ++n)
+  if (m_items.at(n).what != DedupPasteItem::dp_skip) return true;
+return false;
+}
+
+void DedupPastePlanner::CompareItem(size_t index)
+{
+DedupPasteItem& item = m_items.at(index); // Each thread has its own items, so only m_done needs locking
+item.what = SameContents(item.origin, item.dest) ? DedupPasteItem::dp_skip : DedupPasteItem::dp_overwrite;
+
+wxMutexLocker locker(m_donemutex);
+++m_done;
+m_donecondition.Signal();
+}
+
+//static
+bool DedupPastePlanner::SameContents(const wxString& first, const wxString& second)
+{
+static const size_t BLOCKSIZE(1024 * 1024);
+wxLogNull shh;
+wxFile one(first), two(second);
+if (!one.IsOpened() || !two.IsOpened()) return false;   // If in doubt, copy
+
+std::vector<char> buf1(BLOCKSIZE), buf2(BLOCKSIZE);
+while (true)
+  { ssize_t read1 = one.Read(&buf1[0], BLOCKSIZE), read2 = two.Read(&buf2[0], BLOCKSIZE);
+    if (read1 != read2 || read1 == wxInvalidOffset) return false;
+    if (!read1) return true;
+    if (memcmp(&buf1[0], &buf2[0], read1) != 0) return false;
+  }
+}
+
+bool DedupPastePlanner::Confirm(wxWindow* parent) const
+{
+wxULongLong copybytes(0), skipbytes(0); size_t copies(0), skips(0);
+for (size_t n=0; n < m_items.size(); ++n)
+  { const DedupPasteItem& item = m_items.at(n);
+    if (item.what == DedupPasteItem::dp_skip) { skipbytes += item.size; ++skips; }
+     else { copybytes += item.size; ++copies; }
+  }
+
+wxString msg = wxString::Format(_("%s will be copied (%u items).\n%s is already at the destination, so %u files will be skipped."),
+                                  ParseSize(copybytes, true), (unsigned int)copies, ParseSize(skipbytes, true), (unsigned int)skips);
+wxMessageDialog dialog(parent, msg + _("\n\nContinue?"), _("Paste, skipping identical files"), wxYES_NO | wxICON_QUESTION);
+return dialog.ShowModal() == wxID_YES;
+}
+
+size_t DedupPastePlanner::Execute(PasteThreadSuperBlock* tsb, const wxArrayInt& IDs)
+{
+wxCHECK_MSG(tsb, 0, wxT("Passed a NULL superblock"));
+
+std::vector<bool> failed(m_destdirs.GetCount(), false);
+wxString trashbindir;
+for (size_t n=0; n < m_items.size(); ++n)
+  { const DedupPasteItem& item = m_items.at(n);
+    wxString name = item.dest.AfterLast(wxFILE_SEP_PATH);
+    if (item.what == DedupPasteItem::dp_copy)
+      { wxFileName From(item.isdir ? StrWithSep(item.origin) : item.origin), To(StrWithSep(item.dest.BeforeLast(wxFILE_SEP_PATH)));
+        if (MyGenericDirCtrl::Paste(&From, &To, name, item.isdir, false, false, tsb))
+          { wxString frompath = From.GetFullPath(), topath = To.GetFullPath();
+            tsb->StoreUnRedoPaste(new UnRedoPaste(frompath, IDs, topath, name, item.isdir, false, tsb), frompath);
+          }
+         else
+          { failed.at(item.owner) = true; tsb->AddFailures(1); }
+      }
+     else if (item.what == DedupPasteItem::dp_overwrite)
+      { if (trashbindir.empty())                 // Overwritten files are saved for undoing. Use one trash subdir for them all
+          { wxFileName trashdir;
+            if (!DirectoryForDeletions::GetUptothemomentDirname(trashdir, delcan))
+              { wxMessageBox(_("For some reason, trying to create a dir to temporarily-save the overwritten file failed.  Sorry!")); return 0; }
+            trashbindir = StrWithSep(trashdir.GetFullPath());
+          }
+          // Keep the path below the paste's dest dir, as a merge may overwrite several files with the same name
+        wxString trash = trashbindir + item.dest.Mid(m_destdirs.Item(item.owner).Len());
+        wxFileName trashparent(trash);
+        if (!trashparent.DirExists() && !trashparent.Mkdir(0777, wxPATH_MKDIR_FULL))
+          { failed.at(item.owner) = true; tsb->AddFailures(1); continue; }
+
+        tsb->GetCollector().AddOverwrite(item.origin, item.dest, trash);
+        UnRedoPaste* urp = new UnRedoPaste(item.origin, IDs, item.dest, name, false, false, tsb);
+        urp->SetOverwrittenFile(trash);
+        tsb->StoreUnRedoPaste(urp, item.origin);
+      }
+  }
+
+size_t successes = 0;
+for (size_t n=0; n < failed.size(); ++n)
+  if (!failed.at(n)) ++successes;
+return successes;
+}
+
+void* DedupCompareThread::Entry()
+{
+for (size_t n=0; n < m_indices.size(); ++n)
+  m_planner->CompareItem(m_indices.at(n));
+return NULL;
+}
 
 //-----------------------------------------------------------------------------------------------------------------------
 
@@ -450,7 +1024,7 @@ if (GetTreeCtrl()->GetSize().y >50)
 
 void DirGenericDirCtrl::CreateAcceleratorTable()
 {
-int AccelEntries[] = {  SHCUT_CUT, SHCUT_COPY, SHCUT_PASTE, SHCUT_PASTE_DIR_SKELETON, SHCUT_HARDLINK, SHCUT_SOFTLINK,
+int AccelEntries[] = {  SHCUT_CUT, SHCUT_COPY, SHCUT_PASTE, SHCUT_PASTE_DIR_SKELETON, SHCUT_PASTE_DEDUP, SHCUT_HARDLINK, SHCUT_SOFTLINK,
                         SHCUT_TRASH,SHCUT_DELETE, SHCUT_RENAME, SHCUT_NEW, SHCUT_UNDO, SHCUT_REDO, IDM_TOOLBAR_fulltree,
                         SHCUT_REFRESH, SHCUT_FILTER, SHCUT_TOGGLEHIDDEN, SHCUT_PROPERTIES,
                         SHCUT_REPLICATE, SHCUT_SWAPPANES,
@@ -820,7 +1394,7 @@ void DirGenericDirCtrl::ShowContextMenu(wxContextMenuEvent& event)
 if (((MyTreeCtrl*)GetTreeCtrl())->QueryIgnoreRtUp()) return;    // If we've been Rt-dragging & now stopped, we don't want a context menu
 
 wxMenu menu;
-int Firstsection[] = { SHCUT_CUT, SHCUT_COPY, SHCUT_PASTE, SHCUT_PASTE_DIR_SKELETON, SHCUT_SOFTLINK, SHCUT_HARDLINK, wxID_SEPARATOR, 
+int Firstsection[] = { SHCUT_CUT, SHCUT_COPY, SHCUT_PASTE, SHCUT_PASTE_DIR_SKELETON, SHCUT_PASTE_DEDUP, SHCUT_SOFTLINK, SHCUT_HARDLINK, wxID_SEPARATOR, 
                         SHCUT_TRASH, SHCUT_DELETE, wxID_SEPARATOR, SHCUT_REFRESH };
 for (size_t n=0; n < sizeof(Firstsection)/sizeof(int); ++n)
   MyFrame::mainframe->AccelList->AddToMenu(menu, Firstsection[n]);
@@ -1007,7 +1581,7 @@ for (size_t n=0; n < DnDfilecount; ++n)                           // For every e
       { tsb->AddOverallFailures(1); continue; }
 
                                           // If we're here, it worked
-    tsb->AddOverallSuccesses(1); tsb->SetMessageType(_("moved"));
+    tsb->AddOverallSuccesses(1); tsb->SetMessageType(tsbm_moved);
     wxString origFromFP(From.GetFullPath());
     if (FromFD.IsDir())
       From.RemoveDir(From.GetDirCount() - 1);           // If we just dragged a dir, readjust wxFileName to take into account the removal
@@ -1364,7 +1938,7 @@ for (size_t n=0; n < count; n++)                              // For every path
           }
       else MyFrame::mainframe->OnUpdateTrees(path, IDs);      // Otherwise the standard version
   }
-tsb->AddOverallSuccesses(successes); tsb->AddOverallFailures(count - successes); tsb->SetMessageType(fromCut ? _("cut") : _("deleted"));
+tsb->AddOverallSuccesses(successes); tsb->AddOverallFailures(count - successes); tsb->SetMessageType(fromCut ? tsbm_cut : tsbm_deleted);
 if (successes)
   tsb->StartThreads(); 
  else
@@ -1471,6 +2045,7 @@ if (IsArchive)
   }
 
 size_t successes=0, cantdel=0, cantdelsub=0, invalid=0;       // so that for multiple deletions, we can if necessary report on partial success
+wxArrayString todelete, updatepaths, newstartdirs;            // The deletion itself is done by a background job, which then refreshes these
 
 for (size_t n=0; n < count; n++)                              // For every path in the array
   { wxString original;
@@ -1492,10 +2067,9 @@ for (size_t n=0; n < count; n++)                              // For every path
      else  DestFilename = paths[n].AfterLast(wxFILE_SEP_PATH);// If it's a file, store the filename
        
     wxFileName fn(paths[n]);                                  // Turn filepath into the class that does clever things to the file system
-    
-    if (!ReallyDelete(&fn))  break;                           // Do the actual deletion
+    todelete.Add(paths[n]);
 
-    ++successes;            // If we're here, it worked.  Readjust wxFileName to take into account the deletion. 
+    ++successes;            // If we're here, it's deletable.  Readjust wxFileName to take into account the deletion
     if (ItsADir)                                              // If it's a dir,
       { original = fn.GetPath();                              // Save current path
         fn.RemoveDir(fn.GetDirCount() - 1);                   // then readjust wxFileName to take into account the deletion.
@@ -1509,14 +2083,16 @@ for (size_t n=0; n < count; n++)                              // For every path
     if (fileview==ISLEFT && GetPath()==stat.GetFilepath())    // If we've just deleted the selected dir
        SetPath(path); //   we need to SetPath to elsewhere, otherwise the fileview continues to show the contents of the deleted dir!
 
-    wxArrayInt IDs; IDs.Add(GetId());                         // Make an int array to store the ID of the origin pane
     if ((ItsADir && startdir==original) || (startdir==original.BeforeLast(wxFILE_SEP_PATH)))  // Make sure we're not deleting 'root'
       { while (path.Right(1) == wxFILE_SEP_PATH && path.Len() > 1) path.RemoveLast();    // Cope with "/foo///" and also "///"
-        MyFrame::mainframe->OnUpdateTrees(original, IDs, path);// If we are, use the alt version of updatetrees to replace startdir with its parent (path)
+        updatepaths.Add(original); newstartdirs.Add(path);    // If we are, the alt version of updatetrees will replace startdir with its parent (path)
       }
-     else MyFrame::mainframe->OnUpdateTrees(path, IDs);       // Otherwise the standard version
+     else { updatepaths.Add(path); newstartdirs.Add(wxEmptyString); } // Otherwise the standard version
   }
 
+if (!todelete.IsEmpty())                                      // rm -rf can take a long time over a big tree, so don't block the panes meanwhile
+  JobManager::Get().Submit(new ReallyDeleteJob(todelete, updatepaths, newstartdirs, GetId()), true);
+
 if (cantdel || cantdelsub || invalid)                         // Were there any failures above?  If so, do an apologetic dialog
   { wxString msg, msg2, msg3, msg4;
     if (count == 1)
@@ -1542,9 +2118,7 @@ if (cantdel || cantdelsub || invalid)                         // Were there any
   }
 
 if (!successes) { BriefLogStatus bls(_("Deletion failed")); return; }
-
-DoBriefLogStatus(count, wxEmptyString, _("irrevocably deleted"));
-}
+}                                                             // The job reports its own success, once it's finished
 
 //static
 bool MyGenericDirCtrl::ReallyDelete(wxFileName* PathName)  // Deletes files, dirs+contents.  Static as used by UnRedoManager too
@@ -1706,7 +2280,9 @@ if (!stat.IsDir())                    // Check first to see if From isn't a dir.
      else
       if (stat.IsRegularFile())                                                 // If it's a normal file, use built-in wxCopyFile from a thread
         { wxCHECK_MSG(tsb, MPR_fail, wxT("Trying to Paste() a file with an invalid tsb"));
-          tsb->AddToCollector(From->GetFullPath(), To->GetFullPath(), overwrittenfile);
+          PasteThreadSuperBlock* ptsb = dynamic_cast<PasteThreadSuperBlock*>(tsb);  // If it's a further hardlink to something already being pasted, it'll be linked later instead
+          if (!ptsb || !ptsb->DeferHardlink(stat, From->GetFullPath(), To->GetFullPath(), overwrittenfile))
+            tsb->AddToCollector(From->GetFullPath(), To->GetFullPath(), overwrittenfile);
           result = MPR_thread;
         }
      else
@@ -1777,7 +2353,9 @@ if (!dir_skeleton)
          else
            if (stat.IsRegularFile())                                            // If it's a normal file, use built-in wxCopyFile via a thread
             { wxCHECK_MSG(tsb, MPR_fail, wxT("Trying to Paste() a file with an invalid tsb"));
-              tsb->AddToCollector(From->GetFullPath() + file, To->GetFullPath() + file, overwrittenfile);
+              PasteThreadSuperBlock* ptsb = dynamic_cast<PasteThreadSuperBlock*>(tsb);  // A further hardlink to something already being pasted will be linked later instead
+              if (!ptsb || !ptsb->DeferHardlink(stat, From->GetFullPath() + file, To->GetFullPath() + file, overwrittenfile))
+                tsb->AddToCollector(From->GetFullPath() + file, To->GetFullPath() + file, overwrittenfile);
               AtLeastOneSuccess = true; mpresult = MPR_thread;
             }
          else
@@ -1888,10 +2466,10 @@ if (event.GetId() == SHCUT_PASTE_DIR_SKELETON)
 if (!MyGenericDirCtrl::filecount) return;
 
 UnRedoManager::ContinueSuperCluster();                  // Start a new cluster if from Copy, or continue the supercluster started by Cut
-OnPaste(false, destinationpath, paste_dir_skeleton);
+OnPaste(false, destinationpath, paste_dir_skeleton, event.GetId() == SHCUT_PASTE_DEDUP);
 }
 
-void MyGenericDirCtrl::OnPaste(bool FromDnD, const wxString& destinationpath/*=wxT("")*/, bool dir_skeleton/*=false*/)  // Ctrl-V or DnD
+void MyGenericDirCtrl::OnPaste(bool FromDnD, const wxString& destinationpath/*=wxT("")*/, bool dir_skeleton/*=false*/, bool dedup/*=false*/)  // Ctrl-V or DnD
 {
 enum DupRen WhattodoifClash = DR_Unknown, WhattodoifCantRead = DR_Unknown; // These get passed to CheckDupRen.  May become SkipAll, OverwriteAll etc, but start with Unknown
 size_t count;
@@ -1976,7 +2554,31 @@ if (!OriginFileFD.CanTHISUserPotentiallyCopy())         // Make sure we have exe
     
 PasteThreadSuperBlock* tsb = dynamic_cast<PasteThreadSuperBlock*>(ThreadsManager::Get().StartSuperblock(wxT("paste")));
 
-int successes = 0;
+int successes = 0; size_t planned = 0;
+if (dedup && !dir_skeleton) // Merge into whatever's already there, copying only what's missing or different. Anything that can't be merged is pasted the usual way, below
+  { DedupPastePlanner planner;
+    for (size_t c=count; c > 0; --c)
+      if (planner.AddItem(filearray[c-1], path))
+        filearray.RemoveAt(c-1);
+    planned = planner.GetCount(); count -= planned;
+    
+    if (planned)
+      { bool needed = planner.Compare();
+        if (needed && !planner.Confirm(this))
+          { ThreadsManager::Get().AbortThreadSuperblock(tsb);
+            if (UnRedoManager::ClusterIsOpen) UnRedoManager::EndCluster();
+            return;
+          }
+        if (!needed)                                    // Otherwise the user would see nothing happen, and wonder why
+          { wxMessageDialog dialog(this, wxString::Format(_("All %u items are already present at the destination, so nothing needed to be copied."), (unsigned int)planned),
+                                                              _("Paste, skipping identical files"), wxOK | wxICON_INFORMATION);
+            dialog.ShowModal();
+          }
+        successes = planner.Execute(tsb, IDs);
+        DestPath = path;
+      }
+  }
+
 for (size_t c=0; c < count; c++)                        // For every path in the clipboard to be pasted
   { wxString DestFilename;
     bool ItsADir;
@@ -2017,7 +2619,7 @@ for (size_t c=0; c < count; c++)                        // For every path in the
       }
   }
 
-tsb->AddOverallSuccesses(successes); tsb->AddOverallFailures(count - successes); tsb->SetMessageType(_("pasted"));
+tsb->AddOverallSuccesses(successes); tsb->AddOverallFailures(count + planned - successes); tsb->SetMessageType(tsbm_pasted);
 if (successes)
   tsb->StartThreads(); 
  else
@@ -2068,26 +2670,15 @@ wxTreeItemId rootId = GetTreeCtrl()->GetRootItem();
 if (rootId.IsOk())
   { wxDirItemData& data = (wxDirItemData&)*(GetTreeCtrl()->GetItemData(rootId));
     data.m_path = fpath;
+    GetMyTreeCtrl()->IndexItem(rootId);
   }
 }
 
 wxTreeItemId MyGenericDirCtrl::FindIdForPath(const wxString& path) const
 {
-wxString pth = StripSep(path);
-wxTreeCtrl* tree = GetTreeCtrl();
-wxTreeItemId root = m_rootId;
-if (!root.IsOk()) return root; // because of a race condition?
+if (!m_rootId.IsOk()) return m_rootId; // because of a race condition?
 
-wxTreeItemId item = root;                             // Since we don't know where to look in the tree, start from root
-wxDirItemData* data = (wxDirItemData*)tree->GetItemData(item);
-while (data && StripSep(data->m_path) != pth)
-  { item = tree->GetNext(item);                       // Get the next leaf in the tree
-    if (!item.IsOk()) return item;                    // If item is corrupt, return as invalid
-    if (item==root) return wxTreeItemId();            // If we've traversed the whole tree without success, signal by returning invalid
-    data = (wxDirItemData*)tree->GetItemData(item);   // OK, try this leaf
-  }
-
-return item;                                          // If we're here, must have matched  
+return GetMyTreeCtrl()->FindItemForPath(path);       // The treectrl indexes each item by path as it's added, so there's no need to walk the tree
 }
 
 #if defined(__LINUX__) && defined(__WXGTK__)
@@ -2183,6 +2774,9 @@ if (type == IET_rename)
             // For a dirview reordering is easier
 
             DoUpdateTreeRename(id, oldfilepath, newfilepath);
+#ifdef __WXDEBUG__
+            GetMyTreeCtrl()->CheckPathIndex();
+#endif
 
             if (!sortdir.empty())
               { wxTreeItemId sortId = FindIdForPath(sortdir);
@@ -2292,6 +2886,9 @@ if (type == IET_delete)
           wxDirItemData* data = (wxDirItemData*)tree->GetItemData(id);
           bool WasDir = data && data->m_isDir;
           tree->Delete(id);
+#ifdef __WXDEBUG__
+          GetMyTreeCtrl()->CheckPathIndex();
+#endif
           // There are some situations where we need explicitly to remove the watch, as there's no collapse/expand/SetPath
           // and otherwise we risk an "Already watched" assert if the path is recreated e.g. by an undo. Anyway, it's not expensive if the watch doesn't exist
           //wxLogDebug(wxT("IET_delete: *** About to call RemoveWatchLineage %s"), oldfilepath.c_str()); 
@@ -2352,6 +2949,7 @@ if (!data) return;
 wxCHECK_RET((StripSep(data->m_path) == StripSep(oldfilepath)) || (data->m_path.StartsWith(StrWithSep(oldfilepath))), wxT("Trying to update a treeitem unnecessarily"));
 
 data->m_path.replace(0, oldfilepath.Len(), newfilepath);
+GetMyTreeCtrl()->IndexItem(id);
 if (oldfilepath != startdir)
   tree->SetItemText(id, data->m_path.AfterLast(wxFILE_SEP_PATH));
  else                                                                   // Generally we use the filename as label, but not for startdir
@@ -2434,20 +3032,21 @@ wxString fp = StripSep(fpath);
 if (fp == StripSep(startdir))
   return true;  // We can reasonably assume that startdir is visible
 
-wxArrayString dirs;
-if (fulltree)
-  GetVisibleDirs(GetTreeCtrl()->GetRootItem(), dirs);
- else
-  { wxTreeItemId id = FindIdForPath(startdir);
-    if (!id.IsOk()) return false;
-    GetVisibleDirs(id, dirs);
-  }
+  // Rather than listing every visible dir and searching that, find fp's own item and check that each of its ancestors is expanded.
+  // That's what GetVisibleDirs() would have found, but it costs only the depth of fp below the base item
+wxTreeItemId base = fulltree ? GetTreeCtrl()->GetRootItem() : FindIdForPath(startdir);
+if (!base.IsOk()) return false;
 
-for (size_t n=0; n < dirs.GetCount(); ++n)
-  if (fp == StripSep(dirs[n]))
-    return true;
+wxTreeItemId id = FindIdForPath(fp);
+if (!id.IsOk() || id == base) return false;   // Not in the tree at all, or it's the base itself, which GetVisibleDirs() doesn't count
 
-return false;
+while (true)
+  { wxTreeItemId parent = GetTreeCtrl()->GetItemParent(id);
+    if (!parent.IsOk()) return false;         // We've gone past the root without finding base, so fp isn't below it
+    if (parent == base) return true;
+    if (!GetTreeCtrl()->IsExpanded(parent)) return false;
+    id = parent;
+  }
 }
 
 BEGIN_EVENT_TABLE(DirGenericDirCtrl,MyGenericDirCtrl)
@@ -2613,6 +3212,9 @@ try
     int changetype = event.GetChangeType();
     wxString filepath = StripSep(event.GetPath().GetFullPath());  // First check that we need to notice this event
     wxString origfilepath(filepath); // Cache it in case we truncate it
+    DirSizeService::Get().Invalidate(origfilepath); // Any cached recursive sizes of it, or of its parents, are now suspect
+    if (changetype == wxFSW_EVENT_RENAME)
+      DirSizeService::Get().Invalidate(StripSep(event.GetNewPath().GetFullPath()));
     if (m_owner->fileview == ISRIGHT)
       { if (!filepath.StartsWith(m_owner->startdir)         // e.g. startdir is /foo,  filepath /foo/bar/baz
               && !m_owner->startdir.StartsWith(filepath))   // or startdir is /foo/bar/baz/, filepath /foo/
@@ -2733,6 +3335,18 @@ bool isleft = !isright; // readability
 wxString newfilepath = event->GetNewPath().GetFullPath();  // For renames
 try 
   {
+    if (isright && wxStaticCast(m_owner, FileGenericDirCtrl)->IsFlatView()) // A flat view shows the whole subtree, so the usual per-dir updates don't fit
+      { FileGenericDirCtrl* flatview = wxStaticCast(m_owner, FileGenericDirCtrl);
+        switch(event->GetChangeType())
+          { case wxFSW_EVENT_CREATE:  flatview->UpdateFlatView(IET_create, event->GetPath().GetFullPath(), wxT("")); return;
+            case wxFSW_EVENT_RENAME:  flatview->UpdateFlatView(IET_rename, filepath, newfilepath); return;
+            case wxFSW_EVENT_DELETE:  if (StripSep(filepath) != StripSep(m_owner->startdir))
+                                        flatview->UpdateFlatView(IET_delete, filepath, filepath);
+                                      return;
+            default: break;                                  // Modify and attrib events are dealt with in the normal way
+          }
+      }
+
     switch(event->GetChangeType())
       { case wxFSW_EVENT_CREATE:
             { wxString realfilepath = event->GetPath().GetFullPath(); // For Creates, we indexed by path, not filepath, so greatly reducing duplicate updates
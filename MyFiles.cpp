@@ -98,6 +98,8 @@ delete[] idarray;
 //---------------------------------------------------------------------------------------------------------------------------
 static int wxCMPFUNC_CONV SortULLCompareFunction(DataBase**, DataBase**);
 static int wxCMPFUNC_CONV SortULLReverseCompareFunction(DataBase**, DataBase**);
+static void SetSortKey(DataBase& item, enum columntype col, bool decimalsort);
+typedef int (wxCMPFUNC_CONV *SortCompareFunc)(DataBase**, DataBase**);
 
 static int wxCMPFUNC_CONV FilenameCompareFunctionLC_COLLATE(DataBase **first, DataBase **second)  // LC_COLLATE aware
 {
@@ -271,9 +273,12 @@ const int HEADER_HEIGHT = 12;              // // The ht of the header column.  O
 
 FileGenericDirCtrl::FileGenericDirCtrl(wxWindow* parent, const wxWindowID id, const wxString& START_DIR , const wxPoint& pos, const wxSize& size,
                                                                                                  long style, bool full_tree, const wxString& name)
-    : MyGenericDirCtrl(parent, (MyGenericDirCtrl*)this, id, START_DIR ,  pos,  size ,  style , wxEmptyString, 0, name, ISRIGHT, full_tree), reverseorder(false), m_decimalsort(false)
+    : MyGenericDirCtrl(parent, (MyGenericDirCtrl*)this, id, START_DIR ,  pos,  size ,  style , wxEmptyString, 0, name, ISRIGHT, full_tree), reverseorder(false), m_decimalsort(false), m_FlatView(false)
 {
-m_StatusbarInfoValid = false; SelectedCumSize = 0;
+m_StatusbarInfoValid = false; SelectedCumSize = 0; m_SizeIsPartial = false;
+
+m_ResortTimer.SetOwner(this);
+Connect(wxEVT_TIMER, wxTimerEventHandler(FileGenericDirCtrl::OnResortTimer), NULL, this);
 
 headerwindow = new TreeListHeaderWindow(this, NextID++, (MyTreeCtrl*)GetTreeCtrl());
 ((MyTreeCtrl*)GetTreeCtrl())->headerwindow = headerwindow;
@@ -287,7 +292,7 @@ Connect(SHCUT_EXT_FIRSTDOT, SHCUT_EXT_LASTDOT, wxEVT_COMMAND_MENU_SELECTED, wxCo
 void FileGenericDirCtrl::CreateAcceleratorTable()
 {
 int AccelEntries[] = 
-        { SHCUT_CUT, SHCUT_COPY, SHCUT_PASTE, SHCUT_HARDLINK, SHCUT_SOFTLINK, SHCUT_TRASH,
+        { SHCUT_CUT, SHCUT_COPY, SHCUT_PASTE, SHCUT_PASTE_DEDUP, SHCUT_HARDLINK, SHCUT_SOFTLINK, SHCUT_TRASH,
           SHCUT_DELETE, SHCUT_OPEN, SHCUT_OPENWITH, SHCUT_RENAME, SHCUT_NEW, SHCUT_UNDO, SHCUT_REDO,
           SHCUT_REFRESH, SHCUT_FILTER, SHCUT_TOGGLEHIDDEN, SHCUT_PROPERTIES,
           SHCUT_REPLICATE, SHCUT_SWAPPANES,
@@ -297,7 +302,7 @@ int AccelEntries[] =
           SHCUT_SWITCH_FOCUS_COMMANDLINE, SHCUT_SWITCH_FOCUS_TOOLBARTEXT, SHCUT_SWITCH_TO_PREVIOUS_WINDOW,
           SHCUT_PREVIOUS_TAB,SHCUT_NEXT_TAB,
           SHCUT_EXT_FIRSTDOT, SHCUT_EXT_MIDDOT, SHCUT_EXT_LASTDOT,
-          SHCUT_DECIMALAWARE_SORT, SHCUT_NAVIGATE_DIR_UP, SHCUT_NAVIGATE_DIR_PREVIOUS, SHCUT_NAVIGATE_DIR_NEXT
+          SHCUT_DECIMALAWARE_SORT, SHCUT_NAVIGATE_DIR_UP, SHCUT_NAVIGATE_DIR_PREVIOUS, SHCUT_NAVIGATE_DIR_NEXT, SHCUT_FLAT_VIEW
         };
 const size_t shortcutNo = sizeof(AccelEntries)/sizeof(int);
 MyFrame::mainframe->AccelList->CreateAcceleratorTable(this, AccelEntries,  shortcutNo);
@@ -481,6 +486,11 @@ if (GetIsDecimalSort())
  else
   MyFrame::mainframe->AccelList->AddToMenu(menu, SHCUT_DECIMALAWARE_SORT, _("&Sort filenames ending in digits in Decimal order"));
 
+if (IsFlatView())
+  MyFrame::mainframe->AccelList->AddToMenu(menu, SHCUT_FLAT_VIEW, _("Show only this &directory's contents"));
+ else
+  MyFrame::mainframe->AccelList->AddToMenu(menu, SHCUT_FLAT_VIEW, _("List every file in this &subtree"));
+
 menu.AppendSeparator();
 
 wxMenu* colmenu = new wxMenu;
@@ -600,6 +610,9 @@ MyFrame::mainframe->OnArchiveTest(event);
 
 void MyGenericDirCtrl::OnDup(wxCommandEvent& WXUNUSED(event))
 {
+if (ThreadsManager::Get().PasteIsActive())  // We shouldn't try to do 2 pastes at a time, and duplicating involves one
+ { BriefMessageBox(_("Please try again in a moment"), 2,_("I'm busy right now")); return; }
+
 wxArrayString paths; size_t count = GetMultiplePaths(paths);
 if (!count) return;
 if (count > 1) DoMultipleRename(paths, true);
@@ -619,6 +632,7 @@ void MyGenericDirCtrl::DoRename(bool duplicate, const wxString& pathtodup /*=wxT
 wxString path, origname, newname, oldname, displayname;
 int ItsADir, flag = 0;
 bool renamingstartdir = false;
+PasteThreadSuperBlock* tsb = NULL;
 
 if (pathtodup.IsEmpty())
   origname = GetPath();                                           // Get name of selected item
@@ -682,7 +696,13 @@ do              // Do the rest in a loop, to give a 2nd chance if there's a name
     if (ItsADir)
       { oldname += wxFILE_SEP_PATH; newname += wxFILE_SEP_PATH; } // Make sure they're recognised as dirs 
     
-    if (!WithinArc)    flag = Rename(path, oldname, newname, ItsADir, duplicate);  // Do the actual rename/dup in a submethod
+    if (!WithinArc)
+      { if (duplicate)                  // A dup is done by the paste threads, so it needs a superblock. Make a new one for each attempt
+          tsb = dynamic_cast<PasteThreadSuperBlock*>(ThreadsManager::Get().StartSuperblock(wxT("paste")));
+        flag = Rename(path, oldname, newname, ItsADir, duplicate, tsb);  // Do the actual rename/dup in a submethod
+        if (tsb && flag != 1)           // 1 flags a successful dup. Otherwise the superblock won't be used
+          { ThreadsManager::Get().AbortThreadSuperblock(tsb); tsb = NULL; }
+      }
      else                              // Things are very different within an archive
        { wxArrayString filepaths, newpaths;   // Make arrays so as to cope with renaming a dir: all its descendants need to be listed too
         filepaths.Add(path+oldname); newpaths.Add(path+newname); 
@@ -716,31 +736,32 @@ if (origname == startdir)                                         // If we've ju
   }
  else MyFrame::mainframe->OnUpdateTrees(path, IDs);
  
-bool ClusterWasNeeded = UnRedoManager::StartClusterIfNeeded();
-if (duplicate)
+if (duplicate)                    // The superblock adds the UnRedoDup, and reports success, once its threads have completed
   { UnRedoDup* UnRedoptr = new UnRedoDup(path, path, oldname, newname, ItsADir, IDs);  
-    UnRedoManager::AddEntry(UnRedoptr);
-    DoBriefLogStatus(1, wxEmptyString, _("duplicated")); 
+    tsb->StoreUnRedoPaste(UnRedoptr, path + oldname);
+    tsb->AddOverallSuccesses(1); tsb->SetMessageType(tsbm_duplicated);
+    tsb->StartThreads();
+    return;
   }
- else
-  { UnRedoRen* UnRedoptr;
-    if (ItsADir)                        // To get the UnRedoRen right, if it's a dir, we have to merge path & names
-      { newname = path + newname; 
-        if (renamingstartdir)
-          UnRedoptr = new UnRedoRen(origname, newname, wxT(""), newname, ItsADir, IDs); // If renaming startdir, use 4th string as notification
-         else
-          UnRedoptr = new UnRedoRen(origname, newname, wxT(""), wxT(""), ItsADir, IDs); // Otherwise make a new UnRedoRen the standard way
-    
-        wxString filepath = newname;      // While we're in a ItsADir area, we need to select the new dir, else nothing is selected & the fileview is empty
-        while (filepath.Right(1) == wxFILE_SEP_PATH && filepath.Len() > 1)  filepath.RemoveLast();  // We don't want a terminal '/' in FindIdForPath
-        wxTreeItemId item = FindIdForPath(filepath);              // Find the new dir's id, & use this to select it
-        if (item.IsOk())   GetTreeCtrl()->SelectItem(item);
-      }
-      else UnRedoptr = new UnRedoRen(path, path, oldname, newname, ItsADir, IDs);
 
-    DoBriefLogStatus(1, wxEmptyString, _("renamed"));
-    UnRedoManager::AddEntry(UnRedoptr);
+bool ClusterWasNeeded = UnRedoManager::StartClusterIfNeeded();
+UnRedoRen* UnRedoptr;
+if (ItsADir)                            // To get the UnRedoRen right, if it's a dir, we have to merge path & names
+  { newname = path + newname; 
+    if (renamingstartdir)
+      UnRedoptr = new UnRedoRen(origname, newname, wxT(""), newname, ItsADir, IDs); // If renaming startdir, use 4th string as notification
+     else
+      UnRedoptr = new UnRedoRen(origname, newname, wxT(""), wxT(""), ItsADir, IDs); // Otherwise make a new UnRedoRen the standard way
+
+    wxString filepath = newname;        // While we're in a ItsADir area, we need to select the new dir, else nothing is selected & the fileview is empty
+    while (filepath.Right(1) == wxFILE_SEP_PATH && filepath.Len() > 1)  filepath.RemoveLast();  // We don't want a terminal '/' in FindIdForPath
+    wxTreeItemId item = FindIdForPath(filepath);                  // Find the new dir's id, & use this to select it
+    if (item.IsOk())   GetTreeCtrl()->SelectItem(item);
   }
+  else UnRedoptr = new UnRedoRen(path, path, oldname, newname, ItsADir, IDs);
+
+DoBriefLogStatus(1, wxEmptyString, _("renamed"));
+UnRedoManager::AddEntry(UnRedoptr);
 if (ClusterWasNeeded) UnRedoManager::EndCluster();
 }
 
@@ -794,11 +815,50 @@ if (WithinArc)                                                    // If in archi
     return; 
   } 
 
-int successes = 0;
-bool ClusterWasNeeded = UnRedoManager::StartClusterIfNeeded();
-for (size_t n = NewFilepaths.GetCount(); n > 0 ; --n) // Loop backwards, in case we're renaming both a dir & its children: the dir should be before children in the array
-  { bool renamingstartdir = false;
-    wxString origfilepath = OriginalFilepaths[n-1], newfilepath = NewFilepaths[n-1];
+if (!duplicate)                   // Renames are done as one batch: all or nothing, and coping with permutations e.g. a->b, b->a
+  { for (size_t n=0; n < NewFilepaths.GetCount(); ++n)
+      { wxString newname = StripSep(NewFilepaths[n]).AfterLast(wxFILE_SEP_PATH);
+        if (newname.IsEmpty() || (newname == wxT(".")) || (newname == wxT("..")))
+          { wxMessageDialog dialog(this, _("Sorry, this name is Illegal"), _("Oops!"), wxOK | wxICON_ERROR); dialog.ShowModal(); return; }
+      }
+
+    wxString failure;
+    if (!CheckDupRen::RenameBatch(OriginalFilepaths, NewFilepaths, failure))
+      { wxMessageDialog dialog(this, failure + _("\nNothing has been renamed"), _("Oops!"), wxOK | wxICON_ERROR); dialog.ShowModal(); return; }
+
+    wxArrayInt IDs; IDs.Add(GetId());
+    int startdirindex = -1; wxArrayString dirs, actual;
+    CheckDupRen::BatchedPaths(OriginalFilepaths, NewFilepaths, actual); // If a dir and its child were both renamed, the child is now inside the dir's new name
+    for (size_t n=0; n < NewFilepaths.GetCount(); ++n)
+      { wxString origfilepath = StripSep(OriginalFilepaths[n]), newfilepath = actual[n];
+        if (origfilepath == GetCwd())           // If we've just renamed the cwd, change the cwd.  Otherwise Ctrl-T will fail
+          SetWorkingDirectory(newfilepath);
+
+        if (origfilepath == StripSep(startdir)) // If we've just renamed startdir, need to do things differently
+          { MyFrame::mainframe->OnUpdateTrees(origfilepath, IDs, newfilepath);  // Newstartdir will be substituted for the old one
+            startdirindex = (int)n; continue;
+          }
+        wxString dir = newfilepath.BeforeLast(wxFILE_SEP_PATH); // Otherwise update each dir just once, not once per item
+        if (dirs.Index(dir) == wxNOT_FOUND)
+          { dirs.Add(dir); MyFrame::mainframe->OnUpdateTrees(dir, IDs); }
+      }
+
+    bool ClusterWasNeeded = UnRedoManager::StartClusterIfNeeded();
+    UnRedoManager::AddEntry(new UnRedoMultipleRen(OriginalFilepaths, NewFilepaths, IDs, startdirindex)); // One entry, as undoing a permutation piecemeal would clash
+    if (ClusterWasNeeded) UnRedoManager::EndCluster();
+
+    if (fileview==ISLEFT)
+      { SetPath(startdir);                // We need to select the (possibly new) startdir, else nothing is selected & the fileview is empty
+        ReCreateTreeFromSelection();
+      }
+    DoBriefLogStatus(NewFilepaths.GetCount(), wxEmptyString, _("renamed"));
+    return;
+  }
+
+int successes = 0;               // Dups are done by the paste threads, so we need a superblock. It'll also look after the UnRedo cluster
+PasteThreadSuperBlock* tsb = dynamic_cast<PasteThreadSuperBlock*>(ThreadsManager::Get().StartSuperblock(wxT("paste")));
+for (size_t n = NewFilepaths.GetCount(); n > 0 ; --n) // Loop backwards, in case we're duplicating both a dir & its children: the dir should be before children in the array
+  { wxString origfilepath = OriginalFilepaths[n-1], newfilepath = NewFilepaths[n-1];
     if (newfilepath.Right(1) == wxFILE_SEP_PATH) newfilepath.RemoveLast();  // Make sure we can do AfterLast in a minute to get the filename: can't use FileData before the file exists
     FileData Oldfd(origfilepath); bool ItsADir = Oldfd.IsDir();  
     wxString oldname = Oldfd.GetFilename(), newname = newfilepath.AfterLast(wxFILE_SEP_PATH), path = Oldfd.GetPath();
@@ -806,37 +866,15 @@ for (size_t n = NewFilepaths.GetCount(); n > 0 ; --n) // Loop backwards, in case
     if (ItsADir)
       { oldname += wxFILE_SEP_PATH; newname += wxFILE_SEP_PATH; } // Make sure they'll be recognised as dirs 
 
-    Rename(path, oldname, newname, ItsADir, duplicate);           // Do the actual rename/dup in a submethod
+    int answer = Rename(path, oldname, newname, ItsADir, duplicate, tsb);  // Do the actual dup in a submethod
+    if (answer != 1) continue;                                    // A failed dup leaves nothing to undo
     ++successes;
 
-    if (ItsADir && !duplicate && origfilepath == GetCwd())        // If we've just renamed the cwd, change the cwd.  Otherwise Ctrl-T will fail
-            SetWorkingDirectory(newfilepath);
-
     wxArrayInt IDs; IDs.Add(GetId());                             // Update the panes
-    if (origfilepath == startdir)                                 // If we've just renamed startdir, need to do things differently
-      { wxString newstartdir = path + newname.BeforeLast(wxFILE_SEP_PATH);  // We know that newname ends in /, we just put it there!
-        MyFrame::mainframe->OnUpdateTrees(origfilepath, IDs, newstartdir);  // Newstartdir will be substituted for the old one
-        renamingstartdir = true;
-      }
-     else MyFrame::mainframe->OnUpdateTrees(path, IDs);
+    MyFrame::mainframe->OnUpdateTrees(path, IDs);
 
-    if (duplicate)
-      { UnRedoDup* UnRedoptr = new UnRedoDup(path, path, oldname, newname, ItsADir, IDs);  
-        UnRedoManager::AddEntry(UnRedoptr);
-      }
-     else
-      { UnRedoRen* UnRedoptr;
-        if (ItsADir)                      // To get the UnRedoRen right, if it's a dir, we have to merge path & names
-          { newname = path + newname;     // Reconstitute the full filepath. Could have used newfilepath, but this way we know there's a terminal /
-            if (renamingstartdir)
-              UnRedoptr = new UnRedoRen(origfilepath, newname, wxT(""), newname, ItsADir, IDs);      // If renaming startdir, use 4th string as notification
-             else
-              UnRedoptr = new UnRedoRen(origfilepath, newname, wxT(""), wxT(""), ItsADir, IDs); // Otherwise make a new UnRedoRen the standard way
-          }
-         else UnRedoptr = new UnRedoRen(path, path, oldname, newname, ItsADir, IDs);
-          
-        UnRedoManager::AddEntry(UnRedoptr);
-      }      
+    UnRedoDup* UnRedoptr = new UnRedoDup(path, path, oldname, newname, ItsADir, IDs);  // The superblock will add this when its threads have completed
+    tsb->StoreUnRedoPaste(UnRedoptr, path + oldname);
   }
 
 if (fileview==ISLEFT)
@@ -844,8 +882,11 @@ if (fileview==ISLEFT)
     ReCreateTreeFromSelection();
   }
 
-if (ClusterWasNeeded) UnRedoManager::EndCluster();
-DoBriefLogStatus(successes, wxEmptyString, duplicate ? _("duplicated") :_("renamed"));
+tsb->AddOverallSuccesses(successes); tsb->AddOverallFailures(NewFilepaths.GetCount() - successes); tsb->SetMessageType(tsbm_duplicated);
+if (successes)
+  tsb->StartThreads();                    // The superblock reports success when its threads have completed
+ else
+  ThreadsManager::Get().AbortThreadSuperblock(tsb);
 }
 
 int MyGenericDirCtrl::OnNewItem(wxString& newname, wxString& path, bool ItsADir)
@@ -885,7 +926,7 @@ if (!success)
 return true;
 }
 
-int MyGenericDirCtrl::Rename(wxString& path, wxString& origname, wxString& newname, bool ItsADir, bool dup /*=false*/)
+int MyGenericDirCtrl::Rename(wxString& path, wxString& origname, wxString& newname, bool ItsADir, bool dup /*=false*/, PasteThreadSuperBlock* tsb /*=NULL*/)
 {
 int answer;
 
@@ -922,10 +963,10 @@ if (!CheckIt.CheckForAccess(dup))  return false; // This checks for Read permiss
                     // OK, we can go ahead with the Rename or Dup, subcontracting as CheckDupRen is already set up to do so
 if (ItsADir)
   { wxString origpath = path + origname, newpath = path + newname;
-    answer = CheckDupRen::RenameDir(origpath, newpath, dup);
+    answer = CheckDupRen::RenameDir(origpath, newpath, dup, tsb);
   }
 else
-  answer = CheckDupRen::RenameFile(path, origname, newname, dup);
+  answer = CheckDupRen::RenameFile(path, origname, newname, dup, tsb);
 
 if (!answer)
   { wxMessageDialog dialog(this, _("Sorry, for some reason this operation failed\nTry again?"),  _("Oops!"), wxYES_NO |wxICON_ERROR);
@@ -1088,6 +1129,7 @@ if (count == 1)
         if (m_StatusbarInfoValid) 
           { text += wxString::Format(wxT("   %s"), ParseSize(SelectedCumSize, true).c_str());
             if (stat->IsDir()) text += wxString::Format(wxT("%s"), SHOW_RECURSIVE_FILEVIEW_SIZE ? _("  of files and subdirectories") : _(" of files"));
+            if (m_SizeIsPartial) text += _(" so far...");
           }
       }
      else
@@ -1137,7 +1179,9 @@ if (count == 1)
     if (failures < count)
       { 
         if (SHOW_RECURSIVE_FILEVIEW_SIZE && dirs)
-          text = wxString::Format(_("%s in %zu %s"), ParseSize(SelectedCumSize, true), count, _("files and directories"));
+          { text = wxString::Format(_("%s in %zu %s"), ParseSize(SelectedCumSize, true), count, _("files and directories"));
+            if (m_SizeIsPartial) text += _(" so far...");
+          }
          else
           { text = wxString::Format("%s", ParseSize(SelectedCumSize, true));
             wxString DirOrDirs = (dirs>1 ? _("directories"):_("directory"));
@@ -1155,6 +1199,16 @@ MyFrame::mainframe->SetStatusText(text, 2);
 delete stat;
 }
 
+void FileGenericDirCtrl::OnDirSizeProgress(wxULongLong total, bool finished)
+{
+SelectedCumSize = total;
+m_SizeIsPartial = !finished;
+
+wxArrayString selections;
+GetMultiplePaths(selections);
+UpdateStatusbarInfo(selections);
+}
+
 void FileGenericDirCtrl::UpdateFileDataArray(const wxString& filepath)
 {
 if (filepath.empty()) return;
@@ -1172,6 +1226,7 @@ for (size_t n=0; n < CombinedFileDataArray.Count(); ++n)
     wxCHECK_RET(item->IsFake == fd->IsFake, wxT("Trying to replace a DataBase with one of a different type"));
     if (item->IsValid() && item->GetFilepath() == fd->GetFilepath())
       { CumFilesize += fd->Size() - item->Size();               // Note any change in size
+        SetSortKey(*fd, GetSelectedColumn(), GetIsDecimalSort());// A later ResortEntry() relies on every entry holding its sort key
 
         CombinedFileDataArray.Insert(fd, n);
         CombinedFileDataArray.RemoveAt(n+1);
@@ -1281,110 +1336,85 @@ ReCreateTree();                                     // This makes the change vis
 }
 
 
-void FileGenericDirCtrl::SortStats(FileDataObjArray& array)  // Sorts the FileData array according to column selection
+static void SetSortKey(DataBase& item, enum columntype col, bool decimalsort)  // Fills item's sortstring/sortULL/sortint for the col being sorted on
 {
 static const wxString NUMBERS = wxT("0123456789");
-bool reverse = headerwindow->GetSortOrder();
-switch(headerwindow->GetSelectedColumn())                               // Since the col selection defines the sort method required
-  { case filename:    if (reverse)                                      // Here we're just sorting on the filepath, so use it direct, reverse or otherwise
-                        { if (GetIsDecimalSort())
-                           { for (size_t n = 0; n < array.GetCount(); ++n)     // For each array entry,
-                              { wxString filename = array[n].GetFilename().BeforeFirst(wxT('.'));
-                                size_t pos = filename.find_last_not_of(NUMBERS);
-                                if (pos != wxString::npos)
-                                  { array[n].sortstring = filename.Mid(0, pos+1);
-                                    wxULongLong_t ull((wxULongLong_t)-1);
-                                    filename.Mid(pos+1).ToULongLong(&ull);
-                                    array[n].sortULL = ull;
-                                  }
-                              }
-                             array.Sort((*FilenameULLReverseCompareFunc));
+switch(col)
+  { case filename:    if (decimalsort)                                  // Otherwise we're just sorting on the filepath, so nothing to store
+                        { wxString filename = item.GetFilename().BeforeFirst(wxT('.'));
+                          size_t pos = filename.find_last_not_of(NUMBERS);
+                          if (pos != wxString::npos)
+                            { item.sortstring = filename.Mid(0, pos+1);
+                              wxULongLong_t ull((wxULongLong_t)-1);
+                              filename.Mid(pos+1).ToULongLong(&ull);
+                              item.sortULL = ull;
                             }
-                          else
-                           array.Sort((*FilenameReverseCompareFunc));
                         }
-                       else 
-                        { if (GetIsDecimalSort())
-                           { for (size_t n = 0; n < array.GetCount(); ++n)     // For each array entry,
-                              { wxString filename = array[n].GetFilename().BeforeFirst(wxT('.'));
-                                size_t pos = filename.find_last_not_of(NUMBERS);
-                                if (pos != wxString::npos)
-                                  { array[n].sortstring = filename.Mid(0, pos+1);
-                                    wxULongLong_t ull((wxULongLong_t)-1);
-                                    filename.Mid(pos+1).ToULongLong(&ull);
-                                    array[n].sortULL = ull;
-                                  }
+                      break;
+
+    case ext:         { wxString ext = (item.GetFilename().Mid(1)).AfterFirst(wxT('.'));  // Note the Mid(1) to avoid hidden files being called ext.s!
+                        item.sortstring = ext;                          // If we define an 'ext' as 'after the first dot', that's it
+                        if (EXTENSION_START > 0)                        // but for others:
+                          { size_t pos = ext.rfind(wxT('.'));
+                            if (pos != wxString::npos)
+                              { item.sortstring = ext.Mid(pos+1);       // We've found a last dot. Store the remaining string
+                                if (EXTENSION_START == 1)               // and then, if so configured, look for a penultimate one
+                                    { pos = ext.rfind(wxT('.'), pos-1);
+                                      if (pos != wxString::npos)
+                                        item.sortstring = ext.Mid(pos+1);
+                                    }
                               }
-                            array.Sort(FilenameULLCompareFunc);
-                           }
-                          else 
-                            array.Sort((*FilenameCompareFunc));
-                        }
-                        break;
+                          }
+                      }
+                      break;
 
-                       
-    case ext:         for (size_t n = 0; n < array.GetCount(); ++n)
-                        { wxString ext = (array[n].GetFilename().Mid(1)).AfterFirst(wxT('.'));  // Note the Mid(1) to avoid hidden files being called ext.s!
-                          array[n].sortstring = ext;                    // If we define an 'ext' as 'after the first dot', that's it
-                          if (EXTENSION_START > 0)                      // but for others:
-                            { size_t pos = ext.rfind(wxT('.'));
-                              if (pos != wxString::npos)
-                                { array[n].sortstring = ext.Mid(pos+1); // We've found a last dot. Store the remaining string
-                                  if (EXTENSION_START == 1)             // and then, if so configured, look for a penultimate one
-                                      { pos = ext.rfind(wxT('.'), pos-1);
-                                        if (pos != wxString::npos)
-                                          array[n].sortstring = ext.Mid(pos+1);
-                                      }
-                                }
-                            }
-                        }
-                      if (reverse)
-                            array.Sort((*ReverseCompareFunc));
-                       else  array.Sort((*CompareFunc)); break;
-
-    case filesize:    for (size_t n = 0; n < array.GetCount(); ++n)     // For each array entry,
-                        array[n].sortULL = array[n].Size();             // We're sorting on the size, so put it in sortULL (wxULongLong)
-                      if (reverse)
-                            array.Sort(SortULLReverseCompareFunction);
-                       else  array.Sort(SortULLCompareFunction); break;
-  
-    case modtime:      for (size_t n = 0; n < array.GetCount(); ++n)    // For each array entry,
-                        array[n].sortint = array[n].ModificationTime(); // We're sorting on an 'int' variable, so put it in sortint
-                      if (reverse)
-                            array.Sort(SortintReverseCompareFunction);
-                       else  array.Sort(SortintCompareFunction); break;
-  
-    case permissions:    for (size_t n = 0; n < array.GetCount(); ++n)
-                        array[n].sortstring = array[n].PermissionsToText();
-                      if (reverse)
-                            array.Sort((*ReverseCompareFunc));
-                       else  array.Sort((*CompareFunction)); break;
-                       
-    case owner:       for (size_t n = 0; n < array.GetCount(); ++n)
-                        { array[n].sortstring = array[n].GetOwner(); 
-                          if (array[n].sortstring.IsEmpty())  array[n].sortstring = wxT("zzz");
-                        }
-                      if (reverse)
-                            array.Sort((*ReverseCompareFunc));
-                       else  array.Sort((*CompareFunction)); break;
-                      
-    case group:       for (size_t n = 0; n < array.GetCount(); ++n)
-                        { array[n].sortstring = array[n].GetGroup(); 
-                          if (array[n].sortstring.IsEmpty())  array[n].sortstring = wxT("zzz");
-                        }
-                      if (reverse)
-                            array.Sort((*ReverseCompareFunc));
-                       else  array.Sort((*CompareFunction)); break;
-                       
-    case linkage:     for (size_t n = 0; n < array.GetCount(); ++n)
-                        if (array[n].IsSymlink())
-                          array[n].sortstring = array[n].GetSymlinkDestination(); else array[n].sortstring = wxT("zzz");
-                      if (reverse)
-                            array.Sort((*ReverseCompareFunc));
-                       else  array.Sort((*CompareFunc));
+    case filesize:    item.sortULL = item.Size(); break;                // We're sorting on the size, so put it in sortULL (wxULongLong)
+
+    case modtime:     item.sortint = item.ModificationTime(); break;    // We're sorting on an 'int' variable, so put it in sortint
+
+    case permissions: item.sortstring = item.PermissionsToText(); break;
+
+    case owner:       item.sortstring = item.GetOwner();
+                      if (item.sortstring.IsEmpty())  item.sortstring = wxT("zzz");
+                      break;
+
+    case group:       item.sortstring = item.GetGroup();
+                      if (item.sortstring.IsEmpty())  item.sortstring = wxT("zzz");
+                      break;
+
+    case linkage:     if (item.IsSymlink())
+                        item.sortstring = item.GetSymlinkDestination(); else item.sortstring = wxT("zzz");
   }
 }
 
+static SortCompareFunc GetSortCompareFunc(enum columntype col, bool reverse, bool decimalsort)  // Which compare function suits col and the sort order
+{
+switch(col)
+  { case filename:    if (reverse)
+                        return decimalsort ? FilenameULLReverseCompareFunc : FilenameReverseCompareFunc;
+                      return decimalsort ? FilenameULLCompareFunc : FilenameCompareFunc;
+
+    case filesize:    return reverse ? SortULLReverseCompareFunction : SortULLCompareFunction;
+
+    case modtime:     return reverse ? SortintReverseCompareFunction : SortintCompareFunction;
+
+    case permissions:
+    case owner:
+    case group:       return reverse ? ReverseCompareFunc : CompareFunction;
+
+    default:          return reverse ? ReverseCompareFunc : CompareFunc;  // ext and linkage
+  }
+}
+
+void FileGenericDirCtrl::SortStats(FileDataObjArray& array)  // Sorts the FileData array according to column selection
+{
+enum columntype col = headerwindow->GetSelectedColumn();                // Since the col selection defines the sort method required
+for (size_t n = 0; n < array.GetCount(); ++n)                           // For each array entry, store the thing to sort on
+  SetSortKey(array[n], col, GetIsDecimalSort());
+
+array.Sort(GetSortCompareFunc(col, headerwindow->GetSortOrder(), GetIsDecimalSort()));
+}
+
 void FileGenericDirCtrl::SelectFirstItem()
 {
 wxTreeItemId rootId = GetTreeCtrl()->GetRootItem();
@@ -1400,10 +1430,11 @@ bool FileGenericDirCtrl::UpdateTreeFileModify(const wxString& filepath) // Calle
 wxCHECK_MSG(!filepath.empty(), true, wxT("Called UpdateTreeFileModify() with empty fpath"));
 
 if (GetSelectedColumn() != filesize) 
-  return false; // We only need to recreate the tree to sort by size. Otherwise let the caller do a simpler update
+  return false; // We only need to re-sort to sort by size. Otherwise let the caller do a simpler update
 
-if (StripSep(filepath).BeforeLast(wxFILE_SEP_PATH) == StripSep(startdir)) // We know it's a fileview, so no need to look at other situations
-    ReCreateTreeFromSelection();
+if ((StripSep(filepath).BeforeLast(wxFILE_SEP_PATH) == StripSep(startdir)) // We know it's a fileview, so no need to look at other situations
+      || (IsFlatView() && filepath.StartsWith(StrWithSep(startdir))))    // except that a flat view shows the whole subtree
+    QueueResort(filepath);
 
 return true;
 }
@@ -1414,14 +1445,368 @@ wxCHECK_MSG(!filepath.empty(), true, wxT("Called UpdateTreeFileAttrib() with emp
 
 int sorttype = GetSelectedColumn();
 if ((sorttype < modtime) || (sorttype > group)) 
-  return false; // We only need to recreate the tree to sort by datetime, permissions, owner & group. Otherwise let the caller do a simpler update
+  return false; // We only need to re-sort to sort by datetime, permissions, owner & group. Otherwise let the caller do a simpler update
 
-if (StripSep(filepath).BeforeLast(wxFILE_SEP_PATH) == StripSep(startdir)) // We know it's a fileview, so no need to look at other situations
-    ReCreateTreeFromSelection();
+if ((StripSep(filepath).BeforeLast(wxFILE_SEP_PATH) == StripSep(startdir)) // We know it's a fileview, so no need to look at other situations
+      || (IsFlatView() && filepath.StartsWith(StrWithSep(startdir))))    // except that a flat view shows the whole subtree
+    QueueResort(filepath);
 
 return true;
 }
 
+const int FILEVIEW_RESORT_DELAY = 250;             // ms to collect modify/attrib events before re-sorting, so a log being appended to doesn't re-sort continuously
+const size_t MAX_INCREMENTAL_RESORTS = 50;         // If more entries than this changed, it's cheaper just to rebuild the tree
+
+void FileGenericDirCtrl::QueueResort(const wxString& filepath)
+{
+if (m_PendingResorts.Index(filepath) == wxNOT_FOUND)
+  m_PendingResorts.Add(filepath);
+
+if (!m_ResortTimer.IsRunning())
+  m_ResortTimer.Start(FILEVIEW_RESORT_DELAY, wxTIMER_ONE_SHOT);
+}
+
+void FileGenericDirCtrl::OnResortTimer(wxTimerEvent& WXUNUSED(event))
+{
+wxArrayString filepaths(m_PendingResorts);
+m_PendingResorts.Clear();
+
+if (filepaths.GetCount() > MAX_INCREMENTAL_RESORTS)
+  { ReCreateTreeFromSelection(); return; }
+
+for (size_t n=0; n < filepaths.GetCount(); ++n)
+  ResortEntry(filepaths[n]);
+
+GetTreeCtrl()->Refresh();
+}
+
+void FileGenericDirCtrl::ResortEntry(const wxString& filepath)  // Re-stat filepath and move it to its sorted position, without rebuilding the tree
+{
+wxTreeCtrl* tree = GetTreeCtrl();
+wxTreeItemId rootId = tree->GetRootItem();
+if (!rootId.IsOk()) return;
+wxTreeItemId id = GetMyTreeCtrl()->FindItemForPath(filepath);  // The path index finds its treeitem without comparing every row's filepath
+if (!id.IsOk() || (tree->GetItemParent(id) != rootId)) return;  // It's not displayed e.g. it's been filtered out or deleted meanwhile
+
+size_t count = CombinedFileDataArray.GetCount();
+int row = GetMyTreeCtrl()->GetChildIndex(id);                   // Row n of the tree displays CombinedFileDataArray[n]
+size_t n = (size_t)row;
+wxDirItemData* data = (wxDirItemData*)tree->GetItemData(id);
+if (!data || (row == wxNOT_FOUND) || (n >= count) || (StripSep(CombinedFileDataArray[n].GetFilepath()) != StripSep(filepath)))
+  { ReCreateTreeFromSelection(); return; }                      // The tree and the array are out of step, so don't try to be clever
+if (CombinedFileDataArray[n].IsFake) return;
+
+FileData* fd = new FileData(filepath);
+bool WasDir = (n < NoOfDirs);
+bool IsDir = fd->IsDir() || (TREAT_SYMLINKTODIR_AS_DIR && fd->IsSymlinktargetADir());
+if (!fd->IsValid() || (IsDir != WasDir))                         // If a file has become a dir or vice versa, it changes section too
+  { delete fd; ReCreateTreeFromSelection(); return; }
+
+enum columntype col = GetSelectedColumn();
+SetSortKey(*fd, col, GetIsDecimalSort());
+SortCompareFunc compare = GetSortCompareFunc(col, headerwindow->GetSortOrder(), GetIsDecimalSort());
+
+if (!WasDir) CumFilesize += fd->Size() - CombinedFileDataArray[n].Size();
+CombinedFileDataArray.RemoveAt(n);
+
+size_t lo = WasDir ? 0 : NoOfDirs, hi = WasDir ? NoOfDirs-1 : count-1;  // Dirs and files are sorted separately, dirs first
+DataBase* newitem = fd;
+while (lo < hi)                                                 // Binary-search for the first entry that sorts after fd
+  { size_t mid = lo + (hi - lo) / 2;
+    DataBase* item = &CombinedFileDataArray[mid];
+    if (compare(&newitem, &item) < 0) hi = mid;
+     else lo = mid + 1;
+  }
+CombinedFileDataArray.Insert(fd, lo);
+if (lo == n) return;                                            // It's still in the right place, so the treeitem can stay put
+
+  // Move the treeitem too, keeping its label, icons and data. Preserve its selected/focused state, and don't let the tree scroll
+bool WasSelected = tree->IsSelected(id);
+#if wxVERSION_NUMBER >= 2900
+  wxTreeItemId focusId = tree->GetFocusedItem();
+  bool WasFocused = (focusId == id);
+#endif
+int xstart, ystart; tree->GetViewStart(&xstart, &ystart);
+
+wxString text = tree->GetItemText(id);
+int image = tree->GetItemImage(id), expandedimage = tree->GetItemImage(id, wxTreeItemIcon_Expanded);
+tree->SetItemData(id, NULL);                                    // Otherwise Delete() would delete the data too
+tree->Delete(id);
+
+wxTreeItemId newId = tree->InsertItem(rootId, lo, text, image, -1, data);
+if (expandedimage != -1) tree->SetItemImage(newId, expandedimage, wxTreeItemIcon_Expanded);
+
+if (WasSelected) tree->SelectItem(newId);
+#if wxVERSION_NUMBER >= 2900
+  if (WasFocused) tree->SetFocusedItem(newId);
+   else if (focusId.IsOk()) tree->SetFocusedItem(focusId);    // SelectItem() will have moved the focus
+#endif
+tree->Scroll(xstart, ystart);
+}
+
+static int RegularFileIcon(ziptype zt, bool IsArchv)
+{
+if (zt != zt_invalid)                                           // There are special icons for archives etc
+  return Archive::GetIconForArchiveType(zt, IsArchv);
+return IsArchv? GDC_ghostfile : GDC_file;                       // otherwise use the standard icon
+}
+
+wxTreeItemId FileGenericDirCtrl::AddFileItem(wxTreeItemId parentId, DataBase& stat, const wxString& path, const wxString& label, bool IsArchv, int pos /*= -1*/)
+{
+int image;
+if (stat.IsRegularFile())                                       // If the item is a file
+  { ziptype zt =  Archive::Categorise(path);
+    SniffedType sniffed;
+    if (!IsArchv && !stat.IsFake && FileClassifier::Get().Lookup(*((FileData&)stat).GetStatstruct(), sniffed))
+      zt = FileClassifier::ArchiveType(path, sniffed);          // Its content has already been sniffed, which beats guessing from its name. Lookup() doesn't touch the file
+    image = RegularFileIcon(zt, IsArchv);
+  }
+ else if (stat.IsSymlink())                                     // If the item is a symlink
+  { if (stat.IsSymlinktargetADir())                             //  If it's pointing to a dir, use the appropriate icon
+      image = GDC_symlinktofolder;
+     else image = stat.IsBrokenSymlink() ? GDC_brokensymlink : GDC_symlink; // If it's pointing to a file, use that icon
+  }
+ else if (stat.IsFIFO())    image = GDC_pipe;
+ else if (stat.IsBlkDev())  image = GDC_blockdevice;
+ else if (stat.IsCharDev()) image = GDC_chardevice;
+ else if (stat.IsSocket())  image = GDC_socket;
+ else image = GDC_unknownfile;                                  // wtf is this?
+
+wxDirItemData* dir_item = new wxDirItemData(path, label, false);
+if (pos < 0)
+  return GetTreeCtrl()->AppendItem(parentId, label, image, -1, dir_item);
+return GetTreeCtrl()->InsertItem(parentId, (size_t)pos, label, image, -1, dir_item);
+}
+
+void FileGenericDirCtrl::RefreshFileIcon(const wxString& filepath, const SniffedType& type)
+{
+wxTreeItemId id = FindIdForPath(filepath);
+if (!id.IsOk()) return;
+
+FileData fd(filepath);
+if (!fd.IsValid() || !fd.IsRegularFile()) return;               // It's changed since it was sniffed. A fsw event will deal with it
+
+GetTreeCtrl()->SetItemImage(id, RegularFileIcon(FileClassifier::ArchiveType(filepath, type), false));
+}
+
+void FileGenericDirCtrl::OnToggleFlatView(wxCommandEvent& WXUNUSED(event))
+{
+m_FlatView = !m_FlatView;
+if (!m_FlatView) { FlatWalkService::Get().Cancel(this); m_FlatPaths.clear(); }
+
+#if defined(__LINUX__) && defined(__WXGTK__)
+  if (USE_FSWATCHER && m_watcher && m_watcher->GetWatcher() && !m_FlatView)
+    m_watcher->GetWatcher()->RemoveAll();       // Lose the subdir watches. ReCreateTreeFromSelection() will rewatch startdir
+#endif
+
+ReCreateTreeFromSelection();
+}
+
+void FileGenericDirCtrl::StartFlatWalk(const wxString& dirname)
+{
+m_FlatDirs.Clear(); m_FlatPaths.clear();
+FlatWalkService::Get().Request(this, dirname, GetShowHidden(), GetFilterArray());
+}
+
+wxString FileGenericDirCtrl::FlatLabel(const wxString& filepath) const
+{
+wxString prefix = StrWithSep(startdir);
+return filepath.StartsWith(prefix) ? filepath.Mid(prefix.Len()) : filepath;
+}
+
+void FileGenericDirCtrl::OnFlatWalkResults(std::vector<DataBase*>& entries, const wxArrayString& dirs, bool finished, bool incremental)
+{
+wxTreeItemId rootId = GetTreeCtrl()->GetRootItem();
+if (!m_FlatView || !rootId.IsOk())
+  { for (size_t n=0; n < entries.size(); ++n) delete entries[n];
+    return;
+  }
+
+for (size_t n=0; n < entries.size(); ++n)
+  { DataBase* stat = entries[n];
+    if (!stat->IsValid()) { delete stat; continue; }          // It's vanished since it was found
+    if (incremental)
+      { InsertFlatEntry(stat); continue; }
+
+    if (!m_FlatPaths.insert(stat->GetFilepath()).second)      // Already listed
+      { delete stat; continue; }
+    CombinedFileDataArray.Add(stat);                          // Otherwise append while the walk continues; the whole lot is sorted at the end
+    CumFilesize += stat->Size(); ++NoOfFiles;
+    AddFileItem(rootId, *stat, stat->GetFilepath(), FlatLabel(stat->GetFilepath()), false);
+  }
+
+for (size_t n=0; n < dirs.GetCount(); ++n)
+  if (m_FlatDirs.Index(StripSep(dirs[n])) == wxNOT_FOUND) m_FlatDirs.Add(StripSep(dirs[n]));
+
+#if defined(__LINUX__) && defined(__WXGTK__)
+  if (USE_FSWATCHER && m_watcher && m_watcher->GetWatcher())
+    { wxLogNull NoLogWarningsAboutWrongPaths;                 // e.g. if inotify's watch limit is reached
+      for (size_t n=0; n < dirs.GetCount(); ++n)
+        if (StripSep(dirs[n]) != StripSep(startdir))          // That one's already watched
+          m_watcher->GetWatcher()->Add(StrWithSep(dirs[n]));
+    }
+#endif
+
+if (finished && !incremental)
+  SortFlatView();
+ else
+  GetTreeCtrl()->Refresh();
+
+if (this == MyFrame::mainframe->GetActivePane())
+  m_StatusbarInfoValid = false;                               // The file count and cumulative size have changed
+}
+
+void FileGenericDirCtrl::SortFlatView()
+{
+wxTreeCtrl* tree = GetTreeCtrl();
+wxTreeItemId rootId = tree->GetRootItem();
+if (!rootId.IsOk()) return;
+
+wxArrayString selections; GetMultiplePaths(selections);
+int xstart, ystart; tree->GetViewStart(&xstart, &ystart);
+
+SortStats(CombinedFileDataArray);
+
+tree->Freeze();
+tree->DeleteChildren(rootId);
+for (size_t n=0; n < CombinedFileDataArray.GetCount(); ++n)
+  { DataBase& stat = CombinedFileDataArray[n];
+    wxTreeItemId id = AddFileItem(rootId, stat, stat.GetFilepath(), FlatLabel(stat.GetFilepath()), false);
+    if (selections.GetCount() && (selections.Index(stat.GetFilepath()) != wxNOT_FOUND))
+      tree->SelectItem(id);
+  }
+tree->Thaw();
+tree->Scroll(xstart, ystart);
+}
+
+void FileGenericDirCtrl::InsertFlatEntry(DataBase* fd)
+{
+wxTreeItemId rootId = GetTreeCtrl()->GetRootItem();
+if (!rootId.IsOk()) { delete fd; return; }
+
+if (m_FlatPaths.count(fd->GetFilepath()))
+  { UpdateFileDataArray(fd); return; }                        // We already have it
+
+enum columntype col = GetSelectedColumn();
+SetSortKey(*fd, col, GetIsDecimalSort());
+SortCompareFunc compare = GetSortCompareFunc(col, headerwindow->GetSortOrder(), GetIsDecimalSort());
+
+size_t lo = 0, hi = CombinedFileDataArray.GetCount();         // A flat view has no dirs, so the whole array is one sorted section
+while (lo < hi)
+  { size_t mid = lo + (hi - lo) / 2;
+    DataBase* item = &CombinedFileDataArray[mid];
+    if (compare(&fd, &item) < 0) hi = mid;
+     else lo = mid + 1;
+  }
+
+CombinedFileDataArray.Insert(fd, lo);
+m_FlatPaths.insert(fd->GetFilepath());
+CumFilesize += fd->Size(); ++NoOfFiles;
+int xstart, ystart; GetTreeCtrl()->GetViewStart(&xstart, &ystart);
+AddFileItem(rootId, *fd, fd->GetFilepath(), FlatLabel(fd->GetFilepath()), false, (int)lo);
+GetTreeCtrl()->Scroll(xstart, ystart);
+}
+
+void FileGenericDirCtrl::RemoveFlatEntries(const wxString& filepath)
+{
+wxTreeCtrl* tree = GetTreeCtrl();
+wxTreeItemId rootId = tree->GetRootItem();
+if (!rootId.IsOk()) return;
+
+wxString fp = StripSep(filepath), dirprefix = StrWithSep(filepath);
+wxArrayTreeItemIds doomed;
+wxTreeItemIdValue cookie;
+wxTreeItemId id = tree->GetFirstChild(rootId, cookie);
+for (int n=0; (n < (int)CombinedFileDataArray.GetCount()) && id.IsOk(); ++n, id = tree->GetNextChild(rootId, cookie))
+  { wxString path = CombinedFileDataArray[n].GetFilepath();
+    if ((path == fp) || path.StartsWith(dirprefix))
+      doomed.Add(id);
+  }
+for (int n = (int)m_FlatDirs.GetCount() - 1; n >= 0; --n)   // If it was a dir, it and its subdirs will need walking again if they reappear
+  if ((m_FlatDirs[n] == fp) || m_FlatDirs[n].StartsWith(dirprefix))
+    m_FlatDirs.RemoveAt(n);
+if (doomed.IsEmpty()) return;
+
+for (int n = (int)CombinedFileDataArray.GetCount() - 1; n >= 0; --n) // Backwards, so the indices stay valid
+  { DataBase& item = CombinedFileDataArray[n];
+    wxString path = item.GetFilepath();
+    if ((path == fp) || path.StartsWith(dirprefix))
+      { CumFilesize -= item.Size(); if (NoOfFiles) --NoOfFiles;
+        m_FlatPaths.erase(path);
+        CombinedFileDataArray.RemoveAt(n);
+      }
+  }
+
+int xstart, ystart; tree->GetViewStart(&xstart, &ystart);
+for (size_t n=0; n < doomed.GetCount(); ++n)
+  tree->Delete(doomed[n]);
+tree->Scroll(xstart, ystart);
+}
+
+void FileGenericDirCtrl::RescanFlatDir(const wxString& dirname)
+{
+wxString prefix = StrWithSep(dirname);
+
+wxDir dir(dirname);
+if (!dir.IsOpened()) return;
+wxString name;
+bool more = dir.GetFirst(&name, wxEmptyString, wxDIR_FILES | wxDIR_DIRS | wxDIR_HIDDEN);
+for (; more; more = dir.GetNext(&name))
+  { if (m_FlatPaths.count(prefix + name)) continue;            // We already have it
+    FileData* fd = new FileData(prefix + name);
+    if (!fd->IsValid()) { delete fd; continue; }
+    if (fd->IsDir())                                          // A new dir, or one moved in. Walk it like the rest, but insert what's found as it arrives
+      { if ((GetShowHidden() || !name.StartsWith(wxT("."))) && (m_FlatDirs.Index(prefix + name) == wxNOT_FOUND))
+          { m_FlatDirs.Add(prefix + name);
+            FlatWalkService::Get().Request(this, prefix + name, GetShowHidden(), GetFilterArray(), true);
+          }
+        delete fd;
+      }
+     else if (FlatWalkService::IsWanted(name, GetShowHidden(), GetFilterArray()))
+      InsertFlatEntry(fd);
+     else delete fd;
+  }
+}
+
+void FileGenericDirCtrl::UpdateFlatView(InotifyEventType type, const wxString& filepath, const wxString& newfilepath)
+{
+wxString prefix = StrWithSep(startdir);
+switch(type)
+  { case IET_create:  { FileData fd(filepath);                // Creates are stored per parent dir, so look for anything else new there too
+                        wxString dirname = (fd.IsValid() && fd.IsDir()) ? StripSep(filepath).BeforeLast(wxFILE_SEP_PATH) : fd.GetPath();
+                        if (StrWithSep(dirname).StartsWith(prefix))
+                          RescanFlatDir(dirname);
+                        break;
+                      }
+    case IET_delete:  RemoveFlatEntries(filepath);
+#if defined(__LINUX__) && defined(__WXGTK__)
+                      if (m_watcher && (StripSep(filepath) != StripSep(startdir)))
+                        m_watcher->RemoveWatchLineage(filepath);
+#endif
+                      break;
+    case IET_rename:  if (filepath != newfilepath)            // A 'move-within-watch' from one dir to another, or a plain rename
+                        { RemoveFlatEntries(filepath);
+#if defined(__LINUX__) && defined(__WXGTK__)
+                          if (m_watcher) m_watcher->RemoveWatchLineage(filepath);
+#endif
+                          if (!newfilepath.StartsWith(prefix)) break; // It's left our subtree
+                          FileData fd(newfilepath);
+                          if (fd.IsValid()) RescanFlatDir(StripSep(newfilepath).BeforeLast(wxFILE_SEP_PATH));
+                        }
+                       else                                   // We only know about one end of the move, so ask the filesystem which
+                        { FileData fd(filepath);
+                          if (fd.IsValid()) RescanFlatDir(StripSep(filepath).BeforeLast(wxFILE_SEP_PATH));
+                           else RemoveFlatEntries(filepath);
+                        }
+                      break;
+    default:          break;
+  }
+
+GetTreeCtrl()->Refresh();
+if (this == MyFrame::mainframe->GetActivePane())
+  m_StatusbarInfoValid = false;
+}
+
 void MyGenericDirCtrl::OnFilter(wxCommandEvent& WXUNUSED(event))
 {
 wxDialog dlg;
@@ -1847,6 +2232,7 @@ BEGIN_EVENT_TABLE(FileGenericDirCtrl,MyGenericDirCtrl)
   
   EVT_MENU(SHCUT_TOGGLEHIDDEN, FileGenericDirCtrl::OnToggleHidden)
   EVT_MENU(SHCUT_DECIMALAWARE_SORT, FileGenericDirCtrl::OnToggleDecimalAwareSort)
+  EVT_MENU(SHCUT_FLAT_VIEW, FileGenericDirCtrl::OnToggleFlatView)
   EVT_MENU(SHCUT_OPENWITH, FileGenericDirCtrl::OnOpenWith)
   EVT_MENU(SHCUT_OPEN, FileGenericDirCtrl::OnOpen)
   EVT_MENU(SHCUT_OPENWITH_KDESU, FileGenericDirCtrl::OpenWithKdesu)
@@ -23,18 +23,21 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <vector>
 
 WX_DECLARE_OBJARRAY(class DataBase, FileDataObjArray);  // Declare the array of FileData objects (or the FakeFiledata alternative for archives), to hold the result of each file's wxStat
+WX_DECLARE_HASH_SET(wxString, wxStringHash, wxStringEqual, FlatPathSet);
 
 
 class TreeListHeaderWindow;
+struct SniffedType;
 
 class FileGenericDirCtrl  :  public MyGenericDirCtrl    // The class that displays & manipulates files
 {
 public:
 FileGenericDirCtrl(wxWindow* parent, const wxWindowID id, const wxString& START_DIR , const wxPoint& pos, const wxSize& size,
                          long style = wxSUNKEN_BORDER, bool full_tree=false, const wxString& name = wxT("FileGenericDirCtrl"));
-~FileGenericDirCtrl(){ CombinedFileDataArray.Clear(); FileDataArray.Clear(); }
+~FileGenericDirCtrl(){ m_ResortTimer.Stop(); CombinedFileDataArray.Clear(); FileDataArray.Clear(); }
 
 void CreateColumns(bool left);                        // Called after ctor to create the columns.  left says use tabdata's Lwidthcol
 
@@ -44,6 +47,7 @@ void DoSize();
 
 virtual void UpdateStatusbarInfo(const wxString& selected); // Feeds the other overload with a wxArrayString if called with a single selection
 void UpdateStatusbarInfo(const wxArrayString& selections);  // Writes selections' name & size in the statusbar
+void OnDirSizeProgress(wxULongLong total, bool finished);   // DirSizeService has counted some more of the selection's recursive size
 
 void ReloadTree(wxString path, wxArrayInt& IDs);
 void OnOpen(wxCommandEvent& event);                   // From DClick, Context menu or OpenWithKdesu, passes on to DoOpen
@@ -68,11 +72,22 @@ void OnToggleDecimalAwareSort(wxCommandEvent& event);   // Toggles decimal-aware
 void SelectFirstItem();                                 // Selects the first item in the tree. Used during navigation via keyboard
 bool UpdateTreeFileModify(const wxString& filepath);    // Called when a wxFSW_EVENT_MODIFY arrives
 bool UpdateTreeFileAttrib(const wxString& filepath);    // Called when a wxFSW_EVENT_ATTRIB arrives
+void QueueResort(const wxString& filepath);             // Ask for filepath to be moved to its new sorted position soon, coalescing bursts of events
+void ResortEntry(const wxString& filepath);             // Re-stat filepath and move it to its sorted position, without rebuilding the tree
+wxTreeItemId AddFileItem(wxTreeItemId parentId, DataBase& stat, const wxString& path, const wxString& label, bool IsArchv, int pos = -1); // Appends (or inserts at pos) a non-dir item, with the right icon
+void RefreshFileIcon(const wxString& filepath, const SniffedType& type); // FileClassifier has sniffed filepath, and its content deserves a different icon from its name
+
+bool IsFlatView() const { return m_FlatView; }
+void OnToggleFlatView(wxCommandEvent& event);           // Toggles listing every file in the subtree, rather than just this dir's contents
+void StartFlatWalk(const wxString& dirname);            // Called by ExpandDir when we're a flat view
+void OnFlatWalkResults(std::vector<DataBase*>& entries, const wxArrayString& dirs, bool finished, bool incremental); // FlatWalkService found more. We take ownership of entries
+void UpdateFlatView(InotifyEventType type, const wxString& filepath, const wxString& newfilepath); // Keep a flat view current after a create/delete/rename fsw event
 
 size_t NoOfDirs;                                        // These 3 vars are filled during MyGenericDirCtrl::ExpandDir.  Data is displayed in statusbar 
 size_t NoOfFiles;
 wxULongLong CumFilesize;
 wxULongLong SelectedCumSize;
+bool m_SizeIsPartial;                                   // True while DirSizeService is still adding to SelectedCumSize
 
 FileDataObjArray CombinedFileDataArray;                 // Array of FileData objects, which store etc the wxStat data. Stores dirs & files
 FileDataObjArray FileDataArray;                         // Temporary version just for files
@@ -90,9 +105,20 @@ void OnOpenWith(wxCommandEvent& event);
 void OpenWithKdesu(wxCommandEvent& event);
 
 void HeaderWindowClicked(wxListEvent& event);           // A L or R click occurred on the header window
+void OnResortTimer(wxTimerEvent& event);                // Re-sorts the entries queued by QueueResort()
+void SortFlatView();                                    // Sort a flat view once its walk finishes; until then entries are displayed as they arrive
+void InsertFlatEntry(DataBase* fd);                     // Insert a new entry into a flat view at its sorted position
+void RemoveFlatEntries(const wxString& filepath);       // Remove filepath from a flat view, and if it was a dir, everything that was inside it
+void RescanFlatDir(const wxString& dirname);            // Add any of dirname's children that a flat view doesn't yet list
+wxString FlatLabel(const wxString& filepath) const;     // In a flat view an item is labelled with its path relative to startdir
 bool reverseorder;                                      // Is the selected column reverse-sorted?
 bool m_decimalsort;                                     // Should we sort filenames in a decimal-aware manner i.e. foo1, foo2 above foo11?
+bool m_FlatView;                                        // Are we listing every file below startdir, instead of startdir's children?
+wxSortedArrayString m_FlatDirs;                         // The dirs a flat view has walked (or is walking), so a rescan doesn't walk them again
+FlatPathSet m_FlatPaths;                                // The filepaths a flat view's CombinedFileDataArray holds, so a create event needn't scan the array for each
 TreeListHeaderWindow* headerwindow;
+wxTimer m_ResortTimer;                                  // Rate-limits re-sorting after modify/attrib events
+wxArrayString m_PendingResorts;                         // The filepaths waiting for m_ResortTimer to fire
 
 private:
 DECLARE_EVENT_TABLE()
@@ -93,7 +93,9 @@ signal(SIGSEGV, WaitForDebugger);
 signal(SIGABRT, WaitForDebugger);
 
 m_EscapeCode = m_EscapeFlags = 0;
+StartupTracer::Begin(wxT("OnInit"));               // Until we know whether --trace-startup was passed, record the timeline anyway
 
+StartupTracer::Begin(wxT("librsvg and locale"));
 wxString rsvglib = LocateLibrary("librsvg"); // dlopen librsvg if it's available
 if (!rsvglib.empty())
   SetRsvgHandle(dlopen(rsvglib.ToUTF8(), RTLD_LAZY));
@@ -106,6 +108,7 @@ if (!m_locale.AddCatalog(wxT("4Pane")))
   m_locale.AddCatalog(wxT("4pane"));              // Hedge bets re our spelling
 
 m_locale.AddCatalog(wxT("wxstd"));                // Load the standard wxWidgets catalogue too: it'll help if there isn't a 4Pane one for a language
+StartupTracer::End(wxT("librsvg and locale"));
 
 int ret = ParseCmdline();
 if (ret == -2) // A test (for a test-suite?) so exit the eventloop, that being afaict the only way to return true without first starting the gui
@@ -126,8 +129,11 @@ wxString sesstype(wxT("XDG_SESSION_TYPE")), session_type;
 wxGetEnv(sesstype, &session_type); 
 SetWaylandSession(session_type.Lower().Contains(wxT("wayland")));
 
+StartupTracer::Begin(wxT("Find config"));
 if (!Configure::FindIni()) return false;          // Make sure there's a config file, resources etc. If not, show wizard and create one, find them etc, or abort
+StartupTracer::End(wxT("Find config"));
 
+StartupTracer::Begin(wxT("XRC resources"));
 wxInitAllImageHandlers();
 
 wxXmlResource::Get()->InitAllHandlers();
@@ -166,17 +172,21 @@ wxXmlResource::Get()->Load(RCDIR + wxT("configuredialogs.xrc"));
         if (wxMessageBox(errormsg, _("Warning!"),wxICON_ERROR|wxYES_NO) != wxYES) return false;
       }
   }
+StartupTracer::End(wxT("XRC resources"));
 
-              // 4.0 changed the NFS and similar dialogs; again try to detect any stale configs
+              // 4.0 changed the NFS and similar dialogs; again try to detect any stale configs. Creating a dialog is slow, and stale configs rare, so do it once we're displayed
+DoAfterFirstIdle(wxT("Check for stale NFS dialogs"), [this]
   { wxLogNull shh;
     MountNFSDialog dlg;
     wxXmlResource::Get()->LoadDialog(&dlg,MyFrame::mainframe, wxT("MountNFSDlg"));
     if (dlg.FindWindow(wxT("MountptTxt")))
       { wxString errormsg(wxT("Old configuration files detected. This means that the 'Mount' dialogs will not work.\
                               \nI suggest you check your installation, and perhaps delete the file ~/.4Pane\nDo you want to try to continue anyway?"));
-        if (wxMessageBox(errormsg, _("Warning!"),wxICON_ERROR|wxYES_NO) != wxYES) return false;
+        if (wxMessageBox(errormsg, _("Warning!"),wxICON_ERROR|wxYES_NO) != wxYES) frame->Close(true);
       }
-  }
+  });
+
+DoAfterFirstIdle(wxT("Check for interrupted pastes"), [this] { PasteJournal::OfferToResume(frame); }); // Any left by a crash, an exit mid-paste, or a disk that went away
 
 #ifndef NO_LZMA_ARCHIVE_STREAMS
   // See if there's the xz lib available for archive streams
@@ -191,20 +201,76 @@ wxXmlResource::Get()->Load(RCDIR + wxT("configuredialogs.xrc"));
   LIBLZMA_LOADED = (m_liblzma && m_liblzma->IsLoaded());
 #endif // NO_LZMA_ARCHIVE_STREAMS
 
+  // zlib is used directly to make a seek index for .tar.gz archives. wx will already have loaded it, so this should just find that copy
+#if wxVERSION_NUMBER >= 2900  
+  m_libz = new wxDynamicLibrary(wxT("libz.so.1"), wxDL_LAZY | wxDL_QUIET | wxDL_VERBATIM);
+#else
+  {
+  wxLogNull noerrormessage;
+  m_libz = new wxDynamicLibrary(wxT("libz.so.1"), wxDL_LAZY | wxDL_VERBATIM);
+  }
+#endif
+LIBZ_LOADED = (m_libz && m_libz->IsLoaded());
+
+  // zstd and lz4 archive streams are optional too. We only need the runtime libs, not their -dev packages
+#if wxVERSION_NUMBER >= 2900  
+  m_libzstd = new wxDynamicLibrary(wxT("libzstd.so.1"), wxDL_LAZY | wxDL_QUIET | wxDL_VERBATIM);
+  m_liblz4 = new wxDynamicLibrary(wxT("liblz4.so.1"), wxDL_LAZY | wxDL_QUIET | wxDL_VERBATIM);
+#else
+  {
+  wxLogNull noerrormessage;
+  m_libzstd = new wxDynamicLibrary(wxT("libzstd.so.1"), wxDL_LAZY | wxDL_VERBATIM);
+  m_liblz4 = new wxDynamicLibrary(wxT("liblz4.so.1"), wxDL_LAZY | wxDL_VERBATIM);
+  }
+#endif
+LIBZSTD_LOADED = (m_libzstd && m_libzstd->IsLoaded());
+LIBLZ4_LOADED = (m_liblz4 && m_liblz4->IsLoaded());
+
 PreviewManager::Init();
 long height = wxConfigBase::Get()->Read(wxT("/Misc/AppHeight"), 400l);
 long width = wxConfigBase::Get()->Read(wxT("/Misc/AppWidth"), 600l);
 
+StartupTracer::Begin(wxT("MyFrame"));
 frame = new MyFrame(wxSize(width, height));
+StartupTracer::End(wxT("MyFrame"));
 wxString title = GetAppName();                      // In case this isn't the normal one
 if (getuid() == 0) title += wxT(" (superuser)");    // It's nice to know if we're root
 frame->SetTitle(title);
 frame->GetMenuBar()->Check(SHCUT_SHOW_RECURSIVE_SIZE, SHOW_RECURSIVE_FILEVIEW_SIZE);
 frame->GetMenuBar()->Check(SHCUT_RETAIN_REL_TARGET, RETAIN_REL_TARGET);
 frame->GetMenuBar()->Check(SHCUT_RETAIN_MTIME_ON_PASTE, RETAIN_MTIME_ON_PASTE);
+frame->GetMenuBar()->Check(SHCUT_PERSISTENT_UNDO, PERSISTENT_UNDO);
+frame->GetMenuBar()->Check(SHCUT_DIR_CACHE, USE_DIR_CACHE);
+frame->GetMenuBar()->Check(SHCUT_DURABLE_PASTE, DURABLE_PASTE);
+
+Connect(wxEVT_IDLE, wxIdleEventHandler(MyApp::OnFirstIdle));  // The first idle event arrives once the frame and its panes have been displayed
+StartupTracer::End(wxT("OnInit"));
 return true;
 }
 
+void MyApp::DoAfterFirstIdle(const wxString& name, const std::function<void()>& fn)  // For startup work that isn't needed to display the first frame
+{
+if (m_FirstIdleDone) fn();
+ else m_AfterFirstIdle.push_back(std::make_pair(name, fn));
+}
+
+void MyApp::OnFirstIdle(wxIdleEvent& event)
+{
+event.Skip();
+Disconnect(wxEVT_IDLE, wxIdleEventHandler(MyApp::OnFirstIdle));
+m_FirstIdleDone = true;
+StartupTracer::Mark(wxT("First idle"));
+
+std::vector< std::pair<wxString, std::function<void()> > > todo; todo.swap(m_AfterFirstIdle);
+for (size_t n=0; n < todo.size(); ++n)
+  { StartupTracer::Begin(todo[n].first);
+    todo[n].second();
+    StartupTracer::End(todo[n].first);
+  }
+
+StartupTracer::Finish();                           // Startup's over, so write any trace
+}
+
 const wxColour* MyApp::GetBackgroundColourSelected(bool fileview /*=false*/) const
 {
 if (HIGHLIGHT_PANES)
@@ -257,6 +323,7 @@ static const wxCmdLineEntryDesc cmdLineDesc[] =
   { wxCMD_LINE_PARAM,  NULL, NULL, "Display from this filepath (optional)", wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_PARAM_MULTIPLE },
   { wxCMD_LINE_OPTION, "d", "home-dir",  "Use this as the home directory (optional)" },
   { wxCMD_LINE_OPTION, "c", "config-fpath",   "Use this filepath as 4Pane's configuration file (optional; if the filepath doesn't exist, it will be created)" },
+  { wxCMD_LINE_OPTION, NULL, "trace-startup", "Write a timeline of the startup phases to this filepath, in Chrome-trace json format (optional)" },
   { wxCMD_LINE_SWITCH, "h", "help", "Show this help message", wxCMD_LINE_VAL_NONE, wxCMD_LINE_OPTION_HELP },
 #if wxVERSION_NUMBER > 3101
   { wxCMD_LINE_SWITCH, "t", "test", "Testing testing 1 2 3 4", wxCMD_LINE_VAL_NONE, wxCMD_LINE_HIDDEN },
@@ -292,6 +359,10 @@ if (parser.Found(wxT("d"), &HOME))                 // See if there's an alternat
   }
 m_home = HOME;
 
+wxString tracefilepath;
+if (parser.Found(wxT("trace-startup"), &tracefilepath))
+  StartupTracer::SetFilepath(tracefilepath);
+
 if (parser.Found(wxT("c"), &m_ConfigFilepath))       // See if there's an alternative config file, or a desire for one (again, LiveCD)
   { if (wxDirExists(m_ConfigFilepath)) m_ConfigFilepath << wxT("/.4Pane");  // It would normally be a file, but check and, if need be, add the name
     if (!wxIsAbsolutePath(m_ConfigFilepath))         // Check that we weren't passed a filename, rather than a filepath
@@ -388,7 +459,12 @@ return false;
 int MyApp::OnExit()
 {
 delete m_liblzma;
+delete m_libz;
+delete m_libzstd;
+delete m_liblz4;
+JobManager::Release();
 ThreadsManager::Get().Release();
+DirCache::Shutdown();
 PasswordManager::Get().Release();
 BriefLogStatus::DeleteTimer();
 delete wxConfigBase::Set((wxConfigBase*) NULL);
@@ -428,6 +504,7 @@ BEGIN_EVENT_TABLE(MyFrame, wxFrame)
   EVT_MENU(SHCUT_COPY, MyFrame::OnCopy)
   EVT_MENU(SHCUT_PASTE, MyFrame::OnPaste)
   EVT_MENU(SHCUT_PASTE_DIR_SKELETON, MyFrame::OnPaste)
+  EVT_MENU(SHCUT_PASTE_DEDUP, MyFrame::OnPaste)
   EVT_MENU(SHCUT_ESCAPE, MyFrame::OnProcessCancelled)
   EVT_MENU(SHCUT_NEW, MyFrame::OnNew)
   EVT_MENU(SHCUT_HARDLINK, MyFrame::OnHardLink)
@@ -471,6 +548,9 @@ BEGIN_EVENT_TABLE(MyFrame, wxFrame)
   EVT_MENU(SHCUT_TOOL_LOCATE, MyFrame::OnLocate)
   EVT_MENU(SHCUT_TOOL_FIND, MyFrame::OnFind)
   EVT_MENU(SHCUT_TOOL_GREP, MyFrame::OnGrep)
+  EVT_MENU(SHCUT_TOOL_DUPLICATES, MyFrame::OnFindDuplicates)
+  EVT_MENU(SHCUT_SHOW_JOBS, MyFrame::OnShowJobs)
+  EVT_MENU(SHCUT_RESUME_PASTE, MyFrame::OnResumePaste)
   
   EVT_MENU_RANGE(SHCUT_SWITCH_FOCUS_PANES,SHCUT_SWITCH_TO_PREVIOUS_WINDOW, MyFrame::SetFocusViaKeyboard)
   
@@ -483,6 +563,9 @@ BEGIN_EVENT_TABLE(MyFrame, wxFrame)
   EVT_MENU(SHCUT_SHOW_RECURSIVE_SIZE, MyFrame::ToggleFileviewSizetype)
   EVT_MENU(SHCUT_RETAIN_REL_TARGET, MyFrame::ToggleRetainRelSymlinkTarget)
   EVT_MENU(SHCUT_RETAIN_MTIME_ON_PASTE, MyFrame::ToggleRetainMtimeOnPaste)
+  EVT_MENU(SHCUT_PERSISTENT_UNDO, MyFrame::TogglePersistentUndo)
+  EVT_MENU(SHCUT_DIR_CACHE, MyFrame::ToggleDirCache)
+  EVT_MENU(SHCUT_DURABLE_PASTE, MyFrame::ToggleDurablePaste)
   EVT_MENU(SHCUT_CONFIGURE, MyFrame::OnConfigure)
   
   EVT_MENU(SHCUT_SAVETABS, MyFrame::OnSaveTabs)
@@ -510,6 +593,7 @@ BEGIN_EVENT_TABLE(MyFrame, wxFrame)
     EVT_MENU(SPLIT_UNSPLIT, MyFrame::Unsplit)
     
     EVT_MENU(SHCUT_EXIT, MyFrame::OnQuit)
+    EVT_CLOSE(MyFrame::OnClose)
   
   EVT_MENU(SHCUT_FILTER, MyFrame::OnFilter)
   EVT_MENU(SHCUT_TOGGLEHIDDEN, MyFrame::OnToggleHidden)
@@ -528,6 +612,7 @@ BEGIN_EVENT_TABLE(MyFrame, wxFrame)
   EVT_UPDATE_UI_RANGE(SHCUT_SHOW_COL_EXT, SHCUT_SHOW_COL_LINK, MyFrame::DoColViewUI)
   EVT_UPDATE_UI(SHCUT_REFRESH, MyFrame::DoNoPanesUI)
   EVT_UPDATE_UI(SHCUT_PASTE_DIR_SKELETON, MyFrame::OnDirSkeletonUI)
+  EVT_UPDATE_UI(SHCUT_PASTE_DEDUP, MyFrame::DoMiscUI)
   EVT_UPDATE_UI(SHCUT_DUPLICATETAB, MyFrame::DoNoPanesUI)
   EVT_UPDATE_UI(SHCUT_TAB_DELETE_TEMPLATE, MyFrame::DoTabTemplateUI)
   EVT_UPDATE_UI(SHCUT_TOOLS_REPEAT, MyFrame::DoRepeatCommandUI)
@@ -560,8 +645,10 @@ Layout = NULL;
 
 m_tbText = NULL;                                        // In case this isn't going to be used, start with it null for ease of testing
 
+StartupTracer::Begin(wxT("Load configuration"));
 configure =  new class Configure;
 configure->LoadConfiguration();
+StartupTracer::End(wxT("Load configuration"));
 
 wxGetApp().SetPaneHighlightColours();  // Set colours to denote selected/unselectness in the panes
 
@@ -570,8 +657,10 @@ ConfigureMisc::LoadStatusbarWidths(widths); // Load (or set from defaults) the w
 SetStatusBar(CreateStatusBar(4));
 SetStatusWidths(4, widths);
 
+StartupTracer::Begin(wxT("Accelerators"));
 AccelList = new class AcceleratorList(this); AccelList->Init();
 CreateAcceleratorTable();
+StartupTracer::End(wxT("Accelerators"));
 
 mainframe = this;
  
@@ -588,15 +677,17 @@ if (!HELPDIR.IsEmpty())                               // If we couldn't find a v
     if (Help->Initialize(HELPDIR))
        { wxLogError(_("Cannot initialize the help system; aborting.")); return; }
 
-    Help->AddBook(wxFileName(HELPDIR + wxT("/Chapt.hhp")));
+    wxGetApp().DoAfterFirstIdle(wxT("Help book"), [this] { Help->AddBook(wxFileName(HELPDIR + wxT("/Chapt.hhp"))); }); // It's only needed for F1, and parsing it is slow
   }
 
 MyBitmapButton::SetUnknownButtonNo();  // Locate the iconno of unknown.xpm, to use if an icon is missing
 
+StartupTracer::Begin(wxT("Menubar and toolbar"));
 wxMenuBar* MenuBar = new wxMenuBar();
 CreateMenuBar(MenuBar); SetMenuBar(MenuBar);
 
 toolbar = NULL; LoadToolbarButtons();  // Toolbar pt1
+StartupTracer::End(wxT("Menubar and toolbar"));
 
 panelette = new wxPanel(this, -1, wxDefaultPosition, wxDefaultSize, wxTAB_TRAVERSAL, wxT("TBPanel"));  // & pt2, for MyBitmapButtons
 sizerTB = new wxBoxSizer(wxHORIZONTAL);
@@ -606,9 +697,11 @@ sizerTB->Add(panelette, 1, wxEXPAND);
 sizerMain = new wxBoxSizer(wxVERTICAL);
 sizerMain->Add(sizerTB, 0, wxEXPAND);
 
+StartupTracer::Begin(wxT("Layout and panes"));
 AddControls();
 Layout = new LayoutWindows(this);                    // This does the rest of the layout things
 Layout->Setup();
+StartupTracer::End(wxT("Layout and panes"));
 
 #if defined(__WXGTK__)
   // gtk2 steals keydown events for any shortcuts! So if you use DEL as ->Trash, textctrls never get DEL keypresses.  Ditto Copy/Paste.  This is a workaround (see Tools.cpp). 
@@ -678,7 +771,7 @@ AccelList->FillMenuBar(MenuBar, true);
 
 void MyFrame::CreateAcceleratorTable()
 {
-int AccelEntries[] = { SHCUT_LAUNCH_TERMINAL, SHCUT_TOOL_LOCATE, SHCUT_TOOL_FIND, SHCUT_TOOL_GREP, SHCUT_COMMANDLINE, SHCUT_TERMINAL_EMULATOR,
+int AccelEntries[] = { SHCUT_LAUNCH_TERMINAL, SHCUT_TOOL_LOCATE, SHCUT_TOOL_FIND, SHCUT_TOOL_GREP, SHCUT_TOOL_DUPLICATES, SHCUT_SHOW_JOBS, SHCUT_COMMANDLINE, SHCUT_TERMINAL_EMULATOR,
                        SHCUT_ARCHIVE_EXTRACT, SHCUT_ARCHIVE_CREATE, SHCUT_ARCHIVE_COMPRESS, SHCUT_F1, SHCUT_CONFIG_SHORTCUTS, SHCUT_TOOLS_REPEAT
                      };
 const size_t shortcutNo = sizeof(AccelEntries)/sizeof(int);
@@ -838,6 +931,7 @@ switch(event.GetId())                // Otherwise it's (presumably) a pane
     case SHCUT_UNDO:  { bool any = UnRedoManager::UndoAvailable() && !ThreadsManager::Get().PasteIsActive(); event.Enable(any); largesidebar1->Enable(any); return; } // Enable Undo button & sidebar
     case SHCUT_REDO:  { bool any = UnRedoManager::RedoAvailable() && !ThreadsManager::Get().PasteIsActive(); event.Enable(any); largesidebar2->Enable(any); return; } // Enable Redo button & sidebar
     case SHCUT_NEW:     event.Enable(!IsArchive); return;
+    case SHCUT_PASTE_DEDUP:  // Not into an archive: that has its own way of dealing with clashes
     case SHCUT_HARDLINK:
     case SHCUT_SOFTLINK: event.Enable(!IsArchive && (MyGenericDirCtrl::filecount > 0)); return;  // We can't make new files or links within an archive
   }
@@ -1050,7 +1144,20 @@ Layout->m_notebook->SaveDefaults();
 
 void MyFrame::OnQuit(wxCommandEvent& WXUNUSED(event))
 {
-Close(true);
+Close();                                                // Not forced, so that OnClose can veto it if there are jobs still to finish
+}
+
+void MyFrame::OnClose(wxCloseEvent& event)
+{
+if (event.CanVeto() && JobManager::HasUnfinishedJobs())  // Quitting would kill the running jobs, and the queued ones would never run
+  { wxMessageDialog dialog(this, _("Some jobs haven't finished yet.\nIf you quit now, any that are running will be stopped, and any that are queued won't be run.\n\nQuit anyway?"),
+                                                                        _("Unfinished jobs"), wxYES_NO | wxNO_DEFAULT | wxICON_QUESTION);
+    if (dialog.ShowModal() != wxID_YES)
+      { event.Veto(); JobManager::Get().ShowPanel(); return; }  // Show them, so the user can see what's still going on
+  }
+
+ThreadsManager::Get().StopPastes();                     // Paste threads use their superblocks, which are deleted on exit. Their journals are kept, so they can be resumed
+event.Skip();                                           // The default handler destroys the frame
 }
 
 
@@ -1497,6 +1604,33 @@ void MyFrame::OnGrep(wxCommandEvent& WXUNUSED(event))
 Layout->DoTool(grep);
 }
 
+void MyFrame::OnFindDuplicates(wxCommandEvent& WXUNUSED(event))
+{
+MyGenericDirCtrl* pane = GetActivePane();
+if (!pane) return;
+if (pane->arcman && pane->arcman->IsArchive())
+  { BriefMessageBox(_("Sorry, this can't be done inside an archive"), 2, _("Oops!")); return; }
+
+wxString dir = pane->GetActiveDirPath();
+if (dir.empty()) return;
+DuplicatesDlg* dlg = new DuplicatesDlg(this, dir, pane->GetId(), pane->GetShowHidden()); // Modeless, so the panes can be used while it searches. It destroys itself
+dlg->Show();
+}
+
+void MyFrame::OnShowJobs(wxCommandEvent& WXUNUSED(event))
+{
+JobManager::Get().ShowPanel();
+}
+
+void MyFrame::OnResumePaste(wxCommandEvent& WXUNUSED(event))
+{
+if (ThreadsManager::Get().PasteIsActive())  // We shouldn't try to do 2 pastes at a time
+ { BriefMessageBox(_("Please try again in a moment"), 2,_("I'm busy right now")); return; }
+
+if (!PasteJournal::ResumeInterrupted())
+  BriefMessageBox(_("There are no interrupted pastes to resume"), 2, _("Resume Interrupted Paste"));
+}
+
 void MyFrame::OnToolsLaunch(wxCommandEvent& event)
 {
 int id = event.GetId();
@@ -1535,6 +1669,22 @@ void MyFrame::ToggleRetainMtimeOnPaste(wxCommandEvent& WXUNUSED(event))
 RETAIN_MTIME_ON_PASTE = !RETAIN_MTIME_ON_PASTE;
 }
 
+void MyFrame::TogglePersistentUndo(wxCommandEvent& WXUNUSED(event))
+{
+PERSISTENT_UNDO = !PERSISTENT_UNDO;  // The log is opened or discarded by UnRedoManager, so this takes effect on the next start
+}
+
+void MyFrame::ToggleDirCache(wxCommandEvent& WXUNUSED(event))
+{
+USE_DIR_CACHE = !USE_DIR_CACHE;
+if (!USE_DIR_CACHE) DirCache::Discard();  // Don't leave stale data to be found if it's turned on again later
+}
+
+void MyFrame::ToggleDurablePaste(wxCommandEvent& WXUNUSED(event))
+{
+DURABLE_PASTE = !DURABLE_PASTE;
+}
+
 void MyFrame::OnConfigure(wxCommandEvent& WXUNUSED(event))
 {
 configure->Configure4Pane();
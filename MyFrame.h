@@ -20,6 +20,9 @@
 #include "wx/html/helpctrl.h"
 #include "wx/dynlib.h"
 
+#include <vector>
+#include <functional>
+
 #include "MyNotebook.h"
 #include "Externs.h"
 #include "Tools.h"
@@ -68,8 +71,9 @@ protected:
 class MyApp : public wxApp
 {
 public:
-MyApp() : wxApp(), frame(NULL), m_WaylandSession(false) {}
+MyApp() : wxApp(), frame(NULL), m_libz(NULL), m_libzstd(NULL), m_liblz4(NULL), m_WaylandSession(false), m_FirstIdleDone(false) {}
 void RestartApplic();
+void DoAfterFirstIdle(const wxString& name, const std::function<void()>& fn); // For startup work that isn't needed to display the first frame
 
 const wxColour* GetBackgroundColourUnSelected() const { return &m_BackgroundColourUnSelected; }
 const wxColour* GetBackgroundColourSelected(bool fileview = false) const;
@@ -78,6 +82,9 @@ wxColour AdjustColourFromOffset(const wxColour& col, int offset) const;  // Util
 wxImage CorrectForDarkTheme(const wxString& filepath) const;             // Utility function. Loads an b/w image and inverts the cols if using a dark theme
 
 wxDynamicLibrary* GetLiblzma() { return m_liblzma; }
+wxDynamicLibrary* GetLibz() { return m_libz; }
+wxDynamicLibrary* GetLibzstd() { return m_libzstd; }
+wxDynamicLibrary* GetLiblz4() { return m_liblz4; }
 FocusController& GetFocusController() { return m_FocusCtrlr; }
 
 const wxString GetConfigFilepath() const { return m_ConfigFilepath; }
@@ -102,6 +109,7 @@ virtual bool OnInit();
 int OnExit();
 int ParseCmdline();
 int FilterEvent(wxEvent& event);
+void OnFirstIdle(wxIdleEvent& event);
 void SetWaylandSession(bool session_type) { m_WaylandSession = session_type; }
 #if defined(__WXX11__)  && wxVERSION_NUMBER < 2800
 bool ProcessXEvent(WXEvent* _event);    // Grab selection XEvents
@@ -117,6 +125,9 @@ wxColour m_FvBackgroundColourSelected;  // and unfocused, fileview
 MyFrame* frame;
 wxLocale m_locale;
 wxDynamicLibrary* m_liblzma;
+wxDynamicLibrary* m_libz;
+wxDynamicLibrary* m_libzstd;
+wxDynamicLibrary* m_liblz4;
 FocusController m_FocusCtrlr;
 wxString m_XDGconfigdir;
 wxString m_XDGcachedir;
@@ -128,6 +139,8 @@ int m_EscapeCode;
 int m_EscapeFlags;
 bool m_WaylandSession;
 void* m_dlRsvgHandle;
+bool m_FirstIdleDone;
+std::vector< std::pair<wxString, std::function<void()> > > m_AfterFirstIdle; // The deferred startup work, and a name for the startup trace
 };
 
 DECLARE_APP(MyApp)
@@ -337,6 +350,7 @@ void Unsplit(wxCommandEvent& event);
 void OnTabTemplateLoadMenu(wxCommandEvent& event);
 
 void OnQuit(wxCommandEvent& event);
+void OnClose(wxCloseEvent& event);
 void OnHelpF1(wxKeyEvent& event);
 void OnHelpContents(wxCommandEvent& event);
 void OnHelpFAQs(wxCommandEvent& event);
@@ -465,6 +479,9 @@ void OnLaunchTerminal(wxCommandEvent& event);
 void OnLocate(wxCommandEvent& event);
 void OnFind(wxCommandEvent& event);
 void OnGrep(wxCommandEvent& event);
+void OnFindDuplicates(wxCommandEvent& event);
+void OnShowJobs(wxCommandEvent& event);
+void OnResumePaste(wxCommandEvent& event);
 
 void OnAddToBookmarks(wxCommandEvent& event);
 void OnManageBookmarks(wxCommandEvent& event);
@@ -473,6 +490,9 @@ void OnBookmark(wxCommandEvent& event);
 void ToggleFileviewSizetype(wxCommandEvent& event);
 void ToggleRetainRelSymlinkTarget(wxCommandEvent& event);
 void ToggleRetainMtimeOnPaste(wxCommandEvent& event);
+void TogglePersistentUndo(wxCommandEvent& event);
+void ToggleDirCache(wxCommandEvent& event);
+void ToggleDurablePaste(wxCommandEvent& event);
 void OnConfigure(wxCommandEvent& event);
 void OnConfigureShortcuts(wxCommandEvent& event);
 void OnShowBriefMessageBox(wxCommandEvent& event);
@@ -562,14 +562,20 @@ if (GetPath().IsEmpty()) return;  //We must check for emptiness, as this method
 wxArrayString selections;
 size_t count = GetMultiplePaths(selections);
 
+if (fileview == ISRIGHT)
+  { DirSizeService::Get().Cancel(this);             // Any count that's still running is for an outdated selection
+    wxStaticCast(this, FileGenericDirCtrl)->m_SizeIsPartial = false;
+  }
+
 if (arcman && !arcman->IsArchive() && (fileview == ISRIGHT)) // Archives are done in FileGenericDirCtrl::UpdateStatusbarInfo
   { wxStaticCast(this, FileGenericDirCtrl)->SelectedCumSize = 0;
-    for (size_t n=0; n < count; ++n)
-      { if (SHOW_RECURSIVE_FILEVIEW_SIZE)  // Do we use the slow & complete recursive method
-          wxStaticCast(this, FileGenericDirCtrl)->SelectedCumSize += GetDirSizeRecursively(selections.Item(n));
-         else
-          wxStaticCast(this, FileGenericDirCtrl)->SelectedCumSize += GetDirSize(selections.Item(n));  // or the quick and incomplete one-shot?
+    if (SHOW_RECURSIVE_FILEVIEW_SIZE)  // Do we use the slow & complete recursive method? If so, it's done on worker threads, which report back via OnDirSizeProgress()
+      { wxStaticCast(this, FileGenericDirCtrl)->m_SizeIsPartial = true;
+        DirSizeService::Get().Request(wxStaticCast(this, FileGenericDirCtrl), selections);
       }
+     else
+      for (size_t n=0; n < count; ++n)
+        wxStaticCast(this, FileGenericDirCtrl)->SelectedCumSize += GetDirSize(selections.Item(n));  // or the quick and incomplete one-shot?
   }
  else if (arcman && !arcman->IsArchive() && fileview == ISLEFT)
   { wxStaticCast(this, DirGenericDirCtrl)->SelectedCumSize = 0;
@@ -685,7 +691,12 @@ void MyGenericDirCtrl::CreateTree()    // //  Extracted from Create, reused in R
 MyGenericDirCtrl::~MyGenericDirCtrl()
 {
 if (fileview == ISLEFT) { delete arcman; arcman = NULL; }   // //
- else arcman = NULL;                                        // // Needed as Redo sometimes stores subsequently-deleted MyGenericDirCtrls*
+ else { arcman = NULL;                                      // // Needed as Redo sometimes stores subsequently-deleted MyGenericDirCtrls*
+        DirSizeService::Get().Cancel(this);                 // Don't let it report to a dead pane
+        FlatWalkService::Get().Cancel(this);
+        DirCache::Get().Cancel(this);
+        FileClassifier::Get().Cancel(this);
+      }
 
 #if defined(__LINUX__) && defined(__WXGTK__)
 	delete m_watcher;
@@ -871,6 +882,7 @@ void MyGenericDirCtrl::OnEndEditItem(wxTreeEvent &event)
     if (wxRenameFile(data->m_path,new_name))
     {
         data->SetNewDirName(new_name);
+        m_treeCtrl->IndexItem(id);
     }
     else
     {
@@ -999,6 +1011,8 @@ if (IsArchv)  d = new ArcDir(arcman->GetArc());          // //
     d->Open(dirName);
 
 FileGenericDirCtrl* FileCtrl;                                  // //  
+DirCacheListing listing;                                       // // If the user wants it, any cached stat data for dirName's children
+if (!IsArchv) DirCache::Get().Begin(dirName, listing);         // //
 
 if (fileview==ISRIGHT)       // // If this is a fileview, do things differently from normal:  use array of FileData* to store & sort the data
   { FileCtrl = (FileGenericDirCtrl*)this;
@@ -1006,6 +1020,13 @@ if (fileview==ISRIGHT)       // // If this is a fileview, do things differently
     FileCtrl->FileDataArray.Clear();                          // //   & the temp one for files
     FileCtrl->CumFilesize = 0;                                // //     & this dir's cum filesize, to display in statusbar
 
+    if (FileCtrl->IsFlatView() && !IsArchv)                   // // A flat view lists the whole subtree. That's walked on worker threads, and arrives later
+      { FileCtrl->NoOfDirs = 0; FileCtrl->NoOfFiles = 0;
+        FileCtrl->StartFlatWalk(dirName);
+        delete d;
+        return;
+      }
+
     if (d->IsOpened())
     {
         int style = wxDIR_FILES;                              // //
@@ -1029,7 +1050,7 @@ if (fileview==ISRIGHT)       // // If this is a fileview, do things differently
                           if (fd) stat = new FakeFiledata(*fd);
                         }
                     }
-                   else stat = new FileData(dirName + eachFilename);      // // Create a new FileData for the entry & add it to the appropriate array
+                   else stat = DirCache::Get().NewFileData(dirName, eachFilename, listing);      // // Create a new FileData for the entry & add it to the appropriate array
                   if (stat->IsValid())
                     { if (stat->IsDir()                                   // // Is it a dir?
                                   || (TREAT_SYMLINKTODIR_AS_DIR && stat->IsSymlinktargetADir()))  // // or a symlink to one, & user wants to display it with dirs
@@ -1070,7 +1091,7 @@ if (fileview==ISRIGHT)       // // If this is a fileview, do things differently
                               if (fd) stat = new FakeFiledata(*fd);
                             }
                         }
-                       else stat = new FileData(dirName + eachFilename);     // // Create a new FileData for the entry & add it to the appropriate array
+                       else stat = DirCache::Get().NewFileData(dirName, eachFilename, listing);     // // Create a new FileData for the entry & add it to the appropriate array
                       if (stat->IsValid())
                         { if (stat->IsDir()                                  // // Is it a dir?
                                 || (TREAT_SYMLINKTODIR_AS_DIR && stat->IsSymlinktargetADir()))  // // or a symlink to one, & user wants to display it with dirs
@@ -1089,6 +1110,7 @@ if (fileview==ISRIGHT)       // // If this is a fileview, do things differently
               while (d->GetNext(&eachFilename));
           }
         }
+  if (!IsArchv) DirCache::Get().End(dirName, listing, FileCtrl);    // // Store any fresh data, & recheck any cached data in the background
   
   FileCtrl->SortStats(FileCtrl->CombinedFileDataArray);             // // Sort the dirs
   FileCtrl->NoOfDirs = FileCtrl->CombinedFileDataArray.GetCount();  // // Store the no of dirs
@@ -1144,34 +1166,7 @@ if (fileview==ISRIGHT)       // // If this is a fileview, do things differently
             wxString eachFilename(FileCtrl->FileDataArray[i].GetFilename());// // Note that we take the filenames from the sorted FileDataArray
             path = dirName + eachFilename;
 
-            wxDirItemData *dir_item = new wxDirItemData(path,eachFilename,false);
-          if (FileCtrl->FileDataArray[i].IsRegularFile())                   // // If the item is a file
-            { ziptype zt =  Archive::Categorise(path);
-              if (zt != zt_invalid)                                         // // There are special icons for archives etc
-                (void)m_treeCtrl->AppendItem(parentId, eachFilename, Archive::GetIconForArchiveType(zt, IsArchv), -1, dir_item);
-               else (void)m_treeCtrl->AppendItem(parentId, eachFilename, IsArchv? GDC_ghostfile : GDC_file, -1, dir_item);  // // otherwise use the standard icon
-             }
-           else if (FileCtrl->FileDataArray[i].IsSymlink())                 // // If the item is a symlink
-            { 
-              if (FileCtrl->FileDataArray[i].IsSymlinktargetADir())         // //  If it's pointing to a dir, use the appropriate icon
-                (void)m_treeCtrl->AppendItem(parentId, eachFilename, GDC_symlinktofolder, -1, dir_item);  // //
-               else
-                 { if (FileCtrl->FileDataArray[i].IsBrokenSymlink())
-                     (void)m_treeCtrl->AppendItem(parentId, eachFilename, GDC_brokensymlink, -1, dir_item);
-                    else
-                     (void)m_treeCtrl->AppendItem(parentId, eachFilename, GDC_symlink, -1, dir_item);  // // If it's pointing to a file, use that icon
-                 }
-            }
-          else if (FileCtrl->FileDataArray[i].IsFIFO())               // // FIFO
-            (void)m_treeCtrl->AppendItem(parentId, eachFilename, GDC_pipe, -1, dir_item);
-          else if (FileCtrl->FileDataArray[i].IsBlkDev())             // // Block device
-            (void)m_treeCtrl->AppendItem(parentId, eachFilename, GDC_blockdevice, -1, dir_item);
-          else if (FileCtrl->FileDataArray[i].IsCharDev())            // // Char device
-            (void)m_treeCtrl->AppendItem(parentId, eachFilename, GDC_chardevice, -1, dir_item);
-          else if (FileCtrl->FileDataArray[i].IsSocket())             // // Socket
-            (void)m_treeCtrl->AppendItem(parentId, eachFilename, GDC_socket, -1, dir_item);
-
-          else (void)m_treeCtrl->AppendItem(parentId, eachFilename, GDC_unknownfile, -1, dir_item); // // wtf is this?
+          FileCtrl->AddFileItem(parentId, FileCtrl->FileDataArray[i], path, eachFilename, IsArchv);
         }
       else      // // An invalid filedata, so presumably a corrupt file (corrupt dirs were dealt with earlier)
         { wxString name(FileCtrl->FileDataArray[i].ReallyGetName());
@@ -1182,6 +1177,8 @@ if (fileview==ISRIGHT)       // // If this is a fileview, do things differently
         }
     }
 
+    if (!IsArchv) FileClassifier::Get().SniffInBackground(FileCtrl, dirName, FileCtrl->FileDataArray); // // Check in the background what any extless or archive-named files really are, for their icons
+
     size_t count = FileCtrl->FileDataArray.Count();             // // Merge the 2 arrays, Dir <-- File
     for (size_t n = 0;  n < count; ++n)                         // // For count iterations,
         FileCtrl->CombinedFileDataArray.Add(FileCtrl->FileDataArray.Detach(0));  // // transfer array[0], as detaching shifts everything down
@@ -1203,7 +1200,7 @@ if (fileview==ISRIGHT)       // // If this is a fileview, do things differently
                   { DataBase* stat;
                     if (IsArchv)  
                       stat = new FakeDir(eachFilename);     // // 
-                     else stat = new FileData(dirName + eachFilename);    // //
+                     else stat = DirCache::Get().NewFileData(dirName, eachFilename, listing);    // //
                     if (stat->IsValid())
                       { if (stat->IsDir())                    // // Ensure it IS a dir, & not a symlink-to-dir
                           dirs.Add(eachFilename);
@@ -1232,7 +1229,7 @@ if (fileview==ISRIGHT)       // // If this is a fileview, do things differently
                     { DataBase* stat;
                       if (IsArchv)  
                         stat = new FakeDir(eachFilename);        // // 
-                       else   stat = new FileData(dirName + eachFilename);  // //
+                       else   stat = DirCache::Get().NewFileData(dirName, eachFilename, listing);  // //
                       if (stat->IsDir())                         // // Ensure it IS a dir, & not a symlink-to-dir
                             dirs.Add(eachFilename);
                       delete stat;
@@ -1243,6 +1240,7 @@ if (fileview==ISRIGHT)       // // If this is a fileview, do things differently
           }
         }         
      }
+  if (!IsArchv) DirCache::Get().End(dirName, listing);           // //
     
   dirs.Sort((wxArrayString::CompareFunction) (*wxDirCtrlStringCompareFunc));
 
@@ -1348,6 +1346,9 @@ Freeze();
     CollapseDir(*ItemToRefresh);
     ExpandDir(*ItemToRefresh);
 Thaw();
+#ifdef __WXDEBUG__
+  m_treeCtrl->CheckPathIndex();
+#endif
 
 if (!topitem.empty())                                   // // Now make a valiant effort to replicate the previous tree's appearance
   { fv = FindIdForPath(topitem);
@@ -1673,6 +1674,9 @@ Freeze();
 GetTreeCtrl()->DeleteAllItems();              // Uproot the old tree
 CreateTree();                                 // and recreate from new root
 Thaw();                                       // We must thaw before calling ScrollToOldPosition()
+#ifdef __WXDEBUG__
+  m_treeCtrl->CheckPathIndex();
+#endif
 
 if (!topitem.empty())                         // Now make a valiant effort to replicate the previous tree's appearance
   { fv = FindIdForPath(topitem);
@@ -1714,7 +1718,9 @@ if (arcman && arcman->IsArchive())                 // Check that we didn't just
 
 FileData fd(data->m_path);
 if (fd.IsRegularFile() || (fd.IsSymlink() && !fd.IsSymlinktargetADir()))  // Check if the DClick was on a file
-  { if (zt == zt_invalid)                        // (We deal with archives differently)
+  { if (FileClassifier::Get().Contradicts(data->m_path, zt))  // If it's named like an archive but clearly isn't one e.g. a text file called foo.zip, peeking would only fail
+      zt = zt_invalid;                           //  so open it like any other file
+    if (zt == zt_invalid)                        // (We deal with archives differently)
       { ((FileGenericDirCtrl*)this)->OnOpen(event); return; }  // It's a file, so pass to FileGenericDirCtrl::OnOpen
   }
 
@@ -1775,7 +1781,7 @@ if (!arcman->IsArchive() && zt == zt_invalid)     // If we're not already in an
  // Check that any attempt at archive peeking is likely to work, as failure messes up the dirview display
 if (zt != zt_invalid && !ArchiveStream::IsStreamable(zt))
   { switch(zt)
-      { case zt_gzip: case zt_bzip: case zt_lzma: case zt_xz: case zt_lzop: case zt_compress:
+      { case zt_gzip: case zt_bzip: case zt_lzma: case zt_xz: case zt_lzop: case zt_compress: case zt_zstd: case zt_lz4:
                     wxMessageBox(_("This file is compressed, but it's not an archive so you can't peek inside."), _("Sorry")); return;
          default:   wxMessageBox(_("I'm afraid I can't peek inside that sort of archive."), _("Sorry")); return;
       }
@@ -72,6 +72,7 @@ class wxTextCtrl;
 class DirGenericDirCtrl;
 class MyGenericDirCtrl;
 class ThreadSuperBlock;
+class PasteThreadSuperBlock;
 
 
 class MyFSEventManager
@@ -345,7 +346,7 @@ void OnShortcutCut(wxCommandEvent& event);             // // Ctrl-X
 void OnShortcutHardLink(wxCommandEvent& event);        // // Ctr-Sh-L
 void OnShortcutSoftLink(wxCommandEvent& event);        // // Alt-Sh-L
 void OnShortcutPaste(wxCommandEvent& event);           // // Ctrl-V.  Calls the following:
-void OnPaste(bool FromDnD, const wxString& destinationpath = wxT(""), bool dir_skeleton = false);  // // Ctrl-V or DnD
+void OnPaste(bool FromDnD, const wxString& destinationpath = wxT(""), bool dir_skeleton = false, bool dedup = false);  // // Ctrl-V or DnD. dedup means skip what the dest already holds
 void OnReplicate(wxCommandEvent& event);               // // Duplicates this pane's filepath in its opposite pane
 void OnSwapPanes(wxCommandEvent& event);               // // Swap this pane's filepath with that of its opposite pane
 void OnLink(bool FromDnD, int linktype);               // // Create hard or soft link
@@ -364,7 +365,7 @@ void OnDup(wxCommandEvent& event);                                          // /
 void OnRename(wxCommandEvent& event);                                       // // F2 for rename. Calls DoRename
 void DoRename(bool RenameOrDuplicate, const wxString& pathtodup = wxT("")); // // Does either rename or duplicate, depending on the bool
 void DoMultipleRename(wxArrayString& paths, bool duplicate);                // // Renames (or duplicates) multiple files/dirs
-int Rename(wxString& path, wxString& origname, wxString& newname, bool ItsADir, bool dup=false);  // // Renames both dirs & files (or dups if the bool is set)
+int Rename(wxString& path, wxString& origname, wxString& newname, bool ItsADir, bool dup=false, PasteThreadSuperBlock* tsb=NULL);  // // Renames both dirs & files (or dups if the bool is set, using tsb's threads if there is one)
 
 
 void OnIdle(wxIdleEvent& event);                       // // Checks whether we need to update the statusbar with e.g. size of selection?
@@ -46,7 +46,9 @@ DeleteLocation = new DirectoryForDeletions;    // Set up the Deleted and Trash s
 UnRedoMan = new UnRedoManager;                 // The sole instance of UnRedoManager
 UnRedoManager::frame = MyFrame::mainframe;     // Tell UnRedoManager's (static) pointer where it is
 
+StartupTracer::Begin(wxT("Devices"));
 DeviceMan = new DeviceAndMountManager;         // Organises things to do with mounting partitions & devices
+StartupTracer::End(wxT("Devices"));
 LaunchFromMenu = new LaunchMiscTools;          // Launches user-defined external programs & scripts from the Tools menu
 }
 
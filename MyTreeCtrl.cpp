@@ -27,6 +27,7 @@
 #include "MyFrame.h"
 #include "Filetypes.h"
 #include "Redo.h"
+#include "Misc.h"
 #include "Devices.h"
 #include "MyTreeCtrl.h"
 #include "Accelerators.h"
@@ -1639,6 +1640,110 @@ if (headerwindow != NULL) headerwindow->Refresh();
 event.Skip();
 }
 
+wxTreeItemId MyTreeCtrl::FindItemForPath(const wxString& path) const
+{
+PathItemHash::const_iterator iter = m_PathIndex.find(StripSep(path));
+if (iter == m_PathIndex.end()) return wxTreeItemId();
+return iter->second;
+}
+
+int MyTreeCtrl::GetChildIndex(const wxTreeItemId& id) const
+{
+if (!id.IsOk()) return wxNOT_FOUND;
+wxGenericTreeItem* item = (wxGenericTreeItem*)id.m_pItem;
+wxGenericTreeItem* parent = item->GetParent();
+if (!parent) return wxNOT_FOUND;
+
+return parent->GetChildren().Index(item);             // A scan of pointers, which is much cheaper than walking the siblings with GetNextChild()
+}
+
+void MyTreeCtrl::IndexItem(const wxTreeItemId& id)
+{
+if (!id.IsOk()) return;
+UnindexItem(id);                                      // Any path it had before is now stale
+
+wxDirItemData* data = (wxDirItemData*)GetItemData(id);
+if (!data) return;
+
+wxString path = StripSep(data->m_path);
+m_PathIndex[path] = id;                               // If another item already has this path, the newer one wins
+m_ItemIndex[id.GetID()] = path;
+}
+
+void MyTreeCtrl::UnindexItem(const wxTreeItemId& id)
+{
+ItemPathHash::iterator iter = m_ItemIndex.find(id.GetID());
+if (iter == m_ItemIndex.end()) return;
+
+PathItemHash::iterator pathiter = m_PathIndex.find(iter->second);
+if (pathiter != m_PathIndex.end() && pathiter->second == id) // Unless the path has since been claimed by another item
+  m_PathIndex.erase(pathiter);
+m_ItemIndex.erase(iter);
+}
+
+#ifdef __WXDEBUG__
+void MyTreeCtrl::CheckPathIndex() const
+{
+if (!wxTheAssertHandler) return;                      // Asserts are disabled, so don't bother
+
+wxTreeItemId root = GetRootItem();
+size_t count = root.IsOk() ? CheckPathIndexBranch(root) : 0;
+wxASSERT_MSG(m_ItemIndex.size() == count, wxT("The path index holds items that are no longer in the tree"));
+wxASSERT_MSG(m_PathIndex.size() == m_ItemIndex.size(), wxT("The path index and its reverse are out of step"));
+}
+
+size_t MyTreeCtrl::CheckPathIndexBranch(const wxTreeItemId& id) const
+{
+size_t count = 0;
+wxDirItemData* data = (wxDirItemData*)GetItemData(id);
+if (data)
+  { wxString path = StripSep(data->m_path);
+    wxASSERT_MSG(FindItemForPath(path) == id, wxT("A tree item isn't indexed under its path: ") + path);
+    ItemPathHash::const_iterator iter = m_ItemIndex.find(id.GetID());
+    wxASSERT_MSG(iter != m_ItemIndex.end() && iter->second == path, wxT("A tree item's reverse index entry is stale: ") + path);
+    ++count;
+  }
+
+wxTreeItemIdValue cookie;
+for (wxTreeItemId child = GetFirstChild(id, cookie); child.IsOk(); child = GetNextChild(id, cookie))
+  count += CheckPathIndexBranch(child);
+return count;
+}
+#endif
+
+void MyTreeCtrl::OnDeleteItem(wxTreeEvent& event)
+{
+UnindexItem(event.GetItem());
+event.Skip();
+}
+
+wxTreeItemId MyTreeCtrl::AddRoot(const wxString& text, int image, int selImage, wxTreeItemData* data)
+{
+wxTreeItemId id = wxTreeCtrl::AddRoot(text, image, selImage, data);
+IndexItem(id);
+return id;
+}
+
+void MyTreeCtrl::SetItemData(const wxTreeItemId& item, wxTreeItemData* data)
+{
+wxTreeCtrl::SetItemData(item, data);
+IndexItem(item);                                      // If data is NULL, this just unindexes it
+}
+
+wxTreeItemId MyTreeCtrl::DoInsertItem(const wxTreeItemId& parent, size_t pos, const wxString& text, int image, int selImage, wxTreeItemData* data)
+{
+wxTreeItemId id = wxTreeCtrl::DoInsertItem(parent, pos, text, image, selImage, data);
+IndexItem(id);
+return id;
+}
+
+wxTreeItemId MyTreeCtrl::DoInsertAfter(const wxTreeItemId& parent, const wxTreeItemId& idPrevious, const wxString& text, int image, int selImage, wxTreeItemData* data)
+{
+wxTreeItemId id = wxTreeCtrl::DoInsertAfter(parent, idPrevious, text, image, selImage, data);
+IndexItem(id);
+return id;
+}
+
 #if !defined(__WXGTK3__)
 void MyTreeCtrl::OnEraseBackground(wxEraseEvent& event)  // This is only needed in gtk2 under kde and brain-dead theme-manager, but can cause a blackout in some gtk3(themes?)
 {
@@ -1703,6 +1808,7 @@ BEGIN_EVENT_TABLE(MyTreeCtrl,wxTreeCtrl)
     EVT_IDLE(MyTreeCtrl::OnIdle)
     EVT_SIZE(MyTreeCtrl::OnSize)
     EVT_SCROLLWIN(MyTreeCtrl::OnScroll)
+    EVT_TREE_DELETE_ITEM(wxID_ANY, MyTreeCtrl::OnDeleteItem)
 END_EVENT_TABLE()
 
 //---------------------------------------------------------------------------
@@ -1845,10 +1951,26 @@ PreviewPopup::PreviewPopup(wxWindow* parent) : wxPopupTransientWindow(parent), m
 wxString filepath = PreviewManager::GetFilepath();
 wxCHECK_RET(!filepath.empty(), wxT("PreviewManager has an empty filepath"));
 
-if (IsText(filepath)) // Try for text first: *.c files seem to return true from wxImage::CanRead :/
-  { DisplayText(filepath); m_CanDisplay = true; }
- else if (IsImage(filepath))
-  { DisplayImage(filepath); m_CanDisplay = true; }
+SniffedType sniffed = FileClassifier::Get().Classify(filepath); // Look at the content, which is cached per inode so hovering again costs nothing
+switch(sniffed.kind)
+  { case sk_text: case sk_script:
+                  DisplayText(filepath); m_CanDisplay = true; break;
+    case sk_image:
+                  DisplayImage(filepath); m_CanDisplay = true; break;
+    case sk_svg:  if (filepath.Right(4) == ".svg") DisplayImage(filepath); // DisplayImage() only uses librsvg for a *.svg
+                   else DisplayText(filepath);
+                  m_CanDisplay = true; break;
+    case sk_data: if (IsImage(filepath))       // Something we don't know, though wxImage might e.g. a .tga, which has no magic number
+                    { DisplayImage(filepath); m_CanDisplay = true; }
+                  break;
+    case sk_unknown: case sk_empty:            // We couldn't read it, or there was nothing to read, so fall back to the name
+                  if (IsText(filepath)) // Try for text first: *.c files seem to return true from wxImage::CanRead :/
+                    { DisplayText(filepath); m_CanDisplay = true; }
+                   else if (IsImage(filepath))
+                    { DisplayImage(filepath); m_CanDisplay = true; }
+                  break;
+     default:     break;                       // Executables and archives have nothing to preview
+  }
 
 Bind(wxEVT_LEAVE_WINDOW, &PreviewPopup::OnLeavingWindow, this);
 }
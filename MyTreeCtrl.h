@@ -16,6 +16,7 @@
 #include "wx/imaglist.h"
 #include "wx/treectrl.h"
 #include "wx/listctrl.h" // for wxListEvent
+#include "wx/hashmap.h"
 
 
 #include "Externs.h"  
@@ -291,6 +292,9 @@ protected:
 void Notify(){ PreviewManager::OnTimer(); }
 };
 
+WX_DECLARE_STRING_HASH_MAP(wxTreeItemId, PathItemHash);    // A path, and the tree item that displays it
+WX_DECLARE_VOIDPTR_HASH_MAP(wxString, ItemPathHash);        // An item's id, and the path that it's indexed under
+
 //---------------------------------------------------------------------------
 class MyTreeCtrl : public wxTreeCtrl  
 {
@@ -319,6 +323,15 @@ void AdjustMyScrollbars();
 void OnMouseMovement(wxMouseEvent& event);
 
 void CallCalculateLineHeight() { CalculateLineHeight(); } // Relay to generic treectrl protected function
+
+wxTreeItemId FindItemForPath(const wxString& path) const; // Looks up path in the index, so doesn't have to walk the tree
+int GetChildIndex(const wxTreeItemId& id) const;         // id's position among its siblings, or wxNOT_FOUND for the root
+void IndexItem(const wxTreeItemId& id);                 // (Re)index id under its wxDirItemData's current path. Needed whenever that path is altered in place
+#ifdef __WXDEBUG__
+  void CheckPathIndex() const;                          // Asserts that the index and the tree agree. It walks the whole tree, so is for debug builds only
+#endif
+virtual wxTreeItemId AddRoot(const wxString& text, int image = -1, int selImage = -1, wxTreeItemData* data = NULL);
+virtual void SetItemData(const wxTreeItemId& item, wxTreeItemData* data);
 #if wxVERSION_NUMBER > 3102
   virtual void Expand(const wxTreeItemId& item) wxOVERRIDE; // Needed in wx3.2 as otherwise non-fulltree dirview roots don't get children added. See wx git a6b92cb313 and https://trac.wxwidgets.org/ticket/13886
 #endif
@@ -344,12 +357,22 @@ void OnPaint(wxPaintEvent& event);
 void OnIdle(wxIdleEvent& event);
 void OnSize(wxSizeEvent& event);                        // Keeps the headerwindows in step with the treectrl colums
 void OnScroll(wxScrollWinEvent& event);                 // Keeps the headerwindows in step with the treectrl colums
+void OnDeleteItem(wxTreeEvent& event);                  // Sent for each item, including the descendants of a deleted one, so keeps the index in step
+void UnindexItem(const wxTreeItemId& id);
+#ifdef __WXDEBUG__
+  size_t CheckPathIndexBranch(const wxTreeItemId& id) const; // Returns how many items in the branch are indexed
+#endif
+  // All the ways of adding an item end up in one of these, so they're where new items get indexed
+virtual wxTreeItemId DoInsertItem(const wxTreeItemId& parent, size_t pos, const wxString& text, int image, int selImage, wxTreeItemData* data);
+virtual wxTreeItemId DoInsertAfter(const wxTreeItemId& parent, const wxTreeItemId& idPrevious, const wxString& text, int image = -1, int selImage = -1, wxTreeItemData* data = NULL);
 
 wxColour Col0, Col1;                                    // Used when drawing a fileview in stripes
 bool IgnoreRtUp;
 bool dragging;
 wxPoint startpt;                                        // Holds the initial position of a drag-event, so we can delay starting too soon
 MyGenericDirCtrl* parent;
+PathItemHash m_PathIndex;
+ItemPathHash m_ItemIndex;                               // The reverse, so that an item can be unindexed even after its path changed, or its data was removed
 
     DECLARE_EVENT_TABLE()
 };
@@ -1,20 +1,19 @@
 /////////////////////////////////////////////////////////////////////////////
 // Name:        Otherstreams.cpp
-// Purpose:     xz and lmza1 archive streams
+// Purpose:     xz, lmza1, zstd and lz4 archive streams
 // Part of:     4Pane
 // Author:      David Hart
 // Copyright:   (c) 2019 David Hart
 // Licence:     GPL v3
 /////////////////////////////////////////////////////////////////////////////
 
-#ifndef NO_LZMA_ARCHIVE_STREAMS
-
 #include "wx/wxprec.h"
 
 #include "wx/wx.h"
 #include "wx/utils.h"
 #include "wx/intl.h"
 #include "wx/log.h"
+#include "wx/thread.h"
 
 #if wxUSE_STREAMS
 
@@ -22,6 +21,8 @@
 #include "MyFrame.h"
 #include "Otherstreams.h"
 
+#ifndef NO_LZMA_ARCHIVE_STREAMS
+
 XzInputStream::XzInputStream(wxInputStream& Stream, bool use_lzma1 /*= false*/) :  wxFilterInputStream(Stream), m_nBufferPos(0)
 {
 wxCHECK_RET(LIBLZMA_LOADED, wxT("We shouldn't be here if liblzma isn't loaded!"));
@@ -307,5 +308,295 @@ XzClassFactory::GetProtocols(wxStreamProtocolType type) const
     }
 }
 
-#endif  // wxUSE_STREAMS
 #endif  // ndef NO_LZMA_ARCHIVE_STREAMS
+
+//-----------------------------------------------------------------------------------------
+
+ZstdInputStream::ZstdInputStream(wxInputStream& Stream) :  wxFilterInputStream(Stream), m_zStream(NULL), m_midframe(false)
+{
+m_in.src = m_pBuffer; m_in.size = m_in.pos = 0;
+wxCHECK_RET(LIBZSTD_LOADED, wxT("We shouldn't be here if libzstd isn't loaded!"));
+
+ZSTD_createDStream = (dl_ZSTD_createDStream)(wxGetApp().GetLibzstd()->GetSymbol(wxT("ZSTD_createDStream")));
+if (!ZSTD_createDStream) { wxLogWarning(wxT("Failed to load symbol 'ZSTD_createDStream'")); return; }
+ZSTD_freeDStream = (dl_ZSTD_freeDStream)(wxGetApp().GetLibzstd()->GetSymbol(wxT("ZSTD_freeDStream")));
+if (!ZSTD_freeDStream) { wxLogWarning(wxT("Failed to load symbol 'ZSTD_freeDStream'")); return; }
+ZSTD_decompressStream = (dl_ZSTD_decompressStream)(wxGetApp().GetLibzstd()->GetSymbol(wxT("ZSTD_decompressStream")));
+if (!ZSTD_decompressStream) { wxLogWarning(wxT("Failed to load symbol 'ZSTD_decompressStream'")); return; }
+ZSTD_isError = (dl_ZSTD_isError)(wxGetApp().GetLibzstd()->GetSymbol(wxT("ZSTD_isError")));
+if (!ZSTD_isError) { wxLogWarning(wxT("Failed to load symbol 'ZSTD_isError'")); return; }
+
+m_zStream = ZSTD_createDStream();     // A new DStream is ready to use; it doesn't need ZSTD_initDStream()
+if (!m_zStream)
+  wxLogError(wxT("Could not initialize zstd decompression engine!"));
+}
+
+ZstdInputStream::~ZstdInputStream()
+{
+if (m_zStream) ZSTD_freeDStream(m_zStream);
+}
+
+size_t ZstdInputStream::OnSysRead(void* buffer, size_t bufsize)
+{
+if (!m_zStream)
+  m_lasterror = wxSTREAM_READ_ERROR;
+if (!IsOk() || !bufsize)
+  return 0;
+
+ZstdOutBuffer out = { buffer, bufsize, 0 };
+while (out.pos < out.size)
+  { if (m_in.pos == m_in.size)        // The decoder flushes all it can before using up its input, so it's safe to refill here
+      { m_in.size = m_in.pos = 0;
+        if (m_parent_i_stream->IsOk())
+          m_in.size = m_parent_i_stream->Read(m_pBuffer, ZSTD_STREAM_BUF_MAX).LastRead();
+        if (!m_in.size)
+          { if (m_midframe)
+              { wxLogError(_("Decompressing a zstd stream failed: it's truncated"));
+                m_lasterror = wxSTREAM_READ_ERROR;
+              }
+             else m_lasterror = wxSTREAM_EOF;
+            break;
+          }
+      }
+
+    size_t ret = ZSTD_decompressStream(m_zStream, &out, &m_in);  // This copes with concatenated frames by itself
+    if (ZSTD_isError(ret))
+      { wxLogError(_("Decompressing a zstd stream failed"));
+        m_lasterror = wxSTREAM_READ_ERROR;
+        break;
+      }
+    m_midframe = (ret != 0);
+  }
+
+return out.pos;
+}
+
+ZstdOutputStream::ZstdOutputStream(wxOutputStream& Stream, int level /*= 3*/) :  wxFilterOutputStream(Stream), m_zStream(NULL)
+{
+wxCHECK_RET(LIBZSTD_LOADED, wxT("We shouldn't be here if libzstd isn't loaded!"));
+
+ZSTD_createCCtx = (dl_ZSTD_createCCtx)(wxGetApp().GetLibzstd()->GetSymbol(wxT("ZSTD_createCCtx")));
+if (!ZSTD_createCCtx) { wxLogWarning(wxT("Failed to load symbol 'ZSTD_createCCtx'")); return; }
+ZSTD_freeCCtx = (dl_ZSTD_freeCCtx)(wxGetApp().GetLibzstd()->GetSymbol(wxT("ZSTD_freeCCtx")));
+if (!ZSTD_freeCCtx) { wxLogWarning(wxT("Failed to load symbol 'ZSTD_freeCCtx'")); return; }
+ZSTD_CCtx_setParameter = (dl_ZSTD_CCtx_setParameter)(wxGetApp().GetLibzstd()->GetSymbol(wxT("ZSTD_CCtx_setParameter")));
+if (!ZSTD_CCtx_setParameter) { wxLogWarning(wxT("Failed to load symbol 'ZSTD_CCtx_setParameter' (zstd < 1.4?)")); return; }
+ZSTD_compressStream2 = (dl_ZSTD_compressStream2)(wxGetApp().GetLibzstd()->GetSymbol(wxT("ZSTD_compressStream2")));
+if (!ZSTD_compressStream2) { wxLogWarning(wxT("Failed to load symbol 'ZSTD_compressStream2'")); return; }
+ZSTD_isError = (dl_ZSTD_isError)(wxGetApp().GetLibzstd()->GetSymbol(wxT("ZSTD_isError")));
+if (!ZSTD_isError) { wxLogWarning(wxT("Failed to load symbol 'ZSTD_isError'")); return; }
+
+m_zStream = ZSTD_createCCtx();
+if (!m_zStream || ZSTD_isError(ZSTD_CCtx_setParameter(m_zStream, zstd_c_compressionLevel, level)))
+  { wxLogError(wxT("Could not initialize zstd compression engine!"));
+    if (m_zStream) ZSTD_freeCCtx(m_zStream);
+    m_zStream = NULL; return;
+  }
+
+ // Compress on worker threads, one per cpu. This fails harmlessly if libzstd was built without thread support; we just use this thread
+int cpus = wxThread::GetCPUCount();
+if (cpus > 1)
+  ZSTD_CCtx_setParameter(m_zStream, zstd_c_nbWorkers, cpus);
+}
+
+ZstdOutputStream::~ZstdOutputStream()
+{
+if (m_zStream) ZSTD_freeCCtx(m_zStream);
+}
+
+bool ZstdOutputStream::Compress(ZstdInBuffer& in, int directive)
+{
+size_t remaining;
+do
+  { ZstdOutBuffer out = { m_pBuffer, ZSTD_STREAM_BUF_MAX, 0 };
+    remaining = ZSTD_compressStream2(m_zStream, &out, &in, directive);
+    if (ZSTD_isError(remaining))
+      { m_lasterror = wxSTREAM_WRITE_ERROR;
+        wxLogError(_("zstd compression failure"));
+        return false;
+      }
+
+    m_parent_o_stream->Write(m_pBuffer, out.pos);
+    if (m_parent_o_stream->LastWrite() != out.pos) 
+      { m_lasterror = wxSTREAM_WRITE_ERROR;
+        wxLogDebug(wxT("ZstdOutputStream: Error writing to underlying stream"));
+        return false;
+      }
+  }
+  while ((directive == zstd_e_end) ? (remaining != 0) : (in.pos < in.size));  // When ending, 'remaining' is what's still to be flushed
+
+return true;
+}
+
+size_t ZstdOutputStream::OnSysWrite(const void* buffer, size_t bufsize)
+{
+if (!m_zStream)
+  m_lasterror = wxSTREAM_WRITE_ERROR;
+if (!IsOk() || !bufsize)
+  return 0;
+
+ZstdInBuffer in = { buffer, bufsize, 0 };
+Compress(in, zstd_e_continue);
+return in.pos;
+}
+
+bool ZstdOutputStream::Close() // Flushes any remaining compressed data, and writes the frame epilogue
+{
+if (!m_zStream)
+  m_lasterror = wxSTREAM_WRITE_ERROR;
+if (!IsOk())
+  return false;
+
+ZstdInBuffer in = { NULL, 0, 0 };
+Compress(in, zstd_e_end);
+
+return wxFilterOutputStream::Close() && IsOk();
+}
+
+//-----------------------------------------------------------------------------------------
+
+Lz4InputStream::Lz4InputStream(wxInputStream& Stream) :  wxFilterInputStream(Stream), m_lz4Stream(NULL), m_nInPos(0), m_nInLen(0), m_pending(false), m_midframe(false)
+{
+wxCHECK_RET(LIBLZ4_LOADED, wxT("We shouldn't be here if liblz4 isn't loaded!"));
+
+LZ4F_createDecompressionContext = (dl_LZ4F_createDecompressionContext)(wxGetApp().GetLiblz4()->GetSymbol(wxT("LZ4F_createDecompressionContext")));
+if (!LZ4F_createDecompressionContext) { wxLogWarning(wxT("Failed to load symbol 'LZ4F_createDecompressionContext'")); return; }
+LZ4F_freeDecompressionContext = (dl_LZ4F_freeDecompressionContext)(wxGetApp().GetLiblz4()->GetSymbol(wxT("LZ4F_freeDecompressionContext")));
+if (!LZ4F_freeDecompressionContext) { wxLogWarning(wxT("Failed to load symbol 'LZ4F_freeDecompressionContext'")); return; }
+LZ4F_decompress = (dl_LZ4F_decompress)(wxGetApp().GetLiblz4()->GetSymbol(wxT("LZ4F_decompress")));
+if (!LZ4F_decompress) { wxLogWarning(wxT("Failed to load symbol 'LZ4F_decompress'")); return; }
+LZ4F_isError = (dl_LZ4F_isError)(wxGetApp().GetLiblz4()->GetSymbol(wxT("LZ4F_isError")));
+if (!LZ4F_isError) { wxLogWarning(wxT("Failed to load symbol 'LZ4F_isError'")); return; }
+
+if (LZ4F_isError(LZ4F_createDecompressionContext(&m_lz4Stream, lz4f_version)))
+  { m_lz4Stream = NULL;
+    wxLogError(wxT("Could not initialize lz4 decompression engine!"));
+  }
+}
+
+Lz4InputStream::~Lz4InputStream()
+{
+if (m_lz4Stream) LZ4F_freeDecompressionContext(m_lz4Stream);
+}
+
+size_t Lz4InputStream::OnSysRead(void* buffer, size_t bufsize)
+{
+if (!m_lz4Stream)
+  m_lasterror = wxSTREAM_READ_ERROR;
+if (!IsOk() || !bufsize)
+  return 0;
+
+size_t total = 0;
+while (total < bufsize)
+  { if (m_nInPos == m_nInLen && !m_pending)
+      { m_nInLen = m_nInPos = 0;
+        if (m_parent_i_stream->IsOk())
+          m_nInLen = m_parent_i_stream->Read(m_pBuffer, LZ4_STREAM_BUF_MAX).LastRead();
+        if (!m_nInLen)
+          { if (m_midframe)
+              { wxLogError(_("Decompressing a lz4 stream failed: it's truncated"));
+                m_lasterror = wxSTREAM_READ_ERROR;
+              }
+             else m_lasterror = wxSTREAM_EOF;
+            break;
+          }
+      }
+
+    size_t dstsize = bufsize - total, srcsize = m_nInLen - m_nInPos;
+    size_t ret = LZ4F_decompress(m_lz4Stream, (char*)buffer + total, &dstsize, m_pBuffer + m_nInPos, &srcsize, NULL);
+    if (LZ4F_isError(ret))
+      { wxLogError(_("Decompressing a lz4 stream failed"));
+        m_lasterror = wxSTREAM_READ_ERROR;
+        break;
+      }
+    m_pending = (dstsize && dstsize == bufsize - total);  // The output filled, so there may be more to come without any more input
+    m_midframe = (ret != 0);                              // 0 means a frame just ended; a following one will be started automatically
+    m_nInPos += srcsize; total += dstsize;
+  }
+
+return total;
+}
+
+Lz4OutputStream::Lz4OutputStream(wxOutputStream& Stream) :  wxFilterOutputStream(Stream), m_lz4Stream(NULL)
+{
+wxCHECK_RET(LIBLZ4_LOADED, wxT("We shouldn't be here if liblz4 isn't loaded!"));
+
+LZ4F_createCompressionContext = (dl_LZ4F_createCompressionContext)(wxGetApp().GetLiblz4()->GetSymbol(wxT("LZ4F_createCompressionContext")));
+if (!LZ4F_createCompressionContext) { wxLogWarning(wxT("Failed to load symbol 'LZ4F_createCompressionContext'")); return; }
+LZ4F_freeCompressionContext = (dl_LZ4F_freeCompressionContext)(wxGetApp().GetLiblz4()->GetSymbol(wxT("LZ4F_freeCompressionContext")));
+if (!LZ4F_freeCompressionContext) { wxLogWarning(wxT("Failed to load symbol 'LZ4F_freeCompressionContext'")); return; }
+LZ4F_compressBound = (dl_LZ4F_compressBound)(wxGetApp().GetLiblz4()->GetSymbol(wxT("LZ4F_compressBound")));
+if (!LZ4F_compressBound) { wxLogWarning(wxT("Failed to load symbol 'LZ4F_compressBound'")); return; }
+LZ4F_compressBegin = (dl_LZ4F_compressBegin)(wxGetApp().GetLiblz4()->GetSymbol(wxT("LZ4F_compressBegin")));
+if (!LZ4F_compressBegin) { wxLogWarning(wxT("Failed to load symbol 'LZ4F_compressBegin'")); return; }
+LZ4F_compressUpdate = (dl_LZ4F_compressUpdate)(wxGetApp().GetLiblz4()->GetSymbol(wxT("LZ4F_compressUpdate")));
+if (!LZ4F_compressUpdate) { wxLogWarning(wxT("Failed to load symbol 'LZ4F_compressUpdate'")); return; }
+LZ4F_compressEnd = (dl_LZ4F_compressEnd)(wxGetApp().GetLiblz4()->GetSymbol(wxT("LZ4F_compressEnd")));
+if (!LZ4F_compressEnd) { wxLogWarning(wxT("Failed to load symbol 'LZ4F_compressEnd'")); return; }
+LZ4F_isError = (dl_LZ4F_isError)(wxGetApp().GetLiblz4()->GetSymbol(wxT("LZ4F_isError")));
+if (!LZ4F_isError) { wxLogWarning(wxT("Failed to load symbol 'LZ4F_isError'")); return; }
+
+if (LZ4F_isError(LZ4F_createCompressionContext(&m_lz4Stream, lz4f_version)))
+  { m_lz4Stream = NULL;
+    wxLogError(wxT("Could not initialize lz4 compression engine!"));
+    return;
+  }
+
+m_outbuf.SetBufSize(LZ4F_compressBound(LZ4_STREAM_BUF_MAX, NULL));  // NULL preferences means the defaults: 64kB blocks, fast compression
+if (!WriteOut(LZ4F_compressBegin(m_lz4Stream, m_outbuf.GetData(), m_outbuf.GetBufSize(), NULL)))  // The frame header
+  { LZ4F_freeCompressionContext(m_lz4Stream); m_lz4Stream = NULL; }
+}
+
+Lz4OutputStream::~Lz4OutputStream()
+{
+if (m_lz4Stream) LZ4F_freeCompressionContext(m_lz4Stream);
+}
+
+bool Lz4OutputStream::WriteOut(size_t ret)
+{
+if (LZ4F_isError(ret))
+  { m_lasterror = wxSTREAM_WRITE_ERROR;
+    wxLogError(_("lz4 compression failure"));
+    return false;
+  }
+
+m_parent_o_stream->Write(m_outbuf.GetData(), ret);
+if (m_parent_o_stream->LastWrite() != ret) 
+  { m_lasterror = wxSTREAM_WRITE_ERROR;
+    wxLogDebug(wxT("Lz4OutputStream: Error writing to underlying stream"));
+    return false;
+  }
+return true;
+}
+
+size_t Lz4OutputStream::OnSysWrite(const void* buffer, size_t bufsize)
+{
+if (!m_lz4Stream)
+  m_lasterror = wxSTREAM_WRITE_ERROR;
+if (!IsOk() || !bufsize)
+  return 0;
+
+size_t done = 0;
+while (done < bufsize)                // Feed it in chunks that m_outbuf is guaranteed to be big enough for
+  { size_t chunk = wxMin(bufsize - done, (size_t)LZ4_STREAM_BUF_MAX);
+    if (!WriteOut(LZ4F_compressUpdate(m_lz4Stream, m_outbuf.GetData(), m_outbuf.GetBufSize(), (const char*)buffer + done, chunk, NULL)))
+      break;
+    done += chunk;
+  }
+
+return done;
+}
+
+bool Lz4OutputStream::Close() // Flushes any remaining compressed data, and writes the frame footer
+{
+if (!m_lz4Stream)
+  m_lasterror = wxSTREAM_WRITE_ERROR;
+if (!IsOk())
+  return false;
+
+WriteOut(LZ4F_compressEnd(m_lz4Stream, m_outbuf.GetData(), m_outbuf.GetBufSize(), NULL));
+
+return wxFilterOutputStream::Close() && IsOk();
+}
+
+#endif  // wxUSE_STREAMS
@@ -1,6 +1,6 @@
 /////////////////////////////////////////////////////////////////////////////
 // Name:        Otherstreams.h
-// Purpose:     xz and lmza1 archive streams
+// Purpose:     xz, lmza1, zstd and lz4 archive streams
 // Part of:     4Pane
 // Author:      David Hart
 // Copyright:   (c) 2016 David Hart
@@ -10,20 +10,22 @@
 #ifndef _OTHERSTREAMS_H__
 #define _OTHERSTREAMS_H__
 
-#ifndef NO_LZMA_ARCHIVE_STREAMS // Allows compilation where liblzma-dev/xz-libs xz-devel is unavailable
-
 #include "wx/defs.h"
 
 #if wxUSE_STREAMS
 
 #include "wx/stream.h"
-#include <lzma.h>
+#include "wx/buffer.h"
 
 #ifndef IN_BUF_MAX
   #define IN_BUF_MAX	4096
   #define OUT_BUF_MAX	4096
 #endif
 
+#ifndef NO_LZMA_ARCHIVE_STREAMS // Allows compilation where liblzma-dev/xz-libs xz-devel is unavailable
+
+#include <lzma.h>
+
 typedef lzma_ret  (* dl_lzma_stream_decoder) (lzma_stream*, uint64_t, uint32_t);
 typedef lzma_ret  (* dl_lzma_alone_decoder)  (lzma_stream*, uint64_t);
 typedef lzma_ret  (* dl_lzma_code)           (lzma_stream*, lzma_action);
@@ -133,6 +135,129 @@ public:
 };
 
 
-#endif // wxUSE_STREAMS
 #endif // ndef NO_LZMA_ARCHIVE_STREAMS
+
+// zstd and lz4 streams. Both libs are dlopen()ed, so to avoid needing their -dev packages just to build, here are the few bits of their
+// (long stable) APIs that we use: ZSTD_inBuffer, ZSTD_outBuffer, the ZSTD_c_* and ZSTD_e_* values, and LZ4F_VERSION
+#define ZSTD_STREAM_BUF_MAX  131072
+#define LZ4_STREAM_BUF_MAX   65536
+
+struct ZstdInBuffer  { const void* src; size_t size; size_t pos; };
+struct ZstdOutBuffer { void* dst; size_t size; size_t pos; };
+enum { zstd_c_compressionLevel = 100, zstd_c_nbWorkers = 400 };
+enum { zstd_e_continue = 0, zstd_e_end = 2 };
+enum { lz4f_version = 100 };
+
+typedef void*    (* dl_ZSTD_createDStream)     ();
+typedef size_t   (* dl_ZSTD_freeDStream)       (void*);
+typedef size_t   (* dl_ZSTD_decompressStream)  (void*, ZstdOutBuffer*, ZstdInBuffer*);
+typedef void*    (* dl_ZSTD_createCCtx)        ();
+typedef size_t   (* dl_ZSTD_freeCCtx)          (void*);
+typedef size_t   (* dl_ZSTD_CCtx_setParameter) (void*, int, int);
+typedef size_t   (* dl_ZSTD_compressStream2)   (void*, ZstdOutBuffer*, ZstdInBuffer*, int);
+typedef unsigned (* dl_ZSTD_isError)           (size_t);
+
+typedef size_t   (* dl_LZ4F_createDecompressionContext) (void**, unsigned);
+typedef size_t   (* dl_LZ4F_freeDecompressionContext)   (void*);
+typedef size_t   (* dl_LZ4F_decompress)     (void*, void*, size_t*, const void*, size_t*, const void*);
+typedef size_t   (* dl_LZ4F_createCompressionContext)   (void**, unsigned);
+typedef size_t   (* dl_LZ4F_freeCompressionContext)     (void*);
+typedef size_t   (* dl_LZ4F_compressBound)  (size_t, const void*);
+typedef size_t   (* dl_LZ4F_compressBegin)  (void*, void*, size_t, const void*);
+typedef size_t   (* dl_LZ4F_compressUpdate) (void*, void*, size_t, const void*, size_t, const void*);
+typedef size_t   (* dl_LZ4F_compressEnd)    (void*, void*, size_t, const void*);
+typedef unsigned (* dl_LZ4F_isError)        (size_t);
+
+class ZstdInputStream : public wxFilterInputStream
+{
+public:
+  ZstdInputStream(wxInputStream& stream);
+  virtual ~ZstdInputStream();
+
+protected:
+  virtual size_t OnSysRead(void *buffer, size_t bufsize);
+
+  // dlopen()ed symbols
+  dl_ZSTD_createDStream    ZSTD_createDStream;
+  dl_ZSTD_freeDStream      ZSTD_freeDStream;
+  dl_ZSTD_decompressStream ZSTD_decompressStream;
+  dl_ZSTD_isError          ZSTD_isError;
+
+  void*   m_zStream;
+  ZstdInBuffer m_in;
+  bool    m_midframe;                 // True if the last frame we decompressed isn't finished, so running out of input would mean truncation
+  unsigned char m_pBuffer[ZSTD_STREAM_BUF_MAX];
+};
+
+class ZstdOutputStream : public wxFilterOutputStream
+{
+public:
+  ZstdOutputStream(wxOutputStream& stream, int level = 3);  // 3 is zstd's own default, and still much faster than gzip
+  virtual ~ZstdOutputStream();
+
+  virtual bool  Close();
+
+protected:
+  virtual size_t OnSysWrite(const void *buffer, size_t bufsize);
+  bool Compress(ZstdInBuffer& in, int directive);            // Feed 'in' to the compressor, writing whatever it produces to the parent stream
+
+  // dlopen()ed symbols
+  dl_ZSTD_createCCtx        ZSTD_createCCtx;
+  dl_ZSTD_freeCCtx          ZSTD_freeCCtx;
+  dl_ZSTD_CCtx_setParameter ZSTD_CCtx_setParameter;
+  dl_ZSTD_compressStream2   ZSTD_compressStream2;
+  dl_ZSTD_isError           ZSTD_isError;
+
+  void*   m_zStream;
+  char m_pBuffer[ZSTD_STREAM_BUF_MAX];
+};
+
+class Lz4InputStream : public wxFilterInputStream
+{
+public:
+  Lz4InputStream(wxInputStream& stream);
+  virtual ~Lz4InputStream();
+
+protected:
+  virtual size_t OnSysRead(void *buffer, size_t bufsize);
+
+  // dlopen()ed symbols
+  dl_LZ4F_createDecompressionContext LZ4F_createDecompressionContext;
+  dl_LZ4F_freeDecompressionContext   LZ4F_freeDecompressionContext;
+  dl_LZ4F_decompress                 LZ4F_decompress;
+  dl_LZ4F_isError                    LZ4F_isError;
+
+  void*   m_lz4Stream;
+  size_t  m_nInPos, m_nInLen;         // The unconsumed part of m_pBuffer
+  bool    m_pending;                  // The last call filled the output, so the decoder may still be holding decompressed data
+  bool    m_midframe;
+  unsigned char m_pBuffer[LZ4_STREAM_BUF_MAX];
+};
+
+class Lz4OutputStream : public wxFilterOutputStream
+{
+public:
+  Lz4OutputStream(wxOutputStream& stream);
+  virtual ~Lz4OutputStream();
+
+  virtual bool  Close();
+
+protected:
+  virtual size_t OnSysWrite(const void *buffer, size_t bufsize);
+  bool WriteOut(size_t ret);          // Check the result of an LZ4F_compress* call and, if ok, write that many bytes of m_outbuf to the parent
+
+  // dlopen()ed symbols
+  dl_LZ4F_createCompressionContext   LZ4F_createCompressionContext;
+  dl_LZ4F_freeCompressionContext     LZ4F_freeCompressionContext;
+  dl_LZ4F_compressBound              LZ4F_compressBound;
+  dl_LZ4F_compressBegin              LZ4F_compressBegin;
+  dl_LZ4F_compressUpdate             LZ4F_compressUpdate;
+  dl_LZ4F_compressEnd                LZ4F_compressEnd;
+  dl_LZ4F_isError                    LZ4F_isError;
+
+  void*   m_lz4Stream;
+  wxMemoryBuffer m_outbuf;            // Big enough for the worst case of compressing LZ4_STREAM_BUF_MAX bytes
+};
+
+#endif // wxUSE_STREAMS
 #endif // _OTHERSTREAMS_H__
@@ -150,10 +150,71 @@ bool UnRedoManager::Supercluster=false;
 size_t UnRedoManager::currentSupercluster = (uint)-1;
 UnRedoImplementer UnRedoManager::m_implementer;
 MyFrame* UnRedoManager::frame;
+UnRedoLog UnRedoManager::m_log;
+bool UnRedoManager::m_Restored = true;
+size_t UnRedoManager::m_LoggedUndos = 0;
+size_t UnRedoManager::m_LoggedRedos = 0;
+
+UnRedoManager::UnRedoManager()
+{
+UnRedoArray.Alloc(MAX_NUMBER_OF_UNDOS);
+
+if (PERSISTENT_UNDO && !DirectoryForDeletions::GetUndoLogName().IsEmpty())
+  { m_Restored = !m_log.Open(DirectoryForDeletions::GetUndoLogName()); // If we got the log, its contents will be loaded when first needed
+    if (!m_Restored && !m_log.Peek(m_LoggedUndos, m_LoggedRedos))
+      m_LoggedUndos = m_LoggedRedos = 0;
+  }
+}
+
+UnRedoManager::~UnRedoManager()
+{
+if (m_log.IsOpen())
+  { if (!PERSISTENT_UNDO)                            // The user switched it off during this session, so the log is now just clutter
+      { m_log.Close(); wxRemoveFile(DirectoryForDeletions::GetUndoLogName()); }
+     else if (m_Restored)                           // If the previous history was never even loaded, leave both it and its deletions untouched
+      { m_log.Compact(UnRedoArray, m_count);
+                  // Tell DirectoryForDeletions which of its subdirs are still referenced by an unredo. The rest can be purged as usual
+        wxArrayString paths; std::set<wxString> subdirs;
+        for (size_t n=0; n < UnRedoArray.GetCount(); ++n)
+          UnRedoArray[n]->AddReferencedPaths(paths);
+        wxString can(DirectoryForDeletions::GetDeletedName()), rest;
+        for (size_t n=0; n < paths.GetCount(); ++n)
+          if (paths[n].StartsWith(can, &rest) && !rest.IsEmpty())
+            subdirs.insert(rest.BeforeFirst(wxFILE_SEP_PATH));
+        wxArrayString keep;
+        for (std::set<wxString>::const_iterator iter = subdirs.begin(); iter != subdirs.end(); ++iter)
+          keep.Add(*iter);
+        DirectoryForDeletions::KeepOnlyDeletions(keep);
+      }
+    m_log.Close();
+  }
+
+for (size_t n = UnRedoArray.GetCount(); n > 0; --n) // Don't use ClearUnRedoArray(); we don't want to log a Clear
+  delete UnRedoArray[n-1];
+UnRedoArray.Clear(); m_count = 0;
+}
+
+//static
+void UnRedoManager::Restore()
+{
+m_Restored = true;
+if (!m_log.IsOpen()) return;
+
+size_t nextcluster(0);
+if (m_log.Replay(UnRedoArray, m_count, nextcluster))
+  cluster = wxMax(cluster, nextcluster);      // Don't reuse a restored cluster's number, or a new action would be undone along with it
+
+m_log.Compact(UnRedoArray, m_count);          // Start afresh, without the superseded records or any part-written one
+}
 
 //static
 void UnRedoManager::ClearUnRedoArray()
 {
+if (m_log.IsOpen())
+  { m_Restored = true;                              // There's no point in loading the log just to discard it
+    m_log.LogClear(); m_log.Flush();
+  }
+
 int arrcount = (int)UnRedoArray.GetCount();         // Get the real size of array (can't use count, as that is altered by undos)
 for (int n = arrcount;  n > 0; --n)                 // Delete all outstanding unredo objects pointed to by array
   { UnRedo* item = UnRedoArray[n-1]; delete item; 
@@ -177,6 +238,7 @@ return true;
 //static
 void UnRedoManager::StartCluster() // Start a new UnRedoManager cluster.  The cluster will autoincrement with each AddEntry
 {
+EnsureRestored();                  // Otherwise a restored cluster might later be given the same number
 /*if (ClusterIsOpen) 
   { wxLogError(_("Oops, we're trying to open a new cluster when one is already open!?")); } // which should never ever happen*/
 
@@ -193,6 +255,12 @@ void UnRedoManager::EndCluster()  // Closes the currently-open cluster
 
 ClusterIsOpen = false;        // There isn't really anything to do, except reset the flag
 frame->UpdateTrees();         //   and release the Updating of the trees
+
+if (m_log.IsOpen())
+  { m_log.Flush();            // Write the whole cluster's entries to the log at once
+    if (m_log.NeedsCompacting(UnRedoArray.GetCount()))
+      m_log.Compact(UnRedoArray, m_count);
+  }
 }
 
 //static
@@ -227,8 +295,12 @@ if (!ClusterIsOpen) { //wxLogError(_("Oops, we're trying to add to a cluster whe
                     }
 
 if (newentry==NULL) return false;                 // Some implausible problem occurred
+EnsureRestored();
 if (m_count == MAX_NUMBER_OF_UNDOS)                 // Check to see if too many entries.  It doesn't matter if count < arraysize, as then we'd be deleting later entries anyway
   { size_t oldcluster = UnRedoArray[0]->clusterno;  // Oops.  Do a FIFO by removing oldest cluster of entries
+    size_t dropping(0);
+    while (dropping < m_count && UnRedoArray[dropping]->clusterno==oldcluster) ++dropping;
+    m_log.LogDropFront(dropping);
     do
       { UnRedo* item = UnRedoArray[0]; 
         UnRedoArray.RemoveAt(0); --m_count;         // Remove its pointer from the bottom of the array, so shifting the others down
@@ -239,13 +311,15 @@ if (m_count == MAX_NUMBER_OF_UNDOS)                 // Check to see if too many
       // Check that there haven't already been some undos.  If so, adding another undo invalidates any redos, so delete them
 size_t arrno = UnRedoArray.GetCount();            // Get the real size of array
 if (m_count < arrno)                                // If it's bigger than count, there must be redundant entries
-  { for (int n = (int)arrno-1; n >= (int)m_count; --n)
+  { m_log.LogTruncate(m_count);
+    for (int n = (int)arrno-1; n >= (int)m_count; --n)
       { UnRedo* item = UnRedoArray[n]; delete item; UnRedoArray.RemoveAt(n); }  // Delete any entries >= count
   }                                               // This time we don't care about clusters: we must've been at a cluster start anyway, & we're deleting the rest
 
 UnRedoArray.Add(newentry);                        // Append new entry.  NB: Pointer.  It will need to be deleted in destructor when the app exits
 UnRedoArray[m_count]->clusterno = currentcluster;   // Tell the entry to which cluster it belongs
 UnRedoArray[m_count]->UndoPossible = true;          // Set the flag to say there's valid data for a future undo
+m_log.LogAdd(newentry);                             // It's actually written when the cluster ends
 
 ++m_count;                                          // Finally inc the count
 return true;  
@@ -292,6 +366,7 @@ for (size_t n=0; n < MAX_DROPDOWN_DISPLAY; n++)
 //static
 void UnRedoManager::OnUndoSidebar()    // Implements Undoing of multiple clusters
 {
+EnsureRestored();
 if (!m_count) return;
 
 wxString more(_("  ---- MORE ----  ")), previous(_("  -- PREVIOUS --  "));
@@ -345,6 +420,7 @@ do
 void UnRedoManager::UndoEntry(int clusters) // Undoes 'clusters' of clusters of stored actions
 {
 if (m_implementer.IsActive()) return;
+EnsureRestored();
 
   // We need to pass the unredos of each cluster separately to UnRedoImplementer as we must unredo a Move of foo, bar and baz together
   // otherwise a Redo of the move followed by e.g. a rename of foo is likely to break when foo is large: foo won't have finshed moving when the rename happens
@@ -369,7 +445,8 @@ for (int n=0; n < clusters; ++n)                // For every cluster-to-be-undon
   }
 
 if (clusterarr.GetCount())
-  { MyGenericDirCtrl::Clustering = true;
+  { m_log.LogPosition(m_count);
+    MyGenericDirCtrl::Clustering = true;
     m_implementer.DoUnredos(UnRedoArray, first, clusterarr, true);
   }
 }
@@ -377,6 +454,7 @@ if (clusterarr.GetCount())
 //static
 void UnRedoManager::OnRedoSidebar()    // Implements Redoing of multiple clusters
 {
+EnsureRestored();
 size_t arrno = UnRedoArray.GetCount();      // Get the size of the array
 if (arrno==m_count) return;                   // None to redo
 
@@ -432,6 +510,7 @@ do
 void UnRedoManager::RedoEntry(int clusters)   // Redoes 'clusters' of clusters of stored actions
 {
 if (m_implementer.IsActive()) return;
+EnsureRestored();
 
 size_t arraysize = UnRedoArray.GetCount();
 if (m_count >= arraysize)  return;            // If count < array size, there are items available to be redone.
@@ -458,7 +537,8 @@ for (int n=0; n < clusters; ++n)
   }
 
 if (clusterarr.GetCount())
-  { MyGenericDirCtrl::Clustering = true;
+  { m_log.LogPosition(m_count);
+    MyGenericDirCtrl::Clustering = true;
     m_implementer.DoUnredos(UnRedoArray, first, clusterarr, false);
   }
 }
@@ -489,13 +569,15 @@ wxCHECK_RET(count > 0, wxT("Passed an unredo with a zero count of items"));
 
 bool ThreadUsed(false); // This will be set if we actually use a thread below. It lets us start threads if any exist, or clean up if none was needed
 
-  // Before we start the loop, do a one-off sort out of the PasteThreadSuperBlock if this is a Move or Paste
+  // Before we start the loop, do a one-off sort out of the PasteThreadSuperBlock if this is a Move, Paste or Dup
 PasteThreadSuperBlock* tsb = NULL;
 UnRedo* ptr = (*m_UnRedoArray)[m_NextItem];
 if (dynamic_cast<UnRedoPaste*>(ptr))
   { tsb = (PasteThreadSuperBlock*)ThreadsManager::Get().StartSuperblock(wxT("paste"));
     dynamic_cast<UnRedoPaste*>(ptr)->SetThreadSuperblock(tsb);
   }
+ else if (dynamic_cast<UnRedoDup*>(ptr))
+  tsb = (PasteThreadSuperBlock*)ThreadsManager::Get().StartSuperblock(wxT("paste"));
  else if (dynamic_cast<UnRedoMove*>(ptr))
   { tsb = (PasteThreadSuperBlock*)ThreadsManager::Get().StartSuperblock(wxT("move"));
     dynamic_cast<UnRedoMove*>(ptr)->SetThreadSuperblock(tsb);
@@ -516,6 +598,11 @@ for (size_t n=0; n < count; ++n)
       { dynamic_cast<UnRedoMove*>(ptr)->SetThreadSuperblock(tsb);
         ThreadUsed = true; // Move always starts a thread
       }
+     else if (dynamic_cast<UnRedoDup*>(ptr))
+      { bool usable = tsb && !tsb->GetCollectorIsMoves(); // A Move superblock would delete the originals
+        dynamic_cast<UnRedoDup*>(ptr)->SetThreadSuperblock(usable ? tsb : NULL);
+        if (usable && !m_IsUndoing) ThreadUsed = true; // Redo dup should start a thread
+      }
 
     bool result;
     if (m_IsUndoing)
@@ -527,6 +614,7 @@ for (size_t n=0; n < count; ++n)
         return; 
       }
     ptr->ToggleFlags();
+    UnRedoManager::GetLog().LogReplace(m_NextItem, ptr); // The unredo will have altered its state, so rewrite it
 
     // The following line sets ThreadUsed for a paste-undo that doesn't have to retrieve a previously-overwritten file
     if (tsb && !ThreadUsed && !dynamic_cast<UnRedoFile*>(ptr)->GetOverwrittenFile().empty())
@@ -536,7 +624,7 @@ for (size_t n=0; n < count; ++n)
   }
 
 if (tsb)
-  { tsb->SetMessageType(m_IsUndoing ? _("undone") : _("redone"));
+  { tsb->SetMessageType(m_IsUndoing ? tsbm_undone : tsbm_redone);
     tsb->SetUnRedoId(m_CountarrayIndex);
     tsb->StartThreads();
 
@@ -586,6 +674,7 @@ m_IsActive = false; m_UnRedoArray = NULL;
 
 if (UnRedoManager::ClusterIsOpen) UnRedoManager::EndCluster();
 MyFrame::mainframe->UpdateTrees();
+UnRedoManager::GetLog().Flush();
 
 wxString msg = m_Successcount > 1 ? _(" actions ") : _(" action ");
 wxString type = m_IsUndoing ? _("undone") : _("redone");
@@ -595,6 +684,497 @@ if (!successfully || (m_Successcount < m_CountArray.GetCount()))
 DoBriefLogStatus(m_Successcount, msg, type);
 }
 
+//--------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+#include "wx/datstrm.h"
+#include "wx/mstream.h"
+#include <set>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/file.h>                                 // For flock()
+
+static const char UNREDOLOG_MAGIC[] = "4PUNDO01";     // The log file starts with these 8 chars (not the terminator)
+static const size_t UNREDOLOG_MAGICLEN = 8;
+static const size_t UNREDOLOG_FRAMELEN = 8;           // Each record is prefixed by its length and checksum, both wxUint32
+
+bool UnRedoLog::Open(const wxString& filepath)
+{
+Close();
+                        // Use a separate lockfile, as the log itself gets replaced whenever it's compacted
+m_lockfd = open((filepath + wxT(".lock")).fn_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+if (m_lockfd == -1) return false;
+if (flock(m_lockfd, LOCK_EX | LOCK_NB) != 0)         // Another instance is already keeping the log, so this one won't
+  { Close(); return false; }
+
+m_fd = open(filepath.fn_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+if (m_fd == -1)
+  { Close(); return false; }
+m_filepath = filepath; m_records = 0;
+
+char magic[UNREDOLOG_MAGICLEN];
+if ((pread(m_fd, magic, UNREDOLOG_MAGICLEN, 0) != (ssize_t)UNREDOLOG_MAGICLEN) || memcmp(magic, UNREDOLOG_MAGIC, UNREDOLOG_MAGICLEN))
+  { if ((ftruncate(m_fd, 0) != 0) || !WriteAll(m_fd, UNREDOLOG_MAGIC, UNREDOLOG_MAGICLEN))  // A new log, or one we can't make sense of
+      { Close(); return false; }
+  }
+
+return true;
+}
+
+void UnRedoLog::Close()   // NB this doesn't Flush(). UnRedoManager compacts the log before closing it
+{
+m_pending.clear(); m_buffer.SetDataLen(0);
+if (m_fd != -1)     { close(m_fd); m_fd = -1; }
+if (m_lockfd != -1) { close(m_lockfd); m_lockfd = -1; }  // which also releases the flock
+}
+
+void UnRedoLog::LogDropFront(size_t n)
+{
+if (n) LogOp(ULOP_dropfront, n);
+}
+
+void UnRedoLog::LogTruncate(size_t n)
+{
+LogOp(ULOP_truncate, n);
+}
+
+void UnRedoLog::LogPosition(size_t count)
+{
+LogOp(ULOP_position, count);
+}
+
+void UnRedoLog::LogClear()
+{
+m_pending.clear(); m_buffer.SetDataLen(0);            // A Clear supersedes anything not yet written
+LogOp(ULOP_clear, 0);
+}
+
+void UnRedoLog::LogReplace(size_t index, const UnRedo* entry)
+{
+if (!IsOpen() || !entry) return;
+
+EncodePending();
+wxMemoryOutputStream mos; wxDataOutputStream out(mos);
+out.Write8(ULOP_replace); out.Write32(index);
+WriteEntry(out, entry);
+AppendRecord(mos, m_buffer);
+}
+
+void UnRedoLog::LogOp(int op, size_t n)
+{
+if (!IsOpen()) return;
+
+EncodePending();                                      // Keep the records in order. Besides, a pending entry may be about to be deleted
+wxMemoryOutputStream mos; wxDataOutputStream out(mos);
+out.Write8(op); out.Write32(n);
+AppendRecord(mos, m_buffer);
+}
+
+void UnRedoLog::EncodePending()
+{
+for (size_t n=0; n < m_pending.size(); ++n)
+  { wxMemoryOutputStream mos; wxDataOutputStream out(mos);
+    out.Write8(ULOP_add);
+    WriteEntry(out, m_pending[n]);
+    AppendRecord(mos, m_buffer);
+  }
+m_pending.clear();
+}
+
+void UnRedoLog::AppendRecord(wxMemoryOutputStream& payload, wxMemoryBuffer& buf)
+{
+size_t len = payload.GetLength();
+std::vector<char> data(len);
+payload.CopyTo(&data[0], len);
+
+wxUint32 frame[2];
+frame[0] = wxUINT32_SWAP_ON_BE((wxUint32)len);
+frame[1] = wxUINT32_SWAP_ON_BE(Checksum(&data[0], len));
+buf.AppendData(frame, UNREDOLOG_FRAMELEN);
+buf.AppendData(&data[0], len);
+++m_records;
+}
+
+void UnRedoLog::Flush()
+{
+if (!IsOpen()) return;
+
+EncodePending();
+if (!m_buffer.GetDataLen()) return;
+
+bool ok = WriteAll(m_fd, m_buffer.GetData(), m_buffer.GetDataLen()) && (fdatasync(m_fd) == 0);
+m_buffer.SetDataLen(0);
+if (!ok)
+  { wxLogWarning(_("Couldn't write to the Undo log, so Undo history won't be kept after this session"));
+    Close();
+  }
+}
+
+bool UnRedoLog::Compact(const ArrayOfUnRedos& arr, size_t count)
+{
+Flush();                                              // so that if compacting fails, the existing log is still complete
+if (!IsOpen()) return false;
+
+size_t oldrecords = m_records; m_records = 0;
+wxMemoryBuffer buf;
+buf.AppendData(UNREDOLOG_MAGIC, UNREDOLOG_MAGICLEN);
+for (size_t n=0; n < arr.GetCount(); ++n)
+  { wxMemoryOutputStream mos; wxDataOutputStream out(mos);
+    out.Write8(ULOP_add);
+    WriteEntry(out, arr[n]);
+    AppendRecord(mos, buf);
+  }
+wxMemoryOutputStream mos; wxDataOutputStream out(mos);
+out.Write8(ULOP_position); out.Write32(count);
+AppendRecord(mos, buf);
+
+wxString tempname = m_filepath + wxT(".new");
+int fd = open(tempname.fn_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+bool ok = (fd != -1) && WriteAll(fd, buf.GetData(), buf.GetDataLen()) && (fdatasync(fd) == 0);
+if (fd != -1) close(fd);
+if (ok)
+  ok = (rename(tempname.fn_str(), m_filepath.fn_str()) == 0);  // rename() is atomic, so a crash leaves either the old log or the new one
+if (!ok)
+  { unlink(tempname.fn_str()); m_records = oldrecords;
+    return false;
+  }
+
+int newfd = open(m_filepath.fn_str(), O_RDWR | O_APPEND | O_CLOEXEC);  // m_fd still refers to the file we just replaced
+if (newfd == -1)
+  { Close(); return false; }
+close(m_fd); m_fd = newfd;
+
+return true;
+}
+
+bool UnRedoLog::ReadRecords(std::vector<char>& data, std::vector<size_t>& offsets, std::vector<size_t>& lengths)
+{
+if (!IsOpen()) return false;
+
+off_t size = lseek(m_fd, 0, SEEK_END);
+if (size < (off_t)UNREDOLOG_MAGICLEN) return false;
+data.resize(size);
+if (pread(m_fd, &data[0], size, 0) != (ssize_t)size) return false;
+
+size_t offset = UNREDOLOG_MAGICLEN;
+while (offset + UNREDOLOG_FRAMELEN <= (size_t)size)
+  { wxUint32 frame[2];
+    memcpy(frame, &data[offset], UNREDOLOG_FRAMELEN);
+    size_t len = wxUINT32_SWAP_ON_BE(frame[0]);
+    if (!len || (len > (size_t)size - offset - UNREDOLOG_FRAMELEN)) break;  // A record torn by a crash. Everything before it is still good
+    if (Checksum(&data[offset + UNREDOLOG_FRAMELEN], len) != wxUINT32_SWAP_ON_BE(frame[1])) break;
+    offsets.push_back(offset + UNREDOLOG_FRAMELEN); lengths.push_back(len);
+    offset += UNREDOLOG_FRAMELEN + len;
+  }
+
+return true;
+}
+
+bool UnRedoLog::Peek(size_t& undos, size_t& redos)
+{
+std::vector<char> data; std::vector<size_t> offsets, lengths;
+if (!ReadRecords(data, offsets, lengths)) return false;
+
+std::vector<bool> valid;                              // This mirrors Replay(), but only looks at each entry's type
+std::vector<size_t> clusters;
+size_t pos(0);
+for (size_t r=0; r < offsets.size(); ++r)
+  { wxMemoryInputStream mis(&data[offsets[r]], lengths[r]); wxDataInputStream in(mis);
+    switch(in.Read8())
+      { case ULOP_add:      { int type = in.Read8(); size_t clusterno = in.Read32();
+                              valid.push_back(type != URLT_none); clusters.push_back(clusterno);
+                              pos = valid.size(); break;
+                            }
+        case ULOP_dropfront:{ size_t n = wxMin((size_t)in.Read32(), valid.size());
+                              valid.erase(valid.begin(), valid.begin() + n); clusters.erase(clusters.begin(), clusters.begin() + n);
+                              pos = (pos > n ? pos - n : 0); break;
+                            }
+        case ULOP_truncate: { size_t n = in.Read32();
+                              if (valid.size() > n) { valid.resize(n); clusters.resize(n); }
+                              pos = wxMin(pos, valid.size()); break;
+                            }
+        case ULOP_replace:  { size_t index = in.Read32(); int type = in.Read8(); size_t clusterno = in.Read32();
+                              if (index < valid.size())
+                                { valid[index] = (type != URLT_none); clusters[index] = clusterno; }
+                              break;
+                            }
+        case ULOP_position:   pos = wxMin((size_t)in.Read32(), valid.size()); break;
+        case ULOP_clear:      valid.clear(); clusters.clear(); pos = 0; break;
+      }
+  }
+
+size_t first, last;
+LiveRange(valid, clusters, pos, first, last);
+undos = pos - first; redos = last - pos;
+return true;
+}
+
+//static
+void UnRedoLog::LiveRange(const std::vector<bool>& valid, const std::vector<size_t>& clusters, size_t pos, size_t& first, size_t& last)
+{
+    // An entry that couldn't be persisted (e.g. an archive one) spoils its cluster, and the clusters that followed it may depend on it.
+    // So discard the undo history up to and including the newest such cluster, and the redo history from the oldest one
+first = 0; last = valid.size();
+for (size_t n = pos; n > 0; --n)
+  if (!valid[n-1])
+    { first = n;
+      while (first < pos && clusters[first] == clusters[n-1]) ++first;
+      break;
+    }
+for (size_t n = pos; n < valid.size(); ++n)
+  if (!valid[n])
+    { last = n;
+      while (last > pos && clusters[last-1] == clusters[n]) --last;
+      break;
+    }
+while (pos - first > MAX_NUMBER_OF_UNDOS)             // In case MAX_NUMBER_OF_UNDOS was reduced since. Remove whole clusters, as AddEntry does
+  { size_t oldcluster = clusters[first];
+    do ++first; while (first < pos && clusters[first] == oldcluster);
+  }
+}
+
+bool UnRedoLog::Replay(ArrayOfUnRedos& arr, size_t& count, size_t& nextcluster)
+{
+std::vector<char> data; std::vector<size_t> offsets, lengths;
+if (!ReadRecords(data, offsets, lengths)) return false;
+
+std::vector<UnRedo*> entries;                         // NULL entries are ones that couldn't be persisted
+std::vector<size_t> clusters;
+size_t pos(0);                                        // The equivalent of UnRedoManager::m_count
+m_records = offsets.size();
+
+for (size_t r=0; r < offsets.size(); ++r)
+  { wxMemoryInputStream mis(&data[offsets[r]], lengths[r]); wxDataInputStream in(mis);
+    switch(in.Read8())
+      { case ULOP_add:      { size_t clusterno; UnRedo* entry = ReadEntry(in, clusterno);
+                              entries.push_back(entry); clusters.push_back(clusterno);
+                              pos = entries.size(); break;
+                            }
+        case ULOP_dropfront:{ size_t n = wxMin((size_t)in.Read32(), entries.size());
+                              for (size_t i=0; i < n; ++i) delete entries[i];
+                              entries.erase(entries.begin(), entries.begin() + n); clusters.erase(clusters.begin(), clusters.begin() + n);
+                              pos = (pos > n ? pos - n : 0); break;
+                            }
+        case ULOP_truncate: { size_t n = in.Read32();
+                              while (entries.size() > n)
+                                { delete entries.back(); entries.pop_back(); clusters.pop_back(); }
+                              pos = wxMin(pos, entries.size()); break;
+                            }
+        case ULOP_replace:  { size_t index = in.Read32(), clusterno;
+                              UnRedo* entry = ReadEntry(in, clusterno);
+                              if (index < entries.size())
+                                { delete entries[index]; entries[index] = entry; clusters[index] = clusterno; }
+                               else delete entry;
+                              break;
+                            }
+        case ULOP_position:   pos = wxMin((size_t)in.Read32(), entries.size()); break;
+        case ULOP_clear:      for (size_t i=0; i < entries.size(); ++i) delete entries[i];
+                              entries.clear(); clusters.clear(); pos = 0; break;
+      }
+  }
+
+for (size_t n=0; n < clusters.size(); ++n)
+  nextcluster = wxMax(nextcluster, clusters[n] + 1);
+
+std::vector<bool> valid(entries.size());
+for (size_t n=0; n < entries.size(); ++n)
+  valid[n] = (entries[n] != NULL);
+size_t first, last;
+LiveRange(valid, clusters, pos, first, last);
+
+for (size_t n=0; n < entries.size(); ++n)
+  { if (n < first || n >= last) delete entries[n];
+     else 
+      { entries[n]->clusterno = clusters[n];
+        arr.Add(entries[n]);
+      }
+  }
+count = pos - first;
+
+return true;
+}
+
+//static
+void UnRedoLog::WriteEntry(wxDataOutputStream& out, const UnRedo* entry)
+{
+enum UnRedoLogType type = entry->GetLogType();
+out.Write8(type); out.Write32(entry->clusterno);
+if (type != URLT_none)
+  entry->Persist(out);
+}
+
+//static
+UnRedo* UnRedoLog::ReadEntry(wxDataInputStream& in, size_t& clusterno)
+{
+int type = in.Read8();
+clusterno = in.Read32();
+
+wxArrayInt IDs;                                       // The windows will be different by now, so the restored unredos just refresh by path
+UnRedo* entry = NULL;
+switch(type)
+  { case URLT_move:           { wxString finalbit = in.ReadString(); wxString originalfinalbit = in.ReadString();
+                                bool FromDelete = in.Read8();
+                                entry = new UnRedoMove(wxT(""), IDs, wxT(""), finalbit, originalfinalbit, false, FromDelete); break;
+                              }
+    case URLT_paste:          { wxString finalbit = in.ReadString(); bool dirs_only = in.Read8();
+                                entry = new UnRedoPaste(wxT(""), IDs, wxT(""), finalbit, false, dirs_only); break;
+                              }
+    case URLT_link:           { wxString from = in.ReadString(); wxString to = in.ReadString();
+                                bool linktype = in.Read8(); enum changerelative rel = (enum changerelative)in.Read8();
+                                entry = new UnRedoLink(from, IDs, to, linktype, rel); break;
+                              }
+    case URLT_changelinktarget:{wxString link = in.ReadString(); wxString dest = in.ReadString(); wxString target = in.ReadString();
+                                entry = new UnRedoChangeLinkTarget(link, IDs, dest, target); break;
+                              }
+    case URLT_changeattributes:{wxString fpath = in.ReadString(); size_t originalattr = in.Read64(); size_t newattr = in.Read64();
+                                enum AttributeChange which = (enum AttributeChange)in.Read8();
+                                entry = new UnRedoChangeAttributes(fpath, IDs, originalattr, newattr, which); break;
+                              }
+    case URLT_newdirfile:     { wxString filename = in.ReadString(); wxString path = in.ReadString();
+                                entry = new UnRedoNewDirFile(filename, path, false, IDs); break;
+                              }
+    case URLT_dup:            { wxString destpath = in.ReadString(); wxString newpath = in.ReadString();
+                                wxString originalname = in.ReadString(); wxString newname = in.ReadString();
+                                entry = new UnRedoDup(destpath, newpath, originalname, newname, false, IDs); break;
+                              }
+    case URLT_ren:            { wxString destpath = in.ReadString(); wxString newpath = in.ReadString();
+                                wxString originalname = in.ReadString(); wxString newname = in.ReadString();
+                                entry = new UnRedoRen(destpath, newpath, originalname, newname, false, IDs); break;
+                              }
+    case URLT_multipleren:    { wxArrayString oldpaths, newpaths;
+                                size_t count = in.Read32();
+                                for (size_t n=0; n < count; ++n)
+                                  { oldpaths.Add(in.ReadString()); newpaths.Add(in.ReadString()); }
+                                int startdirindex = (int)in.Read32() - 1;
+                                entry = new UnRedoMultipleRen(oldpaths, newpaths, IDs, startdirindex); break;
+                              }
+    default:                    return NULL;          // URLT_none, or something we don't understand
+  }
+
+entry->RestoreState(in);                              // This also restores the clustername, which the ctors may have guessed wrongly
+entry->clusterno = clusterno;
+return entry;
+}
+
+//static
+wxUint32 UnRedoLog::Checksum(const void* data, size_t len)  // FNV-1a. It only has to notice a torn or garbled record
+{
+const unsigned char* p = (const unsigned char*)data;
+wxUint32 hash = 2166136261u;
+for (size_t n=0; n < len; ++n)
+  { hash ^= p[n]; hash *= 16777619u; }
+return hash;
+}
+
+//static
+bool UnRedoLog::WriteAll(int fd, const void* data, size_t len)
+{
+const char* p = (const char*)data;
+while (len)
+  { ssize_t written = write(fd, p, len);
+    if (written < 0)
+      { if (errno == EINTR) continue;
+        return false;
+      }
+    p += written; len -= written;
+  }
+return true;
+}
+
+void UnRedo::Persist(wxDataOutputStream& out) const
+{
+out.WriteString(clustername);
+out.Write8(UndoPossible); out.Write8(RedoPossible); out.Write8(m_UsedThread);
+}
+
+void UnRedo::RestoreState(wxDataInputStream& in)
+{
+clustername = in.ReadString();
+UndoPossible = in.Read8(); RedoPossible = in.Read8(); m_UsedThread = in.Read8();
+}
+
+void UnRedoFile::Persist(wxDataOutputStream& out) const
+{
+UnRedo::Persist(out);
+out.WriteString(original.GetFullPath()); out.WriteString(final.GetFullPath());  // These change with each unredo of a Move or Paste
+out.WriteString(m_OverwrittenFile);
+out.Write8(ItsADir); out.Write8(m_NeedsYield);
+}
+
+void UnRedoFile::RestoreState(wxDataInputStream& in)
+{
+UnRedo::RestoreState(in);
+wxString orig = in.ReadString(), fin = in.ReadString();
+if (orig.IsEmpty()) original.Clear(); else original.Assign(orig);
+if (fin.IsEmpty()) final.Clear(); else final.Assign(fin);
+m_OverwrittenFile = in.ReadString();
+ItsADir = in.Read8(); m_NeedsYield = in.Read8();
+}
+
+void UnRedoFile::AddReferencedPaths(wxArrayString& paths) const
+{
+if (original.IsOk()) paths.Add(original.GetFullPath());
+if (final.IsOk()) paths.Add(final.GetFullPath());
+if (!m_OverwrittenFile.IsEmpty()) paths.Add(m_OverwrittenFile);
+}
+
+void UnRedoMove::Persist(wxDataOutputStream& out) const
+{
+out.WriteString(finalbit); out.WriteString(originalfinalbit); out.Write8(FromDelete);
+UnRedoFile::Persist(out);
+}
+
+void UnRedoPaste::Persist(wxDataOutputStream& out) const
+{
+out.WriteString(finalbit); out.Write8(m_dirs_only);
+UnRedoFile::Persist(out);
+}
+
+void UnRedoLink::Persist(wxDataOutputStream& out) const
+{
+out.WriteString(originfilepath); out.WriteString(linkfilepath); out.Write8(linkage); out.Write8(relativity);
+UnRedoFile::Persist(out);
+}
+
+void UnRedoChangeLinkTarget::Persist(wxDataOutputStream& out) const
+{
+out.WriteString(linkname); out.WriteString(newtarget); out.WriteString(oldtarget);
+UnRedoFile::Persist(out);
+}
+
+void UnRedoChangeAttributes::Persist(wxDataOutputStream& out) const
+{
+out.WriteString(filepath); out.Write64((wxUint64)OriginalAttribute); out.Write64((wxUint64)NewAttribute); out.Write8(whichattribute);
+UnRedoFile::Persist(out);
+}
+
+void UnRedoNewDirFile::Persist(wxDataOutputStream& out) const
+{
+out.WriteString(filename); out.WriteString(path);
+UnRedoFile::Persist(out);
+}
+
+void UnRedoDup::Persist(wxDataOutputStream& out) const
+{
+out.WriteString(destpath); out.WriteString(newpath); out.WriteString(originalname); out.WriteString(newname);
+UnRedoFile::Persist(out);
+}
+
+void UnRedoRen::Persist(wxDataOutputStream& out) const
+{
+out.WriteString(destpath); out.WriteString(newpath); out.WriteString(originalname); out.WriteString(newname);
+UnRedoFile::Persist(out);
+}
+
+void UnRedoMultipleRen::Persist(wxDataOutputStream& out) const
+{
+out.Write32(m_OldFilepaths.GetCount());
+for (size_t n=0; n < m_OldFilepaths.GetCount(); ++n)
+  { out.WriteString(m_OldFilepaths[n]); out.WriteString(m_NewFilepaths[n]); }
+out.Write32((wxUint32)(m_StartdirIndex + 1));
+UnRedoFile::Persist(out);
+}
+
 //--------------------------------------------------------------------------------------------------------------------------------------------------------------
 
                     // A global helper for the archive UnRedos
@@ -895,15 +1475,15 @@ if (!RedoPossible) return false;
 
 if (ItsADir)   
   { wxString originalfilepath = destpath + originalname, finalfilepath = newpath + newname;
-    result = CheckDupRen::RenameDir(originalfilepath, finalfilepath, true);
+    result = CheckDupRen::RenameDir(originalfilepath, finalfilepath, true, m_tsb);
   }
  else
-    result = CheckDupRen::RenameFile(destpath, originalname, newname, true);
+    result = CheckDupRen::RenameFile(destpath, originalname, newname, true, m_tsb);
 
 if (result > 0)                                               // Assuming it worked, we just need to UpdateTrees
       MyFrame::mainframe->OnUpdateTrees(destpath, IDs); 
 
-if (result)  DoBriefLogStatus(1, _("action"),  _(" redone"));
+if (result && !m_tsb)  DoBriefLogStatus(1, _("action"),  _(" redone")); // With a superblock, that'll report when its threads complete
 return (result > 0);
 }
 
@@ -953,6 +1533,48 @@ if (result)  DoBriefLogStatus(1, _("action"),  _(" redone"));
 return (result > 0);
 }
 
+bool UnRedoMultipleRen::DoRenames(const wxArrayString& from, const wxArrayString& to)
+{
+wxString failure;
+if (!CheckDupRen::RenameBatch(from, to, failure))   // If it fails, nothing will have been renamed
+  { wxLogError(failure); return false; }
+
+wxArrayString dirs;                                                 // Update each dir just once, not once per item
+for (size_t n=0; n < from.GetCount(); ++n)
+  { if ((int)n == m_StartdirIndex)                                  // If it's a startdir, tell UpdateTrees to regrow from the new name
+      { MyFrame::mainframe->OnUpdateTrees(StripSep(from[n]), IDs, StripSep(to[n])); continue; }
+    wxString dir = StripSep(to[n]).BeforeLast(wxFILE_SEP_PATH);
+    if (dirs.Index(dir) == wxNOT_FOUND)
+      { dirs.Add(dir); MyFrame::mainframe->OnUpdateTrees(dir, IDs); }
+  }
+return true;
+}
+
+bool UnRedoMultipleRen::Undo()
+{
+if (!UndoPossible) return false;
+
+    // A child of a renamed dir will now be inside the dir's new name, whereas m_NewFilepaths has it inside the old one. So find where each item really is,
+    // and rename it back within that dir. RenameBatch() does the children first, so the dirs are still where we expect when their turn comes
+wxArrayString from, to;
+CheckDupRen::BatchedPaths(m_OldFilepaths, m_NewFilepaths, from);
+for (size_t n=0; n < from.GetCount(); ++n)
+  to.Add(from[n].BeforeLast(wxFILE_SEP_PATH) + wxFILE_SEP_PATH + StripSep(m_OldFilepaths[n]).AfterLast(wxFILE_SEP_PATH));
+
+bool result = DoRenames(from, to);
+if (result)  DoBriefLogStatus(1, _("action"),  _(" undone"));
+return result;
+}
+
+bool UnRedoMultipleRen::Redo()
+{
+if (!RedoPossible) return false;
+
+bool result = DoRenames(m_OldFilepaths, m_NewFilepaths);
+if (result)  DoBriefLogStatus(1, _("action"),  _(" redone"));
+return result;
+}
+
 
 bool UnRedoArchiveRen::Undo()  // Undoing a Rename or Move means ReRenaming. Undoing a Paste means Removing
 {
@@ -1312,12 +1934,29 @@ DeletedName = refuse + wxT("DeletedBy4Pane/"); CreateCan(delcan); // Deletes
 TrashedName = refuse + wxT("TrashedBy4Pane/"); CreateCan(trashcan); // Trashed
 
 TempfileDir = refuse + wxT("Tempfiles/"); CreateCan(tempfilecan);  // And a location for tempfiles
+
+UndoLogName = refuse + wxT("4PaneUndo.log");                        // Used by UnRedoManager if PERSISTENT_UNDO
+
+PasteJournalDir = refuse + wxT("4PanePastes/");                     // Used by PasteJournal. Created when first needed
 }
 
 DirectoryForDeletions::~DirectoryForDeletions()
 {
-wxFileName deleted(DeletedName);  // Deletes the files/dirs that have been deleted into DeletedBy4Pane
-ReallyDelete(&deleted);
+if (!PERSISTENT_UNDO)
+  { wxFileName deleted(DeletedName);  // Deletes the files/dirs that have been deleted into DeletedBy4Pane
+    ReallyDelete(&deleted);
+  }
+ else if (PruneDeletions)          // If the Undo log is being kept, only delete what it no longer needs. If we weren't told, delete nothing
+  { wxArrayString unwanted; wxString name;
+    wxDir dir(DeletedName);
+    if (dir.IsOpened())
+      for (bool cont = dir.GetFirst(&name); cont; cont = dir.GetNext(&name))
+        if (KeptDeletions.Index(name) == wxNOT_FOUND) unwanted.Add(name);
+    for (size_t n=0; n < unwanted.GetCount(); ++n)
+      { wxFileName child(DeletedName, unwanted[n]);
+        ReallyDelete(&child);
+      }
+  }
 
 wxFileName tmp(wxStandardPaths::Get().GetTempDir() + wxT("/4Pane/")); // Ditto for any temp files in /tmp/
 ReallyDelete(&tmp);
@@ -1327,6 +1966,13 @@ ReallyDelete(&temps);
       // Don't do the Trashed dir, it's supposed to stay
 }
 
+//static
+void DirectoryForDeletions::KeepOnlyDeletions(const wxArrayString& subdirs)
+{
+KeptDeletions = subdirs;
+PruneDeletions = true;
+}
+
 //static
 void DirectoryForDeletions::CreateCan(enum whichcan can)  // Create a trash-can or deleted-can, depending on bool
 {
@@ -1471,4 +2117,8 @@ return trashdir.DirExists();
 wxString DirectoryForDeletions::DeletedName;        // Initialise names
 wxString DirectoryForDeletions::TrashedName;
 wxString DirectoryForDeletions::TempfileDir;
+wxString DirectoryForDeletions::UndoLogName;
+wxString DirectoryForDeletions::PasteJournalDir;
+wxArrayString DirectoryForDeletions::KeptDeletions;
+bool DirectoryForDeletions::PruneDeletions = false;
  
@@ -13,8 +13,14 @@
 #include "wx/dir.h"
 #include "wx/toolbar.h"
 
+#include <vector>
+
 class MyGenericDirCtrl;
 class DirGenericDirCtrl;
+class PasteThreadSuperBlock;
+class wxDataOutputStream;
+class wxDataInputStream;
+class wxMemoryOutputStream;
 
                     // This is the pop-up for dir-toolbar directory back/forward-button sidebars
 class MyPopupMenu : public  wxWindow    // Need to derive from wxWindow for the PopupMenu method
@@ -65,6 +71,9 @@ DECLARE_EVENT_TABLE()
 
   //This is my take on Undo/Redo.  A manager class which stores classes for each type of undo, all of which are derived from abstract class UnRedo
 class MyFrame;
+
+enum UnRedoLogType {  URLT_none = 0, URLT_move, URLT_paste, URLT_link, URLT_changelinktarget,  // Identifies each persistable UnRedo in the Undo log.
+                      URLT_changeattributes, URLT_newdirfile, URLT_dup, URLT_ren, URLT_multipleren }; // NB append only: the values are stored on disk
   
 class UnRedo      // Very basic Base class
 {
@@ -85,6 +94,11 @@ bool GetUsedThread() const { return m_UsedThread; }
 virtual bool Undo()=0;            // Abstract, as we certainly don't want any objects,
 virtual bool Redo()=0;
 
+virtual enum UnRedoLogType GetLogType() const { return URLT_none; }  // URLT_none means this type can't outlive the session e.g. the archive ones
+virtual void Persist(wxDataOutputStream& out) const;  // Writes to the Undo log. Subclasses write their ctor params first, then call their base
+virtual void RestoreState(wxDataInputStream& in);     // Reads back what the base Persist() wrote, after the Undo log has reconstructed the object
+virtual void AddReferencedPaths(wxArrayString& WXUNUSED(paths)) const {}  // Used to decide which of the 'deleted' files are still needed
+
 protected:
 bool m_UsedThread;                // Used for unredo move/paste. Was this a simple process or did we need to use a thread?
 };
@@ -113,6 +127,10 @@ wxString GetOverwrittenFile() const { return m_OverwrittenFile; }
 void SetOverwrittenFile(const wxString& overwritten) { m_OverwrittenFile = overwritten; }
 bool GetNeedsYield() const { return m_NeedsYield; }
 void SetNeedsYield(bool yield) { m_NeedsYield = yield; }
+
+void Persist(wxDataOutputStream& out) const;
+void RestoreState(wxDataInputStream& in);
+void AddReferencedPaths(wxArrayString& paths) const;
 };
   
 class UnRedoMove    :    public UnRedoFile    // Used by both Move & Delete
@@ -137,6 +155,9 @@ wxString originalfinalbit;  // This is the pre-Move filename/terminal segment, b
 bool Undo();
 bool Redo();
 
+enum UnRedoLogType GetLogType() const { return URLT_move; }
+void Persist(wxDataOutputStream& out) const;
+
 protected:
 ThreadSuperBlock* m_tsb;
 bool FromDelete;            // Flags whether the calling method was Delete or not.  It makes a difference as to which paths get refreshed
@@ -162,6 +183,9 @@ bool m_dirs_only;
 bool Undo();                // Undoing a Paste means deleting the copy
 bool Redo();
 
+enum UnRedoLogType GetLogType() const { return URLT_paste; }
+void Persist(wxDataOutputStream& out) const;
+
 protected:
 ThreadSuperBlock* m_tsb;
 };
@@ -176,6 +200,9 @@ UnRedoLink(const wxString& from,  const wxArrayInt& IDlist, const wxString& to,
 bool Undo();               // Undoing a Link means deleting the link
 bool Redo();
 
+enum UnRedoLogType GetLogType() const { return URLT_link; }
+void Persist(wxDataOutputStream& out) const;
+
 protected:
 wxString originfilepath;   // The link target, ready for redo
 wxString linkfilepath;     // The link, ready for undo
@@ -194,6 +221,9 @@ UnRedoChangeLinkTarget(const wxString& link, const wxArrayInt& IDlist, const wxS
 bool Undo();              // Undoing a ChangeLinkTarget means changing in reverse
 bool Redo();
 
+enum UnRedoLogType GetLogType() const { return URLT_changelinktarget; }
+void Persist(wxDataOutputStream& out) const;
+
 protected:
 wxString linkname;        // The name of the link
 wxString newtarget;       // The new target
@@ -211,6 +241,9 @@ UnRedoChangeAttributes(const wxString& fpath, const wxArrayInt& IDlist, size_t o
 bool Undo();              // Undoing an attribute change means changing in reverse
 bool Redo();
 
+enum UnRedoLogType GetLogType() const { return URLT_changeattributes; }
+void Persist(wxDataOutputStream& out) const;
+
 protected:
 wxString filepath;
 size_t OriginalAttribute;
@@ -229,6 +262,9 @@ UnRedoNewDirFile(const wxString& newname, const wxString& pth, bool QueryDir, co
 bool Undo();              // Undoing a New means ReallyDeleting it 
 bool Redo();
 
+enum UnRedoLogType GetLogType() const { return URLT_newdirfile; }
+void Persist(wxDataOutputStream& out) const;
+
 protected:
 wxString filename;
 wxString path;
@@ -238,18 +274,24 @@ class UnRedoDup      :    public UnRedoFile    // Duplicates a Dir or File
 {
 public:
 UnRedoDup(const wxString& destpth, const wxString& newpth,const  wxString& origname, const wxString& new_name,  bool QueryDir, wxArrayInt& IDlist)
-            :   UnRedoFile(wxT(""), IDlist), originalname(origname), newname(new_name), destpath(destpth), newpath(newpth)
+            :   UnRedoFile(wxT(""), IDlist), originalname(origname), newname(new_name), destpath(destpth), newpath(newpth), m_tsb(NULL)
                   { ItsADir = QueryDir; clustername = (ItsADir ? _("Duplicate Directory") : _("Duplicate File")); }
 ~UnRedoDup(){}
 
+void SetThreadSuperblock(PasteThreadSuperBlock* tsb) { m_tsb = tsb; }
+
 bool Undo();             // Undoing a Dup means ReallyDeleting it 
-bool Redo();
+bool Redo();             // Redoing it uses the paste threads if there's a superblock
+
+enum UnRedoLogType GetLogType() const { return URLT_dup; }
+void Persist(wxDataOutputStream& out) const;
 
 protected:
 wxString originalname;   // The filename (or NULL)
 wxString newname;        // See above
 wxString destpath;       // The original dirname
 wxString newpath;
+PasteThreadSuperBlock* m_tsb;
 };
 
 
@@ -267,6 +309,9 @@ UnRedoRen(const wxString& destpth, const wxString& newpth, const wxString& orign
 bool Undo();              // Undoing a Rename means ReRenaming it 
 bool Redo();
 
+enum UnRedoLogType GetLogType() const { return URLT_ren; }
+void Persist(wxDataOutputStream& out) const;
+
 protected:
 wxString destpath;        // The path before the filename or last segment of dirname
 wxString originalname;    // The filename (or NULL)
@@ -274,6 +319,28 @@ wxString newpath;
 wxString newname;
 };
 
+class UnRedoMultipleRen      :    public UnRedoFile    // Renames several Dirs/Files as one batch, which may include permutations e.g. a->b, b->a
+{
+public:
+UnRedoMultipleRen(const wxArrayString& oldpaths, const wxArrayString& newpaths, const wxArrayInt& IDlist, int startdirindex = -1)
+          :   UnRedoFile(wxT(""), IDlist, wxT(""), _("Multiple Rename")), m_OldFilepaths(oldpaths), m_NewFilepaths(newpaths), m_StartdirIndex(startdirindex)
+                      { ItsADir = false; }
+~UnRedoMultipleRen(){}
+
+bool Undo();              // Undoing means renaming the whole batch back again, so that the permutations still work
+bool Redo();
+
+enum UnRedoLogType GetLogType() const { return URLT_multipleren; }
+void Persist(wxDataOutputStream& out) const;
+
+protected:
+bool DoRenames(const wxArrayString& from, const wxArrayString& to);
+
+wxArrayString m_OldFilepaths;
+wxArrayString m_NewFilepaths;
+int m_StartdirIndex;      // If one of them was a pane's startdir, its index; otherwise -1
+};
+
 class UnRedoArchiveRen      :    public UnRedoFile    // Renames within an archive
 {
 public:
@@ -415,11 +482,58 @@ bool m_IsUndoing;
 bool m_IsActive;
 };
 
+class UnRedoLog    // Keeps an append-only copy of UnRedoManager's array on disk, so that Undo survives a restart (or a crash)
+{
+public:
+UnRedoLog() : m_fd(-1), m_lockfd(-1), m_records(0) {}
+~UnRedoLog() { Close(); }
+
+bool Open(const wxString& filepath);        // Takes the lock and opens the log. Returns false if another instance owns it, or it can't be used
+void Close();
+bool IsOpen() const { return m_fd != -1; }
+
+bool Replay(ArrayOfUnRedos& arr, size_t& count, size_t& nextcluster);  // Rebuilds the array from the log. Nothing is stat-ed: a stale entry will just fail to unredo
+bool Peek(size_t& undos, size_t& redos);    // How many entries Replay() would give, without creating any of them. Used to answer UpdateUI before the log is restored
+bool Compact(const ArrayOfUnRedos& arr, size_t count);  // Replaces the log with one holding only the live entries
+bool NeedsCompacting(size_t live) const { return m_records > (2 * live) + 1000; }
+
+void LogAdd(UnRedo* entry) { if (IsOpen()) m_pending.push_back(entry); }  // The entry is serialised later, as AddEntry() and its callers are still adjusting it
+void LogDropFront(size_t n);                // These mirror the ways that UnRedoManager alters its array
+void LogTruncate(size_t n);
+void LogReplace(size_t index, const UnRedo* entry);
+void LogPosition(size_t count);
+void LogClear();
+
+void Flush();                               // Writes everything encoded so far in a single write(), then fdatasyncs. Called once per cluster, not per entry
+
+static wxUint32 Checksum(const void* data, size_t len); // These are also used by PasteJournal, whose records are framed the same way
+static bool WriteAll(int fd, const void* data, size_t len);
+static void WriteEntry(wxDataOutputStream& out, const UnRedo* entry); // and these, for a paste's own unredos
+static UnRedo* ReadEntry(wxDataInputStream& in, size_t& clusterno);  // Returns NULL for an entry that couldn't be persisted
+
+protected:
+enum { ULOP_add = 1, ULOP_dropfront, ULOP_truncate, ULOP_replace, ULOP_position, ULOP_clear };
+
+bool ReadRecords(std::vector<char>& data, std::vector<size_t>& offsets, std::vector<size_t>& lengths);  // Loads the log, and finds its intact records
+static void LiveRange(const std::vector<bool>& valid, const std::vector<size_t>& clusters, size_t pos, size_t& first, size_t& last); // Which entries survive a replay
+
+void LogOp(int op, size_t n);
+void EncodePending();                       // Serialise any entries queued by LogAdd()
+void AppendRecord(wxMemoryOutputStream& payload, wxMemoryBuffer& buf);  // Frames a record as [length][checksum][payload]
+
+wxString m_filepath;
+int m_fd;
+int m_lockfd;
+size_t m_records;                           // How many records the file holds, current or superseded. Used to decide when to compact
+std::vector<UnRedo*> m_pending;
+wxMemoryBuffer m_buffer;                    // Encoded records waiting to be written
+};
+
 class UnRedoManager
 {
 public:
-UnRedoManager()  { UnRedoArray.Alloc(MAX_NUMBER_OF_UNDOS); }
-~UnRedoManager(){ ClearUnRedoArray(); }
+UnRedoManager();
+~UnRedoManager();
 static void ClearUnRedoArray();
 static MyFrame *frame;
 static bool AddEntry(UnRedo*);              // Adds a new undoable action to the array
@@ -437,11 +551,14 @@ static void UndoEntry(int clusters = 1);    // Undoes 'clusters' of clusters of
 static void RedoEntry(int clusters = 1);    // Redoes 'clusters' of clusters of stored actions
 static void OnUndoSidebar();                // Called by the Undo-button sidebar
 static void OnRedoSidebar();                // Called by the Redo-button sidebar
-static bool UndoAvailable(){ return (m_count > 0); }  // Used by UpdateUI
-static bool RedoAvailable(){ return (m_count < UnRedoArray.GetCount()); }
+static bool UndoAvailable(){ return m_Restored ? (m_count > 0) : (m_LoggedUndos > 0); }  // Used by UpdateUI, so mustn't restore the log itself
+static bool RedoAvailable(){ return m_Restored ? (m_count < UnRedoArray.GetCount()) : (m_LoggedRedos > 0); }
 static UnRedoImplementer& GetImplementer() { return m_implementer; }
+static UnRedoLog& GetLog() { return m_log; }
 
 protected:
+static void EnsureRestored() { if (!m_Restored) Restore(); }
+static void Restore();                       // Loads any previous session's unredos from the log. Done on first use, not at startup
 static void StartCluster();                  // Start a new UnRedoManager cluster
 static void LoadArray(wxArrayString& namearray, int& index, bool redo);  // used by sidebars, to load a clutch of clusters from the main array into the temp one
 
@@ -451,6 +568,10 @@ static size_t cluster;                      // Holds the arbitrary codeno that w
 static size_t currentcluster;               // Holds the codeno for the currently-open cluster
 static size_t currentSupercluster;
 static UnRedoImplementer m_implementer;
+static UnRedoLog m_log;                      // Only open if PERSISTENT_UNDO, and no other instance already owns it
+static bool m_Restored;
+static size_t m_LoggedUndos;                // What the unrestored log holds, as found by UnRedoLog::Peek()
+static size_t m_LoggedRedos;
 };
 
 
@@ -463,12 +584,19 @@ void EmptyTrash(bool trash);                // Empties trash-can or 'deleted'-ca
 bool ReallyDelete(wxFileName *PathName);
 static bool GetUptothemomentDirname(wxFileName& trashdir, enum whichcan trash);    // Uses DeletedName or whatever to create unique subdir, using current time
 static wxString GetDeletedName(){ return DeletedName; }
+static wxString GetUndoLogName(){ return UndoLogName; }
+static wxString GetPasteJournalDir(){ return PasteJournalDir; }
+static void KeepOnlyDeletions(const wxArrayString& subdirs);  // On exit, purge just the DeletedBy4Pane subdirs not in the list, as the Undo log still needs those
 
 protected:
 static void CreateCan(enum whichcan);       // Create a trash-can or whatever
 static wxString DeletedName;                // Names of the relevant subdirs
 static wxString TrashedName;
 static wxString TempfileDir;
+static wxString UndoLogName;
+static wxString PasteJournalDir;
+static wxArrayString KeptDeletions;
+static bool PruneDeletions;                 // Set by KeepOnlyDeletions()
 };
 
 #endif
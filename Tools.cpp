@@ -31,9 +31,15 @@
 #include "Filetypes.h"
 #include "Accelerators.h"
 #include "Misc.h"
+#include "Redo.h"
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <set>
+#include <algorithm>
 #if defined __WXGTK__
   #include <gtk/gtk.h>
 #endif
@@ -3798,3 +3804,609 @@ void TextCtrlBase::OnFocus(wxFocusEvent& event)
 wxGetApp().GetFocusController().SetCurrentFocus(this);
 event.Skip();
 }
+
+//-----------------------------------------------------------------------------------------------------------------------
+
+#if wxVERSION_NUMBER < 2900
+  DEFINE_EVENT_TYPE(DuplicateScanType)
+#else
+  wxDEFINE_EVENT(DuplicateScanType, wxCommandEvent);
+#endif
+
+static const wxUint64 HASHPRIME1 = wxULL(0x9E3779B185EBCA87), HASHPRIME2 = wxULL(0xC2B2AE3D27D4EB4F), HASHPRIME3 = wxULL(0x165667B19E3779F9),
+                      HASHPRIME4 = wxULL(0x85EBCA77C2B2AE63), HASHPRIME5 = wxULL(0x27D4EB2F165667C5);
+
+static inline wxUint64 HashRotl(wxUint64 x, int r) { return (x << r) | (x >> (64 - r)); }
+static inline wxUint64 HashRound(wxUint64 acc, wxUint64 input) { acc += input * HASHPRIME2; acc = HashRotl(acc, 31); return acc * HASHPRIME1; }
+static inline wxUint64 HashMerge(wxUint64 acc, wxUint64 lane) { acc ^= HashRound(0, lane); return acc * HASHPRIME1 + HASHPRIME4; }
+static inline wxUint64 HashRead64(const unsigned char* p) { wxUint64 x; memcpy(&x, p, 8); return x; } // memcpy, as p needn't be aligned. Compilers turn it into a plain load
+static inline wxUint32 HashRead32(const unsigned char* p) { wxUint32 x; memcpy(&x, p, 4); return x; }
+
+void FastHash64::Reset()
+{
+m_lanes[0] = HASHPRIME1 + HASHPRIME2; m_lanes[1] = HASHPRIME2; m_lanes[2] = 0; m_lanes[3] = (wxUint64)0 - HASHPRIME1;
+m_buffered = 0; m_total = 0;
+}
+
+void FastHash64::Stripe(const unsigned char* p)
+{
+m_lanes[0] = HashRound(m_lanes[0], HashRead64(p));
+m_lanes[1] = HashRound(m_lanes[1], HashRead64(p + 8));
+m_lanes[2] = HashRound(m_lanes[2], HashRead64(p + 16));
+m_lanes[3] = HashRound(m_lanes[3], HashRead64(p + 24));
+}
+
+void FastHash64::Update(const void* data, size_t len)
+{
+const unsigned char* p = (const unsigned char*)data;
+m_total += len;
+
+if (m_buffered)                               // First complete any partial stripe left over from last time
+  { size_t fill = wxMin(len, sizeof(m_buffer) - m_buffered);
+    memcpy(m_buffer + m_buffered, p, fill);
+    m_buffered += fill; p += fill; len -= fill;
+    if (m_buffered < sizeof(m_buffer)) return;
+    Stripe(m_buffer); m_buffered = 0;
+  }
+
+for (; len >= 32; p += 32, len -= 32)         // This is where nearly all the time goes, so keep it simple
+  Stripe(p);
+
+memcpy(m_buffer, p, len); m_buffered = len;
+}
+
+wxUint64 FastHash64::Digest() const
+{
+wxUint64 hash;
+if (m_total >= 32)
+  { hash = HashRotl(m_lanes[0], 1) + HashRotl(m_lanes[1], 7) + HashRotl(m_lanes[2], 12) + HashRotl(m_lanes[3], 18);
+    for (size_t n=0; n < 4; ++n) hash = HashMerge(hash, m_lanes[n]);
+  }
+ else
+  hash = m_lanes[2] + HASHPRIME5;             // Which is the seed, 0
+
+hash += m_total;
+
+const unsigned char* p = m_buffer; size_t len = m_buffered;
+for (; len >= 8; p += 8, len -= 8)
+  hash = HashRotl(hash ^ HashRound(0, HashRead64(p)), 27) * HASHPRIME1 + HASHPRIME4;
+if (len >= 4)
+  { hash = HashRotl(hash ^ ((wxUint64)HashRead32(p) * HASHPRIME1), 23) * HASHPRIME2 + HASHPRIME3; p += 4; len -= 4; }
+for (; len; ++p, --len)
+  hash = HashRotl(hash ^ (*p * HASHPRIME5), 11) * HASHPRIME1;
+
+hash ^= hash >> 33; hash *= HASHPRIME2;        // Avalanche, so that every input bit affects every output bit
+hash ^= hash >> 29; hash *= HASHPRIME3;
+hash ^= hash >> 32;
+return hash;
+}
+
+static const wxUint64 DUPLICATE_ENDSIZE = 64 * 1024;   // How much of each end of a file to hash in the first pass
+static const size_t DUPLICATE_BLOCKSIZE = 1024 * 1024; // The size of each read when hashing a whole file
+
+DuplicateFinder* DuplicateFinder::ms_instance = NULL;
+
+DuplicateFinder::DuplicateFinder() : m_generation(0), m_requester(NULL), m_finished(false), m_EventPending(false)
+{
+Connect(wxID_ANY, DuplicateScanType, wxCommandEventHandler(DuplicateFinder::OnScan), NULL, this);
+}
+
+void DuplicateFinder::Request(DuplicatesDlg* requester, const wxString& dirname, bool showhidden)
+{
+wxCHECK_RET(requester, wxT("A duplicates search with no requester"));
+
+unsigned int generation; DuplicatesDlg* superseded;
+{ wxCriticalSectionLocker locker(m_CritSection);
+  generation = ++m_generation;                // Any earlier search will notice this and give up
+  superseded = (m_requester != requester) ? m_requester : NULL;
+  m_requester = requester; m_progress.Clear(); m_results.clear(); m_finished = false;
+}
+if (superseded)                               // Another dialog was still waiting for its results, so it mustn't be left saying it's searching
+  superseded->OnSuperseded();
+
+DuplicateScanThread* thread = new DuplicateScanThread(generation, dirname, showhidden);
+wxThreadError error;
+#if wxVERSION_NUMBER < 2905
+  error = thread->Create();
+  if (error == wxTHREAD_NO_ERROR)
+    error = thread->Run();
+#else
+  error = thread->Run(); // >2.9.5 Run() calls Create() itself
+#endif
+if (error != wxTHREAD_NO_ERROR)
+  { delete thread;                              // A detached thread that never ran has to be deleted by us
+    Cancel(requester);
+    requester->OnProgress(_("Sorry, the search couldn't be started"));
+  }
+}
+
+void DuplicateFinder::Cancel(const DuplicatesDlg* requester /*= NULL*/)
+{
+wxCriticalSectionLocker locker(m_CritSection);
+if (requester && requester != m_requester) return; // Someone else's search, which we mustn't disturb
+
+++m_generation; m_requester = NULL; m_results.clear();
+}
+
+bool DuplicateFinder::IsCancelled(unsigned int generation)
+{
+wxCriticalSectionLocker locker(m_CritSection);
+return generation != m_generation;
+}
+
+void DuplicateFinder::Report(unsigned int generation, const wxString& progress, std::vector<DuplicateGroup>* results /*= NULL*/)
+{
+wxCriticalSectionLocker locker(m_CritSection);
+if (generation != m_generation) return;
+
+m_progress = progress.c_str();                // Deep-copy: wxString may share its data between threads otherwise
+if (results)
+  { m_results.swap(*results); m_finished = true; }
+
+if (!m_EventPending)                          // Don't flood the eventloop: one pending event can report any number of updates
+  { m_EventPending = true;
+    wxCommandEvent event(DuplicateScanType); event.SetInt(m_generation);
+    wxPostEvent(this, event);
+  }
+}
+
+void DuplicateFinder::OnScan(wxCommandEvent& event)
+{
+DuplicatesDlg* requester; wxString progress; std::vector<DuplicateGroup> results; bool finished;
+{ wxCriticalSectionLocker locker(m_CritSection);
+  m_EventPending = false;
+  if ((unsigned int)event.GetInt() != m_generation || !m_requester) return; // Stale
+  requester = m_requester; progress = m_progress; finished = m_finished;
+  if (finished)
+    { results.swap(m_results); m_requester = NULL; }
+}
+
+if (finished) requester->OnResults(results); // Outside the lock, as these update the dialog
+ else requester->OnProgress(progress);
+}
+
+//static
+bool DuplicateFinder::Walk(unsigned int generation, const wxString& dirname, bool showhidden, std::map< wxUint64, std::vector<wxString> >& bysize)
+{
+struct stat st;
+if (lstat(dirname.mb_str(wxConvUTF8), &st) == -1 || !S_ISDIR(st.st_mode)) return true;
+dev_t dev = st.st_dev;
+
+std::deque<wxString> queue; queue.push_back(dirname); // Iterate, not recurse: a deep tree mustn't exhaust the thread's stack
+std::set< std::pair<dev_t, ino_t> > inodes;   // Hard-links to the same file aren't duplicates: deleting one would save nothing
+size_t files = 0; wxLongLong lastreport = wxGetLocalTimeMillis();
+while (!queue.empty())
+  { if (Get().IsCancelled(generation)) return false;
+
+    wxString dir = queue.front(); queue.pop_front();
+    int dirfd = open(dir.mb_str(wxConvUTF8), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd == -1) continue;
+    DIR* dp = fdopendir(dirfd);
+    if (!dp) { close(dirfd); continue; }
+
+    wxString prefix(dir); if (!prefix.EndsWith(wxT("/"))) prefix << wxFILE_SEP_PATH;
+    struct dirent* ep;
+    while ((ep = readdir(dp)) != NULL)
+      { if (ep->d_name[0] == '.' && (!ep->d_name[1] || (ep->d_name[1] == '.' && !ep->d_name[2]))) continue; // Ignore . and ..
+        if (!showhidden && ep->d_name[0] == '.') continue;
+        if (ep->d_type != DT_UNKNOWN && ep->d_type != DT_DIR && ep->d_type != DT_REG) continue; // Symlinks, fifos etc can't be duplicates, so don't even stat them
+
+        if (fstatat(dirfd, ep->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) continue;
+        if (S_ISDIR(st.st_mode))
+          { if (st.st_dev == dev)                 // Don't wander onto other filesystems
+              queue.push_back(prefix + wxString(ep->d_name, wxConvUTF8));
+          }
+         else if (S_ISREG(st.st_mode) && st.st_size > 0) // Empty files are all identical, and uninteresting
+          { if (st.st_nlink > 1 && !inodes.insert(std::make_pair(st.st_dev, st.st_ino)).second) continue;
+            bysize[st.st_size].push_back(prefix + wxString(ep->d_name, wxConvUTF8));
+            ++files;
+          }
+      }
+    closedir(dp);                             // This closes dirfd too
+
+    wxLongLong now = wxGetLocalTimeMillis();
+    if ((now - lastreport) > 250)
+      { Get().Report(generation, wxString::Format(_("Listing files: %u so far"), (unsigned int)files)); lastreport = now; }
+  }
+
+return true;
+}
+
+//static
+void DuplicateFinder::HashAll(unsigned int generation, std::vector<DuplicateCandidate>& files, bool whole, const wxString& message)
+{
+if (files.empty()) return;
+
+wxCriticalSection lock; size_t next = 0;
+std::vector<DuplicateHashThread*> pool;
+size_t helpers = wxMin(ThreadsManager::GetCPUCount(), files.size()) - 1; // -1 as this thread hashes too
+for (size_t n=0; n < helpers; ++n)
+  { DuplicateHashThread* thread = new DuplicateHashThread(files, whole, lock, next);
+    wxThreadError error;
+#if wxVERSION_NUMBER < 2905
+    error = thread->Create();
+    if (error == wxTHREAD_NO_ERROR)
+      error = thread->Run();
+#else
+    error = thread->Run();
+#endif
+    if (error == wxTHREAD_NO_ERROR) pool.push_back(thread);
+     else delete thread;                      // We'll just have to manage with fewer
+  }
+
+wxLongLong lastreport = wxGetLocalTimeMillis();
+size_t index;
+while (DuplicateHashThread::TakeNext(lock, next, files.size(), index))
+  { if (Get().IsCancelled(generation))
+      { wxCriticalSectionLocker locker(lock); next = files.size(); break; } // which stops the helpers too
+    HashFile(files[index], whole);
+
+    wxLongLong now = wxGetLocalTimeMillis();
+    if ((now - lastreport) > 250)
+      { Get().Report(generation, wxString::Format(message, (unsigned int)index, (unsigned int)files.size())); lastreport = now; }
+  }
+
+for (size_t n=0; n < pool.size(); ++n)        // They're joinable, so wait for each to finish with 'files' before it goes out of scope
+  { pool[n]->Wait(); delete pool[n]; }
+}
+
+//static
+void DuplicateFinder::HashFile(DuplicateCandidate& file, bool whole)
+{
+if (!file.ok || (whole && file.whole)) return; // Either it's no use, or the first pass already hashed all of it
+
+int fd = open(file.filepath.mb_str(wxConvUTF8), O_RDONLY | O_CLOEXEC);
+if (fd == -1) { file.ok = false; return; }
+
+FastHash64 hash;
+if (!whole && file.size > 2 * DUPLICATE_ENDSIZE) // Just the first and last 64K. Files that differ usually do so near one end e.g. in a header or a trailing index
+  { std::vector<char> buffer(DUPLICATE_ENDSIZE);
+    file.ok = (pread(fd, &buffer[0], DUPLICATE_ENDSIZE, 0) == (ssize_t)DUPLICATE_ENDSIZE);
+    if (file.ok)
+      { hash.Update(&buffer[0], DUPLICATE_ENDSIZE);
+        file.ok = (pread(fd, &buffer[0], DUPLICATE_ENDSIZE, file.size - DUPLICATE_ENDSIZE) == (ssize_t)DUPLICATE_ENDSIZE);
+        if (file.ok) hash.Update(&buffer[0], DUPLICATE_ENDSIZE);
+      }
+  }
+ else
+  { 
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL); // Large sequential reads, so let the kernel read well ahead
+#endif
+    std::vector<char> buffer(wxMin((wxUint64)DUPLICATE_BLOCKSIZE, file.size));
+    wxUint64 total = 0; ssize_t got;
+    while ((got = read(fd, &buffer[0], buffer.size())) > 0)
+      { hash.Update(&buffer[0], got); total += got; }
+    file.ok = (got == 0 && total == file.size); // A file that's changed size since it was listed can't be trusted
+    file.whole = true;
+  }
+
+close(fd);
+file.hash = hash.Digest();
+}
+
+//static
+bool DuplicateHashThread::TakeNext(wxCriticalSection& lock, size_t& next, size_t count, size_t& index)
+{
+wxCriticalSectionLocker locker(lock);
+if (next >= count) return false;
+
+index = next++;
+return true;
+}
+
+void* DuplicateHashThread::Entry()
+{
+size_t index;
+while (TakeNext(m_lock, m_next, m_files.size(), index))
+  DuplicateFinder::HashFile(m_files[index], m_whole);
+return NULL;
+}
+
+static void KeepSharedHashes(std::vector<DuplicateCandidate>& files)  // Discards any file that's unreadable, or whose size+hash is unique
+{
+std::map< std::pair<wxUint64, wxUint64>, size_t > counts;
+for (size_t n=0; n < files.size(); ++n)
+  if (files[n].ok) ++counts[std::make_pair(files[n].size, files[n].hash)];
+
+std::vector<DuplicateCandidate> kept;
+for (size_t n=0; n < files.size(); ++n)
+  if (files[n].ok && counts[std::make_pair(files[n].size, files[n].hash)] > 1)
+    kept.push_back(files[n]);
+files.swap(kept);
+}
+
+static bool MoreWasteful(const DuplicateGroup& first, const DuplicateGroup& second) // Sorts the groups that free the most space to the top
+{
+return first.size * (first.filepaths.size() - 1) > second.size * (second.filepaths.size() - 1);
+}
+
+void* DuplicateScanThread::Entry()
+{
+DuplicateFinder& finder = DuplicateFinder::Get();
+
+std::map< wxUint64, std::vector<wxString> > bysize;
+if (!DuplicateFinder::Walk(m_generation, m_dirname, m_showhidden, bysize)) return NULL;
+
+std::vector<DuplicateCandidate> files;        // Only files that share their size with another can be duplicates. That's usually most of them eliminated, without reading anything
+for (std::map< wxUint64, std::vector<wxString> >::const_iterator iter = bysize.begin(); iter != bysize.end(); ++iter)
+  if (iter->second.size() > 1)
+    for (size_t n=0; n < iter->second.size(); ++n)
+      files.push_back(DuplicateCandidate(iter->second[n], iter->first));
+bysize.clear();
+
+DuplicateFinder::HashAll(m_generation, files, false, _("Comparing the ends of files: %u of %u"));
+if (finder.IsCancelled(m_generation)) return NULL;
+KeepSharedHashes(files);
+
+DuplicateFinder::HashAll(m_generation, files, true, _("Comparing whole files: %u of %u"));
+if (finder.IsCancelled(m_generation)) return NULL;
+KeepSharedHashes(files);
+
+std::map< std::pair<wxUint64, wxUint64>, size_t > groupindex;
+std::vector<DuplicateGroup> results;
+for (size_t n=0; n < files.size(); ++n)
+  { std::pair<wxUint64, wxUint64> key(files[n].size, files[n].hash);
+    std::map< std::pair<wxUint64, wxUint64>, size_t >::iterator iter = groupindex.find(key);
+    if (iter == groupindex.end())
+      { iter = groupindex.insert(std::make_pair(key, results.size())).first; results.push_back(DuplicateGroup(files[n].size)); }
+    results[iter->second].filepaths.push_back(files[n].filepath);
+  }
+
+for (size_t n=0; n < results.size(); ++n)
+  std::sort(results[n].filepaths.begin(), results[n].filepaths.end());
+std::stable_sort(results.begin(), results.end(), MoreWasteful);
+
+finder.Report(m_generation, wxEmptyString, &results);
+return NULL;
+}
+
+DuplicatesListCtrl::DuplicatesListCtrl(wxWindow* parent, const std::vector<DuplicateGroup>& groups, const std::vector< std::pair<size_t, size_t> >& rows)
+  : wxListCtrl(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxLC_REPORT | wxLC_VIRTUAL), m_groups(groups), m_rows(rows)
+{
+InsertColumn(0, _("Group")); InsertColumn(1, _("Size"), wxLIST_FORMAT_RIGHT); InsertColumn(2, _("File"));
+SetColumnWidth(0, 60); SetColumnWidth(1, 90); SetColumnWidth(2, 600);
+
+m_attr.SetBackgroundColour(STRIPE_1.IsOk() ? STRIPE_1 : wxColour(0xec, 0xec, 0xf4)); // Alternate groups are shaded, so that it's clear where each starts
+}
+
+wxString DuplicatesListCtrl::OnGetItemText(long item, long column) const
+{
+if (item < 0 || (size_t)item >= m_rows.size()) return wxEmptyString;
+
+const std::pair<size_t, size_t>& row = m_rows[item];
+const DuplicateGroup& group = m_groups[row.first];
+switch(column)
+  { case 0:  return row.second ? wxString() : wxString::Format(wxT("%u"), (unsigned int)row.first + 1); // Only label each group's first row
+    case 1:  return row.second ? wxString() : ParseSize(wxULongLong(group.size), false);
+    default: return group.filepaths[row.second];
+  }
+}
+
+wxListItemAttr* DuplicatesListCtrl::OnGetItemAttr(long item) const
+{
+if (item < 0 || (size_t)item >= m_rows.size()) return NULL;
+return (m_rows[item].first % 2) ? &m_attr : NULL;
+}
+
+DuplicatesDlg::DuplicatesDlg(wxWindow* parent, const wxString& dirname, int paneID, bool showhidden)
+  : wxDialog(parent, wxID_ANY, _("Duplicate Files"), wxDefaultPosition, wxDefaultSize, wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER), m_paneID(paneID), m_finished(false)
+{
+wxBoxSizer* mainsizer = new wxBoxSizer(wxVERTICAL);
+
+m_status = new wxStaticText(this, wxID_ANY, wxString::Format(_("Looking for duplicates in %s"), dirname.c_str()));
+mainsizer->Add(m_status, 0, wxALL | wxEXPAND, 10);
+
+m_list = new DuplicatesListCtrl(this, m_groups, m_rows);
+mainsizer->Add(m_list, 1, wxLEFT | wxRIGHT | wxEXPAND, 10);
+mainsizer->Add(new wxStaticText(this, wxID_ANY, _("Select the file to keep in each group, then choose what to do with the others")), 0, wxALL, 10);
+
+wxBoxSizer* buttonsizer = new wxBoxSizer(wxHORIZONTAL);
+m_trash = new wxButton(this, wxID_ANY, _("&Trash the Others"));
+m_hardlink = new wxButton(this, wxID_ANY, _("Replace with &Hard-links"));
+m_symlink = new wxButton(this, wxID_ANY, _("Replace with &Symlinks"));
+buttonsizer->Add(m_trash); buttonsizer->Add(m_hardlink, 0, wxLEFT, 5); buttonsizer->Add(m_symlink, 0, wxLEFT, 5);
+buttonsizer->AddStretchSpacer();
+buttonsizer->Add(new wxButton(this, wxID_CLOSE));
+mainsizer->Add(buttonsizer, 0, wxLEFT | wxRIGHT | wxBOTTOM | wxEXPAND, 10);
+
+SetSizer(mainsizer);
+wxSize displaysize = wxGetDisplaySize();
+SetSize(displaysize.x / 2, displaysize.y / 2); Centre();
+
+Connect(wxID_ANY, wxEVT_COMMAND_BUTTON_CLICKED, wxCommandEventHandler(DuplicatesDlg::OnButton), NULL, this);
+Connect(wxID_ANY, wxEVT_UPDATE_UI, wxUpdateUIEventHandler(DuplicatesDlg::OnUpdateUI), NULL, this);
+Connect(wxID_ANY, wxEVT_CLOSE_WINDOW, wxCloseEventHandler(DuplicatesDlg::OnClose), NULL, this);
+
+DuplicateFinder::Get().Request(this, dirname, showhidden);
+}
+
+DuplicatesDlg::~DuplicatesDlg()
+{
+DuplicateFinder::Get().Cancel(this);          // Otherwise a late result would be delivered to a dead dialog
+}
+
+void DuplicatesDlg::OnProgress(const wxString& progress)
+{
+m_status->SetLabel(progress);
+}
+
+void DuplicatesDlg::OnSuperseded()
+{
+m_status->SetLabel(_("This search was stopped, as another Duplicate Files search was started"));
+}
+
+void DuplicatesDlg::OnResults(std::vector<DuplicateGroup>& results)
+{
+m_groups.swap(results); m_finished = true;
+RebuildRows();
+}
+
+void DuplicatesDlg::RebuildRows()
+{
+m_rows.clear();
+for (size_t g=0; g < m_groups.size(); ++g)
+  for (size_t n=0; n < m_groups[g].filepaths.size(); ++n)
+    m_rows.push_back(std::make_pair(g, n));
+
+m_list->SetItemCount(m_rows.size());          // The list is virtual, so this is all that it needs
+m_list->Refresh();
+ShowSummary();
+}
+
+void DuplicatesDlg::ShowSummary()
+{
+if (m_groups.empty())
+  { m_status->SetLabel(_("No duplicate files were found")); return; }
+
+wxUint64 wasted = 0; size_t files = 0;
+for (size_t n=0; n < m_groups.size(); ++n)
+  { wasted += m_groups[n].size * (m_groups[n].filepaths.size() - 1); files += m_groups[n].filepaths.size(); }
+m_status->SetLabel(wxString::Format(_("%u files in %u groups of identical files. Keeping only one of each would free %s"),
+                            (unsigned int)files, (unsigned int)m_groups.size(), ParseSize(wxULongLong(wasted), true).c_str()));
+}
+
+void DuplicatesDlg::OnButton(wxCommandEvent& event)
+{
+if (event.GetId() == m_trash->GetId()) DoAction(da_trash);
+ else if (event.GetId() == m_hardlink->GetId()) DoAction(da_hardlink);
+ else if (event.GetId() == m_symlink->GetId()) DoAction(da_symlink);
+ else if (event.GetId() == wxID_CLOSE) Close();
+ else event.Skip();
+}
+
+void DuplicatesDlg::OnUpdateUI(wxUpdateUIEvent& event)
+{
+int id = event.GetId();
+if (id == m_trash->GetId() || id == m_hardlink->GetId() || id == m_symlink->GetId())
+  event.Enable(m_finished && m_list->GetSelectedItemCount() > 0);
+}
+
+void DuplicatesDlg::OnClose(wxCloseEvent& WXUNUSED(event))
+{
+Destroy();                                    // It's modeless, so it has to destroy itself
+}
+
+void DuplicatesDlg::DoAction(enum dupaction action)
+{
+if (ThreadsManager::Get().PasteIsActive())
+  { BriefMessageBox(_("Please try again in a moment"), 2,_("I'm busy right now")); return; }
+
+std::map<size_t, size_t> keepers;             // For each group with a selection, the file to keep. If more than one is selected, the first wins
+long item = -1;
+while ((item = m_list->GetNextItem(item, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED)) != -1)
+  if (keepers.find(m_rows[item].first) == keepers.end())
+    keepers[m_rows[item].first] = m_rows[item].second;
+if (keepers.empty()) return;
+
+std::vector< std::pair<wxString, wxString> > victims; size_t changed = 0; // Each file to be replaced, and the file it duplicates
+{ wxBusyCursor busy;
+  for (std::map<size_t, size_t>::const_iterator iter = keepers.begin(); iter != keepers.end(); ++iter)
+    { const DuplicateGroup& group = m_groups[iter->first];
+      const wxString& keep = group.filepaths[iter->second];
+      for (size_t n=0; n < group.filepaths.size(); ++n)
+        { if (n == iter->second) continue;
+          if (!DedupPastePlanner::SameContents(keep, group.filepaths[n])) // The hashes matched, but check byte-by-byte before destroying anything. And one may have changed since
+            { ++changed; continue; }
+          victims.push_back(std::make_pair(group.filepaths[n], keep));
+        }
+    }
+}
+if (victims.empty())
+  { wxMessageBox(_("None of those files are still identical to the one selected"), _("Duplicate Files"), wxOK, this); return; }
+
+wxString msg;
+if (action == da_trash)
+  msg = wxString::Format(_("Move %u duplicate files to the Trash-can?"), (unsigned int)victims.size());
+ else
+  msg = wxString::Format(_("Replace %u duplicate files by %s to the files being kept?"), (unsigned int)victims.size(),
+                                                        (action == da_hardlink) ? _("hard-links") : _("symlinks"));
+if ((action != da_trash || ASK_ON_TRASH)
+        && wxMessageBox(msg, _("Are you SURE?"), wxYES_NO | wxICON_QUESTION, this) != wxYES) return;
+
+wxFileName trashdirbase;                      // Create a unique subdir in trashdir, using current date/time
+if (!DirectoryForDeletions::GetUptothemomentDirname(trashdirbase, trashcan))
+  { wxMessageBox(_("For some reason, trying to create a dir to receive the deletion failed.  Sorry!")); return; }
+
+wxArrayInt IDs; IDs.Add(m_paneID);
+bool ClusterWasNeeded = UnRedoManager::StartClusterIfNeeded(); // So that a single Undo reverses the lot
+PasteThreadSuperBlock* tsb = NULL;
+if (action == da_trash)
+  tsb = dynamic_cast<PasteThreadSuperBlock*>(ThreadsManager::Get().StartSuperblock(wxT("move")));
+
+std::set<wxString> done; size_t failures = 0;
+for (size_t n=0; n < victims.size(); ++n)
+  { const wxString& filepath = victims[n].first; const wxString& keep = victims[n].second;
+    wxString name = filepath.AfterLast(wxFILE_SEP_PATH);
+
+    wxFileName trashdir;
+    if (victims.size() > 1)                   // As in Delete(), a unique subdir for each item, in case of both ./foo & ./bar/foo
+      { wxString subdirname = trashdirbase.GetFullPath() + CreateSubgroupName(n, victims.size());
+        trashdir.Mkdir(subdirname);
+        trashdir.AssignDir(subdirname);
+      }
+     else trashdir = trashdirbase;
+
+    wxFileName fn(filepath);
+    if (action == da_trash)
+      { if (!MyGenericDirCtrl::Move(&fn, &trashdir, name, tsb)) { ++failures; continue; }
+        fn.SetFullName(wxEmptyString);        // NB The Move altered trashdir to hold the trashed filepath, which is what the UnRedo wants
+        tsb->StoreUnRedoPaste(new UnRedoMove(fn.GetFullPath(), IDs, trashdir.GetFullPath(), name, name, false, true), filepath);
+      }
+     else
+      { // The link has to be made where the duplicate was, so it must first have left. A threaded Move would still be running, so only a rename will do
+        if (!IsThreadlessMovePossible(filepath, trashdir.GetFullPath())) { ++failures; continue; }
+        if (action == da_hardlink)
+          { FileData kept(keep), victim(filepath);
+            if (!kept.IsValid() || !victim.IsValid() || kept.GetDeviceID() != victim.GetDeviceID()) { ++failures; continue; } // Hard-links can't cross filesystems
+          }
+        if (!MyGenericDirCtrl::Move(&fn, &trashdir, name, NULL)) { ++failures; continue; }
+
+        bool linked = (action == da_hardlink) ? CreateHardlink(keep, filepath) : CreateSymlinkWithParameter(keep, filepath, nochange);
+        if (!linked)
+          { wxFileName trashed(trashdir), home(fn.GetPath() + wxFILE_SEP_PATH); // Put it back
+            MyGenericDirCtrl::Move(&trashed, &home, name, NULL);
+            ++failures; continue;
+          }
+
+        fn.SetFullName(wxEmptyString);
+        UnRedoManager::AddEntry(new UnRedoMove(fn.GetFullPath(), IDs, trashdir.GetFullPath(), name, name, false, true));
+        UnRedoManager::AddEntry(new UnRedoLink(keep, IDs, filepath, action == da_symlink, nochange)); // Undone first, so the link is gone before the file returns
+      }
+
+    done.insert(filepath);
+    MyFrame::mainframe->OnUpdateTrees(fn.GetPath(), IDs);
+  }
+
+bool AlreadyEnded = false;
+if (tsb)
+  { tsb->AddOverallSuccesses(done.size()); tsb->AddOverallFailures(failures); tsb->SetMessageType(tsbm_trashed);
+    if (!done.empty())
+      { tsb->StartThreads(); AlreadyEnded = true; } // The cluster is closed when the threads complete
+     else
+      ThreadsManager::Get().AbortThreadSuperblock(tsb); // Otherwise the thread will be orphaned and the progress throbber stuck on 0
+  }
+ else DoBriefLogStatus(done.size(), wxEmptyString, _("replaced by links"));
+if (ClusterWasNeeded && !AlreadyEnded) UnRedoManager::EndCluster();
+
+if (failures || changed)
+  { wxString report;
+    if (changed) report << wxString::Format(_("%u files were left alone, as they're no longer identical to the one being kept.\n"), (unsigned int)changed);
+    if (failures) report << wxString::Format(_("%u files couldn't be dealt with."), (unsigned int)failures);
+    if (failures && action != da_trash)
+      report << _("\nA file can only be replaced by a link if it can simply be renamed into the Trash-can and, for a hard-link, if it's on the same filesystem as the file being kept.");
+    wxMessageBox(report, _("Duplicate Files"), wxOK | wxICON_INFORMATION, this);
+  }
+
+std::vector<DuplicateGroup> remaining;        // Drop what's gone, and any group that's no longer a group
+for (size_t g=0; g < m_groups.size(); ++g)
+  { DuplicateGroup group(m_groups[g].size);
+    for (size_t n=0; n < m_groups[g].filepaths.size(); ++n)
+      if (done.find(m_groups[g].filepaths[n]) == done.end())
+        group.filepaths.push_back(m_groups[g].filepaths[n]);
+    if (group.filepaths.size() > 1) remaining.push_back(group);
+  }
+m_groups.swap(remaining);
+m_list->SetItemState(-1, 0, wxLIST_STATE_SELECTED); // The rows are about to change beneath any selection
+RebuildRows();
+}
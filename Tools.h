@@ -15,6 +15,10 @@
 #include "wx/config.h"
 #include "wx/process.h"
 #include "wx/txtstrm.h"
+#include "wx/listctrl.h"
+
+#include <vector>
+#include <map>
 
 
 class LayoutWindows;
@@ -553,6 +557,157 @@ size_t LastCommandNo;                         // Holds the last tool used, so it
 MyGenericDirCtrl *active, *leftfv, *rightfv, *leftdv, *rightdv;
 };
 
+#if wxVERSION_NUMBER < 2900
+  DECLARE_EVENT_TYPE(DuplicateScanType, wxID_ANY)
+#else
+  wxDECLARE_EVENT(DuplicateScanType, wxCommandEvent);
+#endif
+
+class FastHash64  // A 64bit hash in the style of xxHash64. Its 4 lanes don't depend on each other, so the cpu (or the compiler's vectoriser) can work on them together
+{
+public:
+FastHash64() { Reset(); }
+void Reset();
+void Update(const void* data, size_t len);
+wxUint64 Digest() const;
+
+protected:
+void Stripe(const unsigned char* p);  // Mixes 32 bytes into the lanes
+
+wxUint64 m_lanes[4];
+unsigned char m_buffer[32];           // Any bytes left over from the last Update() that didn't fill a stripe
+size_t m_buffered;
+wxUint64 m_total;
+};
+
+struct DuplicateCandidate  // A file that shares its size with at least one other
+{
+DuplicateCandidate(const wxString& fp, wxUint64 sz) : filepath(fp), size(sz), hash(0), whole(false), ok(true) {}
+
+wxString filepath;
+wxUint64 size;
+wxUint64 hash;         // Of the first & last 64K, and later of the whole file
+bool whole;            // The file was small enough for 'hash' to cover all of it already
+bool ok;               // False if it couldn't be read
+};
+
+struct DuplicateGroup  // Some identical files
+{
+DuplicateGroup(wxUint64 sz = 0) : size(sz) {}
+wxUint64 size;
+std::vector<wxString> filepaths;
+};
+
+class DuplicatesDlg;
+
+class DuplicateFinder : public wxEvtHandler  // Finds identical files in a subtree on worker threads: grouping by size, then by a hash of each end, then by a hash of the whole
+{
+public:
+void Request(DuplicatesDlg* requester, const wxString& dirname, bool showhidden); // Cancels any current request, telling its dialog so
+void Cancel(const DuplicatesDlg* requester = NULL); // Cancel the current request, if it was made by requester (or by anyone if NULL)
+
+  // Worker-thread calls
+bool IsCancelled(unsigned int generation);
+void Report(unsigned int generation, const wxString& progress, std::vector<DuplicateGroup>* results = NULL); // Non-NULL results means the search has finished
+
+static bool Walk(unsigned int generation, const wxString& dirname, bool showhidden, std::map< wxUint64, std::vector<wxString> >& bysize); // Lists the subtree, with an fstatat() per file
+static void HashAll(unsigned int generation, std::vector<DuplicateCandidate>& files, bool whole, const wxString& message); // Hashes the files on a pool of threads
+static void HashFile(DuplicateCandidate& file, bool whole);
+
+static DuplicateFinder& Get() { if (!ms_instance) ms_instance = new DuplicateFinder; return *ms_instance; }
+
+protected:
+void OnScan(wxCommandEvent& event);
+
+wxCriticalSection m_CritSection;             // Protects everything below
+unsigned int m_generation;                   // Incremented by each request or cancellation, so that the worker can tell if its results are still wanted
+DuplicatesDlg* m_requester;
+wxString m_progress;
+std::vector<DuplicateGroup> m_results;
+bool m_finished;
+bool m_EventPending;
+
+private:
+DuplicateFinder();
+
+static DuplicateFinder* ms_instance;
+};
+
+class DuplicateScanThread : public wxThread  // Runs the whole search for one request
+{
+public:
+DuplicateScanThread(unsigned int generation, const wxString& dirname, bool showhidden)
+  : wxThread(wxTHREAD_DETACHED), m_generation(generation), m_dirname(dirname.c_str()), m_showhidden(showhidden) {}
+
+protected:
+void* Entry();
+
+unsigned int m_generation;
+wxString m_dirname;
+bool m_showhidden;
+};
+
+class DuplicateHashThread : public wxThread  // One of the pool used by DuplicateFinder::HashAll()
+{
+public:
+DuplicateHashThread(std::vector<DuplicateCandidate>& files, bool whole, wxCriticalSection& lock, size_t& next)
+  : wxThread(wxTHREAD_JOINABLE), m_files(files), m_whole(whole), m_lock(lock), m_next(next) {}
+
+static bool TakeNext(wxCriticalSection& lock, size_t& next, size_t count, size_t& index); // Claims the next unhashed file. False when there are none left
+
+protected:
+void* Entry();
+
+std::vector<DuplicateCandidate>& m_files;
+bool m_whole;
+wxCriticalSection& m_lock;
+size_t& m_next;
+};
+
+class DuplicatesListCtrl : public wxListCtrl  // A virtual list: only the rows that are scrolled into view cost anything
+{
+public:
+DuplicatesListCtrl(wxWindow* parent, const std::vector<DuplicateGroup>& groups, const std::vector< std::pair<size_t, size_t> >& rows);
+
+protected:
+virtual wxString OnGetItemText(long item, long column) const;
+virtual wxListItemAttr* OnGetItemAttr(long item) const;
+
+const std::vector<DuplicateGroup>& m_groups;
+const std::vector< std::pair<size_t, size_t> >& m_rows; // For each row, its group and its index within that group
+mutable wxListItemAttr m_attr;
+};
+
+class DuplicatesDlg : public wxDialog  // Shows DuplicateFinder's results, one group of identical files after another, and acts on them
+{
+public:
+DuplicatesDlg(wxWindow* parent, const wxString& dirname, int paneID, bool showhidden);
+~DuplicatesDlg();
+
+void OnProgress(const wxString& progress);
+void OnResults(std::vector<DuplicateGroup>& results);
+void OnSuperseded();         // Our search was cancelled because another dialog started one. There's only one search at a time
+
+protected:
+enum dupaction { da_trash, da_hardlink, da_symlink };
+void OnButton(wxCommandEvent& event);
+void OnUpdateUI(wxUpdateUIEvent& event);
+void OnClose(wxCloseEvent& event);
+void DoAction(enum dupaction action);
+void RebuildRows();
+void ShowSummary();
+
+wxStaticText* m_status;
+DuplicatesListCtrl* m_list;
+wxButton* m_trash;
+wxButton* m_hardlink;
+wxButton* m_symlink;
+std::vector<DuplicateGroup> m_groups;
+std::vector< std::pair<size_t, size_t> > m_rows;
+int m_paneID;                // The pane that was active, so that it can be refreshed after any changes
+bool m_finished;
+};
+
 #if defined(__WXGTK__) 
   class EventDistributor : public wxEvtHandler  // Needed in gtk2 to cure event-hijacking problems
   {
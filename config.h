@@ -103,6 +103,9 @@ sutype WHICH_EXTERNAL_SU;                   // If WHICH_SU == mysu, this stores
 wxString OTHER_SU_COMMAND;                  // A user-provided kdesu-equivalent, used when WHICH_SU==othersu
 
 bool LIBLZMA_LOADED = false;
+bool LIBZ_LOADED = false;
+bool LIBZSTD_LOADED = false;
+bool LIBLZ4_LOADED = false;
 
 const bool ISLEFT = 0;                      // The flag for a directory window
 const bool ISRIGHT = 1;                     //  as opposed to a file window
@@ -110,7 +113,11 @@ const bool ISRIGHT = 1;                     //  as opposed to a file window
 bool SHOW_RECURSIVE_FILEVIEW_SIZE = false;  // in fileview display, calculate the size of a dir recursively (and slowly!)
 bool RETAIN_REL_TARGET = false;             // If we Move a relative symlink, keep the original target
 bool RETAIN_MTIME_ON_PASTE = false;         // Move/Paste should not keep the modification time of the origin file
+bool DURABLE_PASTE = false;                 // Paste streams straight into the destination file, rather than via a synced temporary one
 size_t MAX_NUMBER_OF_UNDOS = 10000;         // Amount of memory to allocate for UnRedo
+bool PERSISTENT_UNDO = false;               // Keep the UnRedo history in a log, and the 'deleted' files it needs, so that Undo still works after a restart
+bool USE_DIR_CACHE = false;                 // Keep dirs' stat data between sessions, so that panes can be filled without waiting for a stat per file
+size_t DIR_CACHE_MAX_ENTRIES = 200000;      // The most files' stat data to cache. Beyond that, the least-recently-used dirs are dropped
 size_t MAX_NUMBER_OF_PREVIOUSDIRS = 1000;   // Similarly for previously-visited dirs.  I think 1000 should be enough.
 size_t MAX_DROPDOWN_DISPLAY = 15;           // How many to display at a time on a dropdown menu
 